@@ -0,0 +1,325 @@
+#include "renderer/BoundingVolumeHierarchy.hpp"
+#include "renderer/OcclusionRasterizer.hpp"
+#include "renderer/Settings.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE // bring the depth range from [-1,1] (OpenGL) to [0,1] (Vulkan)
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+
+namespace
+{
+// the instances are scattered over a square of this size on the ground, about as large as the far plane reaches
+constexpr float SCENE_EXTENT = 4000.0f;
+constexpr float SCENE_HEIGHT = 200.0f;
+// every measurement is repeated until it took at least this long, in milliseconds, and the average call is reported
+constexpr float MIN_MEASURE_TIME = 250.0f;
+constexpr uint32_t MIN_MEASURE_CALLS = 5;
+// how many of the instances move between two refits
+constexpr float MOVING_FRACTION = 0.1f;
+// walls standing between the camera and the boxes, every one of them is drawn into the occlusion depth buffer
+constexpr uint32_t NUM_OCCLUDERS = 256;
+constexpr uint32_t NUM_OCCLUDEES = 10000;
+
+// a unit cube, the scale of the instances gives the boxes their sizes
+std::shared_ptr<Mesh> createBoxMesh()
+{
+  auto mesh = std::make_shared<Mesh>();
+  mesh->firstIndex = 0;
+  mesh->indexCount = 0;
+  mesh->boundsMin = glm::vec3(-0.5f);
+  mesh->boundsMax = glm::vec3(0.5f);
+  mesh->boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, glm::length(glm::vec3(0.5f)));
+  return mesh;
+}
+
+// the same unit cube with vertices and indices, for the rasterizer to draw
+std::shared_ptr<Mesh> createBoxMesh(VertexBuffer* vertexBuffer, IndexBuffer* indexBuffer)
+{
+  auto mesh = createBoxMesh();
+  mesh->firstIndex = static_cast<uint32_t>(indexBuffer->getIndices()->size());
+
+  const auto firstVertex = static_cast<uint32_t>(vertexBuffer->getVertices()->size());
+  for (uint32_t corner = 0; corner < 8; ++corner)
+  {
+    Vertex vertex = {};
+    vertex.position = glm::vec3(corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 4 ? 0.5f : -0.5f);
+    vertexBuffer->getVertices()->push_back(vertex);
+  }
+
+  // two triangles for each side, the rasterizer draws both windings alike
+  const uint32_t sides[6][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+                                 { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 } };
+  for (const auto& side : sides)
+  {
+    for (const auto corner : { side[0], side[1], side[2], side[0], side[2], side[3] })
+    {
+      indexBuffer->getIndices()->push_back(firstVertex + corner);
+    }
+  }
+  mesh->indexCount = static_cast<uint32_t>(indexBuffer->getIndices()->size()) - mesh->firstIndex;
+
+  return mesh;
+}
+
+// boxes of random sizes and orientations, all instances of one model
+std::shared_ptr<Model> createScene(const std::shared_ptr<Mesh> mesh, uint32_t numInstances, std::mt19937& random)
+{
+  std::uniform_real_distribution<float> ground(-SCENE_EXTENT * 0.5f, SCENE_EXTENT * 0.5f);
+  std::uniform_real_distribution<float> height(0.0f, SCENE_HEIGHT);
+  std::uniform_real_distribution<float> size(1.0f, 20.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+
+  auto model = std::make_shared<Model>();
+  model->getMeshes()->push_back(mesh);
+  for (uint32_t i = 0; i < numInstances; ++i)
+  {
+    auto instance = model->addInstance();
+    instance->position = glm::vec3(ground(random), height(random), ground(random));
+    instance->scale = glm::vec3(size(random), size(random), size(random));
+    instance->setYaw(angle(random));
+  }
+
+  return model;
+}
+
+void setBounds(Model* model, CullingBounds& bounds)
+{
+  const auto mesh = model->getMeshes()->front().get();
+  const auto instances = model->getInstances();
+  bounds.resize(static_cast<uint32_t>(instances->size()));
+  for (uint32_t i = 0; i < instances->size(); ++i)
+  {
+    bounds.set(i, mesh, instances->at(i)->getWorldMatrix());
+  }
+}
+
+// the average time of a call in milliseconds, the preparation before every call is not counted
+float measure(const std::function<void()>& function, const std::function<void()>& prepare = nullptr)
+{
+  auto total = 0.0f;
+  uint32_t numCalls = 0;
+  while (total < MIN_MEASURE_TIME || numCalls < MIN_MEASURE_CALLS)
+  {
+    if (prepare)
+    {
+      prepare();
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    function();
+    total += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    ++numCalls;
+  }
+
+  return total / static_cast<float>(numCalls);
+}
+
+// the same tests as the queries of the tree, applied to every box
+float getDistanceSquared(const glm::vec3& point, const glm::vec3& min, const glm::vec3& max)
+{
+  const auto offset = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+  return glm::dot(offset, offset);
+}
+
+bool touchesCone(const glm::vec3& apex,
+                 const glm::vec3& direction,
+                 float sinAngle,
+                 float cosAngle,
+                 float range,
+                 const glm::vec3& min,
+                 const glm::vec3& max)
+{
+  if (getDistanceSquared(apex, min, max) > range * range)
+  {
+    return false;
+  }
+
+  const auto center = (min + max) * 0.5f - apex;
+  const auto radius = glm::length(max - min) * 0.5f;
+  const auto alongAxis = glm::dot(center, direction);
+  const auto fromAxis = glm::sqrt(std::max(glm::dot(center, center) - alongAxis * alongAxis, 0.0f));
+  return cosAngle * fromAxis - sinAngle * alongAxis <= radius;
+}
+
+uint32_t countVisible(const std::vector<uint8_t>& visibility, uint32_t numBounds)
+{
+  return static_cast<uint32_t>(std::count(visibility.begin(), visibility.begin() + numBounds, 1));
+}
+
+void printRow(const std::string& name, float linearTime, float treeTime, uint32_t linearCount, uint32_t treeCount)
+{
+  std::printf("  %-8s linear %9.4f ms  tree %9.4f ms  speedup %6.2fx  results %u / %u%s\n", name.c_str(), linearTime,
+              treeTime, linearTime / treeTime, linearCount, treeCount, linearCount != treeCount ? "  MISMATCH" : "");
+}
+
+void benchmarkBoundingVolumeHierarchy(uint32_t numInstances)
+{
+  // the same seed every run, so that every run measures the same scene
+  std::mt19937 random(numInstances);
+  const auto mesh = createBoxMesh();
+  const auto model = createScene(mesh, numInstances, random);
+
+  CullingBounds bounds;
+  setBounds(model.get(), bounds);
+
+  std::printf("%u instances\n", numInstances);
+
+  // a fresh tree is built on its first update
+  BoundingVolumeHierarchy boundingVolumeHierarchy;
+  const auto buildTime = measure([&]() {
+    BoundingVolumeHierarchy tree;
+    tree.update(bounds);
+  });
+  boundingVolumeHierarchy.update(bounds);
+  std::printf("  build    %9.4f ms  nodes %u\n", buildTime, boundingVolumeHierarchy.getNumNodes());
+
+  // a fraction of the instances wanders a little between the refits, like a frame of a scene in motion
+  const auto numMoving = std::max(static_cast<uint32_t>(numInstances * MOVING_FRACTION), 1u);
+  std::uniform_int_distribution<uint32_t> pick(0, numInstances - 1);
+  std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+  const auto refitTime = measure([&]() { boundingVolumeHierarchy.update(bounds); },
+                                 [&]() {
+                                   for (uint32_t i = 0; i < numMoving; ++i)
+                                   {
+                                     const auto index = pick(random);
+                                     const auto& instance = model->getInstances()->at(index);
+                                     instance->position += glm::vec3(step(random), 0.0f, step(random));
+                                     bounds.set(index, mesh.get(), instance->getWorldMatrix());
+                                   }
+                                 });
+  std::printf("  refit    %9.4f ms  moving %u\n", refitTime, numMoving);
+
+  // the default camera settings, looking across the scene from its center
+  const auto projectionMatrix = glm::perspective(glm::radians(75.0f), 16.0f / 9.0f, 0.1f, 3000.0f);
+  const auto viewMatrix =
+    glm::lookAt(glm::vec3(0.0f, 100.0f, 0.0f), glm::vec3(1000.0f, 50.0f, 500.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  const Frustum frustum(projectionMatrix * viewMatrix);
+
+  std::vector<uint8_t> linearVisibility(numInstances), treeVisibility(numInstances);
+  const auto linearCullTime = measure([&]() { bounds.cull(frustum, linearVisibility); });
+  const auto treeCullTime = measure([&]() { boundingVolumeHierarchy.cull(frustum, bounds, treeVisibility); });
+  printRow("frustum", linearCullTime, treeCullTime, countVisible(linearVisibility, numInstances),
+           countVisible(treeVisibility, numInstances));
+
+  // the range of a point light and the cone of a spot light near the camera
+  const auto center = glm::vec3(200.0f, 50.0f, 100.0f);
+  const auto radius = 150.0f;
+  std::vector<uint32_t> linearResult, treeResult;
+  const auto linearSphereTime = measure([&]() {
+    linearResult.clear();
+    for (uint32_t i = 0; i < numInstances; ++i)
+    {
+      if (getDistanceSquared(center, bounds.getBoxMin(i), bounds.getBoxMax(i)) <= radius * radius)
+      {
+        linearResult.push_back(i);
+      }
+    }
+  });
+  const auto treeSphereTime = measure([&]() {
+    treeResult.clear();
+    boundingVolumeHierarchy.querySphere(center, radius, treeResult);
+  });
+  printRow("sphere", linearSphereTime, treeSphereTime, static_cast<uint32_t>(linearResult.size()),
+           static_cast<uint32_t>(treeResult.size()));
+
+  const auto apex = glm::vec3(0.0f, 150.0f, 0.0f);
+  const auto direction = glm::normalize(glm::vec3(1.0f, -0.5f, 0.0f));
+  const auto angle = glm::radians(30.0f);
+  const auto range = 500.0f;
+  const auto linearConeTime = measure([&]() {
+    linearResult.clear();
+    for (uint32_t i = 0; i < numInstances; ++i)
+    {
+      if (touchesCone(apex, direction, glm::sin(angle), glm::cos(angle), range, bounds.getBoxMin(i),
+                      bounds.getBoxMax(i)))
+      {
+        linearResult.push_back(i);
+      }
+    }
+  });
+  const auto treeConeTime = measure([&]() {
+    treeResult.clear();
+    boundingVolumeHierarchy.queryCone(apex, direction, angle, range, treeResult);
+  });
+  printRow("cone", linearConeTime, treeConeTime, static_cast<uint32_t>(linearResult.size()),
+           static_cast<uint32_t>(treeResult.size()));
+}
+
+void benchmarkOcclusionRasterizer()
+{
+  // the rasterizer reads the full precision vertices
+  Settings::vertexCompression = false;
+
+  std::mt19937 random(NUM_OCCLUDERS);
+  auto vertexBuffer = std::make_shared<VertexBuffer>();
+  auto indexBuffer = std::make_shared<IndexBuffer>();
+  const auto occluderMesh = createBoxMesh(vertexBuffer.get(), indexBuffer.get());
+  const auto occluderModel = createScene(occluderMesh, NUM_OCCLUDERS, random);
+  for (auto& instance : *occluderModel->getInstances())
+  {
+    instance->scale = glm::vec3(200.0f, 80.0f, 10.0f);
+    instance->position.y = 40.0f;
+  }
+
+  // only the walls go into the rasterizer, the boxes behind them are what it culls
+  const std::vector<std::shared_ptr<Model>> models = { occluderModel };
+  OcclusionRasterizer occlusionRasterizer(&models, vertexBuffer, indexBuffer, Settings::occluderTriangleBudget);
+  ThreadPool threadPool;
+
+  const auto occludeeMesh = createBoxMesh();
+  const auto occludeeModel = createScene(occludeeMesh, NUM_OCCLUDEES, random);
+  CullingBounds bounds;
+  setBounds(occludeeModel.get(), bounds);
+
+  const auto projectionMatrix = glm::perspective(glm::radians(75.0f), 16.0f / 9.0f, 0.1f, 3000.0f);
+  const auto viewMatrix =
+    glm::lookAt(glm::vec3(0.0f, 100.0f, 0.0f), glm::vec3(1000.0f, 50.0f, 500.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  const auto viewProjectionMatrix = projectionMatrix * viewMatrix;
+
+  // only what survives the frustum is tested for occlusion, like in the renderer
+  std::vector<uint8_t> frustumVisibility(NUM_OCCLUDEES);
+  bounds.cull(Frustum(viewProjectionMatrix), frustumVisibility);
+
+  std::printf("occlusion rasterizer, %u occluder instances, %u occludees\n",
+              occlusionRasterizer.getNumOccluderInstances(), NUM_OCCLUDEES);
+
+  // culling nothing waits for the bands, so that the whole rasterization is measured
+  const CullingBounds noBounds;
+  std::vector<uint8_t> visibility;
+  const auto rasterizeTime = measure([&]() {
+    occlusionRasterizer.rasterize(&threadPool, viewProjectionMatrix);
+    occlusionRasterizer.cull(noBounds, visibility);
+  });
+  std::printf("  rasterize %8.4f ms\n", rasterizeTime);
+
+  uint32_t numOccluded = 0;
+  const auto cullTime = measure([&]() { numOccluded = occlusionRasterizer.cull(bounds, visibility); },
+                                [&]() {
+                                  occlusionRasterizer.rasterize(&threadPool, viewProjectionMatrix);
+                                  occlusionRasterizer.cull(noBounds, visibility);
+                                  visibility = frustumVisibility;
+                                });
+  std::printf("  cull      %8.4f ms  visible %u  occluded %u\n", cullTime,
+              countVisible(frustumVisibility, NUM_OCCLUDEES), numOccluded);
+}
+} // namespace
+
+// measures the culling on the CPU, without a window or a device
+int main()
+{
+  for (const auto numInstances : { 1000u, 10000u, 100000u })
+  {
+    benchmarkBoundingVolumeHierarchy(numInstances);
+  }
+
+  benchmarkOcclusionRasterizer();
+
+  return 0;
+}
@@ -13,14 +13,14 @@ Game::Game()
                                     75.0f, 0.1f, 3000.0f, 5.0f);
   renderer = std::make_shared<Renderer>(window, input, camera);
 
-  weaponModel = renderer->loadModel("models/Machinegun/", "Machinegun.fbx");
+  weaponModel = renderer->loadModelAsync("models/Machinegun/", "Machinegun.fbx");
   weaponModel->scale = glm::vec3(0.1f);
 
-  renderer->loadModel("models/Sponza/", "Sponza.fbx");
-  // auto sanMiguelModel = renderer->loadModel("models/SanMiguel/", "san-miguel-low-poly.obj");
+  renderer->loadModelAsync("models/Sponza/", "Sponza.fbx");
+  // auto sanMiguelModel = renderer->loadModelAsync("models/SanMiguel/", "san-miguel-low-poly.obj");
   // sanMiguelModel->scale = glm::vec3(100.0f);
 
-  oldManModel = renderer->loadModel("models/OldMan/", "OldMan.fbx");
+  oldManModel = renderer->loadModelAsync("models/OldMan/", "OldMan.fbx");
   oldManModel->position = glm::vec3(0.0f, -2.0f, 0.0f);
 
   // light arrays
@@ -29,7 +29,7 @@ Game::Game()
     // left lane
     if (i != 2 && i != 3 && i != 4)
     {
-      auto lightModel = renderer->loadModel("models/Light/", "Light.fbx");
+      auto lightModel = renderer->loadModelAsync("models/Light/", "Light.fbx");
       lightModel->position = glm::vec3(1100.0f - i * 385.0f, 230.0f, 574.0f);
       lightModel->setYaw(180.0f);
       renderer->loadPointLight(glm::vec3(1100.0f - i * 385.0f, 230.0f, 574.0f - 140.0f), glm::vec3(0.45f, 0.6f, 1.0f),
@@ -39,7 +39,7 @@ Game::Game()
     // right lane
     if (i != 1 && i != 3 && i != 5)
     {
-      auto lightModel = renderer->loadModel("models/Light/", "Light.fbx");
+      auto lightModel = renderer->loadModelAsync("models/Light/", "Light.fbx");
       lightModel->position = glm::vec3(1100.0f - i * 385.0f, 230.0f, -644.0f);
       renderer->loadPointLight(glm::vec3(1100.0f - i * 385.0f, 230.0f, -644.0f + 140.0f), glm::vec3(0.45f, 0.6f, 1.0f),
                                330.0f, 4.0f);
@@ -57,7 +57,7 @@ Game::Game()
   */
 
   /*
-  auto tankModel = renderer->loadModel("models/HeavyTank/", "HeavyTank.fbx");
+  auto tankModel = renderer->loadModelAsync("models/HeavyTank/", "HeavyTank.fbx");
   tankModel->position += tankModel->getUp() * 115.0f;
   tankModel->position -= tankModel->getRight() * 1000.0f;
   tankModel->position -= tankModel->getForward() * 15.0f;
@@ -81,6 +81,12 @@ Game::Game()
 
   renderer->finalize();
 
+  if (Settings::headless)
+  // nobody is around to click on "Start Benchmark"
+  {
+    camera->startRails();
+  }
+
   std::chrono::high_resolution_clock timer;
   long long frameCount = 1;
   long long frameTime = 0;
@@ -92,7 +98,7 @@ Game::Game()
 
     bool done = false;
     SDL_Event event;
-    while (SDL_PollEvent(&event))
+    while (!Settings::headless && SDL_PollEvent(&event))
     {
       if (event.type == SDL_QUIT || (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_ESCAPE))
       {
@@ -127,6 +133,12 @@ Game::Game()
     auto applyChanges = update(frameTime / 1000.0f);
     renderer->render();
 
+    if (Settings::headless && camera->getState() != CameraState::OnRails)
+    // the camera left the rails, which means the benchmark is complete
+    {
+      break;
+    }
+
     auto stopTime = timer.now();
     frameTime = std::chrono::duration_cast<std::chrono::microseconds>(stopTime - startTime).count();
 
@@ -150,10 +162,18 @@ Game::Game()
   }
 
   renderer->waitQueueIdle();
+
+  if (Settings::headless && !renderer->exportBenchmarkResults(Settings::headlessResultsFilename))
+  {
+    throw std::runtime_error("Failed to export benchmark results to " + Settings::headlessResultsFilename + ".");
+  }
 }
 
 bool Game::update(float delta)
 {
+  // the UI and uniform buffers of this frame index are about to be overwritten
+  renderer->waitForFrame();
+
   bool applyChanges = renderer->updateUI(delta);
 
   camera->update(delta);
@@ -184,6 +204,23 @@ bool Game::update(float delta)
 
 int main(int argc, char* argv[])
 {
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string argument = argv[i];
+    if (argument == "--headless")
+    {
+      Settings::headless = true;
+    }
+    else if (argument == "--results" && i + 1 < argc)
+    {
+      Settings::headlessResultsFilename = argv[++i];
+    }
+    else if (argument == "--no-vertex-compression")
+    {
+      Settings::vertexCompression = false;
+    }
+  }
+
   try
   {
     std::make_unique<Game>();
@@ -191,10 +228,12 @@ int main(int argc, char* argv[])
   catch (std::exception& error)
   {
     Window::showMessageBox("Error", error.what());
+    return 1;
   }
   catch (...)
   {
     Window::showMessageBox("Error", "Unknown error.");
+    return 1;
   }
 
   return 0;
@@ -10,7 +10,7 @@ private:
   std::shared_ptr<Input> input;
   std::shared_ptr<Camera> camera;
   std::shared_ptr<Renderer> renderer;
-  std::shared_ptr<Model> oldManModel, weaponModel;
+  std::shared_ptr<Transform> oldManModel, weaponModel;
 
 public:
   Game();
@@ -0,0 +1,58 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+  stopping = false;
+
+  if (numThreads == 0)
+  {
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  workers.reserve(numThreads);
+  for (uint32_t i = 0; i < numThreads; ++i)
+  {
+    workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  // tasks that are still queued get finished before the workers return
+  condition.notify_all();
+  for (auto& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::work()
+{
+  while (true)
+  {
+    std::function<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+      if (tasks.empty())
+      {
+        return;
+      }
+
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+
+    // exceptions are caught by the packaged task and rethrown from its future
+    task();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping;
+
+  void work();
+
+public:
+  // zero threads means one per hardware thread
+  ThreadPool(uint32_t numThreads = 0);
+  ~ThreadPool();
+
+  template<typename Function>
+  std::future<std::invoke_result_t<Function>> submit(Function&& function)
+  {
+    // std::function needs to be copyable, std::packaged_task is not
+    auto task =
+      std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::forward<Function>(function));
+    auto future = task->get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push([task]() { (*task)(); });
+    }
+
+    condition.notify_one();
+    return future;
+  }
+
+  uint32_t getNumThreads() const
+  {
+    return static_cast<uint32_t>(workers.size());
+  }
+};
\ No newline at end of file
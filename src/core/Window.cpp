@@ -1,5 +1,7 @@
 #include "Window.hpp"
+#include "renderer/Settings.hpp"
 
+#include <iostream>
 #include <stdexcept>
 #include <vector>
 
@@ -36,24 +38,40 @@ SDL_Window* Window::createWindow(unsigned short width, unsigned short height, Wi
 
 Window::Window(unsigned short width, unsigned short height, WindowMode mode)
 {
-  window = std::unique_ptr<SDL_Window, decltype(windowDeleter)>(createWindow(width, height, mode), windowDeleter);
-
-  setShowMouseCursor(false);
-
   this->width = width;
   this->height = height;
   this->mode = mode;
+
+  if (Settings::headless)
+  // there is no display to open a window on, only keep track of the dimensions of the offscreen target
+  {
+    return;
+  }
+
+  window = std::unique_ptr<SDL_Window, decltype(windowDeleter)>(createWindow(width, height, mode), windowDeleter);
+
+  setShowMouseCursor(false);
 }
 
 void Window::setSize(unsigned short width, unsigned short height)
 {
-  SDL_SetWindowSize(window.get(), width, height);
+  if (window)
+  {
+    SDL_SetWindowSize(window.get(), width, height);
+  }
+
   this->width = width;
   this->height = height;
 }
 
 void Window::setMode(WindowMode mode)
 {
+  if (!window)
+  {
+    this->mode = mode;
+    return;
+  }
+
   auto flags = 0;
 
   if (mode == WindowMode::Fullscreen)
@@ -75,6 +93,11 @@ void Window::setMode(WindowMode mode)
 
 void Window::setShowMouseCursor(bool show)
 {
+  if (!window)
+  {
+    return;
+  }
+
   if (SDL_SetRelativeMouseMode((show ? SDL_FALSE : SDL_TRUE)) < 0)
   {
     throw std::runtime_error("Mouse does not support relative mode, encountered error: " + std::string(SDL_GetError()));
@@ -85,5 +108,11 @@ void Window::setShowMouseCursor(bool show)
 
 void Window::showMessageBox(const std::string& title, const std::string& message)
 {
+  if (Settings::headless)
+  {
+    std::cerr << title << ": " << message << std::endl;
+    return;
+  }
+
   SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, title.c_str(), message.c_str(), nullptr);
 }
\ No newline at end of file
@@ -53,7 +53,7 @@ public:
 
   bool getShowMouseCursor() const
   {
-    return !SDL_GetRelativeMouseMode();
+    return !window || !SDL_GetRelativeMouseMode();
   }
   void setShowMouseCursor(bool show);
 
@@ -0,0 +1,243 @@
+#include "BlockCompression.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+uint16_t packRGB565(const uint8_t* rgb)
+{
+  return static_cast<uint16_t>(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+void unpackRGB565(uint16_t color, uint8_t* rgb)
+{
+  const auto r = (color >> 11) & 0x1F;
+  const auto g = (color >> 5) & 0x3F;
+  const auto b = color & 0x1F;
+  rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+  rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+  rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+}
+} // namespace
+
+void BlockCompression::compressBC1Block(const uint8_t* rgba, uint8_t* block)
+{
+  // the bounding box of the block colors, inset a little to reduce the error of the extreme colors
+  uint8_t minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; ++i)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      minColor[c] = std::min(minColor[c], rgba[i * 4 + c]);
+      maxColor[c] = std::max(maxColor[c], rgba[i * 4 + c]);
+    }
+  }
+
+  for (int c = 0; c < 3; ++c)
+  {
+    const auto inset = (maxColor[c] - minColor[c]) >> 4;
+    minColor[c] = static_cast<uint8_t>(minColor[c] + inset);
+    maxColor[c] = static_cast<uint8_t>(maxColor[c] - inset);
+  }
+
+  // pick the diagonal of the box that follows the colors, green and blue are flipped if they fall while red rises
+  int covariance[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; ++i)
+  {
+    const auto r = rgba[i * 4 + 0] * 2 - (minColor[0] + maxColor[0]);
+    for (int c = 1; c < 3; ++c)
+    {
+      covariance[c] += r * (rgba[i * 4 + c] * 2 - (minColor[c] + maxColor[c]));
+    }
+  }
+
+  for (int c = 1; c < 3; ++c)
+  {
+    if (covariance[c] < 0)
+    {
+      std::swap(minColor[c], maxColor[c]);
+    }
+  }
+
+  auto color0 = packRGB565(maxColor);
+  auto color1 = packRGB565(minColor);
+
+  // the first endpoint has to be the larger one to get four colors instead of three and transparent black
+  if (color0 < color1)
+  {
+    std::swap(color0, color1);
+  }
+
+  uint8_t palette[4][3];
+  unpackRGB565(color0, palette[0]);
+  unpackRGB565(color1, palette[1]);
+  for (int c = 0; c < 3; ++c)
+  {
+    palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+    palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+  }
+
+  uint32_t indices = 0;
+  if (color0 != color1)
+  {
+    for (int i = 0; i < 16; ++i)
+    {
+      uint32_t bestIndex = 0;
+      int bestDistance = INT32_MAX;
+      for (uint32_t j = 0; j < 4; ++j)
+      {
+        const auto dr = rgba[i * 4 + 0] - palette[j][0];
+        const auto dg = rgba[i * 4 + 1] - palette[j][1];
+        const auto db = rgba[i * 4 + 2] - palette[j][2];
+        const auto distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance)
+        {
+          bestDistance = distance;
+          bestIndex = j;
+        }
+      }
+
+      indices |= bestIndex << (i * 2);
+    }
+  }
+
+  block[0] = static_cast<uint8_t>(color0 & 0xFF);
+  block[1] = static_cast<uint8_t>(color0 >> 8);
+  block[2] = static_cast<uint8_t>(color1 & 0xFF);
+  block[3] = static_cast<uint8_t>(color1 >> 8);
+  memcpy(block + 4, &indices, sizeof(indices));
+}
+
+void BlockCompression::compressBC4Block(const uint8_t* values, uint8_t* block)
+{
+  uint8_t minValue = 255, maxValue = 0;
+  for (int i = 0; i < 16; ++i)
+  {
+    minValue = std::min(minValue, values[i]);
+    maxValue = std::max(maxValue, values[i]);
+  }
+
+  // with the first endpoint larger than the second, the six values in between are interpolated
+  uint8_t palette[8];
+  palette[0] = maxValue;
+  palette[1] = minValue;
+  for (int i = 1; i < 7; ++i)
+  {
+    palette[i + 1] = static_cast<uint8_t>(((7 - i) * maxValue + i * minValue) / 7);
+  }
+
+  uint64_t indices = 0;
+  if (maxValue != minValue)
+  {
+    for (int i = 0; i < 16; ++i)
+    {
+      uint64_t bestIndex = 0;
+      int bestDistance = INT32_MAX;
+      for (uint64_t j = 0; j < 8; ++j)
+      {
+        const auto distance = std::abs(values[i] - palette[j]);
+        if (distance < bestDistance)
+        {
+          bestDistance = distance;
+          bestIndex = j;
+        }
+      }
+
+      indices |= bestIndex << (i * 3);
+    }
+  }
+
+  block[0] = maxValue;
+  block[1] = minValue;
+  for (int i = 0; i < 6; ++i)
+  {
+    block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+uint32_t BlockCompression::getBlockSize(BlockFormat format)
+{
+  if (format == BlockFormat::BC1 || format == BlockFormat::BC4)
+  {
+    return 8;
+  }
+  else if (format == BlockFormat::BC3 || format == BlockFormat::BC5)
+  {
+    return 16;
+  }
+
+  throw std::runtime_error("Invalid block format.");
+}
+
+size_t BlockCompression::getCompressedSize(BlockFormat format, uint32_t width, uint32_t height)
+{
+  const auto numBlocksX = static_cast<size_t>((width + 3) / 4);
+  const auto numBlocksY = static_cast<size_t>((height + 3) / 4);
+  return numBlocksX * numBlocksY * getBlockSize(format);
+}
+
+void BlockCompression::compress(BlockFormat format,
+                                const uint8_t* pixels,
+                                uint32_t width,
+                                uint32_t height,
+                                uint8_t* blocks)
+{
+  const auto numChannels = format == BlockFormat::BC4 ? 1u : 4u;
+  const auto blockSize = getBlockSize(format);
+
+  uint8_t texels[16 * 4];
+  uint8_t channel[16];
+
+  for (uint32_t blockY = 0; blockY < height; blockY += 4)
+  {
+    for (uint32_t blockX = 0; blockX < width; blockX += 4)
+    {
+      // blocks along the right and bottom edge repeat the last row and column
+      for (uint32_t y = 0; y < 4; ++y)
+      {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+          const auto sourceX = std::min(blockX + x, width - 1);
+          const auto sourceY = std::min(blockY + y, height - 1);
+          memcpy(texels + (y * 4 + x) * numChannels, pixels + (sourceY * width + sourceX) * numChannels, numChannels);
+        }
+      }
+
+      if (format == BlockFormat::BC1)
+      {
+        compressBC1Block(texels, blocks);
+      }
+      else if (format == BlockFormat::BC3)
+      {
+        for (int i = 0; i < 16; ++i)
+        {
+          channel[i] = texels[i * 4 + 3];
+        }
+
+        compressBC4Block(channel, blocks);
+        compressBC1Block(texels, blocks + 8);
+      }
+      else if (format == BlockFormat::BC4)
+      {
+        compressBC4Block(texels, blocks);
+      }
+      else if (format == BlockFormat::BC5)
+      {
+        for (int c = 0; c < 2; ++c)
+        {
+          for (int i = 0; i < 16; ++i)
+          {
+            channel[i] = texels[i * 4 + c];
+          }
+
+          compressBC4Block(channel, blocks + c * 8);
+        }
+      }
+
+      blocks += blockSize;
+    }
+  }
+}
\ No newline at end of file
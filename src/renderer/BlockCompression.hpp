@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class BlockFormat : uint32_t
+{
+  None,
+  BC1, // rgb, for color textures without alpha
+  BC3, // rgba, for color textures with alpha
+  BC4, // r, for single channel masks
+  BC5  // rg, for tangent space normal maps
+};
+
+// encodes 8 bit pixels into 4x4 blocks, trading some quality for being fast enough to run on texture load
+class BlockCompression
+{
+private:
+  static void compressBC1Block(const uint8_t* rgba, uint8_t* block);
+  static void compressBC4Block(const uint8_t* values, uint8_t* block);
+
+public:
+  static uint32_t getBlockSize(BlockFormat format);
+  static size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height);
+
+  // pixels have to be rgba for bc1, bc3 and bc5, and single channel for bc4
+  static void compress(BlockFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* blocks);
+};
\ No newline at end of file
@@ -0,0 +1,429 @@
+#include "BoundingVolumeHierarchy.hpp"
+
+#include <algorithm>
+#include <limits>
+
+const uint32_t BoundingVolumeHierarchy::MAX_LEAF_SIZE = 4;
+const uint32_t BoundingVolumeHierarchy::NUM_BINS = 16;
+const float BoundingVolumeHierarchy::REBUILD_COST_RATIO = 2.0f;
+
+namespace
+{
+// half of the surface area, which is all the heuristic needs as it only compares areas
+float getArea(const glm::vec3& min, const glm::vec3& max)
+{
+  const auto size = max - min;
+  return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// the corner of the box furthest along the plane normal, or the nearest one with minimum and maximum swapped
+glm::vec3 getCorner(const glm::vec4& plane, const glm::vec3& min, const glm::vec3& max)
+{
+  return glm::vec3(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z);
+}
+
+float getDistanceSquared(const glm::vec3& point, const glm::vec3& min, const glm::vec3& max)
+{
+  const auto offset = point - glm::clamp(point, min, max);
+  return glm::dot(offset, offset);
+}
+
+struct Bin
+{
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+  uint32_t count = 0;
+};
+} // namespace
+
+void BoundingVolumeHierarchy::build(const CullingBounds& bounds)
+{
+  const auto numBounds = bounds.getNumBounds();
+
+  boxMins.resize(numBounds);
+  boxMaxs.resize(numBounds);
+  indices.resize(numBounds);
+  leaves.resize(numBounds);
+  for (uint32_t i = 0; i < numBounds; ++i)
+  {
+    boxMins[i] = bounds.getBoxMin(i);
+    boxMaxs[i] = bounds.getBoxMax(i);
+    indices[i] = i;
+  }
+
+  nodes.clear();
+  builtCost = 0.0f;
+  if (numBounds == 0)
+  {
+    return;
+  }
+
+  nodes.reserve(2 * numBounds - 1);
+  Node root = {};
+  root.count = numBounds;
+  nodes.push_back(root);
+  subdivide(0);
+
+  builtCost = getCost();
+}
+
+void BoundingVolumeHierarchy::subdivide(uint32_t nodeIndex)
+{
+  fitNode(nodeIndex);
+
+  const auto first = nodes[nodeIndex].first;
+  const auto count = nodes[nodeIndex].count;
+  const auto area = getArea(nodes[nodeIndex].min, nodes[nodeIndex].max);
+
+  // the instances are binned by the centers of their boxes
+  auto centerMin = glm::vec3(std::numeric_limits<float>::max());
+  auto centerMax = glm::vec3(-std::numeric_limits<float>::max());
+  for (uint32_t i = first; i < first + count; ++i)
+  {
+    const auto center = (boxMins[indices[i]] + boxMaxs[indices[i]]) * 0.5f;
+    centerMin = glm::min(centerMin, center);
+    centerMax = glm::max(centerMax, center);
+  }
+
+  const auto getBin = [&](uint32_t instance, int axis) {
+    const auto center = (boxMins[instance][axis] + boxMaxs[instance][axis]) * 0.5f;
+    const auto bin = (center - centerMin[axis]) * NUM_BINS / (centerMax[axis] - centerMin[axis]);
+    return std::min(static_cast<uint32_t>(bin), NUM_BINS - 1);
+  };
+
+  // a leaf costs a test per instance, a split one traversal step plus the tests of both children weighted by the
+  // chance of a ray through this node also passing through them
+  auto bestCost = std::numeric_limits<float>::max();
+  auto bestAxis = -1;
+  uint32_t bestSplit = 0;
+
+  std::vector<Bin> bins(NUM_BINS);
+  std::vector<float> rightCosts(NUM_BINS);
+  for (auto axis = 0; axis < 3; ++axis)
+  {
+    const auto extent = centerMax[axis] - centerMin[axis];
+    if (extent <= 0.0f || area <= 0.0f)
+    {
+      continue;
+    }
+
+    std::fill(bins.begin(), bins.end(), Bin());
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+      const auto instance = indices[i];
+      auto& bin = bins[getBin(instance, axis)];
+      bin.min = glm::min(bin.min, boxMins[instance]);
+      bin.max = glm::max(bin.max, boxMaxs[instance]);
+      ++bin.count;
+    }
+
+    // sweep from the right first, so that the sweep from the left can put both sides of every split together
+    Bin right;
+    for (auto i = NUM_BINS - 1; i > 0; --i)
+    {
+      right.min = glm::min(right.min, bins[i].min);
+      right.max = glm::max(right.max, bins[i].max);
+      right.count += bins[i].count;
+      rightCosts[i] = right.count > 0 ? getArea(right.min, right.max) * right.count : 0.0f;
+    }
+
+    Bin left;
+    for (uint32_t i = 0; i < NUM_BINS - 1; ++i)
+    {
+      left.min = glm::min(left.min, bins[i].min);
+      left.max = glm::max(left.max, bins[i].max);
+      left.count += bins[i].count;
+      if (left.count == 0 || left.count == count)
+      {
+        continue;
+      }
+
+      const auto cost = 1.0f + (getArea(left.min, left.max) * left.count + rightCosts[i + 1]) / area;
+      if (cost < bestCost)
+      {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = i + 1;
+      }
+    }
+  }
+
+  if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || bestCost >= count))
+  {
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+      leaves[indices[i]] = nodeIndex;
+    }
+    return;
+  }
+
+  // too many instances with the same center for a leaf are simply split in half
+  auto middle = first + count / 2;
+  if (bestAxis >= 0)
+  {
+    const auto split = std::partition(indices.begin() + first, indices.begin() + first + count,
+                                      [&](uint32_t instance) { return getBin(instance, bestAxis) < bestSplit; });
+    middle = static_cast<uint32_t>(split - indices.begin());
+  }
+
+  const auto left = static_cast<uint32_t>(nodes.size());
+  nodes[nodeIndex].left = left;
+
+  Node child = {};
+  child.parent = nodeIndex;
+  child.first = first;
+  child.count = middle - first;
+  nodes.push_back(child);
+  child.first = middle;
+  child.count = first + count - middle;
+  nodes.push_back(child);
+
+  subdivide(left);
+  subdivide(left + 1);
+}
+
+void BoundingVolumeHierarchy::fitNode(uint32_t nodeIndex)
+{
+  auto& node = nodes[nodeIndex];
+  if (node.left)
+  {
+    node.min = glm::min(nodes[node.left].min, nodes[node.left + 1].min);
+    node.max = glm::max(nodes[node.left].max, nodes[node.left + 1].max);
+    return;
+  }
+
+  node.min = glm::vec3(std::numeric_limits<float>::max());
+  node.max = glm::vec3(-std::numeric_limits<float>::max());
+  for (uint32_t i = node.first; i < node.first + node.count; ++i)
+  {
+    node.min = glm::min(node.min, boxMins[indices[i]]);
+    node.max = glm::max(node.max, boxMaxs[indices[i]]);
+  }
+}
+
+float BoundingVolumeHierarchy::getCost() const
+{
+  const auto rootArea = getArea(nodes.front().min, nodes.front().max);
+  if (rootArea <= 0.0f)
+  {
+    return 0.0f;
+  }
+
+  auto cost = 0.0f;
+  for (const auto& node : nodes)
+  {
+    const auto area = getArea(node.min, node.max) / rootArea;
+    cost += node.left ? area : area * node.count;
+  }
+  return cost;
+}
+
+void BoundingVolumeHierarchy::update(const CullingBounds& bounds)
+{
+  const auto numBounds = bounds.getNumBounds();
+  if (numBounds != leaves.size() || nodes.empty())
+  {
+    build(bounds);
+    return;
+  }
+
+  auto refitted = false;
+  for (uint32_t i = 0; i < numBounds; ++i)
+  {
+    const auto boxMin = bounds.getBoxMin(i);
+    const auto boxMax = bounds.getBoxMax(i);
+    if (boxMin == boxMins[i] && boxMax == boxMaxs[i])
+    {
+      continue;
+    }
+
+    boxMins[i] = boxMin;
+    boxMaxs[i] = boxMax;
+    refitted = true;
+
+    // the ancestors only need to change for as long as their children keep changing
+    auto nodeIndex = leaves[i];
+    while (true)
+    {
+      const auto previousMin = nodes[nodeIndex].min;
+      const auto previousMax = nodes[nodeIndex].max;
+      fitNode(nodeIndex);
+      if (nodeIndex == 0 || (nodes[nodeIndex].min == previousMin && nodes[nodeIndex].max == previousMax))
+      {
+        break;
+      }
+
+      nodeIndex = nodes[nodeIndex].parent;
+    }
+  }
+
+  // instances that moved far from where they were built stretch the nodes above them over empty space
+  if (refitted && getCost() > builtCost * REBUILD_COST_RATIO)
+  {
+    build(bounds);
+  }
+}
+
+void BoundingVolumeHierarchy::cull(const Frustum& frustum,
+                                   const CullingBounds& bounds,
+                                   std::vector<uint8_t>& visibility) const
+{
+  visibility.assign(bounds.getNumBounds(), 0);
+  if (nodes.empty())
+  {
+    return;
+  }
+
+  // a bit per plane that the node is not yet known to be completely in front of, its children skip the others
+  struct Entry
+  {
+    uint32_t node, planes;
+  };
+  std::vector<Entry> stack = { { 0, (1u << frustum.planes.size()) - 1 } };
+
+  while (!stack.empty())
+  {
+    const auto entry = stack.back();
+    stack.pop_back();
+
+    const auto& node = nodes[entry.node];
+    auto planes = entry.planes;
+    auto outside = false;
+    for (uint32_t i = 0; i < frustum.planes.size() && !outside; ++i)
+    {
+      const auto& plane = frustum.planes[i];
+      if (!(planes & (1u << i)))
+      {
+        continue;
+      }
+
+      if (glm::dot(glm::vec3(plane), getCorner(plane, node.min, node.max)) + plane.w < 0.0f)
+      {
+        outside = true;
+      }
+      else if (glm::dot(glm::vec3(plane), getCorner(plane, node.max, node.min)) + plane.w >= 0.0f)
+      {
+        planes &= ~(1u << i);
+      }
+    }
+
+    if (outside)
+    {
+      continue;
+    }
+
+    // the bounds of every instance below are inside as well, including the spheres as they contain the same mesh
+    if (planes == 0)
+    {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i)
+      {
+        visibility[indices[i]] = 1;
+      }
+      continue;
+    }
+
+    if (node.left)
+    {
+      stack.push_back({ node.left, planes });
+      stack.push_back({ node.left + 1, planes });
+      continue;
+    }
+
+    // the same tests as when culling the bounds directly, against the planes the leaf intersects
+    for (uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+      const auto instance = indices[i];
+      const auto boxMin = bounds.getBoxMin(instance);
+      const auto boxMax = bounds.getBoxMax(instance);
+      const auto sphere = bounds.getSphere(instance);
+
+      auto visible = true;
+      for (uint32_t j = 0; j < frustum.planes.size() && visible; ++j)
+      {
+        const auto& plane = frustum.planes[j];
+        if (!(planes & (1u << j)))
+        {
+          continue;
+        }
+
+        visible = glm::dot(glm::vec3(plane), getCorner(plane, boxMin, boxMax)) + plane.w >= 0.0f &&
+                  glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w + sphere.w >= 0.0f;
+      }
+
+      visibility[instance] = visible ? 1 : 0;
+    }
+  }
+}
+
+template<typename Overlaps>
+void BoundingVolumeHierarchy::query(const Overlaps& overlaps, std::vector<uint32_t>& result) const
+{
+  result.clear();
+  if (nodes.empty())
+  {
+    return;
+  }
+
+  std::vector<uint32_t> stack = { 0 };
+  while (!stack.empty())
+  {
+    const auto& node = nodes[stack.back()];
+    stack.pop_back();
+
+    if (!overlaps(node.min, node.max))
+    {
+      continue;
+    }
+
+    if (node.left)
+    {
+      stack.push_back(node.left);
+      stack.push_back(node.left + 1);
+      continue;
+    }
+
+    for (uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+      if (overlaps(boxMins[indices[i]], boxMaxs[indices[i]]))
+      {
+        result.push_back(indices[i]);
+      }
+    }
+  }
+}
+
+void BoundingVolumeHierarchy::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& result) const
+{
+  query(
+    [&](const glm::vec3& min, const glm::vec3& max) {
+      return getDistanceSquared(center, min, max) <= radius * radius;
+    },
+    result);
+}
+
+void BoundingVolumeHierarchy::queryCone(const glm::vec3& apex,
+                                        const glm::vec3& direction,
+                                        float angle,
+                                        float range,
+                                        std::vector<uint32_t>& result) const
+{
+  const auto sinAngle = glm::sin(angle);
+  const auto cosAngle = glm::cos(angle);
+
+  query(
+    [&](const glm::vec3& min, const glm::vec3& max) {
+      if (getDistanceSquared(apex, min, max) > range * range)
+      {
+        return false;
+      }
+
+      // the sphere around the box is outside when its center is further than its radius from the side of the cone,
+      // which behind the apex errs on the side of keeping it
+      const auto center = (min + max) * 0.5f - apex;
+      const auto radius = glm::length(max - min) * 0.5f;
+      const auto alongAxis = glm::dot(center, direction);
+      const auto fromAxis = glm::sqrt(std::max(glm::dot(center, center) - alongAxis * alongAxis, 0.0f));
+      return cosAngle * fromAxis - sinAngle * alongAxis <= radius;
+    },
+    result);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Culling.hpp"
+
+// a tree of boxes over the mesh instances, indexed like the culling bounds it is fitted to, so that the instances a
+// view or a light reaches are found without testing every single one of them
+class BoundingVolumeHierarchy
+{
+public:
+  // leaves are only split further when the surface area heuristic finds that cheaper, or when they hold more
+  static const uint32_t MAX_LEAF_SIZE, NUM_BINS;
+  // how much worse than right after the build the refitted tree may get before it is built again
+  static const float REBUILD_COST_RATIO;
+
+private:
+  struct Node
+  {
+    glm::vec3 min, max;
+    // the instances below a node are a range of the sorted indices
+    uint32_t first, count;
+    // the right child follows the left one, a leaf has none since the root is nobody's child
+    uint32_t left;
+    uint32_t parent;
+  };
+  std::vector<Node> nodes;
+
+  std::vector<uint32_t> indices;
+  // the leaf that holds each instance
+  std::vector<uint32_t> leaves;
+  // the boxes of the instances the tree was last fitted to
+  std::vector<glm::vec3> boxMins, boxMaxs;
+
+  float builtCost = 0.0f;
+
+  void build(const CullingBounds& bounds);
+  void subdivide(uint32_t nodeIndex);
+  void fitNode(uint32_t nodeIndex);
+  // the expected cost of a ray through the root, relative to testing the root itself
+  float getCost() const;
+  // the instances whose boxes overlap, below nodes whose boxes overlap
+  template<typename Overlaps>
+  void query(const Overlaps& overlaps, std::vector<uint32_t>& result) const;
+
+public:
+  // builds the tree on the first call or when the number of bounds changed, and refits the boxes of the instances that
+  // moved along with the nodes above them afterwards
+  void update(const CullingBounds& bounds);
+
+  // the same as culling the bounds directly, but skips the instances below nodes outside the frustum and no longer
+  // tests the ones below nodes completely inside it
+  void cull(const Frustum& frustum, const CullingBounds& bounds, std::vector<uint8_t>& visibility) const;
+
+  // the instances whose boxes touch the sphere, such as the range of a point light
+  void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& result) const;
+  // the instances whose boxes touch the cone of a spot light, with the angle between its axis and side in radians
+  void queryCone(const glm::vec3& apex,
+                 const glm::vec3& direction,
+                 float angle,
+                 float range,
+                 std::vector<uint32_t>& result) const;
+
+  uint32_t getNumNodes() const
+  {
+    return static_cast<uint32_t>(nodes.size());
+  }
+};
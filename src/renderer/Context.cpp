@@ -1,5 +1,6 @@
 #include "Context.hpp"
 #include "Settings.hpp"
+#include "Sync.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -8,6 +9,8 @@
 
 #include <sstream>
 
+const uint32_t Context::QUERIES_PER_FRAME = 8;
+
 #ifdef _DEBUG
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugReportCallbackFunction(VkDebugReportFlagsEXT flags,
                                                                   VkDebugReportObjectTypeEXT objectType,
@@ -31,16 +34,22 @@ vk::Instance* Context::createInstance(const std::shared_ptr<Window> window)
   layers.push_back("VK_LAYER_KHRONOS_validation");
 #endif
 
-  unsigned int extensionCount = 0;
-  if (!SDL_Vulkan_GetInstanceExtensions(window->getWindow(), &extensionCount, nullptr))
-  {
-    throw std::runtime_error("Failed to get instance extensions: " + std::string(SDL_GetError()));
-  }
+  std::vector<const char*> extensions;
 
-  std::vector<const char*> extensions(extensionCount);
-  if (!SDL_Vulkan_GetInstanceExtensions(window->getWindow(), &extensionCount, extensions.data()))
+  if (!Settings::headless)
+  // surface extensions are only required when presenting to a window
   {
-    throw std::runtime_error("Failed to get instance extensions: " + std::string(SDL_GetError()));
+    unsigned int extensionCount = 0;
+    if (!SDL_Vulkan_GetInstanceExtensions(window->getWindow(), &extensionCount, nullptr))
+    {
+      throw std::runtime_error("Failed to get instance extensions: " + std::string(SDL_GetError()));
+    }
+
+    extensions.resize(extensionCount);
+    if (!SDL_Vulkan_GetInstanceExtensions(window->getWindow(), &extensionCount, extensions.data()))
+    {
+      throw std::runtime_error("Failed to get instance extensions: " + std::string(SDL_GetError()));
+    }
   }
 
 #ifdef _DEBUG
@@ -95,18 +104,34 @@ vk::PhysicalDevice* Context::selectPhysicalDevice(const std::shared_ptr<Window>
     throw std::runtime_error("Failed to enumerate physical devices.");
   }
 
+  // in headless mode any device will do, including software rasterizers, but the faster kinds are still preferred
+  std::vector<vk::PhysicalDeviceType> physicalDeviceTypes = { vk::PhysicalDeviceType::eDiscreteGpu };
+  if (Settings::headless)
+  {
+    physicalDeviceTypes.push_back(vk::PhysicalDeviceType::eIntegratedGpu);
+    physicalDeviceTypes.push_back(vk::PhysicalDeviceType::eVirtualGpu);
+    physicalDeviceTypes.push_back(vk::PhysicalDeviceType::eCpu);
+    physicalDeviceTypes.push_back(vk::PhysicalDeviceType::eOther);
+  }
+
   std::stringstream message;
   message << "Physical device list:" << std::endl;
   auto physicalDeviceIndex = -1;
+  auto physicalDeviceRank = physicalDeviceTypes.size();
 
   for (auto i = 0; i < physicalDevices.size(); ++i)
   {
     const auto physicalDeviceProperties = physicalDevices[i].getProperties();
     message << "#" << i << ": " << physicalDeviceProperties.deviceName << std::endl;
 
-    if (physicalDeviceIndex < 0 && physicalDeviceProperties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu)
+    for (size_t rank = 0; rank < physicalDeviceRank; ++rank)
     {
-      physicalDeviceIndex = i;
+      if (physicalDeviceProperties.deviceType == physicalDeviceTypes[rank])
+      {
+        physicalDeviceIndex = i;
+        physicalDeviceRank = rank;
+        break;
+      }
     }
   }
 
@@ -116,14 +141,21 @@ vk::PhysicalDevice* Context::selectPhysicalDevice(const std::shared_ptr<Window>
   }
 
   message << std::endl << "Picked physical device #" << physicalDeviceIndex << ".";
-  window->showMessageBox("Makma", message.str());
+  if (!Settings::headless)
+  {
+    window->showMessageBox("Makma", message.str());
+  }
 
-  return new vk::PhysicalDevice(physicalDevices[0]);
+  return new vk::PhysicalDevice(physicalDevices[physicalDeviceIndex]);
 }
 
 vk::Device* Context::createDevice(const vk::SurfaceKHR* surface,
                                   const vk::PhysicalDevice* physicalDevice,
-                                  uint32_t& queueFamilyIndex)
+                                  uint32_t& queueFamilyIndex,
+                                  uint32_t& transferQueueFamilyIndex,
+                                  vk::PhysicalDeviceFeatures& enabledFeatures,
+                                  bool& viewportIndexFromVertexShader,
+                                  bool& drawIndirectCount)
 {
   uint32_t queueFamilyPropertyCount = 0;
   physicalDevice->getQueueFamilyProperties(&queueFamilyPropertyCount, nullptr, vk::DispatchLoaderStatic());
@@ -141,7 +173,7 @@ vk::Device* Context::createDevice(const vk::SurfaceKHR* surface,
   {
     if (queueFamilyProperties[i].queueCount > 0 && queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics)
     {
-      if (physicalDevice->getSurfaceSupportKHR(i, *surface))
+      if (!surface || physicalDevice->getSurfaceSupportKHR(i, *surface))
       {
         queueFamilyIndex = i;
         queueFamilyFound = true;
@@ -155,16 +187,70 @@ vk::Device* Context::createDevice(const vk::SurfaceKHR* surface,
     throw std::runtime_error("Failed to find suitable queue family for physical device.");
   }
 
+  // a transfer-only queue family maps to the copy engines, which can upload while the graphics queue is busy
+  transferQueueFamilyIndex = queueFamilyIndex;
+  for (uint32_t i = 0; i < queueFamilyProperties.size(); ++i)
+  {
+    const auto queueFlags = queueFamilyProperties[i].queueFlags;
+    if (queueFamilyProperties[i].queueCount > 0 && (queueFlags & vk::QueueFlagBits::eTransfer) &&
+        !(queueFlags & vk::QueueFlagBits::eGraphics) && !(queueFlags & vk::QueueFlagBits::eCompute))
+    {
+      transferQueueFamilyIndex = i;
+      break;
+    }
+  }
+
   std::vector<float> queuePriorities = { 1.0f };
-  auto deviceQueueCreateInfo =
-    vk::DeviceQueueCreateInfo().setQueueFamilyIndex(queueFamilyIndex).setPQueuePriorities(queuePriorities.data());
-  deviceQueueCreateInfo.setQueueCount(static_cast<uint32_t>(queuePriorities.size()));
-  std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-  auto deviceFeatures = vk::PhysicalDeviceFeatures().setSamplerAnisotropy(true);
+  std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
+  deviceQueueCreateInfos.push_back(
+    vk::DeviceQueueCreateInfo().setQueueFamilyIndex(queueFamilyIndex).setPQueuePriorities(queuePriorities.data()));
+  deviceQueueCreateInfos.back().setQueueCount(static_cast<uint32_t>(queuePriorities.size()));
+
+  if (transferQueueFamilyIndex != queueFamilyIndex)
+  {
+    deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo()
+                                       .setQueueFamilyIndex(transferQueueFamilyIndex)
+                                       .setPQueuePriorities(queuePriorities.data()));
+    deviceQueueCreateInfos.back().setQueueCount(static_cast<uint32_t>(queuePriorities.size()));
+  }
+
+  std::vector<const char*> deviceExtensions;
+  if (surface)
+  {
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+  const auto supportedFeatures = physicalDevice->getFeatures();
+  enabledFeatures = vk::PhysicalDeviceFeatures()
+                      .setSamplerAnisotropy(supportedFeatures.samplerAnisotropy)
+                      .setTextureCompressionBC(supportedFeatures.textureCompressionBC);
+  // culling on the GPU writes indirect draws that start at arbitrary instances, several of them per call if possible
+  enabledFeatures.setMultiDrawIndirect(supportedFeatures.multiDrawIndirect)
+    .setDrawIndirectFirstInstance(supportedFeatures.drawIndirectFirstInstance);
+
+  // all cascades of a shadow map can be drawn in one pass when the vertex shader picks the viewport of each one, and
+  // the culling pass can write how many of several indirect draws the geometry pass has to make
+  viewportIndexFromVertexShader = false;
+  drawIndirectCount = false;
+  for (const auto& extensionProperties : physicalDevice->enumerateDeviceExtensionProperties())
+  {
+    const auto extensionName = std::string(extensionProperties.extensionName);
+    if (supportedFeatures.multiViewport && extensionName == VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME)
+    {
+      deviceExtensions.push_back(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+      enabledFeatures.setMultiViewport(true);
+      viewportIndexFromVertexShader = true;
+    }
+    else if (supportedFeatures.multiDrawIndirect && extensionName == VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)
+    {
+      deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+      drawIndirectCount = true;
+    }
+  }
+
   auto deviceCreateInfo = vk::DeviceCreateInfo()
-                            .setQueueCreateInfoCount(1)
-                            .setPQueueCreateInfos(&deviceQueueCreateInfo)
-                            .setPEnabledFeatures(&deviceFeatures);
+                            .setQueueCreateInfoCount(static_cast<uint32_t>(deviceQueueCreateInfos.size()))
+                            .setPQueueCreateInfos(deviceQueueCreateInfos.data())
+                            .setPEnabledFeatures(&enabledFeatures);
   deviceCreateInfo.setEnabledExtensionCount(static_cast<uint32_t>(deviceExtensions.size()))
     .setPpEnabledExtensionNames(deviceExtensions.data());
   auto device = physicalDevice->createDevice(deviceCreateInfo);
@@ -195,7 +281,10 @@ vk::CommandPool* Context::createCommandPoolRepeat(const vk::Device* device, uint
 
 vk::QueryPool* Context::createQueryPool(const vk::Device* device)
 {
-  auto queryPoolCreateInfo = vk::QueryPoolCreateInfo().setQueryType(vk::QueryType::eTimestamp).setQueryCount(8);
+  // every frame in flight gets its own range of queries so they do not overwrite each other's timestamps
+  auto queryPoolCreateInfo = vk::QueryPoolCreateInfo()
+                               .setQueryType(vk::QueryType::eTimestamp)
+                               .setQueryCount(QUERIES_PER_FRAME * Sync::MAX_FRAMES_IN_FLIGHT);
   auto queryPool = device->createQueryPool(queryPoolCreateInfo);
   return new vk::QueryPool(queryPool);
 }
@@ -233,12 +322,30 @@ Context::Context(const std::shared_ptr<Window> window)
     createDebugReportCallback(instance.get()), debugReportCallbackDeleter);
 #endif
 
-  surface =
-    std::unique_ptr<vk::SurfaceKHR, decltype(surfaceDeleter)>(createSurface(window, instance.get()), surfaceDeleter);
+  if (!Settings::headless)
+  {
+    surface =
+      std::unique_ptr<vk::SurfaceKHR, decltype(surfaceDeleter)>(createSurface(window, instance.get()), surfaceDeleter);
+  }
+
   physicalDevice = std::unique_ptr<vk::PhysicalDevice>(selectPhysicalDevice(window, instance.get()));
   device = std::unique_ptr<vk::Device, decltype(deviceDeleter)>(createDevice(surface.get(), physicalDevice.get(),
-                                                                             queueFamilyIndex),
+                                                                             queueFamilyIndex,
+                                                                             transferQueueFamilyIndex,
+                                                                             enabledFeatures,
+                                                                             viewportIndexFromVertexShader,
+                                                                             drawIndirectCount),
                                                                 deviceDeleter);
+
+  // the command of the extension has to be loaded from the device, like the debug report callback from the instance
+  cmdDrawIndexedIndirectCount = nullptr;
+  if (drawIndirectCount)
+  {
+    cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+      device->getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+  }
+
+  memoryAllocator = std::make_unique<MemoryAllocator>(device.get(), physicalDevice.get());
   commandPoolOnce = std::unique_ptr<vk::CommandPool, decltype(commandPoolDeleter)>(
     createCommandPoolOnce(device.get(), queueFamilyIndex), commandPoolDeleter);
   commandPoolRepeat = std::unique_ptr<vk::CommandPool, decltype(commandPoolDeleter)>(
@@ -247,6 +354,7 @@ Context::Context(const std::shared_ptr<Window> window)
     std::unique_ptr<vk::QueryPool, decltype(queryPoolDeleter)>(createQueryPool(device.get()), queryPoolDeleter);
 
   queue = device->getQueue(queueFamilyIndex, 0);
+  transferQueue = device->getQueue(transferQueueFamilyIndex, 0);
 }
 
 void Context::calculateUniformBufferDataAlignment()
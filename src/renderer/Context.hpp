@@ -1,5 +1,6 @@
 #pragma once
 
+#include "MemoryAllocator.hpp"
 #include "core/Window.hpp"
 
 #include <vulkan/vulkan.hpp>
@@ -8,6 +9,10 @@
 
 class Context
 {
+public:
+  // begin and end timestamps for each of the four passes
+  static const uint32_t QUERIES_PER_FRAME;
+
 private:
   static vk::Instance* createInstance(const std::shared_ptr<Window> window);
   std::function<void(vk::Instance*)> instanceDeleter = [](vk::Instance* instance) { instance->destroy(); };
@@ -37,14 +42,22 @@ private:
   static vk::PhysicalDevice* selectPhysicalDevice(const std::shared_ptr<Window> window, const vk::Instance* instance);
   std::unique_ptr<vk::PhysicalDevice> physicalDevice;
 
-  static vk::Device*
-  createDevice(const vk::SurfaceKHR* surface, const vk::PhysicalDevice* physicalDevice, uint32_t& queueFamilyIndex);
+  static vk::Device* createDevice(const vk::SurfaceKHR* surface,
+                                  const vk::PhysicalDevice* physicalDevice,
+                                  uint32_t& queueFamilyIndex,
+                                  uint32_t& transferQueueFamilyIndex,
+                                  vk::PhysicalDeviceFeatures& enabledFeatures,
+                                  bool& viewportIndexFromVertexShader,
+                                  bool& drawIndirectCount);
   std::function<void(vk::Device*)> deviceDeleter = [](vk::Device* device) {
     if (device)
       device->destroy();
   };
   std::unique_ptr<vk::Device, decltype(deviceDeleter)> device;
 
+  // declared after the device so that its memory is freed first
+  std::unique_ptr<MemoryAllocator> memoryAllocator;
+
   static vk::CommandPool* createCommandPoolOnce(const vk::Device* device, uint32_t queueFamilyIndex);
   static vk::CommandPool* createCommandPoolRepeat(const vk::Device* device, uint32_t queueFamilyIndex);
   std::function<void(vk::CommandPool*)> commandPoolDeleter = [this](vk::CommandPool* commandPool) {
@@ -63,6 +76,17 @@ private:
   uint32_t queueFamilyIndex;
   vk::Queue queue;
 
+  // equal to the graphics queue family and queue when the device has no dedicated transfer queue family
+  uint32_t transferQueueFamilyIndex;
+  vk::Queue transferQueue;
+
+  vk::PhysicalDeviceFeatures enabledFeatures;
+  // the vertex shader can pick the viewport it draws into, needs both multiple viewports and an extension
+  bool viewportIndexFromVertexShader;
+  // indirect draws can read how many of them to make from a buffer
+  bool drawIndirectCount;
+  PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount;
+
   uint32_t uniformBufferDataAlignment;
   uint32_t uniformBufferDataAlignmentLarge;
 
@@ -87,6 +111,10 @@ public:
   {
     return device.get();
   }
+  MemoryAllocator* getMemoryAllocator() const
+  {
+    return memoryAllocator.get();
+  }
   vk::CommandPool* getCommandPoolOnce() const
   {
     return commandPoolOnce.get();
@@ -107,6 +135,31 @@ public:
   {
     return queue;
   }
+  uint32_t getTransferQueueFamilyIndex() const
+  {
+    return transferQueueFamilyIndex;
+  }
+  vk::Queue getTransferQueue() const
+  {
+    return transferQueue;
+  }
+  bool hasDedicatedTransferQueue() const
+  {
+    return transferQueueFamilyIndex != queueFamilyIndex;
+  }
+  const vk::PhysicalDeviceFeatures& getEnabledFeatures() const
+  {
+    return enabledFeatures;
+  }
+  bool supportsViewportIndexFromVertexShader() const
+  {
+    return viewportIndexFromVertexShader;
+  }
+  // null unless the device supports indirect draw counts
+  PFN_vkCmdDrawIndexedIndirectCountKHR getCmdDrawIndexedIndirectCount() const
+  {
+    return cmdDrawIndexedIndirectCount;
+  }
   uint32_t getUniformBufferDataAlignment() const
   {
     return uniformBufferDataAlignment;
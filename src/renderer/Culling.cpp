@@ -0,0 +1,191 @@
+#include "Culling.hpp"
+
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+namespace
+{
+constexpr uint32_t LANES = 4;
+
+glm::vec4 normalizePlane(const glm::vec4& plane)
+{
+  return plane / glm::length(glm::vec3(plane));
+}
+} // namespace
+
+Frustum::Frustum(const glm::mat4& viewProjectionMatrix)
+{
+  // glm matrices are column major, so these are the rows of the matrix
+  const auto row0 = glm::vec4(viewProjectionMatrix[0][0], viewProjectionMatrix[1][0], viewProjectionMatrix[2][0],
+                              viewProjectionMatrix[3][0]);
+  const auto row1 = glm::vec4(viewProjectionMatrix[0][1], viewProjectionMatrix[1][1], viewProjectionMatrix[2][1],
+                              viewProjectionMatrix[3][1]);
+  const auto row2 = glm::vec4(viewProjectionMatrix[0][2], viewProjectionMatrix[1][2], viewProjectionMatrix[2][2],
+                              viewProjectionMatrix[3][2]);
+  const auto row3 = glm::vec4(viewProjectionMatrix[0][3], viewProjectionMatrix[1][3], viewProjectionMatrix[2][3],
+                              viewProjectionMatrix[3][3]);
+
+  planes[0] = normalizePlane(row3 + row0); // left
+  planes[1] = normalizePlane(row3 - row0); // right
+  planes[2] = normalizePlane(row3 + row1); // top or bottom, depending on the sign of the y axis
+  planes[3] = normalizePlane(row3 - row1);
+  planes[4] = normalizePlane(row2);        // near, the depth range starts at zero
+  planes[5] = normalizePlane(row3 - row2); // far
+}
+
+void Frustum::removeNearPlane()
+{
+  // no point is ever behind this plane
+  planes[4] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void CullingBounds::resize(uint32_t numBounds)
+{
+  this->numBounds = numBounds;
+
+  const auto paddedNumBounds = (numBounds + LANES - 1) / LANES * LANES;
+  for (auto array : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ, &centerX, &centerY, &centerZ, &radius })
+  {
+    array->assign(paddedNumBounds, 0.0f);
+  }
+}
+
+void CullingBounds::set(uint32_t index, const Mesh* mesh, const glm::mat4& worldMatrix)
+{
+  glm::vec3 boxMin, boxMax;
+  getWorldBox(mesh, worldMatrix, boxMin, boxMax);
+
+  minX[index] = boxMin.x;
+  minY[index] = boxMin.y;
+  minZ[index] = boxMin.z;
+  maxX[index] = boxMax.x;
+  maxY[index] = boxMax.y;
+  maxZ[index] = boxMax.z;
+
+  // a non-uniform scale stretches the sphere by the largest of the axis scales
+  const auto sphereCenter = glm::vec3(worldMatrix * glm::vec4(glm::vec3(mesh->boundingSphere), 1.0f));
+  const auto scale = std::max({ glm::length(glm::vec3(worldMatrix[0])), glm::length(glm::vec3(worldMatrix[1])),
+                                glm::length(glm::vec3(worldMatrix[2])) });
+
+  centerX[index] = sphereCenter.x;
+  centerY[index] = sphereCenter.y;
+  centerZ[index] = sphereCenter.z;
+  radius[index] = mesh->boundingSphere.w * scale;
+}
+
+void CullingBounds::cull(const Frustum& frustum, std::vector<uint8_t>& visibility) const
+{
+  visibility.resize(numBounds);
+
+#ifdef CULLING_SSE
+  for (uint32_t i = 0; i < numBounds; i += LANES)
+  {
+    auto outside = _mm_setzero_ps();
+    for (const auto& plane : frustum.planes)
+    {
+      const auto planeX = _mm_set1_ps(plane.x);
+      const auto planeY = _mm_set1_ps(plane.y);
+      const auto planeZ = _mm_set1_ps(plane.z);
+      const auto planeW = _mm_set1_ps(plane.w);
+
+      // a box is outside when the corner furthest along the plane normal is behind the plane, which is the same
+      // corner for all boxes
+      const auto cornerX = _mm_loadu_ps(plane.x > 0.0f ? &maxX[i] : &minX[i]);
+      const auto cornerY = _mm_loadu_ps(plane.y > 0.0f ? &maxY[i] : &minY[i]);
+      const auto cornerZ = _mm_loadu_ps(plane.z > 0.0f ? &maxZ[i] : &minZ[i]);
+      auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX, cornerX), _mm_mul_ps(planeY, cornerY)),
+                                 _mm_add_ps(_mm_mul_ps(planeZ, cornerZ), planeW));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+
+      // a sphere is outside when its center is more than its radius behind the plane
+      distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX, _mm_loadu_ps(&centerX[i])),
+                                       _mm_mul_ps(planeY, _mm_loadu_ps(&centerY[i]))),
+                            _mm_add_ps(_mm_mul_ps(planeZ, _mm_loadu_ps(&centerZ[i])), planeW));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, _mm_loadu_ps(&radius[i])), _mm_setzero_ps()));
+    }
+
+    // the padding at the end of the arrays has no visibility to write
+    const auto mask = _mm_movemask_ps(outside);
+    for (uint32_t lane = 0; lane < LANES && i + lane < numBounds; ++lane)
+    {
+      visibility[i + lane] = (mask & (1 << lane)) ? 0 : 1;
+    }
+  }
+#else
+  for (uint32_t i = 0; i < numBounds; ++i)
+  {
+    bool outside = false;
+    for (const auto& plane : frustum.planes)
+    {
+      const auto corner = glm::vec3(plane.x > 0.0f ? maxX[i] : minX[i], plane.y > 0.0f ? maxY[i] : minY[i],
+                                    plane.z > 0.0f ? maxZ[i] : minZ[i]);
+      const auto center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f ||
+          glm::dot(glm::vec3(plane), center) + plane.w + radius[i] < 0.0f)
+      {
+        outside = true;
+        break;
+      }
+    }
+
+    visibility[i] = outside ? 0 : 1;
+  }
+#endif
+}
+
+void getWorldBox(const Mesh* mesh, const glm::mat4& worldMatrix, glm::vec3& boxMin, glm::vec3& boxMax)
+{
+  // the box around the transformed box, its extent is the local extent projected onto each world axis
+  const auto center = glm::vec3(worldMatrix * glm::vec4((mesh->boundsMin + mesh->boundsMax) * 0.5f, 1.0f));
+  const auto extent = (mesh->boundsMax - mesh->boundsMin) * 0.5f;
+  const auto worldExtent = glm::abs(glm::vec3(worldMatrix[0])) * extent.x +
+                           glm::abs(glm::vec3(worldMatrix[1])) * extent.y +
+                           glm::abs(glm::vec3(worldMatrix[2])) * extent.z;
+
+  boxMin = center - worldExtent;
+  boxMax = center + worldExtent;
+}
+
+bool isAnyInstanceVisible(const uint8_t* visibility, uint32_t numInstances)
+{
+  if (!visibility)
+  {
+    return true;
+  }
+
+  return std::find(visibility, visibility + numInstances, static_cast<uint8_t>(1)) != visibility + numInstances;
+}
+
+void drawVisibleInstances(const vk::CommandBuffer* commandBuffer,
+                          const Mesh* mesh,
+                          uint32_t firstInstance,
+                          uint32_t numInstances,
+                          const uint8_t* visibility)
+{
+  if (!visibility)
+  {
+    commandBuffer->drawIndexed(mesh->indexCount, numInstances, mesh->firstIndex, 0, firstInstance);
+    return;
+  }
+
+  for (uint32_t i = 0; i < numInstances;)
+  {
+    if (!visibility[i])
+    {
+      ++i;
+      continue;
+    }
+
+    const auto runStart = i;
+    while (i < numInstances && visibility[i])
+    {
+      ++i;
+    }
+
+    commandBuffer->drawIndexed(mesh->indexCount, i - runStart, mesh->firstIndex, 0, firstInstance + runStart);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Model.hpp"
+
+#include <array>
+
+// the six planes of a view volume, with the normals in xyz pointing inwards and the distance to the origin in w
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes;
+
+  // extracts the planes from a view projection matrix with a depth range of zero to one
+  explicit Frustum(const glm::mat4& viewProjectionMatrix);
+
+  // stops testing against the near plane, so that the volume reaches all the way back towards the viewer
+  void removeNearPlane();
+};
+
+// what became of the camera's mesh instances in the last frame, laid out like the statistics of the culling shader
+struct CullingStatistics
+{
+  uint32_t numMeshInstances;
+  uint32_t frustumCulled;
+  // hidden behind what was drawn before them on the GPU, or behind the occluders on the CPU
+  uint32_t occlusionCulled;
+  // found occluded by the first pass but then drawn by the second one after all
+  uint32_t disoccluded;
+  // measured on the host when culling occlusion on the CPU, the GPU leaves it at zero
+  float occlusionRasterizerTime;
+  // only on the CPU as well, spent refitting the bounding volume hierarchy and querying it for the camera and lights
+  float boundingVolumeHierarchyTime;
+  // lights without shadow maps whose range reaches no visible instance, skipped by the lighting pass
+  uint32_t lightsCulled;
+};
+
+// world space bounding boxes and spheres of the mesh instances, stored as a structure of arrays so that the culling
+// tests several of them with every SIMD instruction
+class CullingBounds
+{
+private:
+  std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+  std::vector<float> centerX, centerY, centerZ, radius;
+  uint32_t numBounds = 0;
+
+public:
+  // the arrays are padded to a whole number of SIMD lanes
+  void resize(uint32_t numBounds);
+  // transforms the bounds of the mesh by the world matrix of one of its instances
+  void set(uint32_t index, const Mesh* mesh, const glm::mat4& worldMatrix);
+
+  // sets the visibility of every instance whose box and sphere both intersect the frustum to 1, and to 0 otherwise
+  void cull(const Frustum& frustum, std::vector<uint8_t>& visibility) const;
+
+  uint32_t getNumBounds() const
+  {
+    return numBounds;
+  }
+  glm::vec3 getBoxMin(uint32_t index) const
+  {
+    return glm::vec3(minX[index], minY[index], minZ[index]);
+  }
+  glm::vec3 getBoxMax(uint32_t index) const
+  {
+    return glm::vec3(maxX[index], maxY[index], maxZ[index]);
+  }
+  // the center in xyz and the radius in w
+  glm::vec4 getSphere(uint32_t index) const
+  {
+    return glm::vec4(centerX[index], centerY[index], centerZ[index], radius[index]);
+  }
+};
+
+// the world space box around the bounds of the mesh transformed by the world matrix of one of its instances
+void getWorldBox(const Mesh* mesh, const glm::mat4& worldMatrix, glm::vec3& boxMin, glm::vec3& boxMax);
+
+// true if any of the instances is visible, or if there is no visibility at all
+bool isAnyInstanceVisible(const uint8_t* visibility, uint32_t numInstances);
+
+// draws every run of visible instances next to each other with a single call, or all instances without a visibility
+void drawVisibleInstances(const vk::CommandBuffer* commandBuffer,
+                          const Mesh* mesh,
+                          uint32_t firstInstance,
+                          uint32_t numInstances,
+                          const uint8_t* visibility);
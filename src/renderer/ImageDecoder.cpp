@@ -0,0 +1,260 @@
+#include "ImageDecoder.hpp"
+#include "TextureCache.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SWIZZLE_SSSE3
+#define SWIZZLE_SSSE3_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define SWIZZLE_SSSE3
+#define SWIZZLE_SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+
+std::unordered_map<std::string, std::shared_ptr<ImageDecoder::Decode>> ImageDecoder::decodes;
+std::mutex ImageDecoder::decodesMutex;
+
+namespace
+{
+// same weights that stb_image uses to convert to grey
+inline uint8_t computeLuminance(uint8_t r, uint8_t g, uint8_t b)
+{
+  return static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+#ifdef SWIZZLE_SSSE3
+bool isSSSE3Supported()
+{
+#ifdef _MSC_VER
+  int cpuInfo[4];
+  __cpuid(cpuInfo, 1);
+  return (cpuInfo[2] & (1 << 9)) != 0;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// returns the number of pixels converted, the rest is left for the scalar loop
+SWIZZLE_SSSE3_TARGET size_t expandRGBToRGBASSSE3(const uint8_t* source, uint8_t* destination, size_t numPixels)
+{
+  const auto shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const auto alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+  // every iteration reads 16 bytes but only consumes 12, so stop early enough to not read past the end
+  size_t i = 0;
+  for (; i + 6 <= numPixels; i += 4)
+  {
+    const auto rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 3));
+    const auto rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 4), rgba);
+  }
+
+  return i;
+}
+#endif
+
+void expandRGBToRGBA(const uint8_t* source, uint8_t* destination, size_t numPixels)
+{
+  size_t i = 0;
+
+#ifdef SWIZZLE_SSSE3
+  static const bool ssse3Supported = isSSSE3Supported();
+  if (ssse3Supported)
+  {
+    i = expandRGBToRGBASSSE3(source, destination, numPixels);
+  }
+#endif
+
+  for (; i < numPixels; ++i)
+  {
+    destination[i * 4 + 0] = source[i * 3 + 0];
+    destination[i * 4 + 1] = source[i * 3 + 1];
+    destination[i * 4 + 2] = source[i * 3 + 2];
+    destination[i * 4 + 3] = 0xFF;
+  }
+}
+} // namespace
+
+void ImageDecoder::convertPixels(const uint8_t* source,
+                                 uint32_t sourceChannels,
+                                 uint8_t* destination,
+                                 uint32_t destinationChannels,
+                                 size_t numPixels)
+{
+  if (sourceChannels == destinationChannels)
+  {
+    memcpy(destination, source, numPixels * sourceChannels);
+  }
+  else if (destinationChannels == 4 && sourceChannels == 3)
+  {
+    expandRGBToRGBA(source, destination, numPixels);
+  }
+  else if (destinationChannels == 4 && sourceChannels <= 2)
+  // grey, with or without alpha
+  {
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+      const auto grey = source[i * sourceChannels];
+      destination[i * 4 + 0] = grey;
+      destination[i * 4 + 1] = grey;
+      destination[i * 4 + 2] = grey;
+      destination[i * 4 + 3] = sourceChannels == 2 ? source[i * 2 + 1] : 0xFF;
+    }
+  }
+  else if (destinationChannels == 1 && sourceChannels == 2)
+  {
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+      destination[i] = source[i * 2];
+    }
+  }
+  else if (destinationChannels == 1 && sourceChannels >= 3)
+  {
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+      const auto pixel = source + i * sourceChannels;
+      destination[i] = computeLuminance(pixel[0], pixel[1], pixel[2]);
+    }
+  }
+  else
+  {
+    throw std::runtime_error("Failed to convert pixels from " + std::to_string(sourceChannels) + " to " +
+                             std::to_string(destinationChannels) + " channels.");
+  }
+}
+
+std::shared_ptr<DecodedImage> ImageDecoder::decode(const std::string& filename, uint32_t numChannels)
+{
+  // decode in the layout of the file and swizzle afterwards, which is faster than the conversion in stb_image
+  int32_t width, height, fileChannels;
+  stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, &fileChannels, 0);
+
+  if (!pixels)
+  {
+    throw std::runtime_error("Failed to load texture from file \"" + filename + "\": Unable to load pixel data.");
+  }
+
+  auto image = std::make_shared<DecodedImage>();
+  image->width = static_cast<uint32_t>(width);
+  image->height = static_cast<uint32_t>(height);
+  image->numChannels = numChannels;
+  image->blockFormat = BlockFormat::None;
+
+  const auto numPixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+  image->pixels.resize(numPixels * numChannels);
+  image->levels.push_back({ image->width, image->height, 0, image->pixels.size() });
+
+  try
+  {
+    convertPixels(pixels, static_cast<uint32_t>(fileChannels), image->pixels.data(), numChannels, numPixels);
+  }
+  catch (...)
+  {
+    stbi_image_free(pixels);
+    throw;
+  }
+
+  stbi_image_free(pixels);
+  return image;
+}
+
+std::string ImageDecoder::getKey(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat)
+{
+  return filename + "#" + std::to_string(numChannels) + "#" + std::to_string(static_cast<uint32_t>(blockFormat));
+}
+
+void ImageDecoder::Decode::run()
+{
+  // whoever gets here first does the work, which also lets a waiting thread decode instead of blocking on the pool
+  if (started.exchange(true))
+  {
+    return;
+  }
+
+  try
+  {
+    if (blockFormat == BlockFormat::None)
+    {
+      promise.set_value(ImageDecoder::decode(filename, numChannels));
+    }
+    else
+    {
+      promise.set_value(TextureCache::load(filename, numChannels, blockFormat));
+    }
+  }
+  catch (...)
+  {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+void ImageDecoder::prefetch(ThreadPool* threadPool,
+                            const std::string& filename,
+                            uint32_t numChannels,
+                            BlockFormat blockFormat)
+{
+  if (!threadPool)
+  {
+    return;
+  }
+
+  auto decode = std::make_shared<Decode>();
+
+  {
+    std::lock_guard<std::mutex> lock(decodesMutex);
+    if (!decodes.emplace(getKey(filename, numChannels, blockFormat), decode).second)
+    {
+      return;
+    }
+
+    decode->filename = filename;
+    decode->numChannels = numChannels;
+    decode->blockFormat = blockFormat;
+    decode->started = false;
+    decode->future = decode->promise.get_future().share();
+  }
+
+  threadPool->submit([decode]() { decode->run(); });
+}
+
+std::shared_ptr<DecodedImage>
+ImageDecoder::get(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat)
+{
+  std::shared_ptr<Decode> decode;
+
+  {
+    std::lock_guard<std::mutex> lock(decodesMutex);
+    auto entry = decodes.find(getKey(filename, numChannels, blockFormat));
+    if (entry != decodes.end())
+    {
+      decode = entry->second;
+      decodes.erase(entry);
+    }
+  }
+
+  if (!decode)
+  {
+    return blockFormat == BlockFormat::None ? ImageDecoder::decode(filename, numChannels) :
+                                              TextureCache::load(filename, numChannels, blockFormat);
+  }
+
+  decode->run();
+  return decode->future.get();
+}
+
+void ImageDecoder::clear()
+{
+  std::lock_guard<std::mutex> lock(decodesMutex);
+  for (auto& decode : decodes)
+  {
+    // keeps queued decodes from starting
+    decode.second->started = true;
+  }
+  decodes.clear();
+}
\ No newline at end of file
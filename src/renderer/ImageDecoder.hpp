@@ -0,0 +1,63 @@
+#pragma once
+
+#include "BlockCompression.hpp"
+#include "core/ThreadPool.hpp"
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+struct DecodedImage
+{
+  struct Level
+  {
+    uint32_t width, height;
+    size_t offset, size;
+  };
+
+  uint32_t width, height, numChannels;
+  // plain pixels only have the first level, block compressed images come with their whole mip chain
+  BlockFormat blockFormat;
+  std::vector<Level> levels;
+  std::vector<uint8_t> pixels;
+};
+
+// decodes image files into tightly packed 8 bit pixels, either right away or ahead of time on a thread pool
+class ImageDecoder
+{
+private:
+  struct Decode
+  {
+    std::string filename;
+    uint32_t numChannels;
+    BlockFormat blockFormat;
+    std::atomic<bool> started;
+    std::promise<std::shared_ptr<DecodedImage>> promise;
+    std::shared_future<std::shared_ptr<DecodedImage>> future;
+
+    void run();
+  };
+
+  static std::unordered_map<std::string, std::shared_ptr<Decode>> decodes;
+  static std::mutex decodesMutex;
+
+  static std::string getKey(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat);
+
+public:
+  static std::shared_ptr<DecodedImage> decode(const std::string& filename, uint32_t numChannels);
+
+  // starts decoding in the background, does nothing if no thread pool is given, block formats load the texture cache
+  static void
+  prefetch(ThreadPool* threadPool, const std::string& filename, uint32_t numChannels, BlockFormat blockFormat);
+  // returns the prefetched image if there is one and decodes right away otherwise, safe to call from any thread
+  static std::shared_ptr<DecodedImage>
+  get(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat);
+  // drops prefetched images that nobody asked for
+  static void clear();
+
+  static void convertPixels(const uint8_t* source,
+                            uint32_t sourceChannels,
+                            uint8_t* destination,
+                            uint32_t destinationChannels,
+                            size_t numPixels);
+};
\ No newline at end of file
@@ -2,7 +2,8 @@
 
 std::shared_ptr<Texture> Material::defaultWhiteRGBATexture, Material::defaultBlackRTexture,
   Material::defaultNormalRGBTexture;
-std::vector<std::shared_ptr<Material>> Material::materials;
+std::unordered_map<std::string, std::shared_future<std::shared_ptr<Material>>> Material::materials;
+std::mutex Material::materialsMutex;
 uint32_t Material::numMaterials = 0;
 
 vk::DescriptorSet* Material::createDescriptorSet(const std::shared_ptr<Context> context,
@@ -82,7 +83,7 @@ void Material::setDiffuseTexture(const std::string& filename)
 
 void Material::setNormalTexture(const std::string& filename)
 {
-  normalTexture = Texture::cacheTexture(context, filename, vk::Format::eR8G8B8A8Unorm);
+  normalTexture = Texture::cacheTexture(context, filename, vk::Format::eR8G8B8A8Unorm, true);
 }
 
 void Material::setMetallicTexture(const std::string& filename)
@@ -105,24 +106,126 @@ void Material::loadDefaultTextures(const std::shared_ptr<Context> context)
   defaultWhiteRGBATexture = std::make_shared<Texture>(context, "textures/DefaultWhite.tga", vk::Format::eR8G8B8A8Unorm);
   defaultBlackRTexture = std::make_shared<Texture>(context, "textures/DefaultBlack.tga", vk::Format::eR8Unorm);
   defaultNormalRGBTexture =
-    std::make_shared<Texture>(context, "textures/DefaultNormal.tga", vk::Format::eR8G8B8A8Unorm);
+    std::make_shared<Texture>(context, "textures/DefaultNormal.tga", vk::Format::eR8G8B8A8Unorm, true);
+}
+
+void Material::prefetchTextures(ThreadPool* threadPool,
+                                const std::string& diffuseTextureFilename,
+                                const std::string& normalTextureFilename,
+                                const std::string& metallicTextureFilename,
+                                const std::string& roughnessTextureFilename)
+{
+  // has to match the formats the setters use
+  if (!diffuseTextureFilename.empty())
+  {
+    Texture::prefetch(threadPool, diffuseTextureFilename, vk::Format::eR8G8B8A8Unorm);
+  }
+
+  if (!normalTextureFilename.empty())
+  {
+    Texture::prefetch(threadPool, normalTextureFilename, vk::Format::eR8G8B8A8Unorm, true);
+  }
+
+  if (!metallicTextureFilename.empty())
+  {
+    Texture::prefetch(threadPool, metallicTextureFilename, vk::Format::eR8Unorm);
+  }
+
+  if (!roughnessTextureFilename.empty())
+  {
+    Texture::prefetch(threadPool, roughnessTextureFilename, vk::Format::eR8Unorm);
+  }
 }
 
 std::shared_ptr<Material> Material::getMaterialFromCache(const std::string& name)
 {
-  for (auto& material : materials)
+  std::shared_future<std::shared_ptr<Material>> future;
+
   {
-    if (material->name.compare(name) == 0)
+    std::lock_guard<std::mutex> lock(materialsMutex);
+    auto entry = materials.find(name);
+    if (entry == materials.end())
     {
-      return material;
+      return nullptr;
     }
+
+    future = entry->second;
   }
 
-  return nullptr;
+  return future.get();
 }
 
-void Material::addMaterialToCache(const std::shared_ptr<Material> material)
+std::shared_ptr<Material> Material::cacheMaterial(const std::shared_ptr<Context> context,
+                                                  const std::string& name,
+                                                  const std::string& diffuseTextureFilename,
+                                                  const std::string& normalTextureFilename,
+                                                  const std::string& metallicTextureFilename,
+                                                  const std::string& roughnessTextureFilename)
 {
-  materials.push_back(material);
-  numMaterials++;
+  std::promise<std::shared_ptr<Material>> promise;
+  std::shared_future<std::shared_ptr<Material>> future;
+  bool create = false;
+
+  {
+    std::lock_guard<std::mutex> lock(materialsMutex);
+    auto entry = materials.find(name);
+    if (entry == materials.end())
+    // the first thread to ask for a material creates it, everyone after that waits for the result
+    {
+      future = promise.get_future().share();
+      materials.emplace(name, future);
+      numMaterials++;
+      create = true;
+    }
+    else
+    {
+      future = entry->second;
+    }
+  }
+
+  if (!create)
+  {
+    return future.get();
+  }
+
+  try
+  {
+    auto material = std::make_shared<Material>(context, name);
+
+    // an empty filename keeps the default texture
+    if (!diffuseTextureFilename.empty())
+    {
+      material->setDiffuseTexture(diffuseTextureFilename);
+    }
+
+    if (!normalTextureFilename.empty())
+    {
+      material->setNormalTexture(normalTextureFilename);
+    }
+
+    if (!metallicTextureFilename.empty())
+    {
+      material->setMetallicTexture(metallicTextureFilename);
+    }
+
+    if (!roughnessTextureFilename.empty())
+    {
+      material->setRoughnessTexture(roughnessTextureFilename);
+    }
+
+    promise.set_value(material);
+    return material;
+  }
+  catch (...)
+  {
+    // let the threads already waiting fail as well, but allow a later attempt to try again
+    {
+      std::lock_guard<std::mutex> lock(materialsMutex);
+      materials.erase(name);
+      numMaterials--;
+    }
+
+    promise.set_exception(std::current_exception());
+    throw;
+  }
 }
@@ -3,6 +3,10 @@
 #include "buffers/DescriptorPool.hpp"
 #include "Texture.hpp"
 
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
 class Material
 {
 private:
@@ -18,7 +22,8 @@ private:
   std::shared_ptr<Texture> diffuseTexture, normalTexture, metallicTexture, roughnessTexture;
 
   static std::shared_ptr<Texture> defaultWhiteRGBATexture, defaultBlackRTexture, defaultNormalRGBTexture;
-  static std::vector<std::shared_ptr<Material>> materials;
+  static std::unordered_map<std::string, std::shared_future<std::shared_ptr<Material>>> materials;
+  static std::mutex materialsMutex;
   static uint32_t numMaterials;
 
 public:
@@ -54,8 +59,20 @@ public:
   }
 
   static void loadDefaultTextures(const std::shared_ptr<Context> context);
+  // decodes the textures of a material ahead of time, empty filenames are skipped
+  static void prefetchTextures(ThreadPool* threadPool,
+                               const std::string& diffuseTextureFilename,
+                               const std::string& normalTextureFilename,
+                               const std::string& metallicTextureFilename,
+                               const std::string& roughnessTextureFilename);
+  // both are safe to call from any thread, and wait for a material that another thread is still creating
   static std::shared_ptr<Material> getMaterialFromCache(const std::string& name);
-  static void addMaterialToCache(const std::shared_ptr<Material> material);
+  static std::shared_ptr<Material> cacheMaterial(const std::shared_ptr<Context> context,
+                                                 const std::string& name,
+                                                 const std::string& diffuseTextureFilename,
+                                                 const std::string& normalTextureFilename,
+                                                 const std::string& metallicTextureFilename,
+                                                 const std::string& roughnessTextureFilename);
   static uint32_t getNumMaterials()
   {
     return numMaterials;
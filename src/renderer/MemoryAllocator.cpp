@@ -0,0 +1,602 @@
+#include "MemoryAllocator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace
+{
+// every power of two is split into 16 size classes, so a range from a class is at most 1/16 larger than needed
+const uint32_t SECOND_LEVEL_BITS = 4;
+const uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_BITS;
+const uint32_t FIRST_LEVEL_COUNT = 64;
+
+// heaps smaller than eight times this get blocks of an eighth of their size
+const vk::DeviceSize MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// sizes below the second level count get one class each, above that the first level is the highest set bit and the
+// second level the bits right below it
+void getSizeClass(vk::DeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+  if (size < SECOND_LEVEL_COUNT)
+  {
+    firstLevel = 0;
+    secondLevel = static_cast<uint32_t>(size);
+    return;
+  }
+
+  const auto highestBit = static_cast<uint32_t>(std::bit_width(size)) - 1;
+  firstLevel = highestBit - SECOND_LEVEL_BITS + 1;
+  secondLevel = static_cast<uint32_t>(size >> (highestBit - SECOND_LEVEL_BITS)) & (SECOND_LEVEL_COUNT - 1);
+}
+} // namespace
+
+struct MemoryAllocator::Range
+{
+  vk::DeviceSize offset, size;
+  bool free;
+  Block* block;
+
+  // physical neighbors in the block
+  Range* previous;
+  Range* next;
+
+  // neighbors in the free list of the size class, only used while the range is free
+  Range* previousFree;
+  Range* nextFree;
+};
+
+struct MemoryAllocator::Block
+{
+  vk::DeviceMemory memory;
+  vk::DeviceSize size;
+  void* mappedData;
+  uint32_t numAllocations;
+
+  // general placement, ranges cover the whole block without gaps
+  Range* firstRange;
+
+  // linear placement, end of the last allocation
+  vk::DeviceSize top;
+};
+
+struct MemoryAllocator::Pool
+{
+  uint32_t memoryTypeIndex;
+  bool image;
+  Placement placement;
+
+  vk::DeviceSize blockSize;
+  // non coherent memory is flushed in whole atoms, so no two allocations may share one
+  vk::DeviceSize minAlignment;
+
+  std::vector<std::unique_ptr<Block>> blocks;
+  // blocks without any allocations, freeing keeps at most one of them
+  uint32_t numEmptyBlocks = 0;
+
+  // a bit is set for each size class that has a free range
+  uint64_t firstLevelBitmap = 0;
+  uint32_t secondLevelBitmaps[FIRST_LEVEL_COUNT] = {};
+  Range* freeRanges[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT] = {};
+
+  void insertFreeRange(Range* range)
+  {
+    uint32_t firstLevel, secondLevel;
+    getSizeClass(range->size, firstLevel, secondLevel);
+
+    range->previousFree = nullptr;
+    range->nextFree = freeRanges[firstLevel][secondLevel];
+    if (range->nextFree)
+    {
+      range->nextFree->previousFree = range;
+    }
+
+    freeRanges[firstLevel][secondLevel] = range;
+    firstLevelBitmap |= uint64_t(1) << firstLevel;
+    secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+  }
+
+  void removeFreeRange(Range* range)
+  {
+    uint32_t firstLevel, secondLevel;
+    getSizeClass(range->size, firstLevel, secondLevel);
+
+    if (range->previousFree)
+    {
+      range->previousFree->nextFree = range->nextFree;
+    }
+    else
+    {
+      freeRanges[firstLevel][secondLevel] = range->nextFree;
+    }
+
+    if (range->nextFree)
+    {
+      range->nextFree->previousFree = range->previousFree;
+    }
+
+    if (!freeRanges[firstLevel][secondLevel])
+    {
+      secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+      if (!secondLevelBitmaps[firstLevel])
+      {
+        firstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+      }
+    }
+  }
+
+  // finds a free range of at least the given size in constant time, or null if there is none
+  Range* findFreeRange(vk::DeviceSize size) const
+  {
+    // round up to the next size class, so that every range in the class that is found is large enough
+    if (size >= SECOND_LEVEL_COUNT)
+    {
+      size += (vk::DeviceSize(1) << (std::bit_width(size) - 1 - SECOND_LEVEL_BITS)) - 1;
+    }
+
+    uint32_t firstLevel, secondLevel;
+    getSizeClass(size, firstLevel, secondLevel);
+
+    auto secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (!secondLevelMap)
+    {
+      const auto firstLevelMap =
+        firstLevel + 1 < FIRST_LEVEL_COUNT ? firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1)) : 0;
+      if (!firstLevelMap)
+      {
+        return nullptr;
+      }
+
+      firstLevel = static_cast<uint32_t>(std::countr_zero(firstLevelMap));
+      secondLevelMap = secondLevelBitmaps[firstLevel];
+    }
+
+    secondLevel = static_cast<uint32_t>(std::countr_zero(secondLevelMap));
+    return freeRanges[firstLevel][secondLevel];
+  }
+};
+
+MemoryAllocator::MemoryAllocator(const vk::Device* device, const vk::PhysicalDevice* physicalDevice)
+{
+  this->device = device;
+
+  memoryProperties = physicalDevice->getMemoryProperties();
+
+  const auto limits = physicalDevice->getProperties().limits;
+  bufferImageGranularity = limits.bufferImageGranularity;
+  nonCoherentAtomSize = limits.nonCoherentAtomSize;
+
+  numDedicatedAllocations = 0;
+  dedicatedBytes = 0;
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+  for (auto& pool : pools)
+  {
+    while (!pool->blocks.empty())
+    {
+      destroyBlock(pool.get(), pool->blocks.back().get());
+    }
+  }
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags memoryPropertyFlags) const
+{
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+  {
+    if ((memoryTypeBits & (1 << i)) &&
+        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
+    {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("Failed to find suitable memory type.");
+}
+
+bool MemoryAllocator::hasMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags memoryPropertyFlags) const
+{
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+  {
+    if ((memoryTypeBits & (1 << i)) &&
+        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+MemoryAllocator::Pool* MemoryAllocator::getPool(uint32_t memoryTypeIndex, bool image, Placement placement)
+{
+  // buffers and images only have to be kept apart if the device needs a gap between them
+  if (bufferImageGranularity <= 1)
+  {
+    image = false;
+  }
+
+  for (auto& pool : pools)
+  {
+    if (pool->memoryTypeIndex == memoryTypeIndex && pool->image == image && pool->placement == placement)
+    {
+      return pool.get();
+    }
+  }
+
+  auto pool = std::make_unique<Pool>();
+  pool->memoryTypeIndex = memoryTypeIndex;
+  pool->image = image;
+  pool->placement = placement;
+
+  const auto memoryType = memoryProperties.memoryTypes[memoryTypeIndex];
+  pool->blockSize = std::min(MAX_BLOCK_SIZE, memoryProperties.memoryHeaps[memoryType.heapIndex].size / 8);
+
+  pool->minAlignment = 1;
+  if ((memoryType.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) &&
+      !(memoryType.propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent))
+  {
+    pool->minAlignment = nonCoherentAtomSize;
+  }
+
+  pools.push_back(std::move(pool));
+  return pools.back().get();
+}
+
+vk::DeviceMemory
+MemoryAllocator::allocateDeviceMemory(uint32_t memoryTypeIndex, vk::DeviceSize size, void*& mappedData)
+{
+  auto memoryAllocateInfo = vk::MemoryAllocateInfo().setAllocationSize(size).setMemoryTypeIndex(memoryTypeIndex);
+  auto memory = device->allocateMemory(memoryAllocateInfo);
+
+  // memory can only be mapped once at a time, so host visible memory stays mapped for as long as it exists
+  mappedData = nullptr;
+  if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+  {
+    mappedData = device->mapMemory(memory, 0, VK_WHOLE_SIZE);
+  }
+
+  return memory;
+}
+
+MemoryAllocator::Block* MemoryAllocator::createBlock(Pool* pool)
+{
+  auto block = std::make_unique<Block>();
+  block->size = pool->blockSize;
+  block->memory = allocateDeviceMemory(pool->memoryTypeIndex, block->size, block->mappedData);
+  block->numAllocations = 0;
+  block->firstRange = nullptr;
+  block->top = 0;
+
+  if (pool->placement == Placement::General)
+  {
+    block->firstRange = new Range{ 0, block->size, true, block.get(), nullptr, nullptr, nullptr, nullptr };
+    pool->insertFreeRange(block->firstRange);
+  }
+
+  pool->blocks.push_back(std::move(block));
+  ++pool->numEmptyBlocks;
+  return pool->blocks.back().get();
+}
+
+void MemoryAllocator::destroyBlock(Pool* pool, Block* block)
+{
+  for (auto range = block->firstRange; range;)
+  {
+    const auto next = range->next;
+    if (range->free)
+    {
+      pool->removeFreeRange(range);
+    }
+
+    delete range;
+    range = next;
+  }
+
+  device->freeMemory(block->memory);
+
+  const auto isBlock = [block](const std::unique_ptr<Block>& candidate) { return candidate.get() == block; };
+  pool->blocks.erase(std::find_if(pool->blocks.begin(), pool->blocks.end(), isBlock));
+}
+
+void MemoryAllocator::allocateGeneral(Pool* pool,
+                                      vk::DeviceSize size,
+                                      vk::DeviceSize alignment,
+                                      Allocation* allocation)
+{
+  // asking for room for the worst case padding guarantees that the aligned allocation fits into the range found
+  auto range = pool->findFreeRange(size + alignment - 1);
+  if (!range)
+  {
+    range = createBlock(pool)->firstRange;
+  }
+
+  pool->removeFreeRange(range);
+
+  const auto offset = alignUp(range->offset, alignment);
+  if (offset > range->offset)
+  // give the padding in front back as a range of its own, the range before it is never free
+  {
+    auto padding =
+      new Range{ range->offset, offset - range->offset, true, range->block, range->previous, range, nullptr, nullptr };
+    if (range->previous)
+    {
+      range->previous->next = padding;
+    }
+    else
+    {
+      range->block->firstRange = padding;
+    }
+
+    range->previous = padding;
+    range->offset = offset;
+    range->size -= padding->size;
+    pool->insertFreeRange(padding);
+  }
+
+  if (range->size > size)
+  // and the same for the rest behind the allocation
+  {
+    auto rest =
+      new Range{ offset + size, range->size - size, true, range->block, range, range->next, nullptr, nullptr };
+    if (range->next)
+    {
+      range->next->previous = rest;
+    }
+
+    range->next = rest;
+    range->size = size;
+    pool->insertFreeRange(rest);
+  }
+
+  range->free = false;
+
+  allocation->block = range->block;
+  allocation->range = range;
+  allocation->offset = offset;
+}
+
+void MemoryAllocator::allocateLinear(Pool* pool,
+                                     vk::DeviceSize size,
+                                     vk::DeviceSize alignment,
+                                     Allocation* allocation)
+{
+  auto block = pool->blocks.empty() ? nullptr : pool->blocks.back().get();
+  auto offset = block ? alignUp(block->top, alignment) : 0;
+  if (!block || offset + size > block->size)
+  {
+    block = createBlock(pool);
+    offset = 0;
+  }
+
+  block->top = offset + size;
+
+  allocation->block = block;
+  allocation->range = nullptr;
+  allocation->offset = offset;
+}
+
+void MemoryAllocator::freeGeneral(Pool* pool, Allocation* allocation)
+{
+  auto range = allocation->range;
+  range->free = true;
+
+  if (range->previous && range->previous->free)
+  {
+    auto previous = range->previous;
+    pool->removeFreeRange(previous);
+
+    previous->size += range->size;
+    previous->next = range->next;
+    if (range->next)
+    {
+      range->next->previous = previous;
+    }
+
+    delete range;
+    range = previous;
+  }
+
+  if (range->next && range->next->free)
+  {
+    auto next = range->next;
+    pool->removeFreeRange(next);
+
+    range->size += next->size;
+    range->next = next->next;
+    if (next->next)
+    {
+      next->next->previous = range;
+    }
+
+    delete next;
+  }
+
+  pool->insertFreeRange(range);
+}
+
+MemoryAllocator::Allocation* MemoryAllocator::allocate(const vk::MemoryRequirements& memoryRequirements,
+                                                       vk::MemoryPropertyFlags memoryPropertyFlags,
+                                                       bool image,
+                                                       Placement placement,
+                                                       bool dedicated)
+{
+  const auto memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto pool = getPool(memoryTypeIndex, image, placement);
+
+  auto allocation = std::make_unique<Allocation>();
+  allocation->size = memoryRequirements.size;
+  allocation->pool = nullptr;
+  allocation->block = nullptr;
+  allocation->range = nullptr;
+
+  if (dedicated || memoryRequirements.size > pool->blockSize / 2)
+  {
+    allocation->memory = allocateDeviceMemory(memoryTypeIndex, memoryRequirements.size, allocation->mappedData);
+    allocation->offset = 0;
+
+    ++numDedicatedAllocations;
+    dedicatedBytes += memoryRequirements.size;
+    return allocation.release();
+  }
+
+  const auto alignment = std::max(memoryRequirements.alignment, pool->minAlignment);
+  const auto size = alignUp(memoryRequirements.size, pool->minAlignment);
+
+  if (placement == Placement::General)
+  {
+    allocateGeneral(pool, size, alignment, allocation.get());
+  }
+  else
+  {
+    allocateLinear(pool, size, alignment, allocation.get());
+  }
+
+  auto block = allocation->block;
+  if (block->numAllocations++ == 0)
+  {
+    --pool->numEmptyBlocks;
+  }
+
+  allocation->pool = pool;
+  allocation->memory = block->memory;
+  allocation->size = size;
+  allocation->mappedData = block->mappedData ? static_cast<char*>(block->mappedData) + allocation->offset : nullptr;
+  return allocation.release();
+}
+
+void MemoryAllocator::free(Allocation* allocation)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto pool = allocation->pool;
+  if (!pool)
+  {
+    device->freeMemory(allocation->memory);
+
+    --numDedicatedAllocations;
+    dedicatedBytes -= allocation->size;
+    delete allocation;
+    return;
+  }
+
+  auto block = allocation->block;
+  if (pool->placement == Placement::General)
+  {
+    freeGeneral(pool, allocation);
+  }
+
+  delete allocation;
+
+  if (--block->numAllocations == 0)
+  {
+    block->top = 0;
+
+    // keep one empty block around, so that a resource that is recreated over and over does not allocate every time
+    if (pool->numEmptyBlocks > 0)
+    {
+      destroyBlock(pool, block);
+    }
+    else
+    {
+      ++pool->numEmptyBlocks;
+    }
+  }
+}
+
+MemoryAllocator::Allocation* MemoryAllocator::allocateForBuffer(vk::Buffer buffer,
+                                                                vk::MemoryPropertyFlags memoryPropertyFlags,
+                                                                Placement placement)
+{
+  auto allocation = allocate(device->getBufferMemoryRequirements(buffer), memoryPropertyFlags, false, placement);
+  device->bindBufferMemory(buffer, allocation->memory, allocation->offset);
+  return allocation;
+}
+
+// all images in the renderer use optimal tiling, which is what the buffer image granularity is about
+MemoryAllocator::Allocation* MemoryAllocator::allocateForImage(vk::Image image,
+                                                               vk::MemoryPropertyFlags memoryPropertyFlags,
+                                                               Placement placement,
+                                                               bool dedicated)
+{
+  auto allocation =
+    allocate(device->getImageMemoryRequirements(image), memoryPropertyFlags, true, placement, dedicated);
+  device->bindImageMemory(image, allocation->memory, allocation->offset);
+  return allocation;
+}
+
+MemoryAllocator::Allocation* MemoryAllocator::allocateForTransientImage(vk::Image image)
+{
+  const auto memoryRequirements = device->getImageMemoryRequirements(image);
+
+  // tile based devices keep transient attachments on chip and only commit lazily allocated memory if they spill
+  vk::MemoryPropertyFlags memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+  if (hasMemoryType(memoryRequirements.memoryTypeBits,
+                    memoryPropertyFlags | vk::MemoryPropertyFlagBits::eLazilyAllocated))
+  {
+    memoryPropertyFlags |= vk::MemoryPropertyFlagBits::eLazilyAllocated;
+  }
+
+  auto allocation = allocate(memoryRequirements, memoryPropertyFlags, true, Placement::General, true);
+  device->bindImageMemory(image, allocation->memory, allocation->offset);
+  return allocation;
+}
+
+MemoryAllocator::Statistics MemoryAllocator::getStatistics()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  Statistics statistics = {};
+  statistics.numDedicatedAllocations = numDedicatedAllocations;
+  statistics.numAllocations = numDedicatedAllocations;
+  statistics.dedicatedBytes = dedicatedBytes;
+
+  for (const auto& pool : pools)
+  {
+    for (const auto& block : pool->blocks)
+    {
+      ++statistics.numBlocks;
+      statistics.numAllocations += block->numAllocations;
+      statistics.blockBytes += block->size;
+
+      if (pool->placement == Placement::General)
+      {
+        for (auto range = block->firstRange; range; range = range->next)
+        {
+          if (range->free)
+          {
+            statistics.freeBytes += range->size;
+            statistics.largestFreeRange = std::max(statistics.largestFreeRange, range->size);
+          }
+          else
+          {
+            statistics.usedBytes += range->size;
+          }
+        }
+      }
+      else
+      // space freed in the middle of a linear block is only reclaimed with the whole block, so it counts as used
+      {
+        statistics.usedBytes += block->top;
+        statistics.freeBytes += block->size - block->top;
+        statistics.largestFreeRange = std::max(statistics.largestFreeRange, block->size - block->top);
+      }
+    }
+  }
+
+  statistics.fragmentation =
+    statistics.freeBytes > 0 ?
+      1.0f - static_cast<float>(statistics.largestFreeRange) / static_cast<float>(statistics.freeBytes) :
+      0.0f;
+
+  return statistics;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// hands out ranges of a few large blocks of device memory instead of allocating memory for every single resource
+class MemoryAllocator
+{
+public:
+  enum class Placement
+  {
+    // good fit from segregated free lists, freed ranges are merged with their neighbors and reused right away
+    General,
+    // packed one after another, which suits resources that live until shutdown, a block is only reused once
+    // everything in it has been freed
+    Linear
+  };
+
+  struct Statistics
+  {
+    uint32_t numBlocks, numAllocations, numDedicatedAllocations;
+    vk::DeviceSize blockBytes, usedBytes, freeBytes, largestFreeRange, dedicatedBytes;
+    // share of the free space in blocks that is not part of the largest free range, 0 when it is all in one piece
+    float fragmentation;
+  };
+
+private:
+  struct Range;
+  struct Block;
+  struct Pool;
+
+public:
+  struct Allocation
+  {
+    vk::DeviceMemory memory;
+    // the size is padded so that offset and size can always be used to flush the whole allocation
+    vk::DeviceSize offset, size;
+    // points at the start of the allocation, null unless the memory type is host visible
+    void* mappedData;
+
+  private:
+    friend class MemoryAllocator;
+
+    // all null for dedicated allocations, which own their memory
+    Pool* pool;
+    Block* block;
+    Range* range;
+  };
+
+private:
+  const vk::Device* device;
+  vk::PhysicalDeviceMemoryProperties memoryProperties;
+  vk::DeviceSize bufferImageGranularity;
+  vk::DeviceSize nonCoherentAtomSize;
+
+  std::vector<std::unique_ptr<Pool>> pools;
+  uint32_t numDedicatedAllocations;
+  vk::DeviceSize dedicatedBytes;
+
+  // resources are created on the thread pool as well
+  std::mutex mutex;
+
+  Pool* getPool(uint32_t memoryTypeIndex, bool image, Placement placement);
+  Block* createBlock(Pool* pool);
+  void destroyBlock(Pool* pool, Block* block);
+  vk::DeviceMemory allocateDeviceMemory(uint32_t memoryTypeIndex, vk::DeviceSize size, void*& mappedData);
+
+  void allocateGeneral(Pool* pool, vk::DeviceSize size, vk::DeviceSize alignment, Allocation* allocation);
+  void allocateLinear(Pool* pool, vk::DeviceSize size, vk::DeviceSize alignment, Allocation* allocation);
+  static void freeGeneral(Pool* pool, Allocation* allocation);
+
+public:
+  MemoryAllocator(const vk::Device* device, const vk::PhysicalDevice* physicalDevice);
+  ~MemoryAllocator();
+
+  uint32_t findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags memoryPropertyFlags) const;
+  bool hasMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags memoryPropertyFlags) const;
+
+  // dedicated allocations get memory of their own, which is also done for anything larger than half a block
+  Allocation* allocate(const vk::MemoryRequirements& memoryRequirements,
+                       vk::MemoryPropertyFlags memoryPropertyFlags,
+                       bool image,
+                       Placement placement = Placement::General,
+                       bool dedicated = false);
+  void free(Allocation* allocation);
+
+  // allocate and bind in one go
+  Allocation* allocateForBuffer(vk::Buffer buffer,
+                                vk::MemoryPropertyFlags memoryPropertyFlags,
+                                Placement placement = Placement::General);
+  Allocation* allocateForImage(vk::Image image,
+                               vk::MemoryPropertyFlags memoryPropertyFlags,
+                               Placement placement = Placement::General,
+                               bool dedicated = false);
+  // for attachments that never leave their render pass, backed by lazily allocated memory where the device has it
+  Allocation* allocateForTransientImage(vk::Image image);
+
+  Statistics getStatistics();
+};
\ No newline at end of file
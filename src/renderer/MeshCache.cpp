@@ -0,0 +1,328 @@
+#include "MeshCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t MeshCache::VERSION = 2;
+
+namespace
+{
+const char MAGIC[4] = { 'M', 'K', 'M', 'C' };
+
+struct Header
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  // compared before the hash, which is only computed when either of them changed
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint32_t importFlags;
+  uint32_t vertexSize;
+  uint32_t numVertices, numIndices, numMeshes, numMaterials;
+};
+// the size and modification time of the source, zero if it can not be read
+void getSourceStamp(const std::string& filename, uint64_t& size, int64_t& time)
+{
+  std::error_code error;
+  size = std::filesystem::file_size(filename, error);
+  if (error)
+  {
+    size = 0;
+  }
+
+  const auto lastWriteTime = std::filesystem::last_write_time(filename, error);
+  time = error ? 0 : static_cast<int64_t>(lastWriteTime.time_since_epoch().count());
+}
+} // namespace
+
+struct MeshCache::MappedFile
+{
+  const char* data = nullptr;
+  size_t size = 0;
+
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+
+  MappedFile(const std::string& filename)
+  {
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+      return;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+      return;
+    }
+
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data)
+    {
+      size = static_cast<size_t>(fileSize.QuadPart);
+    }
+  }
+
+  ~MappedFile()
+  {
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+  }
+#else
+  int file = -1;
+
+  MappedFile(const std::string& filename)
+  {
+    file = open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+      return;
+    }
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+      return;
+    }
+
+    auto mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapped != MAP_FAILED)
+    {
+      data = static_cast<const char*>(mapped);
+      size = static_cast<size_t>(fileStat.st_size);
+    }
+  }
+
+  ~MappedFile()
+  {
+    if (data)
+      munmap(const_cast<char*>(data), size);
+    if (file >= 0)
+      close(file);
+  }
+#endif
+};
+
+MeshCache::MeshCache(const std::string& filename, const std::string& sourceFilename, uint32_t importFlags)
+{
+  vertices = nullptr;
+  indices = nullptr;
+  numVertices = numIndices = 0;
+
+  mappedFile = std::make_unique<MappedFile>(filename);
+  valid = mappedFile->data && parse(sourceFilename, importFlags);
+
+  if (!valid)
+  {
+    meshes.clear();
+    materials.clear();
+    mappedFile = nullptr;
+  }
+}
+
+MeshCache::~MeshCache() = default;
+
+bool MeshCache::parse(const std::string& sourceFilename, uint32_t importFlags)
+{
+  const auto data = mappedFile->data;
+  const auto size = mappedFile->size;
+
+  if (size < sizeof(Header))
+  {
+    return false;
+  }
+
+  Header header;
+  memcpy(&header, data, sizeof(Header));
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+      header.importFlags != importFlags || header.vertexSize != sizeof(Vertex))
+  {
+    return false;
+  }
+
+  // a source of the same size that was not written since is taken to be unchanged, hashing it would read all of it on
+  // every start, while one that was only touched still matches its hash
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  getSourceStamp(sourceFilename, sourceSize, sourceTime);
+  if ((header.sourceSize != sourceSize || header.sourceTime != sourceTime) &&
+      header.sourceHash != hashFile(sourceFilename))
+  {
+    return false;
+  }
+
+  size_t offset = sizeof(Header);
+  const auto vertexDataSize = static_cast<size_t>(header.numVertices) * sizeof(Vertex);
+  const auto indexDataSize = static_cast<size_t>(header.numIndices) * sizeof(uint32_t);
+  const auto meshDataSize = static_cast<size_t>(header.numMeshes) * sizeof(MeshRange);
+  if (size - offset < vertexDataSize + indexDataSize + meshDataSize)
+  {
+    return false;
+  }
+
+  // the header and all arrays are multiples of four bytes, so the arrays can be used in place
+  vertices = reinterpret_cast<const Vertex*>(data + offset);
+  numVertices = header.numVertices;
+  offset += vertexDataSize;
+
+  indices = reinterpret_cast<const uint32_t*>(data + offset);
+  numIndices = header.numIndices;
+  offset += indexDataSize;
+
+  meshes.resize(header.numMeshes);
+  memcpy(meshes.data(), data + offset, meshDataSize);
+  offset += meshDataSize;
+
+  const auto readString = [&](std::string& string) {
+    uint32_t length;
+    if (size - offset < sizeof(length))
+    {
+      return false;
+    }
+
+    memcpy(&length, data + offset, sizeof(length));
+    offset += sizeof(length);
+
+    if (size - offset < length)
+    {
+      return false;
+    }
+
+    string.assign(data + offset, length);
+    offset += length;
+    return true;
+  };
+
+  materials.resize(header.numMaterials);
+  for (auto& material : materials)
+  {
+    if (!readString(material.name) || !readString(material.diffuseTexture) || !readString(material.normalTexture) ||
+        !readString(material.metallicTexture) || !readString(material.roughnessTexture))
+    {
+      return false;
+    }
+  }
+
+  for (const auto& mesh : meshes)
+  {
+    if (mesh.materialIndex >= materials.size() || mesh.firstIndex > numIndices ||
+        mesh.indexCount > numIndices - mesh.firstIndex)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t MeshCache::hashFile(const std::string& filename)
+{
+  MappedFile file(filename);
+  if (!file.data)
+  {
+    throw std::runtime_error("Failed to open file \"" + filename + "\".");
+  }
+
+  // 64 bit FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < file.size; ++i)
+  {
+    hash ^= static_cast<uint8_t>(file.data[i]);
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+bool MeshCache::write(const std::string& filename,
+                      const std::string& sourceFilename,
+                      uint32_t importFlags,
+                      const std::vector<Vertex>& vertices,
+                      const std::vector<uint32_t>& indices,
+                      const std::vector<MeshRange>& meshes,
+                      const std::vector<MaterialReference>& materials)
+{
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.sourceHash = hashFile(sourceFilename);
+  getSourceStamp(sourceFilename, header.sourceSize, header.sourceTime);
+  header.importFlags = importFlags;
+  header.vertexSize = sizeof(Vertex);
+  header.numVertices = static_cast<uint32_t>(vertices.size());
+  header.numIndices = static_cast<uint32_t>(indices.size());
+  header.numMeshes = static_cast<uint32_t>(meshes.size());
+  header.numMaterials = static_cast<uint32_t>(materials.size());
+
+  // write to a temporary file first so that an interrupted write never leaves a truncated cache behind
+  const auto temporaryFilename = filename + ".tmp";
+  {
+    std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      return false;
+    }
+
+    const auto writeString = [&file](const std::string& string) {
+      const auto length = static_cast<uint32_t>(string.size());
+      file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+      file.write(string.data(), length);
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+    file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(meshes.data()), meshes.size() * sizeof(MeshRange));
+    for (const auto& material : materials)
+    {
+      writeString(material.name);
+      writeString(material.diffuseTexture);
+      writeString(material.normalTexture);
+      writeString(material.metallicTexture);
+      writeString(material.roughnessTexture);
+    }
+
+    if (!file)
+    {
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporaryFilename, filename, error);
+  if (error)
+  {
+    std::filesystem::remove(temporaryFilename, error);
+    return false;
+  }
+
+  return true;
+}
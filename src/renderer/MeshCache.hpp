@@ -0,0 +1,81 @@
+#pragma once
+
+#include "buffers/VertexBuffer.hpp"
+
+#include <string>
+#include <vector>
+
+// binary cache of the vertex and index data of an imported model, memory mapped on load
+class MeshCache
+{
+public:
+  static const uint32_t VERSION;
+
+  struct MeshRange
+  {
+    uint32_t firstIndex, indexCount, materialIndex;
+  };
+
+  struct MaterialReference
+  {
+    std::string name, diffuseTexture, normalTexture, metallicTexture, roughnessTexture;
+  };
+
+private:
+  struct MappedFile;
+  std::unique_ptr<MappedFile> mappedFile;
+
+  const Vertex* vertices;
+  const uint32_t* indices;
+  uint32_t numVertices, numIndices;
+  std::vector<MeshRange> meshes;
+  std::vector<MaterialReference> materials;
+
+  bool valid;
+
+  bool parse(const std::string& sourceFilename, uint32_t importFlags);
+
+public:
+  // maps the cache file, which is only considered valid if it was written for the same source data and import flags,
+  // the source is only hashed when its size or modification time changed
+  MeshCache(const std::string& filename, const std::string& sourceFilename, uint32_t importFlags);
+  ~MeshCache();
+
+  static uint64_t hashFile(const std::string& filename);
+  static bool write(const std::string& filename,
+                    const std::string& sourceFilename,
+                    uint32_t importFlags,
+                    const std::vector<Vertex>& vertices,
+                    const std::vector<uint32_t>& indices,
+                    const std::vector<MeshRange>& meshes,
+                    const std::vector<MaterialReference>& materials);
+
+  bool isValid() const
+  {
+    return valid;
+  }
+  const Vertex* getVertices() const
+  {
+    return vertices;
+  }
+  uint32_t getNumVertices() const
+  {
+    return numVertices;
+  }
+  const uint32_t* getIndices() const
+  {
+    return indices;
+  }
+  uint32_t getNumIndices() const
+  {
+    return numIndices;
+  }
+  const std::vector<MeshRange>& getMeshes() const
+  {
+    return meshes;
+  }
+  const std::vector<MaterialReference>& getMaterials() const
+  {
+    return materials;
+  }
+};
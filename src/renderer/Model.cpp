@@ -3,64 +3,82 @@
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
-std::shared_ptr<Mesh> Model::loadMeshData(const std::shared_ptr<Context> context,
-                                          const aiMesh* mesh,
-                                          const aiMaterial* material,
-                                          const std::string& path,
-                                          const std::string& filename,
-                                          const uint32_t numIndices)
+#include <unordered_map>
+
+namespace
 {
-  auto meshData = std::make_shared<Mesh>();
+// part of the mesh cache key, changing these invalidates all existing caches
+const uint32_t importFlags = aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices |
+                             aiProcess_ImproveCacheLocality | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph;
 
-  meshData->firstIndex = static_cast<uint32_t>(numIndices);
-  meshData->indexCount = mesh->mNumFaces * 3;
+std::string prependPath(const std::string& path, const std::string& filename)
+{
+  return filename.empty() ? filename : path + filename;
+}
+} // namespace
 
-  aiString materialName;
-  if (material->Get(AI_MATKEY_NAME, materialName) != aiReturn::aiReturn_SUCCESS)
+std::shared_ptr<Material> Model::cacheMaterial(const std::shared_ptr<Context> context,
+                                               const MeshCache::MaterialReference& materialReference,
+                                               const std::string& path)
+{
+  return Material::cacheMaterial(context, materialReference.name, prependPath(path, materialReference.diffuseTexture),
+                                 prependPath(path, materialReference.normalTexture),
+                                 prependPath(path, materialReference.metallicTexture),
+                                 prependPath(path, materialReference.roughnessTexture));
+}
+
+void Model::prefetchTextures(ThreadPool* threadPool,
+                             const std::vector<MeshCache::MaterialReference>& materialReferences,
+                             const std::string& path)
+{
+  for (const auto& materialReference : materialReferences)
   {
-    throw std::runtime_error("Model \"" + path + filename + "\" has invalid material with no name.");
+    Material::prefetchTextures(threadPool, prependPath(path, materialReference.diffuseTexture),
+                               prependPath(path, materialReference.normalTexture),
+                               prependPath(path, materialReference.metallicTexture),
+                               prependPath(path, materialReference.roughnessTexture));
   }
+}
 
-  meshData->material = Material::getMaterialFromCache(materialName.C_Str());
+MeshCache::MaterialReference
+Model::getMaterialReference(const aiMaterial* material, const std::string& path, const std::string& filename)
+{
+  MeshCache::MaterialReference materialReference;
 
-  if (meshData->material)
+  aiString materialName;
+  if (material->Get(AI_MATKEY_NAME, materialName) != aiReturn::aiReturn_SUCCESS)
   {
-    return meshData;
+    throw std::runtime_error("Model \"" + path + filename + "\" has invalid material with no name.");
   }
+  materialReference.name = materialName.C_Str();
 
-  meshData->material = std::make_shared<Material>(context, materialName.C_Str());
-
-  aiString diffuseTextureFilename, normalTextureFilename, occlusionTextureFilename, metallicTextureFilename,
-    roughnessTextureFilename;
+  // texture filenames are stored relative to the model so that the cache stays valid when the model is moved
+  aiString diffuseTextureFilename, normalTextureFilename, metallicTextureFilename, roughnessTextureFilename;
 
   if (material->GetTexture(aiTextureType_DIFFUSE, 0, &diffuseTextureFilename) == aiReturn::aiReturn_SUCCESS)
   {
-    meshData->material->setDiffuseTexture(path + std::string(diffuseTextureFilename.C_Str()));
+    materialReference.diffuseTexture = diffuseTextureFilename.C_Str();
   }
 
   if (material->GetTexture(aiTextureType_HEIGHT, 0, &normalTextureFilename) == aiReturn::aiReturn_SUCCESS)
   {
-    meshData->material->setNormalTexture(path + std::string(normalTextureFilename.C_Str()));
+    materialReference.normalTexture = normalTextureFilename.C_Str();
   }
 
   if (material->GetTexture(aiTextureType_AMBIENT, 0, &metallicTextureFilename) == aiReturn::aiReturn_SUCCESS)
   {
-    meshData->material->setMetallicTexture(path + std::string(metallicTextureFilename.C_Str()));
+    materialReference.metallicTexture = metallicTextureFilename.C_Str();
   }
 
   if (material->GetTexture(aiTextureType_SPECULAR, 0, &roughnessTextureFilename) == aiReturn::aiReturn_SUCCESS)
   {
-    meshData->material->setRoughnessTexture(path + std::string(roughnessTextureFilename.C_Str()));
+    materialReference.roughnessTexture = roughnessTextureFilename.C_Str();
   }
 
-  Material::addMaterialToCache(meshData->material);
-
-  return meshData;
+  return materialReference;
 }
 
-void Model::appendDataToIndexBuffer(const aiMesh* mesh,
-                                    const std::shared_ptr<IndexBuffer> indexBuffer,
-                                    const uint32_t numVertices)
+void Model::appendDataToIndices(const aiMesh* mesh, std::vector<uint32_t>& indices, const uint32_t numVertices)
 {
   for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
   {
@@ -73,13 +91,15 @@ void Model::appendDataToIndexBuffer(const aiMesh* mesh,
 
     for (unsigned int j = 0; j < face.mNumIndices; ++j)
     {
-      indexBuffer->getIndices()->push_back(static_cast<uint32_t>(numVertices) + face.mIndices[j]);
+      indices.push_back(numVertices + face.mIndices[j]);
     }
   }
 }
 
-void Model::appendDataToVertexBuffer(const aiMesh* mesh, const std::shared_ptr<VertexBuffer> vertexBuffer)
+void Model::appendDataToVertices(const aiMesh* mesh, std::vector<Vertex>& vertices)
 {
+  vertices.reserve(vertices.size() + mesh->mNumVertices);
+
   for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
   {
     const auto position = mesh->mVertices[i];
@@ -88,62 +108,209 @@ void Model::appendDataToVertexBuffer(const aiMesh* mesh, const std::shared_ptr<V
     const auto tangent = mesh->HasTangentsAndBitangents() ? mesh->mTangents[i] : aiVector3D(0.0f);
     const auto bitangent = mesh->HasTangentsAndBitangents() ? mesh->mBitangents[i] : aiVector3D(0.0f);
 
-    vertexBuffer->getVertices()->push_back({ { position.x, position.y, position.z },
-                                             { uv.x, uv.y },
-                                             { normal.x, normal.y, normal.z },
-                                             { tangent.x, tangent.y, tangent.z },
-                                             { bitangent.x, bitangent.y, bitangent.z } });
+    vertices.push_back({ { position.x, position.y, position.z },
+                         { { uv.x, uv.y },
+                           { normal.x, normal.y, normal.z },
+                           { tangent.x, tangent.y, tangent.z },
+                           { bitangent.x, bitangent.y, bitangent.z } } });
   }
 }
 
-Model::Model(const std::shared_ptr<Context> context,
-             const std::shared_ptr<VertexBuffer> vertexBuffer,
-             const std::shared_ptr<IndexBuffer> indexBuffer,
-             const std::string& path,
-             const std::string& filename)
+std::shared_ptr<ModelBlock> Model::loadBlock(const std::shared_ptr<Context> context,
+                                             ThreadPool* threadPool,
+                                             const std::string& path,
+                                             const std::string& filename)
 {
-  Assimp::Importer importer;
-  const auto scene =
-    importer.ReadFile(path + filename, aiProcess_CalcTangentSpace | aiProcess_FlipUVs |
-                                         aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality |
-                                         aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph);
+  auto block = std::make_shared<ModelBlock>();
+
+  const auto cacheFilename = path + filename + ".meshcache";
+
+  std::vector<MeshCache::MaterialReference> materialReferences;
+
+  auto meshCache = std::make_unique<MeshCache>(cacheFilename, path + filename, importFlags);
+  if (meshCache->isValid())
+  // skip the import and keep the cache mapped until the block has been spliced in
+  {
+    block->vertices = meshCache->getVertices();
+    block->numVertices = meshCache->getNumVertices();
+    block->indices = meshCache->getIndices();
+    block->numIndices = meshCache->getNumIndices();
+    block->meshRanges = meshCache->getMeshes();
+    materialReferences = meshCache->getMaterials();
+    block->meshCache = std::move(meshCache);
+
+    prefetchTextures(threadPool, materialReferences, path);
+  }
+  else
+  {
+    meshCache = nullptr;
+
+    Assimp::Importer importer;
+    const auto scene = importer.ReadFile(path + filename, importFlags);
+
+    if (!scene)
+    {
+      throw std::runtime_error("Failed to load model \"" + path + filename + "\".");
+    }
+
+    if (!scene->HasMeshes())
+    {
+      throw std::runtime_error("Model \"" + path + filename + "\" has no meshes.");
+    }
+
+    if (!scene->HasMaterials())
+    {
+      throw std::runtime_error("Model \"" + path + filename + "\" has no materials.");
+    }
 
-  if (!scene)
+    // gather the materials first, so that their textures decode while the geometry gets converted
+    std::unordered_map<unsigned int, uint32_t> materialIndices;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+      const auto mesh = scene->mMeshes[i];
+
+      if (mesh->HasPositions() && materialIndices.find(mesh->mMaterialIndex) == materialIndices.end())
+      {
+        materialReferences.push_back(getMaterialReference(scene->mMaterials[mesh->mMaterialIndex], path, filename));
+        materialIndices.emplace(mesh->mMaterialIndex, static_cast<uint32_t>(materialReferences.size() - 1));
+      }
+    }
+
+    prefetchTextures(threadPool, materialReferences, path);
+
+    auto& vertices = block->importedVertices;
+    auto& indices = block->importedIndices;
+
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+      const auto mesh = scene->mMeshes[i];
+
+      if (!mesh->HasPositions())
+      {
+        continue;
+      }
+
+      MeshCache::MeshRange meshRange;
+      meshRange.firstIndex = static_cast<uint32_t>(indices.size());
+      meshRange.materialIndex = materialIndices.at(mesh->mMaterialIndex);
+
+      appendDataToIndices(mesh, indices, static_cast<uint32_t>(vertices.size()));
+      appendDataToVertices(mesh, vertices);
+
+      meshRange.indexCount = static_cast<uint32_t>(indices.size()) - meshRange.firstIndex;
+      block->meshRanges.push_back(meshRange);
+    }
+
+    // failing to write the cache only means the next start has to import again
+    MeshCache::write(cacheFilename, path + filename, importFlags, vertices, indices, block->meshRanges,
+                     materialReferences);
+
+    block->vertices = vertices.data();
+    block->numVertices = static_cast<uint32_t>(vertices.size());
+    block->indices = indices.data();
+    block->numIndices = static_cast<uint32_t>(indices.size());
+  }
+
+  // materials and their textures are cached globally, so concurrent loads of the same asset share one instance
+  block->materials.reserve(materialReferences.size());
+  for (const auto& materialReference : materialReferences)
   {
-    throw std::runtime_error("Failed to load model \"" + path + filename + "\".");
+    block->materials.push_back(cacheMaterial(context, materialReference, path));
   }
 
-  if (!scene->HasMeshes())
+  return block;
+}
+
+void Model::spliceBlock(const std::shared_ptr<VertexBuffer> vertexBuffer,
+                        const std::shared_ptr<IndexBuffer> indexBuffer,
+                        const ModelBlock* block,
+                        bool compressVertices)
+{
+  const auto baseVertex = static_cast<uint32_t>(compressVertices ? vertexBuffer->getCompressedVertices()->size() :
+                                                                   vertexBuffer->getVertices()->size());
+  const auto baseIndex = static_cast<uint32_t>(indexBuffer->getIndices()->size());
+
+  if (compressVertices)
   {
-    throw std::runtime_error("Model \"" + path + filename + "\" has no meshes.");
+    vertexBuffer->getCompressedVertices()->resize(baseVertex + block->numVertices);
+  }
+  else
+  {
+    vertexBuffer->getVertices()->resize(baseVertex + block->numVertices);
+    memcpy(vertexBuffer->getVertices()->data() + baseVertex, block->vertices, block->numVertices * sizeof(Vertex));
   }
 
-  if (!scene->HasMaterials())
+  // indices are relative to the first vertex of this model and need to be moved behind the vertices already there
+  indexBuffer->getIndices()->resize(baseIndex + block->numIndices);
+  auto dst = indexBuffer->getIndices()->data() + baseIndex;
+  for (uint32_t i = 0; i < block->numIndices; ++i)
   {
-    throw std::runtime_error("Model \"" + path + filename + "\" has no materials.");
+    dst[i] = block->indices[i] + baseVertex;
   }
 
-  for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+  for (const auto& meshRange : block->meshRanges)
   {
-    const auto mesh = scene->mMeshes[i];
+    auto mesh = std::make_shared<Mesh>();
+    mesh->firstIndex = baseIndex + meshRange.firstIndex;
+    mesh->indexCount = meshRange.indexCount;
+    mesh->material = block->materials.at(meshRange.materialIndex);
 
-    if (!mesh->HasPositions())
+    mesh->boundsMin = mesh->boundsMax = glm::vec3(0.0f);
+    for (uint32_t i = 0; i < meshRange.indexCount; ++i)
     {
-      continue;
+      const auto& position = block->vertices[block->indices[meshRange.firstIndex + i]].position;
+      mesh->boundsMin = i == 0 ? position : glm::min(mesh->boundsMin, position);
+      mesh->boundsMax = i == 0 ? position : glm::max(mesh->boundsMax, position);
+    }
+
+    // centered on the box, which is usually tighter than the sphere around the box
+    const auto center = (mesh->boundsMin + mesh->boundsMax) * 0.5f;
+    auto radius = 0.0f;
+    for (uint32_t i = 0; i < meshRange.indexCount; ++i)
+    {
+      const auto& position = block->vertices[block->indices[meshRange.firstIndex + i]].position;
+      radius = glm::max(radius, glm::distance(center, position));
     }
+    mesh->boundingSphere = glm::vec4(center, radius);
 
-    const auto material = scene->mMaterials[mesh->mMaterialIndex];
-    meshes.push_back(
-      loadMeshData(context, mesh, material, path, filename, static_cast<uint32_t>(indexBuffer->getIndices()->size())));
-    appendDataToIndexBuffer(mesh, indexBuffer, static_cast<uint32_t>(vertexBuffer->getVertices()->size()));
-    appendDataToVertexBuffer(mesh, vertexBuffer);
+    // meshes never share vertices, so each vertex is quantized against the bounds of the only mesh using it
+    if (compressVertices)
+    {
+      auto compressedVertices = vertexBuffer->getCompressedVertices()->data() + baseVertex;
+      for (uint32_t i = 0; i < meshRange.indexCount; ++i)
+      {
+        const auto index = block->indices[meshRange.firstIndex + i];
+        compressedVertices[index] =
+          VertexBuffer::compressVertex(block->vertices[index], mesh->boundsMin, mesh->boundsMax - mesh->boundsMin);
+      }
+    }
+
+    meshes.push_back(mesh);
   }
 }
 
+Model::Model(const std::shared_ptr<Context> context,
+             const std::shared_ptr<VertexBuffer> vertexBuffer,
+             const std::shared_ptr<IndexBuffer> indexBuffer,
+             const std::string& path,
+             const std::string& filename,
+             bool compressVertices)
+{
+  const auto block = loadBlock(context, nullptr, path, filename);
+  spliceBlock(vertexBuffer, indexBuffer, block.get(), compressVertices);
+}
+
 void Model::finalizeMaterials(const std::shared_ptr<DescriptorPool> descriptorPool)
 {
   for (auto& mesh : meshes)
   {
     mesh->material->finalize(descriptorPool);
   }
+}
+
+std::shared_ptr<Transform> Model::addInstance()
+{
+  auto instance = std::make_shared<Transform>();
+  instances.push_back(instance);
+  return instance;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Material.hpp"
+#include "MeshCache.hpp"
 #include "buffers/IndexBuffer.hpp"
 #include "buffers/VertexBuffer.hpp"
 #include "core/Transform.hpp"
@@ -10,36 +11,86 @@
 struct Mesh
 {
   uint32_t firstIndex, indexCount;
+  glm::vec3 boundsMin, boundsMax;
+  // center in xyz and radius in w, in model space like the box
+  glm::vec4 boundingSphere;
   std::shared_ptr<Material> material;
 };
 
-class Model : public Transform
+// vertex and index data of a single model with indices relative to its own first vertex, built without touching the
+// shared vertex and index buffers so that any number of models can be loaded on worker threads at once
+struct ModelBlock
+{
+  std::unique_ptr<MeshCache> meshCache;
+  std::vector<Vertex> importedVertices;
+  std::vector<uint32_t> importedIndices;
+
+  const Vertex* vertices;
+  const uint32_t* indices;
+  uint32_t numVertices, numIndices;
+  std::vector<MeshCache::MeshRange> meshRanges;
+  std::vector<std::shared_ptr<Material>> materials;
+};
+
+// loaded once per file, every placement of it in the world is an instance that only carries its own transform
+class Model
 {
 private:
   std::vector<std::shared_ptr<Mesh>> meshes;
+  std::vector<std::shared_ptr<Transform>> instances;
+  uint32_t firstInstance = 0;
 
-  std::shared_ptr<Mesh> loadMeshData(const std::shared_ptr<Context> context,
-                                     const aiMesh* mesh,
-                                     const aiMaterial* material,
-                                     const std::string& path,
-                                     const std::string& filename,
-                                     const uint32_t numIndices);
-  void appendDataToIndexBuffer(const aiMesh* mesh,
-                               const std::shared_ptr<IndexBuffer> indexBuffer,
-                               const uint32_t numVertices);
-  void appendDataToVertexBuffer(const aiMesh* mesh, const std::shared_ptr<VertexBuffer> vertexBuffer);
+  static std::shared_ptr<Material> cacheMaterial(const std::shared_ptr<Context> context,
+                                                const MeshCache::MaterialReference& materialReference,
+                                                const std::string& path);
+  static void prefetchTextures(ThreadPool* threadPool,
+                               const std::vector<MeshCache::MaterialReference>& materialReferences,
+                               const std::string& path);
+  static MeshCache::MaterialReference
+  getMaterialReference(const aiMaterial* material, const std::string& path, const std::string& filename);
+  static void appendDataToIndices(const aiMesh* mesh, std::vector<uint32_t>& indices, const uint32_t numVertices);
+  static void appendDataToVertices(const aiMesh* mesh, std::vector<Vertex>& vertices);
 
 public:
+  // creates an empty model that gets its meshes once a block is spliced in
+  Model() = default;
   Model(const std::shared_ptr<Context> context,
         const std::shared_ptr<VertexBuffer> vertexBuffer,
         const std::shared_ptr<IndexBuffer> indexBuffer,
         const std::string& path,
-        const std::string& filename);
+        const std::string& filename,
+        bool compressVertices = false);
+
+  // safe to call from any thread, textures are decoded on the thread pool if one is given
+  static std::shared_ptr<ModelBlock> loadBlock(const std::shared_ptr<Context> context,
+                                               ThreadPool* threadPool,
+                                               const std::string& path,
+                                               const std::string& filename);
+  // compressed models go into the compressed vertex array, their indices refer to that array instead
+  void spliceBlock(const std::shared_ptr<VertexBuffer> vertexBuffer,
+                   const std::shared_ptr<IndexBuffer> indexBuffer,
+                   const ModelBlock* block,
+                   bool compressVertices);
 
   void finalizeMaterials(const std::shared_ptr<DescriptorPool> descriptorPool);
 
+  std::shared_ptr<Transform> addInstance();
+
   std::vector<std::shared_ptr<Mesh>>* getMeshes()
   {
     return &meshes;
   }
+  std::vector<std::shared_ptr<Transform>>* getInstances()
+  {
+    return &instances;
+  }
+  // index of the first instance in the instance buffer, the instances of a model are stored next to each other
+  uint32_t getFirstInstance() const
+  {
+    return firstInstance;
+  }
+  void setFirstInstance(uint32_t firstInstance)
+  {
+    this->firstInstance = firstInstance;
+  }
 };
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "OcclusionRasterizer.hpp"
+#include "Settings.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+const uint32_t OcclusionRasterizer::WIDTH = 256;
+const uint32_t OcclusionRasterizer::HEIGHT = 128;
+const uint32_t OcclusionRasterizer::TILE_SIZE = 8;
+
+namespace
+{
+// the rows are processed four pixels at a time, so the width has to be a multiple of that
+constexpr uint32_t LANES = 4;
+
+glm::vec3 toScreen(const glm::vec4& clip)
+{
+  const auto ndc = glm::vec3(clip) / clip.w;
+  return glm::vec3((ndc.x * 0.5f + 0.5f) * OcclusionRasterizer::WIDTH,
+                   (ndc.y * 0.5f + 0.5f) * OcclusionRasterizer::HEIGHT, glm::clamp(ndc.z, 0.0f, 1.0f));
+}
+
+// cuts off the part of the triangle in front of the near plane, which leaves up to four vertices
+uint32_t clipNear(const glm::vec4* triangle, glm::vec4* polygon)
+{
+  uint32_t numVertices = 0;
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    const auto& current = triangle[i];
+    const auto& next = triangle[(i + 1) % 3];
+
+    if (current.z >= 0.0f)
+    {
+      polygon[numVertices++] = current;
+    }
+
+    if ((current.z >= 0.0f) != (next.z >= 0.0f))
+    {
+      polygon[numVertices++] = glm::mix(current, next, current.z / (current.z - next.z));
+    }
+  }
+
+  return numVertices;
+}
+} // namespace
+
+OcclusionRasterizer::OcclusionRasterizer(const std::vector<std::shared_ptr<Model>>* models,
+                                         const std::shared_ptr<VertexBuffer> vertexBuffer,
+                                         const std::shared_ptr<IndexBuffer> indexBuffer,
+                                         uint32_t triangleBudget)
+{
+  depths.assign(WIDTH * HEIGHT, 1.0f);
+  tileDepths.assign((WIDTH / TILE_SIZE) * (HEIGHT / TILE_SIZE), 1.0f);
+
+  const auto indices = indexBuffer->getIndices();
+
+  // compressed positions are stored relative to the bounds of their mesh
+  const auto getPosition = [&](uint32_t index, const Mesh* mesh) {
+    if (Settings::vertexCompression)
+    {
+      const auto& position = vertexBuffer->getCompressedVertices()->at(index).position;
+      return mesh->boundsMin + glm::vec3(position) / 65535.0f * (mesh->boundsMax - mesh->boundsMin);
+    }
+
+    return vertexBuffer->getVertices()->at(index).position;
+  };
+
+  struct Candidate
+  {
+    Model* model;
+    const Mesh* mesh;
+    float area;
+  };
+  std::vector<Candidate> candidates;
+  for (auto& model : *models)
+  {
+    if (model->getInstances()->empty())
+    {
+      continue;
+    }
+
+    for (auto& mesh : *model->getMeshes())
+    {
+      auto area = 0.0f;
+      for (uint32_t i = 0; i + 2 < mesh->indexCount; i += 3)
+      {
+        const auto v0 = getPosition(indices->at(mesh->firstIndex + i), mesh.get());
+        const auto v1 = getPosition(indices->at(mesh->firstIndex + i + 1), mesh.get());
+        const auto v2 = getPosition(indices->at(mesh->firstIndex + i + 2), mesh.get());
+        area += glm::length(glm::cross(v1 - v0, v2 - v0)) * 0.5f;
+      }
+
+      candidates.push_back({ model.get(), mesh.get(), area });
+    }
+  }
+
+  // the largest surfaces hide the most, meshes that do not fit into the remaining budget are skipped
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) { return a.area > b.area; });
+
+  uint32_t numTriangles = 0;
+  for (const auto& candidate : candidates)
+  {
+    const auto numInstances = static_cast<uint32_t>(candidate.model->getInstances()->size());
+    const auto meshTriangles = candidate.mesh->indexCount / 3 * numInstances;
+    if (numTriangles + meshTriangles > triangleBudget)
+    {
+      continue;
+    }
+    numTriangles += meshTriangles;
+
+    // meshes never share vertices, but their vertices do not have to follow each other
+    OccluderMesh occluderMesh;
+    std::unordered_map<uint32_t, uint32_t> localIndices;
+    for (uint32_t i = 0; i < candidate.mesh->indexCount / 3 * 3; ++i)
+    {
+      const auto index = indices->at(candidate.mesh->firstIndex + i);
+      auto localIndex = localIndices.find(index);
+      if (localIndex == localIndices.end())
+      {
+        localIndex = localIndices.emplace(index, static_cast<uint32_t>(occluderMesh.positions.size())).first;
+        occluderMesh.positions.push_back(getPosition(index, candidate.mesh));
+      }
+      occluderMesh.indices.push_back(localIndex->second);
+    }
+
+    const auto mesh = static_cast<uint32_t>(occluderMeshes.size());
+    occluderMeshes.push_back(std::move(occluderMesh));
+    for (auto& instance : *candidate.model->getInstances())
+    {
+      occluderInstances.push_back({ mesh, instance });
+    }
+  }
+}
+
+OcclusionRasterizer::~OcclusionRasterizer()
+{
+  // the bands write into this rasterizer
+  for (auto& band : bands)
+  {
+    band.wait();
+  }
+}
+
+void OcclusionRasterizer::rasterize(ThreadPool* threadPool, const glm::mat4& viewProjectionMatrix)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  // the bands of a rasterization that was never culled with still write into the depth buffer
+  for (auto& band : bands)
+  {
+    band.wait();
+  }
+  bands.clear();
+
+  this->viewProjectionMatrix = viewProjectionMatrix;
+
+  triangles.clear();
+  std::vector<glm::vec4> clipPositions;
+  for (const auto& occluderInstance : occluderInstances)
+  {
+    const auto& occluderMesh = occluderMeshes.at(occluderInstance.mesh);
+    const auto matrix = viewProjectionMatrix * occluderInstance.transform->getWorldMatrix();
+
+    clipPositions.resize(occluderMesh.positions.size());
+    for (size_t i = 0; i < clipPositions.size(); ++i)
+    {
+      clipPositions[i] = matrix * glm::vec4(occluderMesh.positions[i], 1.0f);
+    }
+
+    for (size_t i = 0; i < occluderMesh.indices.size(); i += 3)
+    {
+      const glm::vec4 triangle[] = { clipPositions[occluderMesh.indices[i]],
+                                     clipPositions[occluderMesh.indices[i + 1]],
+                                     clipPositions[occluderMesh.indices[i + 2]] };
+
+      // entirely outside one of the side planes
+      if ((triangle[0].x > triangle[0].w && triangle[1].x > triangle[1].w && triangle[2].x > triangle[2].w) ||
+          (triangle[0].x < -triangle[0].w && triangle[1].x < -triangle[1].w && triangle[2].x < -triangle[2].w) ||
+          (triangle[0].y > triangle[0].w && triangle[1].y > triangle[1].w && triangle[2].y > triangle[2].w) ||
+          (triangle[0].y < -triangle[0].w && triangle[1].y < -triangle[1].w && triangle[2].y < -triangle[2].w))
+      {
+        continue;
+      }
+
+      glm::vec4 polygon[4];
+      const auto numVertices = clipNear(triangle, polygon);
+      for (uint32_t j = 1; j + 1 < numVertices; ++j)
+      {
+        auto v0 = toScreen(polygon[0]), v1 = toScreen(polygon[j]), v2 = toScreen(polygon[j + 1]);
+
+        // both sides of an occluder hide what is behind it, so the winding is made the same for all triangles
+        const auto area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-6f)
+        {
+          continue;
+        }
+        if (area < 0.0f)
+        {
+          std::swap(v1, v2);
+        }
+
+        triangles.push_back(v0);
+        triangles.push_back(v1);
+        triangles.push_back(v2);
+      }
+    }
+  }
+
+  // each band covers whole rows of tiles, so that it can reduce its own tiles without waiting for the others
+  const auto numTileRows = HEIGHT / TILE_SIZE;
+  const auto numBands = std::clamp(threadPool ? threadPool->getNumThreads() : 1u, 1u, numTileRows);
+  const auto tileRowsPerBand = (numTileRows + numBands - 1) / numBands;
+  for (uint32_t firstTileRow = 0; firstTileRow < numTileRows; firstTileRow += tileRowsPerBand)
+  {
+    const auto bandTileRows = std::min(tileRowsPerBand, numTileRows - firstTileRow);
+    if (threadPool)
+    {
+      bands.push_back(threadPool->submit([this, firstTileRow, bandTileRows]() {
+        rasterizeBand(firstTileRow, bandTileRows);
+      }));
+    }
+    else
+    {
+      rasterizeBand(firstTileRow, bandTileRows);
+    }
+  }
+
+  time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void OcclusionRasterizer::rasterizeBand(uint32_t firstTileRow, uint32_t numTileRows)
+{
+  const auto firstRow = static_cast<int>(firstTileRow * TILE_SIZE);
+  const auto endRow = static_cast<int>((firstTileRow + numTileRows) * TILE_SIZE);
+  std::fill(depths.begin() + firstRow * WIDTH, depths.begin() + endRow * WIDTH, 1.0f);
+
+  for (size_t i = 0; i < triangles.size(); i += 3)
+  {
+    const auto& v0 = triangles[i];
+    const auto& v1 = triangles[i + 1];
+    const auto& v2 = triangles[i + 2];
+
+    // the pixels whose centers may be covered, clamped to the band
+    const auto minY = std::max(static_cast<int>(std::floor(std::min({ v0.y, v1.y, v2.y }))), firstRow);
+    const auto maxY = std::min(static_cast<int>(std::floor(std::max({ v0.y, v1.y, v2.y }))), endRow - 1);
+    const auto minX = std::max(static_cast<int>(std::floor(std::min({ v0.x, v1.x, v2.x }))), 0);
+    const auto maxX =
+      std::min(static_cast<int>(std::floor(std::max({ v0.x, v1.x, v2.x }))), static_cast<int>(WIDTH) - 1);
+    if (minY > maxY || minX > maxX)
+    {
+      continue;
+    }
+
+    // edge functions are positive inside the counter clockwise triangle, the depth is a plane in screen space
+    const glm::vec3 a(v0.y - v1.y, v1.y - v2.y, v2.y - v0.y);
+    const glm::vec3 b(v1.x - v0.x, v2.x - v1.x, v0.x - v2.x);
+    const glm::vec3 c(-(a.x * v0.x + b.x * v0.y), -(a.y * v1.x + b.y * v1.y), -(a.z * v2.x + b.z * v2.y));
+
+    const auto area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    const auto depthX = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    const auto depthY = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    const auto depthC = v0.z - depthX * v0.x - depthY * v0.y;
+
+#ifdef OCCLUSION_SSE
+    const auto laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const auto zero = _mm_setzero_ps();
+    for (auto y = minY; y <= maxY; ++y)
+    {
+      const auto pixelY = static_cast<float>(y) + 0.5f;
+      const auto rowEdge0 = _mm_set1_ps(b.x * pixelY + c.x);
+      const auto rowEdge1 = _mm_set1_ps(b.y * pixelY + c.y);
+      const auto rowEdge2 = _mm_set1_ps(b.z * pixelY + c.z);
+      const auto rowDepth = _mm_set1_ps(depthY * pixelY + depthC);
+
+      auto row = depths.data() + y * WIDTH;
+      for (auto x = minX / static_cast<int>(LANES) * static_cast<int>(LANES); x <= maxX; x += LANES)
+      {
+        const auto pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+        const auto edge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.x), pixelX), rowEdge0);
+        const auto edge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.y), pixelX), rowEdge1);
+        const auto edge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.z), pixelX), rowEdge2);
+        const auto inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)),
+                                       _mm_cmpge_ps(edge2, zero));
+        if (_mm_movemask_ps(inside) == 0)
+        {
+          continue;
+        }
+
+        const auto depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthX), pixelX), rowDepth);
+        const auto current = _mm_loadu_ps(row + x);
+        const auto nearest = _mm_min_ps(current, depth);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+      }
+    }
+#else
+    for (auto y = minY; y <= maxY; ++y)
+    {
+      const auto pixelY = static_cast<float>(y) + 0.5f;
+      auto row = depths.data() + y * WIDTH;
+      for (auto x = minX; x <= maxX; ++x)
+      {
+        const auto pixelX = static_cast<float>(x) + 0.5f;
+        if (a.x * pixelX + b.x * pixelY + c.x >= 0.0f && a.y * pixelX + b.y * pixelY + c.y >= 0.0f &&
+            a.z * pixelX + b.z * pixelY + c.z >= 0.0f)
+        {
+          row[x] = std::min(row[x], depthX * pixelX + depthY * pixelY + depthC);
+        }
+      }
+    }
+#endif
+  }
+
+  // the farthest depth of each tile lets most bounds be tested without looking at its pixels
+  const auto tilesPerRow = WIDTH / TILE_SIZE;
+  for (auto tileY = firstTileRow; tileY < firstTileRow + numTileRows; ++tileY)
+  {
+    for (uint32_t tileX = 0; tileX < tilesPerRow; ++tileX)
+    {
+      auto farthest = 0.0f;
+      for (uint32_t y = tileY * TILE_SIZE; y < (tileY + 1) * TILE_SIZE; ++y)
+      {
+        const auto row = depths.data() + y * WIDTH + tileX * TILE_SIZE;
+        farthest = std::max(farthest, *std::max_element(row, row + TILE_SIZE));
+      }
+      tileDepths[tileY * tilesPerRow + tileX] = farthest;
+    }
+  }
+}
+
+bool OcclusionRasterizer::isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+  auto screenMin = glm::vec3(std::numeric_limits<float>::max());
+  auto screenMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (uint32_t i = 0; i < 8; ++i)
+  {
+    const auto corner = glm::vec3((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y,
+                                  (i & 4) ? boundsMax.z : boundsMin.z);
+    const auto clip = viewProjectionMatrix * glm::vec4(corner, 1.0f);
+
+    // the bounds reach past the near plane, where nothing can be in front of them
+    if (clip.z < 0.0f)
+    {
+      return false;
+    }
+
+    const auto screen = toScreen(clip);
+    screenMin = glm::min(screenMin, screen);
+    screenMax = glm::max(screenMax, screen);
+  }
+
+  const auto minX = std::max(static_cast<int>(std::floor(screenMin.x)), 0);
+  const auto maxX = std::min(static_cast<int>(std::floor(screenMax.x)), static_cast<int>(WIDTH) - 1);
+  const auto minY = std::max(static_cast<int>(std::floor(screenMin.y)), 0);
+  const auto maxY = std::min(static_cast<int>(std::floor(screenMax.y)), static_cast<int>(HEIGHT) - 1);
+  if (minX > maxX || minY > maxY)
+  {
+    return false;
+  }
+
+  // hidden in every tile it covers
+  const auto nearest = screenMin.z;
+  auto hiddenInTiles = true;
+  for (auto tileY = minY / static_cast<int>(TILE_SIZE); tileY <= maxY / static_cast<int>(TILE_SIZE); ++tileY)
+  {
+    for (auto tileX = minX / static_cast<int>(TILE_SIZE); tileX <= maxX / static_cast<int>(TILE_SIZE); ++tileX)
+    {
+      hiddenInTiles = hiddenInTiles && nearest > tileDepths[tileY * (WIDTH / TILE_SIZE) + tileX];
+    }
+  }
+  if (hiddenInTiles)
+  {
+    return true;
+  }
+
+  // a tile may only be partly covered by the occluders, while the bounds may not reach the uncovered part
+  for (auto y = minY; y <= maxY; ++y)
+  {
+    const auto row = depths.data() + y * WIDTH;
+#ifdef OCCLUSION_SSE
+    const auto nearestLanes = _mm_set1_ps(nearest);
+    const auto laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const auto rangeMin = _mm_set1_ps(static_cast<float>(minX));
+    const auto rangeMax = _mm_set1_ps(static_cast<float>(maxX));
+    for (auto x = minX / static_cast<int>(LANES) * static_cast<int>(LANES); x <= maxX; x += LANES)
+    {
+      const auto pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+      const auto inRange = _mm_and_ps(_mm_cmpge_ps(pixelX, rangeMin), _mm_cmple_ps(pixelX, rangeMax));
+      if (_mm_movemask_ps(_mm_and_ps(inRange, _mm_cmpge_ps(_mm_loadu_ps(row + x), nearestLanes))) != 0)
+      {
+        return false;
+      }
+    }
+#else
+    for (auto x = minX; x <= maxX; ++x)
+    {
+      if (row[x] >= nearest)
+      {
+        return false;
+      }
+    }
+#endif
+  }
+
+  return true;
+}
+
+uint32_t OcclusionRasterizer::cull(const CullingBounds& bounds, std::vector<uint8_t>& visibility)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  for (auto& band : bands)
+  {
+    band.get();
+  }
+  bands.clear();
+
+  uint32_t numOccluded = 0;
+  for (uint32_t i = 0; i < bounds.getNumBounds(); ++i)
+  {
+    if (visibility[i] && isOccluded(bounds.getBoxMin(i), bounds.getBoxMax(i)))
+    {
+      visibility[i] = 0;
+      ++numOccluded;
+    }
+  }
+
+  time += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  return numOccluded;
+}
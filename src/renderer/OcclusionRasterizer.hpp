@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Culling.hpp"
+#include "core/ThreadPool.hpp"
+
+// a small depth buffer on the host that the meshes covering the most area for their triangles are rasterized into
+// every frame, so that the mesh instances hidden behind them are culled before any commands are recorded
+class OcclusionRasterizer
+{
+public:
+  // the depth buffer is split into square tiles, each of which also stores its farthest depth
+  static const uint32_t WIDTH, HEIGHT, TILE_SIZE;
+
+private:
+  // model space positions with indices into them, shared by every instance of the mesh
+  struct OccluderMesh
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+  };
+  std::vector<OccluderMesh> occluderMeshes;
+
+  struct OccluderInstance
+  {
+    uint32_t mesh;
+    std::shared_ptr<Transform> transform;
+  };
+  std::vector<OccluderInstance> occluderInstances;
+
+  // in screen space with the depth in z, three vertices per triangle and counter clockwise
+  std::vector<glm::vec3> triangles;
+  std::vector<float> depths, tileDepths;
+
+  glm::mat4 viewProjectionMatrix;
+  std::vector<std::future<void>> bands;
+  float time = 0.0f;
+
+  void rasterizeBand(uint32_t firstTileRow, uint32_t numTileRows);
+  bool isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+public:
+  // picks the meshes with the largest surfaces until the triangles of all their instances reach the budget
+  OcclusionRasterizer(const std::vector<std::shared_ptr<Model>>* models,
+                      const std::shared_ptr<VertexBuffer> vertexBuffer,
+                      const std::shared_ptr<IndexBuffer> indexBuffer,
+                      uint32_t triangleBudget);
+  ~OcclusionRasterizer();
+
+  // transforms the occluders and starts rasterizing them on the thread pool, in bands of tile rows
+  void rasterize(ThreadPool* threadPool, const glm::mat4& viewProjectionMatrix);
+  // waits for the rasterization and sets the visibility of every visible instance hidden behind the occluders to 0,
+  // returns how many that were
+  uint32_t cull(const CullingBounds& bounds, std::vector<uint8_t>& visibility);
+
+  uint32_t getNumOccluderInstances() const
+  {
+    return static_cast<uint32_t>(occluderInstances.size());
+  }
+  // spent by the calling thread in the last rasterization and culling, including the wait for the bands, in
+  // milliseconds
+  float getTime() const
+  {
+    return time;
+  }
+};
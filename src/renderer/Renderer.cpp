@@ -1,7 +1,10 @@
 #include "Renderer.hpp"
+#include "ImageDecoder.hpp"
 #include "Settings.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
 
 #define GLM_FORCE_RADIANS
 #include <glm/gtc/matrix_transform.hpp>
@@ -18,17 +21,58 @@ Renderer::Renderer(const std::shared_ptr<Window> window,
   vertexBuffer = std::make_shared<VertexBuffer>();
   indexBuffer = std::make_shared<IndexBuffer>();
 
+  Texture::createUploader(context);
   Material::loadDefaultTextures(context);
 
+  threadPool = std::make_unique<ThreadPool>();
+
   unitQuadModel = std::make_shared<Model>(context, vertexBuffer, indexBuffer, "Models/UnitQuad/", "UnitQuad.obj");
   unitSphereModel = std::make_shared<Model>(context, vertexBuffer, indexBuffer, "Models/UnitSphere/", "UnitSphere.obj");
 }
 
-std::shared_ptr<Model> Renderer::loadModel(const std::string& path, const std::string& filename)
+std::shared_ptr<Transform> Renderer::loadModel(const std::string& path, const std::string& filename)
+{
+  auto model = modelCache.find(path + filename);
+  if (model == modelCache.end())
+  {
+    auto newModel =
+      std::make_shared<Model>(context, vertexBuffer, indexBuffer, path, filename, Settings::vertexCompression);
+    model = modelCache.emplace(path + filename, newModel).first;
+    modelList.push_back(newModel);
+  }
+
+  return model->second->addInstance();
+}
+
+std::shared_ptr<Transform> Renderer::loadModelAsync(const std::string& path, const std::string& filename)
+{
+  auto model = modelCache.find(path + filename);
+  if (model == modelCache.end())
+  // only import each file once, also keeps multiple threads from writing the same mesh cache
+  {
+    auto future = threadPool->submit([context = context, threadPool = threadPool.get(), path, filename]() {
+      return Model::loadBlock(context, threadPool, path, filename);
+    });
+
+    model = modelCache.emplace(path + filename, std::make_shared<Model>()).first;
+    pendingModels.emplace_back(model->second, future.share());
+    modelList.push_back(model->second);
+  }
+
+  return model->second->addInstance();
+}
+
+void Renderer::waitForModels()
 {
-  auto model = std::make_shared<Model>(context, vertexBuffer, indexBuffer, path, filename);
-  modelList.push_back(model);
-  return model;
+  for (auto& pendingModel : pendingModels)
+  {
+    pendingModel.first->spliceBlock(vertexBuffer, indexBuffer, pendingModel.second.get().get(),
+                                    Settings::vertexCompression);
+  }
+
+  // releases the blocks, including any mapped mesh caches
+  pendingModels.clear();
+  ImageDecoder::clear();
 }
 
 std::shared_ptr<Light> Renderer::loadDirectionalLight(const glm::vec3& position,
@@ -65,23 +109,220 @@ std::shared_ptr<Light> Renderer::loadSpotLight(const glm::vec3& position,
   return light;
 }
 
+void Renderer::recordShadowPass(const std::shared_ptr<ShadowMap> shadowMap,
+                                uint32_t shadowMapIndex,
+                                uint32_t frameIndex)
+{
+  // only the instances that moved recently are drawn every frame while caching the others
+  const auto casters = Settings::shadowCaching ? &dynamicCasters : nullptr;
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+  {
+    shadowMap->recordCommandBuffer(vertexBuffer, indexBuffer, instanceBuffer,
+                                   dynamicUniformBuffer->getDescriptor(1)->getSet(frameIndex), shadowPipeline,
+                                   &modelList, shadowMapIndex, numShadowMaps, frameIndex, cullingBuffer.get(), casters);
+  }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+  {
+    shadowMap->recordCommandBuffer(
+      vertexBuffer, indexBuffer, instanceBuffer,
+      shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex), shadowPipeline,
+      &modelList, shadowMapIndex, numShadowMaps, frameIndex, cullingBuffer.get(), casters);
+  }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    shadowMap->recordCommandBuffer(vertexBuffer, indexBuffer, instanceBuffer,
+                                   frameDataStorageBuffer->getDescriptor(0)->getSet(frameIndex), shadowPipeline,
+                                   &modelList, shadowMapIndex, numShadowMaps, frameIndex, cullingBuffer.get(), casters);
+  }
+}
+
+void Renderer::recordGeometryPass(uint32_t frameIndex)
+{
+  const auto visibility = isCullingOnCPU() ? &geometryVisibility : nullptr;
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer, instanceBuffer,
+                                        frameDataStorageBuffer->getDescriptor(0)->getSet(frameIndex), &modelList,
+                                        lightingBuffer->getCommandBuffer(frameIndex), frameIndex, visibility,
+                                        cullingBuffer.get());
+  }
+  else
+  {
+    geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer, instanceBuffer,
+                                        uniformBuffer->getDescriptor(0)->getSet(frameIndex), &modelList,
+                                        lightingBuffer->getCommandBuffer(frameIndex), frameIndex, visibility,
+                                        cullingBuffer.get());
+  }
+}
+
+void Renderer::recordLightingPass(uint32_t frameIndex)
+{
+  const auto visibility = boundingVolumeHierarchy ? &lightVisibility : nullptr;
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+  {
+    lightingBuffer->recordCommandBuffers(
+      lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer, uniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      dynamicUniformBuffer->getDescriptor(1)->getSet(frameIndex),
+      dynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      dynamicUniformBuffer->getDescriptor(2)->getSet(frameIndex),
+      dynamicUniformBuffer->getDescriptor(3)->getSet(frameIndex), lightList, numShadowMaps, unitQuadModel,
+      unitSphereModel, frameIndex, visibility);
+  }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+  {
+    lightingBuffer->recordCommandBuffers(
+      lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer, uniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      shadowMapSplitDepthsDynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      lightWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex),
+      lightDataDynamicUniformBuffer->getDescriptor(0)->getSet(frameIndex), lightList, numShadowMaps, unitQuadModel,
+      unitSphereModel, frameIndex, visibility);
+  }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    lightingBuffer->recordCommandBuffers(lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer,
+                                         frameDataStorageBuffer->getDescriptor(0)->getSet(frameIndex), nullptr,
+                                         nullptr, nullptr, nullptr, lightList, numShadowMaps, unitQuadModel,
+                                         unitSphereModel, frameIndex, visibility);
+  }
+}
+
+bool Renderer::isCullingOnCPU() const
+{
+  return Settings::frustumCulling && !cullingBuffer;
+}
+
+bool Renderer::isCullingCascadesOnCPU() const
+{
+  return isCullingOnCPU() || (cullingBuffer && Settings::shadowCaching);
+}
+
+bool Renderer::canCullOnGPU() const
+{
+  // without indirect draws starting at any instance the visible instances can not be drawn from where they were written
+  return Settings::frustumCulling && Settings::gpuCulling && context->getEnabledFeatures().drawIndirectFirstInstance;
+}
+
+void Renderer::recordCommandBuffers(uint32_t frameIndex)
+{
+  uint32_t shadowMapIndex = 0;
+  for (auto& light : lightList)
+  {
+    if (light->shadowMap)
+    {
+      recordShadowPass(light->shadowMap, shadowMapIndex, frameIndex);
+      ++shadowMapIndex;
+    }
+  }
+
+  // the geometry pass executes the lighting pass command buffer, so that has to be recorded first
+  recordLightingPass(frameIndex);
+  recordGeometryPass(frameIndex);
+}
+
+void Renderer::finalizeCullingPass()
+{
+  cullingPipeline.reset();
+  cullingBuffer.reset();
+  depthPyramid.reset();
+  depthPyramidPipeline.reset();
+  hasDepthPyramid = false;
+  occlusionRasterizer.reset();
+  boundingVolumeHierarchy.reset();
+  cpuCullingStatistics = {};
+  lightVisibility.assign(lightList.size(), 1);
+
+  // culling occlusion on the CPU needs nothing from the GPU, the occluders are picked from the host copies of the
+  // vertices and indices
+  if (!canCullOnGPU())
+  {
+    if (Settings::frustumCulling && Settings::softwareOcclusionCulling)
+    {
+      occlusionRasterizer = std::make_unique<OcclusionRasterizer>(&modelList, vertexBuffer, indexBuffer,
+                                                                  Settings::occluderTriangleBudget);
+    }
+
+    // built from the bounds of the first frame
+    if (Settings::frustumCulling && Settings::boundingVolumeHierarchy)
+    {
+      boundingVolumeHierarchy = std::make_unique<BoundingVolumeHierarchy>();
+    }
+    return;
+  }
+
+  // the geometry buffer has to exist already, the pyramid is reduced from its depth
+  if (Settings::occlusionCulling)
+  {
+    depthPyramidPipeline = std::make_shared<DepthPyramidPipeline>(context, descriptorPool);
+    depthPyramid =
+      std::make_shared<DepthPyramid>(window, context, descriptorPool, geometryBuffer->getDepthImageView());
+  }
+
+  cullingPipeline = std::make_shared<CullingPipeline>(context, descriptorPool, Settings::occlusionCulling);
+  // the camera is the first view, the cascades only follow when the shadow maps draw from the culling buffer
+  const auto numCascadeViews = Settings::shadowCaching ? 0 : numShadowMaps * Settings::shadowMapCascadeCount;
+  cullingBuffer = std::make_shared<CullingBuffer>(context, descriptorPool, instanceBuffer, &modelList,
+                                                  1 + numCascadeViews, depthPyramid);
+
+  // the culling commands never change, regardless of whether the other command buffers are reused
+  for (uint32_t frameIndex = 0; frameIndex < Sync::MAX_FRAMES_IN_FLIGHT; ++frameIndex)
+  {
+    cullingBuffer->recordCommandBuffer(cullingPipeline, instanceBuffer, frameIndex);
+    if (depthPyramid)
+    {
+      cullingBuffer->recordOcclusionCommandBuffer(cullingPipeline, depthPyramidPipeline, instanceBuffer, frameIndex);
+    }
+  }
+}
+
 void Renderer::finalizeShadowPass()
 {
   std::vector<vk::DescriptorSetLayout> setLayouts;
 
   if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
   {
-    setLayouts.push_back(*dynamicUniformBuffer->getDescriptor(2)->getLayout()); // geometry world matrix
     setLayouts.push_back(
       *dynamicUniformBuffer->getDescriptor(1)->getLayout()); // shadow map cascade view projection matrices
   }
   else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
   {
-    setLayouts.push_back(*geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getLayout());
     setLayouts.push_back(*shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getLayout());
   }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    setLayouts.push_back(*frameDataStorageBuffer->getDescriptor(0)->getLayout());
+  }
+
+  // all cascades of a shadow map are drawn in one pass when the vertex shader can pick the viewport of each one, but
+  // not from the draws of the culling buffer, which are written per cascade
+  const auto allCascades =
+    Settings::shadowSinglePass && context->supportsViewportIndexFromVertexShader() &&
+    static_cast<uint32_t>(Settings::shadowMapCascadeCount) <=
+      context->getPhysicalDevice()->getProperties().limits.maxViewports &&
+    (Settings::shadowCaching || !cullingBuffer);
+  shadowPipeline = std::make_shared<ShadowPipeline>(context, setLayouts, allCascades);
+
+  shadowAtlas.reset();
+  if (numShadowMaps > 0)
+  {
+    shadowAtlas = std::make_shared<ShadowAtlas>(context, shadowPipeline->getRenderPass(), numShadowMaps);
+  }
 
-  shadowPipeline = std::make_shared<ShadowPipeline>(context, setLayouts);
+  // the geometry buffer has to exist already and keep its depth, the range is reduced from it
+  depthReduction.reset();
+  depthReductionPipeline.reset();
+  if (Settings::shadowSampleDistribution && numShadowMaps > 0)
+  {
+    depthReductionPipeline = std::make_shared<DepthReductionPipeline>(context, descriptorPool);
+    depthReduction =
+      std::make_shared<DepthReduction>(window, context, descriptorPool, geometryBuffer->getDepthImageView());
+
+    // the reduction commands never change, regardless of whether the other command buffers are reused
+    for (uint32_t frameIndex = 0; frameIndex < Sync::MAX_FRAMES_IN_FLIGHT; ++frameIndex)
+    {
+      depthReduction->recordCommandBuffer(depthReductionPipeline, frameIndex);
+    }
+  }
 
   uint32_t shadowMapIndex = 0;
   for (uint32_t i = 0; i < lightList.size(); ++i)
@@ -93,25 +334,13 @@ void Renderer::finalizeShadowPass()
       continue;
     }
 
-    light->shadowMap = std::make_shared<ShadowMap>(context, descriptorPool, shadowPipeline);
+    light->shadowMap = std::make_shared<ShadowMap>(context, descriptorPool, shadowAtlas, shadowMapIndex);
 
     if (Settings::reuseCommandBuffers)
     {
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        light->shadowMap->recordCommandBuffer(vertexBuffer, indexBuffer,
-                                              dynamicUniformBuffer->getDescriptor(1)->getSet(),
-                                              dynamicUniformBuffer->getDescriptor(2)->getSet(), shadowPipeline,
-                                              &modelList, shadowMapIndex, numShadowMaps);
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-      {
-        light->shadowMap->recordCommandBuffer(
-          vertexBuffer, indexBuffer,
-          shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(),
-          geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(), shadowPipeline, &modelList,
-          shadowMapIndex, numShadowMaps);
-      }
+      // each frame in flight gets its own command buffer bound to its own region of the uniform buffers
+      for (uint32_t frameIndex = 0; frameIndex < Sync::MAX_FRAMES_IN_FLIGHT; ++frameIndex)
+        recordShadowPass(light->shadowMap, shadowMapIndex, frameIndex);
     }
 
     ++shadowMapIndex;
@@ -120,57 +349,43 @@ void Renderer::finalizeShadowPass()
 
 void Renderer::finalizeGeometryPass()
 {
-  geometryBuffer = std::make_shared<GeometryBuffer>(window, context, descriptorPool);
+  // the lighting buffer is rendered to in the second subpass of the geometry buffer render pass
+  lightingBuffer = std::make_shared<LightingBuffer>(window, context, descriptorPool);
+  geometryBuffer = std::make_shared<GeometryBuffer>(window, context, descriptorPool, lightingBuffer->getImageViews(),
+                                                    canCullOnGPU() && Settings::occlusionCulling,
+                                                    Settings::shadowSampleDistribution && numShadowMaps > 0);
 
+  // world matrices come from the instance buffer
   std::vector<vk::DescriptorSetLayout> setLayouts;
-  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
   {
-    setLayouts.push_back(*dynamicUniformBuffer->getDescriptor(2)->getLayout()); // geometry world matrix
+    setLayouts.push_back(*frameDataStorageBuffer->getDescriptor(0)->getLayout());
   }
-  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+  else
   {
-    setLayouts.push_back(*geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getLayout());
+    setLayouts.push_back(*uniformBuffer->getDescriptor(0)->getLayout());
   }
-  setLayouts.push_back(*uniformBuffer->getDescriptor(0)->getLayout());
   setLayouts.push_back(*descriptorPool->getMaterialLayout());
 
-  geometryPipeline = std::make_shared<GeometryPipeline>(window, context, setLayouts, geometryBuffer->getRenderPass());
-
-  if (Settings::reuseCommandBuffers)
-  {
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-    {
-      geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer,
-                                          uniformBuffer->getDescriptor(0)->getSet(),
-                                          dynamicUniformBuffer->getDescriptor(2)->getSet(), &modelList, numShadowMaps);
-    }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-    {
-      geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer,
-                                          uniformBuffer->getDescriptor(0)->getSet(),
-                                          geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(),
-                                          &modelList, numShadowMaps);
-    }
-  }
+  geometryPipeline =
+    std::make_shared<GeometryPipeline>(window, context, setLayouts, geometryBuffer->getRenderPass(), canCullOnGPU());
 }
 
 void Renderer::finalizeLightingPass()
 {
-  lightingBuffer = std::make_shared<LightingBuffer>(window, context, descriptorPool);
-
   std::vector<vk::DescriptorSetLayout> setLayoutsNoShadowMaps, setLayoutsWithShadowMaps;
   if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
   {
-    setLayoutsNoShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(3)->getLayout()); // light world matrix
+    setLayoutsNoShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(2)->getLayout()); // light world matrix
     setLayoutsNoShadowMaps.push_back(*uniformBuffer->getDescriptor(0)->getLayout());
     setLayoutsNoShadowMaps.push_back(*descriptorPool->getGeometryBufferLayout());
-    setLayoutsNoShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(4)->getLayout()); // light data
+    setLayoutsNoShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(3)->getLayout()); // light data
 
-    setLayoutsWithShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(3)->getLayout()); // light world matrix
+    setLayoutsWithShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(2)->getLayout()); // light world matrix
     setLayoutsWithShadowMaps.push_back(*uniformBuffer->getDescriptor(0)->getLayout());
     setLayoutsWithShadowMaps.push_back(*descriptorPool->getGeometryBufferLayout());
     setLayoutsWithShadowMaps.push_back(*descriptorPool->getShadowMapLayout());
-    setLayoutsWithShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(4)->getLayout()); // light data
+    setLayoutsWithShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(3)->getLayout()); // light data
     setLayoutsWithShadowMaps.push_back(
       *dynamicUniformBuffer->getDescriptor(1)->getLayout()); // shadow map cascade view projection matrices
     setLayoutsWithShadowMaps.push_back(*dynamicUniformBuffer->getDescriptor(0)->getLayout()); // shadow map split depths
@@ -191,31 +406,26 @@ void Renderer::finalizeLightingPass()
       *shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getLayout());
     setLayoutsWithShadowMaps.push_back(*shadowMapSplitDepthsDynamicUniformBuffer->getDescriptor(0)->getLayout());
   }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    setLayoutsNoShadowMaps.push_back(*frameDataStorageBuffer->getDescriptor(0)->getLayout());
+    setLayoutsNoShadowMaps.push_back(*descriptorPool->getGeometryBufferLayout());
+
+    setLayoutsWithShadowMaps.push_back(*frameDataStorageBuffer->getDescriptor(0)->getLayout());
+    setLayoutsWithShadowMaps.push_back(*descriptorPool->getGeometryBufferLayout());
+    setLayoutsWithShadowMaps.push_back(*descriptorPool->getShadowMapLayout());
+  }
 
   lightingPipelines = std::make_shared<LightingPipelines>(window, context, setLayoutsNoShadowMaps,
-                                                          setLayoutsWithShadowMaps, lightingBuffer->getRenderPass());
+                                                          setLayoutsWithShadowMaps, geometryBuffer->getRenderPass());
 
   if (Settings::reuseCommandBuffers)
   {
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-    {
-      lightingBuffer->recordCommandBuffers(lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer,
-                                           uniformBuffer->getDescriptor(0)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(1)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(0)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(3)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(4)->getSet(), lightList, numShadowMaps,
-                                           static_cast<uint32_t>(modelList.size()), unitQuadModel, unitSphereModel);
-    }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+    // the geometry pass executes the lighting pass command buffer, so that has to be recorded first
+    for (uint32_t frameIndex = 0; frameIndex < Sync::MAX_FRAMES_IN_FLIGHT; ++frameIndex)
     {
-      lightingBuffer->recordCommandBuffers(
-        lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer, uniformBuffer->getDescriptor(0)->getSet(),
-        shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        shadowMapSplitDepthsDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        lightWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        lightDataDynamicUniformBuffer->getDescriptor(0)->getSet(), lightList, numShadowMaps,
-        static_cast<uint32_t>(modelList.size()), unitQuadModel, unitSphereModel);
+      recordLightingPass(frameIndex);
+      recordGeometryPass(frameIndex);
     }
   }
 }
@@ -224,7 +434,7 @@ void Renderer::finalizeCompositePass()
 {
   swapchain = std::make_unique<Swapchain>(window, context);
 
-  if (!swapchain->getSwapchain())
+  if (!swapchain->getRenderPass())
   // this means we minimized the window and there is nothing to render
   {
     return;
@@ -249,13 +459,15 @@ void Renderer::finalize()
     window->setMode(static_cast<WindowMode>(Settings::windowMode));
   }
 
-  /* TODO: syncing
   if (sync)
   // no need to wait when we run finalize the first time
   {
-    sync->waitForAllFences();
+    // frames still in flight reference resources that are about to be recreated
+    waitQueueIdle();
   }
-  */
+
+  waitForModels();
+  Texture::flushUploads();
 
   numShadowMaps = 0;
   for (auto& light : lightList)
@@ -274,82 +486,113 @@ void Renderer::finalize()
 
   descriptorPool = std::make_shared<DescriptorPool>(context, Material::getNumMaterials(), numShadowMaps);
 
-  uniformBuffer = std::make_shared<UniformBuffer>(context, sizeof(UniformBufferData), false);
-  uniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eVertex, sizeof(UniformBufferData));
-  if (Settings::keepUniformBufferMemoryMapped)
-    uniformBuffer->getBuffer()->mapMemory();
+  if (Settings::dynamicUniformBufferStrategy != SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    uniformBuffer =
+      std::make_shared<UniformBuffer>(context, sizeof(UniformBufferData), false, Sync::MAX_FRAMES_IN_FLIGHT);
+    uniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eVertex, sizeof(UniformBufferData));
+  }
 
   if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
   {
     vk::DeviceSize size =
-      (numShadowMaps + static_cast<uint32_t>(modelList.size()) + 2 * static_cast<uint32_t>(lightList.size())) *
-        context->getUniformBufferDataAlignment() +
+      (numShadowMaps + 2 * static_cast<uint32_t>(lightList.size())) * context->getUniformBufferDataAlignment() +
       numShadowMaps * context->getUniformBufferDataAlignmentLarge();
-    dynamicUniformBuffer = std::make_shared<UniformBuffer>(context, size, true);
+    dynamicUniformBuffer = std::make_shared<UniformBuffer>(context, size, true, Sync::MAX_FRAMES_IN_FLIGHT);
     dynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                         sizeof(glm::mat4)); // shadow map split depths
     dynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                         sizeof(glm::mat4) * Settings::shadowMapCascadeCount); // shadow map cascade view
                                                                                               // projection matrices
-    dynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
-                                        sizeof(glm::mat4)); // geometry world matrix
     dynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                         sizeof(glm::mat4)); // light world matrix
     dynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                         sizeof(glm::mat4)); // light data
-    if (Settings::keepUniformBufferMemoryMapped)
-      dynamicUniformBuffer->getBuffer()->mapMemory();
   }
   else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
   {
     shadowMapSplitDepthsDynamicUniformBuffer =
-      std::make_shared<UniformBuffer>(context, numShadowMaps * context->getUniformBufferDataAlignment(), true);
+      std::make_shared<UniformBuffer>(context, numShadowMaps * context->getUniformBufferDataAlignment(), true,
+                                      Sync::MAX_FRAMES_IN_FLIGHT);
     shadowMapSplitDepthsDynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                                             sizeof(glm::mat4)); // TODO: is eAllGraphics necessary here
                                                                                 // and just above?
-    if (Settings::keepUniformBufferMemoryMapped)
-      shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->mapMemory();
 
     shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer =
-      std::make_shared<UniformBuffer>(context, numShadowMaps * context->getUniformBufferDataAlignmentLarge(), true);
+      std::make_shared<UniformBuffer>(context, numShadowMaps * context->getUniformBufferDataAlignmentLarge(), true,
+                                      Sync::MAX_FRAMES_IN_FLIGHT);
     shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->addDescriptor(
       descriptorPool, vk::ShaderStageFlagBits::eAllGraphics, sizeof(glm::mat4) * Settings::shadowMapCascadeCount);
-    if (Settings::keepUniformBufferMemoryMapped)
-      shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->mapMemory();
-
-    geometryWorldMatrixDynamicUniformBuffer = std::make_shared<UniformBuffer>(
-      context, static_cast<uint32_t>(modelList.size()) * context->getUniformBufferDataAlignment(), true);
-    geometryWorldMatrixDynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
-                                                           sizeof(glm::mat4));
-    if (Settings::keepUniformBufferMemoryMapped)
-      geometryWorldMatrixDynamicUniformBuffer->getBuffer()->mapMemory();
 
     lightWorldMatrixDynamicUniformBuffer = std::make_shared<UniformBuffer>(
-      context, static_cast<uint32_t>(lightList.size()) * context->getUniformBufferDataAlignment(), true);
+      context, static_cast<uint32_t>(lightList.size()) * context->getUniformBufferDataAlignment(), true,
+      Sync::MAX_FRAMES_IN_FLIGHT);
     lightWorldMatrixDynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                                         sizeof(glm::mat4));
-    if (Settings::keepUniformBufferMemoryMapped)
-      lightWorldMatrixDynamicUniformBuffer->getBuffer()->mapMemory();
 
     lightDataDynamicUniformBuffer = std::make_shared<UniformBuffer>(
-      context, static_cast<uint32_t>(lightList.size()) * context->getUniformBufferDataAlignment(), true);
+      context, static_cast<uint32_t>(lightList.size()) * context->getUniformBufferDataAlignment(), true,
+      Sync::MAX_FRAMES_IN_FLIGHT);
     lightDataDynamicUniformBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics,
                                                  sizeof(glm::mat4));
-    if (Settings::keepUniformBufferMemoryMapped)
-      lightDataDynamicUniformBuffer->getBuffer()->mapMemory();
   }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    // the matrices are tightly packed as the shaders index them instead of binding each at a dynamic offset
+    const auto numMatrices =
+      numShadowMaps * (1 + Settings::shadowMapCascadeCount) + 2 * static_cast<uint32_t>(lightList.size());
+    frameDataStorageBuffer = std::make_shared<UniformBuffer>(
+      context, sizeof(UniformBufferData) + numMatrices * sizeof(glm::mat4), false, Sync::MAX_FRAMES_IN_FLIGHT, true);
+    // the whole remainder of the buffer is visible from each frame's region, so that growing it needs no new range
+    frameDataStorageBuffer->addDescriptor(descriptorPool, vk::ShaderStageFlagBits::eAllGraphics, VK_WHOLE_SIZE);
+  }
+
+  // the instances of each model are stored next to each other, so that one draw call covers all of them
+  uint32_t numInstances = 0;
+  for (auto& model : modelList)
+  {
+    model->setFirstInstance(numInstances);
+    numInstances += static_cast<uint32_t>(model->getInstances()->size());
+  }
+  instanceBuffer = std::make_shared<InstanceBuffer>(context, numInstances, Sync::MAX_FRAMES_IN_FLIGHT);
+
+  uint32_t numMeshInstances = 0;
+  for (auto& model : modelList)
+  {
+    numMeshInstances += static_cast<uint32_t>(model->getMeshes()->size() * model->getInstances()->size());
+  }
+  geometryCullingBounds.resize(numMeshInstances);
+  // everything counts as visible until the first frame is culled
+  geometryVisibility.assign(numMeshInstances, 1);
+
+  // and as a static caster until it moves
+  previousWorldMatrices.clear();
+  for (auto& model : modelList)
+  {
+    for (auto& instance : *model->getInstances())
+    {
+      previousWorldMatrices.push_back(instance->getWorldMatrix());
+    }
+  }
+  framesSinceMoved.assign(numInstances, ShadowMap::FRAMES_UNTIL_STATIC);
+  dynamicCasters.assign(numMeshInstances, 0);
 
   for (auto& model : modelList)
   {
     model->finalizeMaterials(descriptorPool);
   }
 
-  finalizeShadowPass();
+  // the depth pyramid of the culling pass is reduced from the geometry buffer, while the lighting pass records the
+  // geometry pass and the draws it reads from the culling pass
   finalizeGeometryPass();
+  finalizeCullingPass();
+  finalizeShadowPass();
   finalizeLightingPass();
   finalizeCompositePass();
 
-  if (!swapchain->getSwapchain())
+  sync = std::make_unique<Sync>(context);
+
+  if (!swapchain->getRenderPass())
   // this means we minimized the window and there is nothing to render
   {
     return;
@@ -358,42 +601,186 @@ void Renderer::finalize()
   std::vector<vk::DescriptorSetLayout> setLayouts;
   setLayouts.push_back(*descriptorPool->getFontLayout());
   ui = std::make_shared<UI>(window, context, descriptorPool, setLayouts, swapchain->getRenderPass());
+}
 
-  sync = std::make_unique<Sync>(context);
+void Renderer::waitForFrame() const
+{
+  if (sync)
+  {
+    sync->waitForFence();
+  }
+}
+
+bool Renderer::exportBenchmarkResults(const std::string& filename) const
+{
+  return ui->exportResults(filename);
 }
 
 bool Renderer::updateUI(float delta)
 {
-  if (!swapchain->getSwapchain())
+  if (!swapchain->getRenderPass())
   // this means we minimized the window and there is nothing to update
   {
     return false;
   }
 
-  return ui->update(input, camera, lightList, shadowPipeline, compositePipeline, lightingBuffer, delta);
+  // the frame with the current index is done, so its statistics are complete
+  CullingStatistics cullingStatistics = {};
+  if (cullingBuffer)
+  {
+    cullingStatistics = *cullingBuffer->getStatistics(sync->getCurrentFrame());
+  }
+  else if (isCullingOnCPU())
+  {
+    cullingStatistics = cpuCullingStatistics;
+  }
+
+  return ui->update(input, camera, lightList, shadowPipeline, compositePipeline, lightingBuffer, cullingStatistics,
+                    delta, sync->getCurrentFrame());
 }
 
 void Renderer::updateBuffers()
 {
+  // only the current frame's region is written, the GPU may still be reading the others
+  const auto frameIndex = sync->getCurrentFrame();
+
   // uniform buffer
 
   uniformBufferData.cameraViewProjectionMatrix = (*camera->getProjectionMatrix()) * (*camera->getViewMatrix());
   uniformBufferData.cameraPositionNearClip = glm::vec4(camera->position, camera->getNearClip());
   uniformBufferData.cameraForwardFarClip = glm::vec4(camera->getForward(), camera->getFarClip());
 
-  if (!Settings::keepUniformBufferMemoryMapped)
-    uniformBuffer->getBuffer()->mapMemory();
-  memcpy(uniformBuffer->getBuffer()->getMemoryMappedLocation(), &uniformBufferData, sizeof(UniformBufferData));
-  if (!Settings::keepUniformBufferMemoryMapped)
-    uniformBuffer->getBuffer()->unmapMemory();
+  // the superglobal strategy writes it to the start of the frame data instead
+  auto resized = false;
+  if (Settings::dynamicUniformBufferStrategy != SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    uniformBuffer->beginFrame(frameIndex);
+    memcpy(uniformBuffer->allocate(sizeof(UniformBufferData)), &uniformBufferData, sizeof(UniformBufferData));
+    resized = uniformBuffer->wasResized();
+  }
+
+  // instance buffer
+
+  auto instances = instanceBuffer->getInstances(frameIndex);
+  uint32_t boundsIndex = 0;
+  auto castersChanged = false;
+  sceneBoundsMin = glm::vec3(std::numeric_limits<float>::max());
+  sceneBoundsMax = glm::vec3(-std::numeric_limits<float>::max());
+  for (auto& model : modelList)
+  {
+    const auto meshes = model->getMeshes();
+    const auto numInstances = static_cast<uint32_t>(model->getInstances()->size());
+    for (uint32_t i = 0; i < numInstances; ++i)
+    {
+      instances->worldMatrix = model->getInstances()->at(i)->getWorldMatrix();
+
+      if (Settings::shadowCaching)
+      {
+        const auto instanceIndex = model->getFirstInstance() + i;
+        auto& previousWorldMatrix = previousWorldMatrices.at(instanceIndex);
+        auto& frames = framesSinceMoved.at(instanceIndex);
+        frames =
+          instances->worldMatrix != previousWorldMatrix ? 0 : std::min(frames + 1, ShadowMap::FRAMES_UNTIL_STATIC);
+        previousWorldMatrix = instances->worldMatrix;
+
+        // the cached casters of every cascade hold this instance where it was or lack it where it is now
+        const uint8_t isDynamic = frames < ShadowMap::FRAMES_UNTIL_STATIC ? 1 : 0;
+        if (!meshes->empty() && dynamicCasters.at(boundsIndex + i) != isDynamic)
+        {
+          castersChanged = true;
+          for (uint32_t j = 0; j < meshes->size(); ++j)
+          {
+            dynamicCasters.at(boundsIndex + j * numInstances + i) = isDynamic;
+          }
+        }
+      }
+
+      if (isCullingCascadesOnCPU())
+      {
+        for (uint32_t j = 0; j < meshes->size(); ++j)
+        {
+          geometryCullingBounds.set(boundsIndex + j * numInstances + i, meshes->at(j).get(), instances->worldMatrix);
+        }
+      }
+
+      for (const auto& mesh : *meshes)
+      {
+        glm::vec3 boxMin, boxMax;
+        getWorldBox(mesh.get(), instances->worldMatrix, boxMin, boxMax);
+        sceneBoundsMin = glm::min(sceneBoundsMin, boxMin);
+        sceneBoundsMax = glm::max(sceneBoundsMax, boxMax);
+      }
+
+      ++instances;
+    }
+    boundsIndex += static_cast<uint32_t>(meshes->size()) * numInstances;
+  }
+
+  if (castersChanged)
+  {
+    for (auto& light : lightList)
+    {
+      if (light->shadowMap)
+      {
+        light->shadowMap->invalidateCache();
+      }
+    }
+  }
+
+  // the cascades are split over the whole camera frustum, unless the depth buffer of an earlier frame narrows it down
+  auto shadowDepthRange = glm::vec2(camera->getNearClip(), camera->getFarClip());
+  if (depthReduction)
+  {
+    const auto depthRange = depthReduction->getDepthRange(frameIndex);
+    if (depthRange.x <= depthRange.y)
+    {
+      const auto inverseProjectionMatrix = glm::inverse(*camera->getProjectionMatrix());
+      const auto getViewDistance = [&inverseProjectionMatrix](float depth) {
+        const auto position = inverseProjectionMatrix * glm::vec4(0.0f, 0.0f, depth, 1.0f);
+        return -position.z / position.w;
+      };
+
+      // rounded outwards to quarter octaves, so that the splits do not move with every small change in the view and
+      // what came into view since that frame is most likely still covered
+      const auto nearest = glm::exp2(glm::floor(glm::log2(getViewDistance(depthRange.x)) * 4.0f) / 4.0f);
+      const auto farthest = glm::exp2((glm::floor(glm::log2(getViewDistance(depthRange.y)) * 4.0f) + 1.0f) / 4.0f);
+      shadowDepthRange = glm::clamp(glm::vec2(nearest, farthest), shadowDepthRange.x, shadowDepthRange.y);
+    }
+  }
+
+  if (isCullingOnCPU())
+  {
+    const auto frustum = Frustum(uniformBufferData.cameraViewProjectionMatrix);
+    if (boundingVolumeHierarchy)
+    {
+      const auto start = std::chrono::high_resolution_clock::now();
+      boundingVolumeHierarchy->update(geometryCullingBounds);
+      boundingVolumeHierarchy->cull(frustum, geometryCullingBounds, geometryVisibility);
+      cpuCullingStatistics.boundingVolumeHierarchyTime =
+        std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    else
+    {
+      geometryCullingBounds.cull(frustum, geometryVisibility);
+    }
+
+    cpuCullingStatistics.numMeshInstances = static_cast<uint32_t>(geometryVisibility.size());
+    cpuCullingStatistics.frustumCulled =
+      static_cast<uint32_t>(std::count(geometryVisibility.begin(), geometryVisibility.end(), 0));
+
+    // the occluders are rasterized on the thread pool while the rest of the buffers are written
+    if (occlusionRasterizer)
+    {
+      occlusionRasterizer->rasterize(threadPool.get(), uniformBufferData.cameraViewProjectionMatrix);
+    }
+  }
 
   // dynamic uniform buffer
 
+  // the dynamic offsets recorded in the command buffers rely on the data being allocated in the same order every frame
   if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
   {
-    if (!Settings::keepUniformBufferMemoryMapped)
-      dynamicUniformBuffer->getBuffer()->mapMemory();
-    auto dst = (char*)dynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
+    dynamicUniformBuffer->beginFrame(frameIndex);
 
     // shadow map split depths
     for (size_t i = 0; i < lightList.size(); ++i)
@@ -401,9 +788,10 @@ void Renderer::updateBuffers()
       const auto light = lightList.at(i);
       if (light->shadowMap)
       {
-        light->shadowMap->update(camera, glm::normalize(light->getForward()));
-        memcpy(dst, light->shadowMap->getSplitDepths(), sizeof(glm::mat4));
-        dst += context->getUniformBufferDataAlignment();
+        light->shadowMap->update(camera, glm::normalize(light->getForward()), sceneBoundsMin, sceneBoundsMax,
+                                 shadowDepthRange);
+        memcpy(dynamicUniformBuffer->allocate(sizeof(glm::mat4)), light->shadowMap->getSplitDepths(),
+               sizeof(glm::mat4));
       }
     }
 
@@ -413,20 +801,12 @@ void Renderer::updateBuffers()
       const auto light = lightList.at(i);
       if (light->shadowMap)
       {
-        memcpy(dst, light->shadowMap->getCascadeViewProjectionMatrices(),
+        memcpy(dynamicUniformBuffer->allocate(sizeof(glm::mat4) * Settings::shadowMapCascadeCount),
+               light->shadowMap->getCascadeViewProjectionMatrices(),
                sizeof(glm::mat4) * Settings::shadowMapCascadeCount);
-        dst += context->getUniformBufferDataAlignmentLarge();
       }
     }
 
-    // geometry world matrix
-    for (size_t i = 0; i < modelList.size(); ++i)
-    {
-      auto worldMatrix = modelList.at(i)->getWorldMatrix();
-      memcpy(dst, &worldMatrix, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
-    }
-
     // light world matrix
     for (size_t i = 0; i < lightList.size(); ++i)
     {
@@ -438,8 +818,7 @@ void Renderer::updateBuffers()
         lightWorldMatrix = light->getWorldMatrix();
       }
 
-      memcpy(dst, &lightWorldMatrix, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
+      memcpy(dynamicUniformBuffer->allocate(sizeof(glm::mat4)), &lightWorldMatrix, sizeof(glm::mat4));
     }
 
     // light data
@@ -447,104 +826,63 @@ void Renderer::updateBuffers()
     {
       const auto light = lightList.at(i);
       auto data = light->getData();
-      memcpy(dst, &data, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
+      memcpy(dynamicUniformBuffer->allocate(sizeof(glm::mat4)), &data, sizeof(glm::mat4));
     }
 
-    auto memoryRange =
-      vk::MappedMemoryRange().setMemory(*dynamicUniformBuffer->getBuffer()->getMemory()).setSize(VK_WHOLE_SIZE);
+    auto memoryRange = dynamicUniformBuffer->getMappedMemoryRange();
     context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
-    if (!Settings::keepUniformBufferMemoryMapped)
-      dynamicUniformBuffer->getBuffer()->unmapMemory();
+
+    resized = resized || dynamicUniformBuffer->wasResized();
   }
   else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
   {
     // shadow map split depths
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->mapMemory();
-    auto dst = (char*)shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
+    shadowMapSplitDepthsDynamicUniformBuffer->beginFrame(frameIndex);
 
     for (size_t i = 0; i < lightList.size(); ++i)
     {
       const auto light = lightList.at(i);
       if (light->shadowMap)
       {
-        light->shadowMap->update(camera, glm::normalize(light->getForward()));
-        memcpy(dst, light->shadowMap->getSplitDepths(), sizeof(glm::mat4));
-        dst += context->getUniformBufferDataAlignment();
+        light->shadowMap->update(camera, glm::normalize(light->getForward()), sceneBoundsMin, sceneBoundsMax,
+                                 shadowDepthRange);
+        memcpy(shadowMapSplitDepthsDynamicUniformBuffer->allocate(sizeof(glm::mat4)),
+               light->shadowMap->getSplitDepths(), sizeof(glm::mat4));
       }
     }
 
     if (Settings::flushDynamicUniformBufferMemoryIndividually)
     {
-      auto memoryRange = vk::MappedMemoryRange()
-                           .setMemory(*shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->getMemory())
-                           .setSize(sizeof(glm::mat4));
+      auto memoryRange = shadowMapSplitDepthsDynamicUniformBuffer->getMappedMemoryRange();
       context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
     }
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->unmapMemory();
-
     // shadow map cascade view projection matrices
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->mapMemory();
-    dst = (char*)shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
+    shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->beginFrame(frameIndex);
 
     for (size_t i = 0; i < lightList.size(); ++i)
     {
       const auto light = lightList.at(i);
       if (light->shadowMap)
       {
-        memcpy(dst, light->shadowMap->getCascadeViewProjectionMatrices(),
+        memcpy(shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->allocate(
+                 sizeof(glm::mat4) * Settings::shadowMapCascadeCount),
+               light->shadowMap->getCascadeViewProjectionMatrices(),
                sizeof(glm::mat4) * Settings::shadowMapCascadeCount);
-        dst += context->getUniformBufferDataAlignmentLarge();
       }
     }
 
     if (Settings::flushDynamicUniformBufferMemoryIndividually)
     {
-      auto memoryRange =
-        vk::MappedMemoryRange()
-          .setMemory(*shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->getMemory())
-          .setSize(sizeof(glm::mat4) * Settings::shadowMapCascadeCount);
-      context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
-    }
-
-    if (!Settings::keepUniformBufferMemoryMapped)
-      shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->unmapMemory();
-
-    // geometry world matrix
-
-    if (!Settings::keepUniformBufferMemoryMapped)
-      geometryWorldMatrixDynamicUniformBuffer->getBuffer()->mapMemory();
-    dst = (char*)geometryWorldMatrixDynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
-
-    for (size_t i = 0; i < modelList.size(); ++i)
-    {
-      const auto worldMatrix = modelList.at(i)->getWorldMatrix();
-      memcpy(dst, &worldMatrix, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
-    }
-
-    if (Settings::flushDynamicUniformBufferMemoryIndividually)
-    {
-      auto memoryRange = vk::MappedMemoryRange()
-                           .setMemory(*geometryWorldMatrixDynamicUniformBuffer->getBuffer()->getMemory())
-                           .setSize(sizeof(glm::mat4));
+      auto memoryRange = shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getMappedMemoryRange();
       context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
     }
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      geometryWorldMatrixDynamicUniformBuffer->getBuffer()->unmapMemory();
-
     // light world matrix
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      lightWorldMatrixDynamicUniformBuffer->getBuffer()->mapMemory();
-    dst = (char*)lightWorldMatrixDynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
+    lightWorldMatrixDynamicUniformBuffer->beginFrame(frameIndex);
 
     for (size_t i = 0; i < lightList.size(); ++i)
     {
@@ -556,67 +894,209 @@ void Renderer::updateBuffers()
         lightWorldCameraViewProjectionMatrix = light->getWorldMatrix();
       }
 
-      memcpy(dst, &lightWorldCameraViewProjectionMatrix, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
+      memcpy(lightWorldMatrixDynamicUniformBuffer->allocate(sizeof(glm::mat4)), &lightWorldCameraViewProjectionMatrix,
+             sizeof(glm::mat4));
     }
 
     if (Settings::flushDynamicUniformBufferMemoryIndividually)
     {
-      auto memoryRange = vk::MappedMemoryRange()
-                           .setMemory(*lightWorldMatrixDynamicUniformBuffer->getBuffer()->getMemory())
-                           .setSize(sizeof(glm::mat4));
+      auto memoryRange = lightWorldMatrixDynamicUniformBuffer->getMappedMemoryRange();
       context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
     }
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      lightWorldMatrixDynamicUniformBuffer->getBuffer()->unmapMemory();
-
     // lighting data
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      lightDataDynamicUniformBuffer->getBuffer()->mapMemory();
-    dst = (char*)lightDataDynamicUniformBuffer->getBuffer()->getMemoryMappedLocation();
+    lightDataDynamicUniformBuffer->beginFrame(frameIndex);
 
     for (size_t i = 0; i < lightList.size(); ++i)
     {
       const auto lightData = lightList.at(i)->getData();
-      memcpy(dst, &lightData, sizeof(glm::mat4));
-      dst += context->getUniformBufferDataAlignment();
+      memcpy(lightDataDynamicUniformBuffer->allocate(sizeof(glm::mat4)), &lightData, sizeof(glm::mat4));
     }
 
     if (Settings::flushDynamicUniformBufferMemoryIndividually)
     {
-      auto memoryRange = vk::MappedMemoryRange()
-                           .setMemory(*lightDataDynamicUniformBuffer->getBuffer()->getMemory())
-                           .setSize(sizeof(glm::mat4));
+      auto memoryRange = lightDataDynamicUniformBuffer->getMappedMemoryRange();
       context->getDevice()->flushMappedMemoryRanges(1, &memoryRange);
     }
 
-    if (!Settings::keepUniformBufferMemoryMapped)
-      lightDataDynamicUniformBuffer->getBuffer()->unmapMemory();
-
     if (!Settings::flushDynamicUniformBufferMemoryIndividually)
     {
       std::vector<vk::MappedMemoryRange> mappedMemoryRanges;
-      mappedMemoryRanges.push_back(vk::MappedMemoryRange()
-                                     .setMemory(*shadowMapSplitDepthsDynamicUniformBuffer->getBuffer()->getMemory())
-                                     .setSize(sizeof(glm::mat4)));
-      mappedMemoryRanges.push_back(
-        vk::MappedMemoryRange()
-          .setMemory(*shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getBuffer()->getMemory())
-          .setSize(sizeof(glm::mat4) * Settings::shadowMapCascadeCount));
-      mappedMemoryRanges.push_back(vk::MappedMemoryRange()
-                                     .setMemory(*geometryWorldMatrixDynamicUniformBuffer->getBuffer()->getMemory())
-                                     .setSize(sizeof(glm::mat4)));
-      mappedMemoryRanges.push_back(vk::MappedMemoryRange()
-                                     .setMemory(*lightWorldMatrixDynamicUniformBuffer->getBuffer()->getMemory())
-                                     .setSize(sizeof(glm::mat4)));
-      mappedMemoryRanges.push_back(vk::MappedMemoryRange()
-                                     .setMemory(*lightDataDynamicUniformBuffer->getBuffer()->getMemory())
-                                     .setSize(sizeof(glm::mat4)));
+      mappedMemoryRanges.push_back(shadowMapSplitDepthsDynamicUniformBuffer->getMappedMemoryRange());
+      mappedMemoryRanges.push_back(shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getMappedMemoryRange());
+      mappedMemoryRanges.push_back(lightWorldMatrixDynamicUniformBuffer->getMappedMemoryRange());
+      mappedMemoryRanges.push_back(lightDataDynamicUniformBuffer->getMappedMemoryRange());
       context->getDevice()->flushMappedMemoryRanges(static_cast<uint32_t>(mappedMemoryRanges.size()),
                                                     mappedMemoryRanges.data());
     }
+
+    resized = resized || shadowMapSplitDepthsDynamicUniformBuffer->wasResized() ||
+              shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->wasResized() ||
+              lightWorldMatrixDynamicUniformBuffer->wasResized() || lightDataDynamicUniformBuffer->wasResized();
+  }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    // everything is written in one allocation, which the lighting and shadow passes index with the same layout
+    const auto numMatrices =
+      numShadowMaps * (1 + Settings::shadowMapCascadeCount) + 2 * static_cast<uint32_t>(lightList.size());
+
+    frameDataStorageBuffer->beginFrame(frameIndex);
+    auto frameData = static_cast<char*>(
+      frameDataStorageBuffer->allocate(sizeof(UniformBufferData) + numMatrices * sizeof(glm::mat4)));
+
+    memcpy(frameData, &uniformBufferData, sizeof(UniformBufferData));
+    auto matrices = reinterpret_cast<glm::mat4*>(frameData + sizeof(UniformBufferData));
+
+    // shadow map split depths
+    for (size_t i = 0; i < lightList.size(); ++i)
+    {
+      const auto light = lightList.at(i);
+      if (light->shadowMap)
+      {
+        light->shadowMap->update(camera, glm::normalize(light->getForward()), sceneBoundsMin, sceneBoundsMax,
+                                 shadowDepthRange);
+        // one float per cascade, the rest of the matrix stays unused
+        *matrices = glm::mat4(0.0f);
+        memcpy(matrices, light->shadowMap->getSplitDepths(), sizeof(float) * Settings::shadowMapCascadeCount);
+        ++matrices;
+      }
+    }
+
+    // shadow map cascade view projection matrices
+    for (size_t i = 0; i < lightList.size(); ++i)
+    {
+      const auto light = lightList.at(i);
+      if (light->shadowMap)
+      {
+        memcpy(matrices, light->shadowMap->getCascadeViewProjectionMatrices(),
+               sizeof(glm::mat4) * Settings::shadowMapCascadeCount);
+        matrices += Settings::shadowMapCascadeCount;
+      }
+    }
+
+    // light world matrix
+    for (size_t i = 0; i < lightList.size(); ++i)
+    {
+      const auto light = lightList.at(i);
+
+      *matrices = glm::mat4(1.0f);
+      if (light->type != LightType::Directional)
+      {
+        *matrices = light->getWorldMatrix();
+      }
+      ++matrices;
+    }
+
+    // light data
+    for (size_t i = 0; i < lightList.size(); ++i)
+    {
+      const auto data = lightList.at(i)->getData();
+      memcpy(matrices, &data, sizeof(glm::mat4));
+      ++matrices;
+    }
+
+    // the storage buffer is host coherent, so there is nothing to flush
+
+    resized = resized || frameDataStorageBuffer->wasResized();
+  }
+
+  // the cascade matrices are up to date now
+  if (isCullingCascadesOnCPU())
+  {
+    for (auto& light : lightList)
+    {
+      if (light->shadowMap)
+      {
+        light->shadowMap->cull(geometryCullingBounds, boundingVolumeHierarchy.get());
+      }
+    }
+  }
+
+  if (isCullingOnCPU())
+  {
+    // the shadow casters are culled with their own visibility, so only the camera loses the occluded instances
+    if (occlusionRasterizer)
+    {
+      cpuCullingStatistics.occlusionCulled = occlusionRasterizer->cull(geometryCullingBounds, geometryVisibility);
+      cpuCullingStatistics.occlusionRasterizerTime = occlusionRasterizer->getTime();
+    }
+
+    // the lighting pass only shades the pixels of instances drawn this frame, so a light whose range reaches none of
+    // them has nothing to light
+    if (boundingVolumeHierarchy)
+    {
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      cpuCullingStatistics.lightsCulled = 0;
+      for (size_t i = 0; i < lightList.size(); ++i)
+      {
+        const auto light = lightList.at(i);
+        if (light->type == LightType::Directional || light->shadowMap)
+        {
+          continue;
+        }
+
+        if (light->type == LightType::Point)
+        {
+          boundingVolumeHierarchy->querySphere(light->position, light->getRange(), lightInstances);
+        }
+        else
+        {
+          boundingVolumeHierarchy->queryCone(light->position, light->getForward(), glm::radians(light->spotAngle),
+                                             light->getRange(), lightInstances);
+        }
+
+        const auto visible = std::any_of(lightInstances.begin(), lightInstances.end(),
+                                         [this](uint32_t instance) { return geometryVisibility[instance] != 0; });
+        lightVisibility[i] = visible ? 1 : 0;
+        if (!visible)
+        {
+          ++cpuCullingStatistics.lightsCulled;
+        }
+      }
+
+      cpuCullingStatistics.boundingVolumeHierarchyTime +=
+        std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+  }
+  else if (cullingBuffer)
+  {
+    auto viewData = cullingBuffer->getViewData(frameIndex);
+    viewData->cameraViewProjectionMatrix = uniformBufferData.cameraViewProjectionMatrix;
+    viewData->previousCameraViewProjectionMatrix = previousCameraViewProjectionMatrix;
+    viewData->hasDepthPyramid = hasDepthPyramid ? 1 : 0;
+    previousCameraViewProjectionMatrix = uniformBufferData.cameraViewProjectionMatrix;
+
+    // the camera comes first, followed by the cascades of every shadow map in the order of their lights unless they
+    // are culled on the CPU
+    auto planes = cullingBuffer->getViewPlanes(frameIndex);
+    const auto cameraFrustum = Frustum(uniformBufferData.cameraViewProjectionMatrix);
+    planes = std::copy(cameraFrustum.planes.begin(), cameraFrustum.planes.end(), planes);
+
+    for (auto& light : lightList)
+    {
+      if (!light->shadowMap || isCullingCascadesOnCPU())
+      {
+        continue;
+      }
+
+      for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+      {
+        auto cascadeFrustum = Frustum(light->shadowMap->getCascadeViewProjectionMatrices()[i]);
+        cascadeFrustum.removeNearPlane();
+        planes = std::copy(cascadeFrustum.planes.begin(), cascadeFrustum.planes.end(), planes);
+      }
+    }
+  }
+
+  // a uniform buffer grew and rewrote its descriptor sets, which invalidates the command buffers recorded with them
+  if (resized && Settings::reuseCommandBuffers)
+  {
+    for (uint32_t i = 0; i < Sync::MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+      recordCommandBuffers(i);
+    }
   }
 }
 
@@ -631,13 +1111,14 @@ void Renderer::render()
 
   if (!Settings::reuseCommandBuffers)
   {
+    // the vertex and index buffers get recreated, but the frames in flight may still be reading from the old ones
+    waitQueueIdle();
+
     vertexBuffer->finalize(context);
     indexBuffer->finalize(context);
   }
 
-  // sync->waitForFences(); TODO: syncing
-
-  swapchain->recordCommandBuffers(compositePipeline, lightingBuffer, vertexBuffer, indexBuffer, unitQuadModel, ui);
+  const auto frameIndex = sync->getCurrentFrame();
 
   // shadow pass
 
@@ -645,31 +1126,26 @@ void Renderer::render()
     vk::SubmitInfo().setSignalSemaphoreCount(1).setPSignalSemaphores(sync->getShadowPassDoneSemaphore());
   std::vector<vk::CommandBuffer> commandBuffers;
 
+  // culling on the GPU goes first, all later passes read the draws it writes
+  if (cullingBuffer)
+  {
+    commandBuffers.push_back(*cullingBuffer->getCommandBuffer(frameIndex));
+  }
+
   uint32_t shadowMapIndex = 0;
   for (auto& light : lightList)
   {
     if (light->shadowMap)
     {
-      if (!Settings::reuseCommandBuffers)
+      // the casters drawn into each cascade change along with its matrix, and so does what is cached, drawing all
+      // cascades in one pass writes the instances of its draws while recording
+      if (!Settings::reuseCommandBuffers || isCullingOnCPU() || Settings::shadowCaching ||
+          shadowPipeline->getCascadesPipeline())
       {
-        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-        {
-          light->shadowMap->recordCommandBuffer(vertexBuffer, indexBuffer,
-                                                dynamicUniformBuffer->getDescriptor(1)->getSet(),
-                                                dynamicUniformBuffer->getDescriptor(2)->getSet(), shadowPipeline,
-                                                &modelList, shadowMapIndex, numShadowMaps);
-        }
-        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-        {
-          light->shadowMap->recordCommandBuffer(
-            vertexBuffer, indexBuffer,
-            shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(),
-            geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(), shadowPipeline, &modelList,
-            shadowMapIndex, numShadowMaps);
-        }
+        recordShadowPass(light->shadowMap, shadowMapIndex, frameIndex);
       }
 
-      commandBuffers.push_back(*light->shadowMap->getCommandBuffer());
+      commandBuffers.push_back(*light->shadowMap->getCommandBuffer(frameIndex));
       ++shadowMapIndex;
     }
   }
@@ -678,98 +1154,67 @@ void Renderer::render()
     .setPCommandBuffers(commandBuffers.data());
   context->getQueue().submit({ submitInfo }, nullptr);
 
-  // geometry pass
+  // geometry and lighting pass
 
   if (!Settings::reuseCommandBuffers)
   {
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-    {
-      geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer,
-                                          uniformBuffer->getDescriptor(0)->getSet(),
-                                          dynamicUniformBuffer->getDescriptor(2)->getSet(), &modelList, numShadowMaps);
-    }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+    recordLightingPass(frameIndex);
+    recordGeometryPass(frameIndex);
+  }
+  else if (isCullingOnCPU())
+  {
+    // the draw calls depend on what is visible this frame, and so do the lights once the hierarchy culls them
+    if (boundingVolumeHierarchy)
     {
-      geometryBuffer->recordCommandBuffer(geometryPipeline, vertexBuffer, indexBuffer,
-                                          uniformBuffer->getDescriptor(0)->getSet(),
-                                          geometryWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(),
-                                          &modelList, numShadowMaps);
+      recordLightingPass(frameIndex);
     }
+    recordGeometryPass(frameIndex);
   }
 
-  submitInfo = vk::SubmitInfo()
-                 .setSignalSemaphoreCount(1)
-                 .setPSignalSemaphores(sync->getGeometryPassDoneSemaphore())
-                 .setCommandBufferCount(1)
-                 .setPCommandBuffers(geometryBuffer->getCommandBuffer());
-
+  // both passes share one render pass, only the lighting subpass reads the shadow maps
+  vk::PipelineStageFlags shadowPassWaitStageFlags[] = { vk::PipelineStageFlagBits::eFragmentShader };
   if (Settings::renderMode == SETTINGS_RENDER_MODE_SERIAL)
   {
-    vk::PipelineStageFlags stageFlags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-    submitInfo.setWaitSemaphoreCount(1)
-      .setPWaitSemaphores(sync->getShadowPassDoneSemaphore())
-      .setPWaitDstStageMask(stageFlags);
+    shadowPassWaitStageFlags[0] = vk::PipelineStageFlagBits::eTopOfPipe;
   }
 
+  submitInfo = vk::SubmitInfo()
+                 .setWaitSemaphoreCount(1)
+                 .setPWaitSemaphores(sync->getShadowPassDoneSemaphore())
+                 .setPWaitDstStageMask(shadowPassWaitStageFlags);
+  // the depth is reduced right after it was written, before the composite pass waits on this submit
+  commandBuffers = { *geometryBuffer->getCommandBuffer(frameIndex) };
+  if (depthReduction)
+  {
+    commandBuffers.push_back(*depthReduction->getCommandBuffer(frameIndex));
+  }
+  submitInfo.setSignalSemaphoreCount(1)
+    .setPSignalSemaphores(sync->getLightingPassDoneSemaphore())
+    .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()))
+    .setPCommandBuffers(commandBuffers.data());
   context->getQueue().submit({ submitInfo }, nullptr);
 
-  // lighting pass
+  // the next frame culls against the pyramid this one built
+  hasDepthPyramid = depthPyramid != nullptr;
 
-  if (!Settings::reuseCommandBuffers)
-  {
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-    {
-      lightingBuffer->recordCommandBuffers(lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer,
-                                           uniformBuffer->getDescriptor(0)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(1)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(0)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(3)->getSet(),
-                                           dynamicUniformBuffer->getDescriptor(4)->getSet(), lightList, numShadowMaps,
-                                           static_cast<uint32_t>(modelList.size()), unitQuadModel, unitSphereModel);
-    }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-    {
-      lightingBuffer->recordCommandBuffers(
-        lightingPipelines, geometryBuffer, vertexBuffer, indexBuffer, uniformBuffer->getDescriptor(0)->getSet(),
-        shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        shadowMapSplitDepthsDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        lightWorldMatrixDynamicUniformBuffer->getDescriptor(0)->getSet(),
-        lightDataDynamicUniformBuffer->getDescriptor(0)->getSet(), lightList, numShadowMaps,
-        static_cast<uint32_t>(modelList.size()), unitQuadModel, unitSphereModel);
-    }
-  }
+  // composite pass
 
-  if (Settings::renderMode == SETTINGS_RENDER_MODE_PARALLEL)
-  {
-    vk::PipelineStageFlags stageFlags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                            vk::PipelineStageFlagBits::eColorAttachmentOutput };
-    std::vector<vk::Semaphore> waitSemaphores = { *sync->getShadowPassDoneSemaphore(),
-                                                  *sync->getGeometryPassDoneSemaphore() };
-    submitInfo = vk::SubmitInfo()
-                   .setWaitSemaphoreCount(static_cast<uint32_t>(waitSemaphores.size()))
-                   .setPWaitSemaphores(waitSemaphores.data())
-                   .setPWaitDstStageMask(stageFlags);
-    submitInfo.setSignalSemaphoreCount(1)
-      .setPSignalSemaphores(sync->getLightingPassDoneSemaphore())
-      .setCommandBufferCount(1)
-      .setPCommandBuffers(lightingBuffer->getCommandBuffer());
-    context->getQueue().submit({ submitInfo }, nullptr);
-  }
-  else if (Settings::renderMode == SETTINGS_RENDER_MODE_SERIAL)
+  if (Settings::headless)
+  // there is no surface to acquire images from or present to, so render straight into the offscreen image
   {
     vk::PipelineStageFlags stageFlags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-    submitInfo = vk::SubmitInfo()
-                   .setWaitSemaphoreCount(1)
-                   .setPWaitSemaphores(sync->getGeometryPassDoneSemaphore())
-                   .setPWaitDstStageMask(stageFlags);
-    submitInfo.setSignalSemaphoreCount(1)
-      .setPSignalSemaphores(sync->getLightingPassDoneSemaphore())
-      .setCommandBufferCount(1)
-      .setPCommandBuffers(lightingBuffer->getCommandBuffer());
-    context->getQueue().submit({ submitInfo }, nullptr);
-  }
+    submitInfo.setWaitSemaphoreCount(1)
+      .setPWaitSemaphores(sync->getLightingPassDoneSemaphore())
+      .setPWaitDstStageMask(stageFlags);
+    swapchain->recordCommandBuffer(frameIndex, 0, compositePipeline, lightingBuffer, vertexBuffer, indexBuffer,
+                                   unitQuadModel, ui);
+    submitInfo.setPCommandBuffers(swapchain->getCommandBuffer(frameIndex)).setSignalSemaphoreCount(0);
+    sync->resetFence();
+    context->getQueue().submit({ submitInfo }, *sync->getFence());
 
-  // composite pass
+    sync->advanceFrameIndex();
+    return;
+  }
 
   auto nextImage =
     context->getDevice()->acquireNextImageKHR(*swapchain->getSwapchain(), std::numeric_limits<uint64_t>::max(),
@@ -786,6 +1231,9 @@ void Renderer::render()
   }
 
   auto imageIndex = nextImage.value;
+  swapchain->recordCommandBuffer(frameIndex, imageIndex, compositePipeline, lightingBuffer, vertexBuffer, indexBuffer,
+                                 unitQuadModel, ui);
+
   vk::PipelineStageFlags stageFlags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput,
                                           vk::PipelineStageFlagBits::eColorAttachmentOutput };
   std::vector<vk::Semaphore> waitSemaphores = { *sync->getLightingPassDoneSemaphore(),
@@ -793,10 +1241,11 @@ void Renderer::render()
   submitInfo.setWaitSemaphoreCount(static_cast<uint32_t>(waitSemaphores.size()))
     .setPWaitSemaphores(waitSemaphores.data())
     .setPWaitDstStageMask(stageFlags);
-  submitInfo.setPCommandBuffers(swapchain->getCommandBuffer(imageIndex))
+  submitInfo.setPCommandBuffers(swapchain->getCommandBuffer(frameIndex))
     .setSignalSemaphoreCount(1)
     .setPSignalSemaphores(sync->getCompositePassDoneSemaphore());
-  context->getQueue().submit({ submitInfo }, /**sync->getFence() TODO: syncing*/ nullptr);
+  sync->resetFence();
+  context->getQueue().submit({ submitInfo }, *sync->getFence());
 
   // present
 
@@ -816,5 +1265,4 @@ void Renderer::render()
   }
 
   sync->advanceFrameIndex();
-  waitQueueIdle();
 }
@@ -1,13 +1,20 @@
 #pragma once
 
+#include "BoundingVolumeHierarchy.hpp"
+#include "Culling.hpp"
 #include "Model.hpp"
+#include "OcclusionRasterizer.hpp"
 #include "Sync.hpp"
 #include "core/Camera.hpp"
 #include "core/Light.hpp"
+#include "core/ThreadPool.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
 #include "renderer/buffers/UniformBuffer.hpp"
 #include "renderer/composite_pass/Swapchain.hpp"
+#include "renderer/culling_pass/CullingBuffer.hpp"
 #include "renderer/geometry_pass/GeometryBuffer.hpp"
 #include "renderer/lighting_pass/LightingBuffer.hpp"
+#include "renderer/shadow_pass/DepthReduction.hpp"
 #include "renderer/shadow_pass/ShadowPipeline.hpp"
 
 struct UniformBufferData
@@ -33,14 +40,60 @@ private:
   std::shared_ptr<UniformBuffer> uniformBuffer;
   std::shared_ptr<UniformBuffer> dynamicUniformBuffer;
   std::shared_ptr<UniformBuffer> shadowMapSplitDepthsDynamicUniformBuffer,
-    shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer, geometryWorldMatrixDynamicUniformBuffer,
-    lightWorldMatrixDynamicUniformBuffer, lightDataDynamicUniformBuffer;
+    shadowMapCascadeViewProjectionMatricesDynamicUniformBuffer, lightWorldMatrixDynamicUniformBuffer,
+    lightDataDynamicUniformBuffer;
+  // holds the uniform buffer data followed by all dynamic uniform buffer data for the superglobal strategy
+  std::shared_ptr<UniformBuffer> frameDataStorageBuffer;
+  std::shared_ptr<InstanceBuffer> instanceBuffer;
+
+  // one entry per instance of every mesh, in the order the geometry and shadow passes draw them
+  CullingBounds geometryCullingBounds;
+  std::vector<uint8_t> geometryVisibility;
+  // only exists while culling on the CPU, hides the instances behind the largest meshes from the visibility above
+  std::unique_ptr<OcclusionRasterizer> occlusionRasterizer;
+  // only exists while culling on the CPU as well, fitted to the bounds above every frame
+  std::unique_ptr<BoundingVolumeHierarchy> boundingVolumeHierarchy;
+  CullingStatistics cpuCullingStatistics = {};
+  // one per light, the lighting pass skips the lights without shadow maps that reach no visible instance
+  std::vector<uint8_t> lightVisibility;
+  std::vector<uint32_t> lightInstances;
+
+  // one per instance, to find the ones that moved since the last frame while caching static shadow casters
+  std::vector<glm::mat4> previousWorldMatrices;
+  std::vector<uint32_t> framesSinceMoved;
+  // one per mesh instance like the visibility above, set for the instances that moved recently
+  std::vector<uint8_t> dynamicCasters;
+
+  // the box around every mesh instance in the current frame, the shadow maps fit their depth ranges to it
+  glm::vec3 sceneBoundsMin, sceneBoundsMax;
+
+  // only exists while culling on the GPU, the passes then draw what it wrote instead of the visibility above
+  std::shared_ptr<CullingPipeline> cullingPipeline;
+  std::shared_ptr<CullingBuffer> cullingBuffer;
+  // only exist while culling occlusion, the pyramid is built from the depth of the first camera pass every frame
+  std::shared_ptr<DepthPyramidPipeline> depthPyramidPipeline;
+  std::shared_ptr<DepthPyramid> depthPyramid;
+  // the depth pyramid was rendered with the camera of the previous frame, until then it holds nothing
+  glm::mat4 previousCameraViewProjectionMatrix;
+  bool hasDepthPyramid = false;
 
   std::vector<std::shared_ptr<Model>> modelList;
+  // every file is only loaded once, loading it again adds another instance to the same model
+  std::unordered_map<std::string, std::shared_ptr<Model>> modelCache;
+
+  std::unique_ptr<ThreadPool> threadPool;
+  // models are spliced in the order they were requested
+  std::vector<std::pair<std::shared_ptr<Model>, std::shared_future<std::shared_ptr<ModelBlock>>>> pendingModels;
+
   std::vector<std::shared_ptr<Light>> lightList;
   std::shared_ptr<Model> unitQuadModel, unitSphereModel;
 
   std::shared_ptr<ShadowPipeline> shadowPipeline;
+  // only exists with shadow maps, they all render into and are sampled from it
+  std::shared_ptr<ShadowAtlas> shadowAtlas;
+  // only exist while fitting the cascades to the visible depth, reduced from the geometry buffer every frame
+  std::shared_ptr<DepthReductionPipeline> depthReductionPipeline;
+  std::shared_ptr<DepthReduction> depthReduction;
 
   std::shared_ptr<GeometryBuffer> geometryBuffer;
   std::shared_ptr<GeometryPipeline> geometryPipeline;
@@ -57,17 +110,32 @@ private:
 
   uint32_t numShadowMaps;
 
+  void finalizeCullingPass();
   void finalizeShadowPass();
   void finalizeGeometryPass();
   void finalizeLightingPass();
   void finalizeCompositePass();
 
+  void recordShadowPass(const std::shared_ptr<ShadowMap> shadowMap, uint32_t shadowMapIndex, uint32_t frameIndex);
+  void recordGeometryPass(uint32_t frameIndex);
+  void recordLightingPass(uint32_t frameIndex);
+  void recordCommandBuffers(uint32_t frameIndex);
+
+  bool isCullingOnCPU() const;
+  // the cached shadow maps pick their static and dynamic casters from the instance buffer, so they need the cascades
+  // culled on the CPU even when the GPU culls the camera
+  bool isCullingCascadesOnCPU() const;
+  bool canCullOnGPU() const;
+
 public:
   Renderer(const std::shared_ptr<Window> window,
            const std::shared_ptr<Input> input,
            const std::shared_ptr<Camera> camera);
 
-  std::shared_ptr<Model> loadModel(const std::string& path, const std::string& filename);
+  // both return the transform of a new instance of the model
+  std::shared_ptr<Transform> loadModel(const std::string& path, const std::string& filename);
+  // returns right away, the model receives its meshes in waitForModels()
+  std::shared_ptr<Transform> loadModelAsync(const std::string& path, const std::string& filename);
   std::shared_ptr<Light> loadDirectionalLight(const glm::vec3& position,
                                               const glm::vec3& eulerAngles,
                                               const glm::vec3& color,
@@ -82,10 +150,15 @@ public:
                                        float intensity,
                                        float cutoffCosine);
 
+  // splices all asynchronously loaded models into the shared buffers, rethrowing the first error, called by finalize()
+  void waitForModels();
   void finalize();
+  // blocks until the GPU is done with the frame that last used the current frame index
+  void waitForFrame() const;
   bool updateUI(float delta);
   void updateBuffers();
   void render();
+  bool exportBenchmarkResults(const std::string& filename) const;
   // void waitDeviceIdle() const { context->getDevice()->waitIdle(); }
   void waitQueueIdle() const
   {
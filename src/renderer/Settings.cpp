@@ -1,19 +1,35 @@
 #include "Settings.hpp"
 
+bool Settings::headless = false;
+std::string Settings::headlessResultsFilename = "benchmark.csv";
+
 int Settings::windowWidth = 1280;
 int Settings::windowHeight = 720;
 int Settings::windowMode = 0;
 int Settings::renderMode = SETTINGS_RENDER_MODE_PARALLEL;
 bool Settings::mipMapping = true;
 float Settings::mipLoadBias = -0.85f;
+bool Settings::textureCompression = true;
 bool Settings::reuseCommandBuffers = true;
 bool Settings::transientCommandPool = true;
 bool Settings::vertexIndexBufferStaging = true;
-bool Settings::keepUniformBufferMemoryMapped = true;
+bool Settings::vertexCompression = true;
+bool Settings::frustumCulling = true;
+bool Settings::gpuCulling = true;
+bool Settings::occlusionCulling = true;
+bool Settings::softwareOcclusionCulling = true;
+int Settings::occluderTriangleBudget = 20000;
+bool Settings::boundingVolumeHierarchy = true;
 int Settings::dynamicUniformBufferStrategy = SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL;
 bool Settings::flushDynamicUniformBufferMemoryIndividually = false;
-int Settings::shadowMapResolution = 4096;
+int Settings::shadowMapResolution = 2048;
 int Settings::shadowMapCascadeCount = 6;
+int Settings::shadowAtlasResolution = 8192;
+bool Settings::shadowCaching = true;
+float Settings::shadowCacheThreshold = 2.0f;
+int Settings::shadowFarCascadeInterval = 2;
+bool Settings::shadowSinglePass = false;
+bool Settings::shadowSampleDistribution = false;
 float Settings::shadowBias = 0.001f;
 int Settings::shadowFilterRange = 2;
 float Settings::bloomThreshold = 0.8f;
@@ -5,25 +5,42 @@
 
 #define SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL 0
 #define SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL 1
-// TODO: implement #define SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL	2
+#define SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL 2
+
+#include <string>
 
 class Settings
 {
 public:
+  static bool headless;
+  static std::string headlessResultsFilename;
   static int windowWidth;
   static int windowHeight;
   static int windowMode;
   static int renderMode;
   static bool mipMapping;
   static float mipLoadBias;
+  static bool textureCompression;
   static bool transientCommandPool;
   static bool reuseCommandBuffers;
   static bool vertexIndexBufferStaging;
-  static bool keepUniformBufferMemoryMapped;
+  static bool vertexCompression;
+  static bool frustumCulling;
+  static bool gpuCulling;
+  static bool occlusionCulling;
+  static bool softwareOcclusionCulling;
+  static int occluderTriangleBudget;
+  static bool boundingVolumeHierarchy;
   static int dynamicUniformBufferStrategy;
   static bool flushDynamicUniformBufferMemoryIndividually;
   static int shadowMapResolution;
   static int shadowMapCascadeCount;
+  static int shadowAtlasResolution;
+  static bool shadowCaching;
+  static float shadowCacheThreshold;
+  static int shadowFarCascadeInterval;
+  static bool shadowSinglePass;
+  static bool shadowSampleDistribution;
   static float shadowBias;
   static int shadowFilterRange;
   static float bloomThreshold;
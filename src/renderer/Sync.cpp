@@ -2,13 +2,6 @@
 
 const uint32_t Sync::MAX_FRAMES_IN_FLIGHT = 2;
 
-vk::Semaphore* Sync::createSemaphore(const std::shared_ptr<Context> context)
-{
-  auto semaphoreCreateInfo = vk::SemaphoreCreateInfo();
-  auto semaphore = context->getDevice()->createSemaphore(semaphoreCreateInfo);
-  return new vk::Semaphore(semaphore);
-}
-
 std::vector<vk::Semaphore>* Sync::createSemaphores(const std::shared_ptr<Context> context)
 {
   auto semaphores = std::vector<vk::Semaphore>(MAX_FRAMES_IN_FLIGHT);
@@ -21,9 +14,9 @@ std::vector<vk::Semaphore>* Sync::createSemaphores(const std::shared_ptr<Context
   return new std::vector<vk::Semaphore>(semaphores);
 }
 
-/*
-std::vector<vk::Fence> *Sync::createFences(const std::shared_ptr<Context> context)
+std::vector<vk::Fence>* Sync::createFences(const std::shared_ptr<Context> context)
 {
+  // start out signaled so that waiting on a frame that has never been submitted returns immediately
   auto fences = std::vector<vk::Fence>(MAX_FRAMES_IN_FLIGHT);
   auto fenceCreateInfo = vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled);
   for (size_t i = 0; i < fences.size(); ++i)
@@ -33,42 +26,41 @@ std::vector<vk::Fence> *Sync::createFences(const std::shared_ptr<Context> contex
 
   return new std::vector<vk::Fence>(fences);
 }
-*/
 
 Sync::Sync(const std::shared_ptr<Context> context)
 {
   this->context = context;
 
-  shadowPassDoneSemaphore =
-    std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)>(createSemaphore(context), semaphoreDeleter);
-  geometryPassDoneSemaphore =
-    std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)>(createSemaphore(context), semaphoreDeleter);
-  lightingPassDoneSemaphore =
-    std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)>(createSemaphore(context), semaphoreDeleter);
-
   imageAvailableSemaphores =
     std::unique_ptr<std::vector<vk::Semaphore>, decltype(semaphoresDeleter)>(createSemaphores(context),
                                                                              semaphoresDeleter);
+  shadowPassDoneSemaphores =
+    std::unique_ptr<std::vector<vk::Semaphore>, decltype(semaphoresDeleter)>(createSemaphores(context),
+                                                                             semaphoresDeleter);
+  lightingPassDoneSemaphores =
+    std::unique_ptr<std::vector<vk::Semaphore>, decltype(semaphoresDeleter)>(createSemaphores(context),
+                                                                             semaphoresDeleter);
   compositePassDoneSemaphores =
     std::unique_ptr<std::vector<vk::Semaphore>, decltype(semaphoresDeleter)>(createSemaphores(context),
                                                                              semaphoresDeleter);
 
-  // fences = std::unique_ptr<std::vector<vk::Fence>, decltype(fencesDeleter)>(createFences(context), fencesDeleter);
+  fences = std::unique_ptr<std::vector<vk::Fence>, decltype(fencesDeleter)>(createFences(context), fencesDeleter);
 
   currentFrame = 0;
 }
 
-/*
-void Sync::waitForFences() const
+void Sync::waitForFence() const
 {
-  context->getDevice()->waitForFences(1, &fences->at(currentFrame), true, std::numeric_limits<uint64_t>::max());
-  context->getDevice()->resetFences(1, &fences->at(currentFrame));
+  if (context->getDevice()->waitForFences(1, &fences->at(currentFrame), true, std::numeric_limits<uint64_t>::max()) !=
+      vk::Result::eSuccess)
+  {
+    throw std::runtime_error("Failed to wait for frame fence.");
+  }
 }
 
-void Sync::waitForAllFences() const
+void Sync::resetFence() const
 {
-  context->getDevice()->waitForFences(static_cast<uint32_t>(fences->size()), fences->data(), true,
-std::numeric_limits<uint64_t>::max()); context->getDevice()->resetFences(static_cast<uint32_t>(fences->size()),
-fences->data());
+  // only reset right before the submission that signals the fence again, otherwise a frame that gets skipped (for
+  // example because the swapchain is out of date) would leave the fence unsignaled forever
+  context->getDevice()->resetFences(1, &fences->at(currentFrame));
 }
-*/
\ No newline at end of file
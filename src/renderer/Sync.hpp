@@ -4,20 +4,13 @@
 
 class Sync
 {
-private:
+public:
   static const uint32_t MAX_FRAMES_IN_FLIGHT;
 
+private:
   std::shared_ptr<Context> context;
   uint32_t currentFrame;
 
-  static vk::Semaphore* createSemaphore(const std::shared_ptr<Context> context);
-  std::function<void(vk::Semaphore*)> semaphoreDeleter = [this](vk::Semaphore* semaphore) {
-    if (context->getDevice())
-      context->getDevice()->destroySemaphore(*semaphore);
-  };
-  std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)> shadowPassDoneSemaphore, geometryPassDoneSemaphore,
-    lightingPassDoneSemaphore;
-
   static std::vector<vk::Semaphore>* createSemaphores(const std::shared_ptr<Context> context);
   std::function<void(std::vector<vk::Semaphore>*)> semaphoresDeleter = [this](std::vector<vk::Semaphore>* semaphores) {
     if (context->getDevice())
@@ -27,44 +20,50 @@ private:
     }
   };
   std::unique_ptr<std::vector<vk::Semaphore>, decltype(semaphoresDeleter)> imageAvailableSemaphores,
-    compositePassDoneSemaphores;
+    shadowPassDoneSemaphores, lightingPassDoneSemaphores, compositePassDoneSemaphores;
 
-  /*
-  static std::vector<vk::Fence> *createFences(const std::shared_ptr<Context> context);
-  std::function<void(std::vector<vk::Fence>*)> fencesDeleter = [this](std::vector<vk::Fence> *fences) { if
-  (context->getDevice()) { for (auto &fence : *fences) context->getDevice()->destroyFence(fence); } };
+  static std::vector<vk::Fence>* createFences(const std::shared_ptr<Context> context);
+  std::function<void(std::vector<vk::Fence>*)> fencesDeleter = [this](std::vector<vk::Fence>* fences) {
+    if (context->getDevice())
+    {
+      for (auto& fence : *fences)
+        context->getDevice()->destroyFence(fence);
+    }
+  };
   std::unique_ptr<std::vector<vk::Fence>, decltype(fencesDeleter)> fences;
-  */
 
 public:
   Sync(const std::shared_ptr<Context> context);
 
-  // void waitForFences() const;
-  // void waitForAllFences() const;
+  void waitForFence() const;
+  void resetFence() const;
   void advanceFrameIndex()
   {
-    currentFrame = (++currentFrame) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
   }
 
+  uint32_t getCurrentFrame() const
+  {
+    return currentFrame;
+  }
   vk::Semaphore* getImageAvailableSemaphore() const
   {
     return &imageAvailableSemaphores.get()->at(currentFrame);
   }
   vk::Semaphore* getShadowPassDoneSemaphore() const
   {
-    return shadowPassDoneSemaphore.get();
-  }
-  vk::Semaphore* getGeometryPassDoneSemaphore() const
-  {
-    return geometryPassDoneSemaphore.get();
+    return &shadowPassDoneSemaphores.get()->at(currentFrame);
   }
   vk::Semaphore* getLightingPassDoneSemaphore() const
   {
-    return lightingPassDoneSemaphore.get();
+    return &lightingPassDoneSemaphores.get()->at(currentFrame);
   }
   vk::Semaphore* getCompositePassDoneSemaphore() const
   {
     return &compositePassDoneSemaphores.get()->at(currentFrame);
   }
-  // vk::Fence *getFence() const { return &fences.get()->at(currentFrame); }
-};
\ No newline at end of file
+  vk::Fence* getFence() const
+  {
+    return &fences.get()->at(currentFrame);
+  }
+};
@@ -1,51 +1,11 @@
 #include "Texture.hpp"
+#include "ImageDecoder.hpp"
 #include "Settings.hpp"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
-std::vector<std::shared_ptr<Texture>> Texture::textures;
-
-vk::Buffer*
-Texture::createBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size, vk::BufferUsageFlags usage)
-{
-  auto bufferCreateInfo = vk::BufferCreateInfo().setSize(size).setUsage(usage);
-  auto buffer = context->getDevice()->createBuffer(bufferCreateInfo);
-  return new vk::Buffer(buffer);
-}
-
-vk::DeviceMemory* Texture::createBufferMemory(const std::shared_ptr<Context> context,
-                                              const vk::Buffer* buffer,
-                                              vk::DeviceSize size,
-                                              vk::MemoryPropertyFlags memoryPropertyFlags)
-{
-  auto memoryRequirements = context->getDevice()->getBufferMemoryRequirements(*buffer);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for buffer.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindBufferMemory(*buffer, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
-}
+std::unordered_map<std::string, std::shared_future<std::shared_ptr<Texture>>> Texture::textures;
+std::mutex Texture::texturesMutex;
+std::unique_ptr<TextureUploader> Texture::uploader;
+bool Texture::blockCompression = false;
 
 vk::Image* Texture::createImage(const std::shared_ptr<Context> context,
                                 uint32_t width,
@@ -60,7 +20,7 @@ vk::Image* Texture::createImage(const std::shared_ptr<Context> context,
                            .setArrayLayers(1);
   imageCreateInfo.setFormat(format)
     .setInitialLayout(vk::ImageLayout::ePreinitialized)
-    .setUsage(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled);
+    .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
 
   if (Settings::mipMapping)
   {
@@ -72,36 +32,13 @@ vk::Image* Texture::createImage(const std::shared_ptr<Context> context,
   return new vk::Image(image);
 }
 
-vk::DeviceMemory* Texture::createImageMemory(const std::shared_ptr<Context> context,
-                                             const vk::Image* image,
-                                             vk::MemoryPropertyFlags memoryPropertyFlags)
+MemoryAllocator::Allocation* Texture::createImageMemory(const std::shared_ptr<Context> context,
+                                                        const vk::Image* image,
+                                                        vk::MemoryPropertyFlags memoryPropertyFlags)
 {
-  auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(*image);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for image.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindImageMemory(*image, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
+  // textures stay cached until shutdown, so they can be packed tightly
+  return context->getMemoryAllocator()->allocateForImage(*image, memoryPropertyFlags,
+                                                         MemoryAllocator::Placement::Linear);
 }
 
 vk::ImageView* Texture::createImageView(const std::shared_ptr<Context> context,
@@ -123,7 +60,8 @@ vk::Sampler* Texture::createSampler(const std::shared_ptr<Context> context, uint
                              .setMagFilter(vk::Filter::eLinear)
                              .setMinFilter(vk::Filter::eLinear)
                              .setMipmapMode(vk::SamplerMipmapMode::eLinear);
-  samplerCreateInfo.setAnisotropyEnable(true).setMaxAnisotropy(16.0f);
+  samplerCreateInfo.setAnisotropyEnable(context->getPhysicalDevice()->getFeatures().samplerAnisotropy)
+    .setMaxAnisotropy(16.0f);
 
   if (Settings::mipMapping)
   {
@@ -134,164 +72,175 @@ vk::Sampler* Texture::createSampler(const std::shared_ptr<Context> context, uint
   return new vk::Sampler(sampler);
 }
 
-Texture::Texture(const std::shared_ptr<Context> context, const std::string& filename, vk::Format format)
+uint32_t Texture::getNumChannels(vk::Format format)
 {
-  this->context = context;
-  this->filename = filename;
-
-  int pixelFormat = 0;
-  int numChannels = 0;
   if (format == vk::Format::eR8G8B8A8Unorm)
   {
-    pixelFormat = STBI_rgb_alpha;
-    numChannels = 4;
+    return 4;
   }
   else if (format == vk::Format::eR8Unorm)
   {
-    pixelFormat = STBI_grey;
-    numChannels = 1;
+    return 1;
   }
-  else
+
+  throw std::runtime_error("Failed to load texture: Invalid pixel format.");
+}
+
+BlockFormat Texture::getBlockFormat(vk::Format format, bool normalMap)
+{
+  if (!blockCompression)
   {
-    throw std::runtime_error("Failed to load texture from file \"" + filename + "\": Invalid pixel format.");
+    return BlockFormat::None;
   }
 
-  int32_t width, height;
-  stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, nullptr, pixelFormat);
-
-  if (!pixels)
+  if (getNumChannels(format) == 1)
   {
-    throw std::runtime_error("Failed to load texture from file \"" + filename + "\": Unable to load pixel data.");
+    return BlockFormat::BC4;
   }
 
-  mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+  // bc3 is only requested, images without any transparency are baked as bc1
+  return normalMap ? BlockFormat::BC5 : BlockFormat::BC3;
+}
 
-  VkDeviceSize imageSize = width * height * numChannels;
+vk::Format Texture::getFormat(BlockFormat blockFormat)
+{
+  switch (blockFormat)
+  {
+  case BlockFormat::BC1:
+    return vk::Format::eBc1RgbUnormBlock;
+  case BlockFormat::BC3:
+    return vk::Format::eBc3UnormBlock;
+  case BlockFormat::BC4:
+    return vk::Format::eBc4UnormBlock;
+  case BlockFormat::BC5:
+    return vk::Format::eBc5UnormBlock;
+  default:
+    throw std::runtime_error("Failed to load texture: Invalid block format.");
+  }
+}
 
-  std::unique_ptr<vk::Buffer, decltype(bufferDeleter)> stagingBuffer;
-  std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)> stagingBufferMemory;
+Texture::Texture(const std::shared_ptr<Context> context,
+                 const std::string& filename,
+                 vk::Format format,
+                 bool normalMap)
+{
+  this->context = context;
+  this->filename = filename;
 
-  stagingBuffer = std::unique_ptr<vk::Buffer, decltype(bufferDeleter)>(
-    createBuffer(context, imageSize, vk::BufferUsageFlagBits::eTransferSrc), bufferDeleter);
-  stagingBufferMemory = std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)>(
-    createBufferMemory(context, stagingBuffer.get(), imageSize,
-                       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent),
-    bufferMemoryDeleter);
+  if (!uploader)
+  {
+    throw std::runtime_error("Failed to load texture from file \"" + filename + "\": No texture uploader.");
+  }
 
-  auto memory = context->getDevice()->mapMemory(*stagingBufferMemory, 0, imageSize);
-  memcpy(memory, pixels, static_cast<size_t>(imageSize));
-  context->getDevice()->unmapMemory(*stagingBufferMemory);
+  // picks up the pixels if they were prefetched while the model was still being imported
+  const auto decodedImage = ImageDecoder::get(filename, getNumChannels(format), getBlockFormat(format, normalMap));
+  const auto width = decodedImage->width;
+  const auto height = decodedImage->height;
+
+  const auto compressed = decodedImage->blockFormat != BlockFormat::None;
+  if (compressed)
+  // block compressed images come with their mip chain, which can not be blitted anyway
+  {
+    format = getFormat(decodedImage->blockFormat);
+    mipLevels = static_cast<uint32_t>(decodedImage->levels.size());
+  }
+  else
+  {
+    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+  }
 
   image = std::unique_ptr<vk::Image, decltype(imageDeleter)>(createImage(context, width, height, format, mipLevels),
                                                              imageDeleter);
-  imageMemory = std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)>(
-    createImageMemory(context, image.get(), vk::MemoryPropertyFlagBits::eDeviceLocal), bufferMemoryDeleter);
-
-  auto commandBufferAllocateInfo =
-    vk::CommandBufferAllocateInfo().setCommandPool(*context->getCommandPoolOnce()).setCommandBufferCount(1);
-  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
-  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  commandBuffer.begin(commandBufferBeginInfo);
+  imageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)>(
+    createImageMemory(context, image.get(), vk::MemoryPropertyFlagBits::eDeviceLocal), imageMemoryDeleter);
 
-  if (Settings::mipMapping)
+  if (compressed)
   {
-    auto barrier = vk::ImageMemoryBarrier()
-                     .setOldLayout(vk::ImageLayout::eUndefined)
-                     .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
-                     .setImage(*image);
-    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1))
-      .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-                                  vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
-
-    auto region = vk::BufferImageCopy()
-                    .setImageExtent(vk::Extent3D(width, height, 1))
-                    .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1));
-    commandBuffer.copyBufferToImage(*stagingBuffer, *image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-
-    barrier = vk::ImageMemoryBarrier().setImage(*image);
-    for (uint32_t i = 1; i < mipLevels; ++i)
-    {
-      barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i - 1, 1, 0, 1));
-      barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal).setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
-      barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eTransferRead);
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
-                                    vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+    uploader->uploadLevels(image.get(), decodedImage.get(), Settings::mipMapping ? mipLevels : 1);
+  }
+  else
+  {
+    uploader->upload(image.get(), width, height, mipLevels, decodedImage->pixels.data(), decodedImage->pixels.size());
+  }
 
-      auto blit = vk::ImageBlit()
-                    .setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(width, height, 1) })
-                    .setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0, 1));
-      blit.setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(width / 2, height / 2, 1) })
-        .setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1));
-      commandBuffer.blitImage(*image, vk::ImageLayout::eTransferSrcOptimal, *image,
-                              vk::ImageLayout::eTransferDstOptimal, 1, &blit, vk::Filter::eLinear);
+  imageView =
+    std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)>(createImageView(context, image.get(), format, mipLevels),
+                                                               imageViewDeleter);
+  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context, mipLevels), samplerDeleter);
+}
 
-      barrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal).setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-      barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferRead).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
-                                    vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+std::shared_ptr<Texture> Texture::cacheTexture(const std::shared_ptr<Context> context,
+                                               const std::string& filename,
+                                               vk::Format format,
+                                               bool normalMap)
+{
+  std::promise<std::shared_ptr<Texture>> promise;
+  std::shared_future<std::shared_ptr<Texture>> future;
+  bool load = false;
 
-      width = width > 1 ? width / 2 : width;
-      height = height > 1 ? height / 2 : height;
+  {
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    auto entry = textures.find(filename);
+    if (entry == textures.end())
+    // the first thread to ask for a texture loads it, everyone after that waits for the result
+    {
+      future = promise.get_future().share();
+      textures.emplace(filename, future);
+      load = true;
+    }
+    else
+    {
+      future = entry->second;
     }
-
-    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, mipLevels - 1, 1, 0, 1));
-    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal).setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
-                                  vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
   }
-  else
-  {
-    auto barrier = vk::ImageMemoryBarrier()
-                     .setOldLayout(vk::ImageLayout::ePreinitialized)
-                     .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
-                     .setImage(*image);
-    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
-      .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
-                                  vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
 
-    auto region = vk::BufferImageCopy()
-                    .setImageExtent(vk::Extent3D(width, height, 1))
-                    .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1));
-    commandBuffer.copyBufferToImage(*stagingBuffer, *image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-
-    barrier = vk::ImageMemoryBarrier()
-                .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-                .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-                .setImage(*image);
-    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
-    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
-                                  vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+  if (!load)
+  {
+    return future.get();
   }
 
-  commandBuffer.end();
-  auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&commandBuffer);
-  context->getQueue().submit({ submitInfo }, nullptr);
-  context->getQueue().waitIdle();
+  try
+  {
+    auto texture = std::make_shared<Texture>(context, filename, format, normalMap);
+    promise.set_value(texture);
+    return texture;
+  }
+  catch (...)
+  {
+    // let the threads already waiting fail as well, but allow a later attempt to try again
+    {
+      std::lock_guard<std::mutex> lock(texturesMutex);
+      textures.erase(filename);
+    }
 
-  context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
 
-  imageView =
-    std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)>(createImageView(context, image.get(), format, mipLevels),
-                                                               imageViewDeleter);
-  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context, mipLevels), samplerDeleter);
+void Texture::createUploader(const std::shared_ptr<Context> context)
+{
+  uploader = std::make_unique<TextureUploader>(context);
+  blockCompression = Settings::textureCompression && context->getPhysicalDevice()->getFeatures().textureCompressionBC;
 }
 
-std::shared_ptr<Texture>
-Texture::cacheTexture(const std::shared_ptr<Context> context, const std::string& filename, vk::Format format)
+void Texture::prefetch(ThreadPool* threadPool, const std::string& filename, vk::Format format, bool normalMap)
 {
-  for (auto& texture : textures)
   {
-    if (texture->filename.compare(filename) == 0)
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    if (textures.find(filename) != textures.end())
     {
-      return texture;
+      return;
     }
   }
 
-  auto texture = std::make_shared<Texture>(context, filename, format);
-  textures.push_back(texture);
-  return texture;
+  ImageDecoder::prefetch(threadPool, filename, getNumChannels(format), getBlockFormat(format, normalMap));
+}
+
+void Texture::flushUploads()
+{
+  if (uploader)
+  {
+    uploader->flush();
+  }
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "Context.hpp"
+#include "TextureUploader.hpp"
+#include "core/ThreadPool.hpp"
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
 
 class Texture
 {
@@ -10,22 +16,6 @@ private:
   std::string filename;
   uint32_t mipLevels;
 
-  static vk::Buffer*
-  createBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size, vk::BufferUsageFlags usage);
-  std::function<void(vk::Buffer*)> bufferDeleter = [this](vk::Buffer* buffer) {
-    if (context->getDevice())
-      context->getDevice()->destroyBuffer(*buffer);
-  };
-
-  static vk::DeviceMemory* createBufferMemory(const std::shared_ptr<Context> context,
-                                              const vk::Buffer* buffer,
-                                              vk::DeviceSize size,
-                                              vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> bufferMemoryDeleter = [this](vk::DeviceMemory* bufferMemory) {
-    if (context->getDevice())
-      context->getDevice()->freeMemory(*bufferMemory);
-  };
-
   static vk::Image* createImage(const std::shared_ptr<Context> context,
                                 uint32_t width,
                                 uint32_t height,
@@ -37,10 +27,15 @@ private:
   };
   std::unique_ptr<vk::Image, decltype(imageDeleter)> image;
 
-  static vk::DeviceMemory* createImageMemory(const std::shared_ptr<Context> context,
-                                             const vk::Image* image,
-                                             vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)> imageMemory;
+  static MemoryAllocator::Allocation* createImageMemory(const std::shared_ptr<Context> context,
+                                                        const vk::Image* image,
+                                                        vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(MemoryAllocator::Allocation*)> imageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* imageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(imageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)> imageMemory;
 
   static vk::ImageView* createImageView(const std::shared_ptr<Context> context,
                                         const vk::Image* image,
@@ -59,10 +54,22 @@ private:
   };
   std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
 
-  static std::vector<std::shared_ptr<Texture>> textures;
+  static uint32_t getNumChannels(vk::Format format);
+  static BlockFormat getBlockFormat(vk::Format format, bool normalMap);
+  static vk::Format getFormat(BlockFormat blockFormat);
+
+  static std::unordered_map<std::string, std::shared_future<std::shared_ptr<Texture>>> textures;
+  static std::mutex texturesMutex;
+
+  static std::unique_ptr<TextureUploader> uploader;
+  static bool blockCompression;
 
 public:
-  Texture(const std::shared_ptr<Context> context, const std::string& filename, vk::Format format);
+  // normal maps only keep their x and y channels when block compressed
+  Texture(const std::shared_ptr<Context> context,
+          const std::string& filename,
+          vk::Format format,
+          bool normalMap = false);
 
   vk::ImageView* getImageView() const
   {
@@ -73,6 +80,17 @@ public:
     return sampler.get();
   }
 
-  static std::shared_ptr<Texture>
-  cacheTexture(const std::shared_ptr<Context> context, const std::string& filename, vk::Format format);
+  // starts decoding a texture that is going to be loaded soon on the thread pool
+  static void
+  prefetch(ThreadPool* threadPool, const std::string& filename, vk::Format format, bool normalMap = false);
+  // also decides whether textures get block compressed, which needs device support
+  static void createUploader(const std::shared_ptr<Context> context);
+  // textures can not be sampled before their uploads have been flushed
+  static void flushUploads();
+
+  // safe to call from any thread, waits for a texture that another thread is still loading
+  static std::shared_ptr<Texture> cacheTexture(const std::shared_ptr<Context> context,
+                                               const std::string& filename,
+                                               vk::Format format,
+                                               bool normalMap = false);
 };
@@ -0,0 +1,271 @@
+#include "TextureCache.hpp"
+#include "MeshCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+const uint32_t TextureCache::VERSION = 1;
+
+namespace
+{
+const char MAGIC[4] = { 'M', 'K', 'T', 'C' };
+
+struct Header
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t numChannels;
+  uint32_t requestedBlockFormat, blockFormat;
+  uint32_t width, height, numLevels;
+};
+
+// an image can be used with more than one format, so every format gets its own cache
+std::string getCacheFilename(const std::string& filename, BlockFormat blockFormat)
+{
+  switch (blockFormat)
+  {
+  case BlockFormat::BC1:
+    return filename + ".bc1.texcache";
+  case BlockFormat::BC3:
+    return filename + ".bc3.texcache";
+  case BlockFormat::BC4:
+    return filename + ".bc4.texcache";
+  case BlockFormat::BC5:
+    return filename + ".bc5.texcache";
+  default:
+    throw std::runtime_error("Invalid block format.");
+  }
+}
+
+void appendLevels(DecodedImage* image)
+{
+  auto width = image->width, height = image->height;
+  size_t offset = 0;
+  while (true)
+  {
+    const auto size = BlockCompression::getCompressedSize(image->blockFormat, width, height);
+    image->levels.push_back({ width, height, offset, size });
+    offset += size;
+
+    if (width == 1 && height == 1)
+    {
+      break;
+    }
+
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+}
+
+// 2x2 box filter, odd edges repeat the last row or column
+void downsample(const std::vector<uint8_t>& source,
+                uint32_t sourceWidth,
+                uint32_t sourceHeight,
+                uint32_t numChannels,
+                std::vector<uint8_t>& destination,
+                uint32_t width,
+                uint32_t height)
+{
+  destination.resize(static_cast<size_t>(width) * height * numChannels);
+
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    const auto y0 = std::min(y * 2, sourceHeight - 1);
+    const auto y1 = std::min(y * 2 + 1, sourceHeight - 1);
+
+    for (uint32_t x = 0; x < width; ++x)
+    {
+      const auto x0 = std::min(x * 2, sourceWidth - 1);
+      const auto x1 = std::min(x * 2 + 1, sourceWidth - 1);
+
+      for (uint32_t c = 0; c < numChannels; ++c)
+      {
+        const auto sum = source[(static_cast<size_t>(y0) * sourceWidth + x0) * numChannels + c] +
+                         source[(static_cast<size_t>(y0) * sourceWidth + x1) * numChannels + c] +
+                         source[(static_cast<size_t>(y1) * sourceWidth + x0) * numChannels + c] +
+                         source[(static_cast<size_t>(y1) * sourceWidth + x1) * numChannels + c];
+        destination[(static_cast<size_t>(y) * width + x) * numChannels + c] = static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+}
+} // namespace
+
+std::shared_ptr<DecodedImage> TextureCache::read(const std::string& filename,
+                                                 uint64_t sourceHash,
+                                                 uint32_t numChannels,
+                                                 BlockFormat blockFormat)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file)
+  {
+    return nullptr;
+  }
+
+  Header header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)))
+  {
+    return nullptr;
+  }
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+      header.sourceHash != sourceHash || header.numChannels != numChannels ||
+      header.requestedBlockFormat != static_cast<uint32_t>(blockFormat) || header.width == 0 || header.height == 0)
+  {
+    return nullptr;
+  }
+
+  auto image = std::make_shared<DecodedImage>();
+  image->width = header.width;
+  image->height = header.height;
+  image->numChannels = numChannels;
+  image->blockFormat = static_cast<BlockFormat>(header.blockFormat);
+
+  if (image->blockFormat != blockFormat && (blockFormat != BlockFormat::BC3 || image->blockFormat != BlockFormat::BC1))
+  {
+    return nullptr;
+  }
+
+  appendLevels(image.get());
+  if (image->levels.size() != header.numLevels)
+  {
+    return nullptr;
+  }
+
+  const auto& lastLevel = image->levels.back();
+  image->pixels.resize(lastLevel.offset + lastLevel.size);
+  if (!file.read(reinterpret_cast<char*>(image->pixels.data()), image->pixels.size()))
+  {
+    return nullptr;
+  }
+
+  return image;
+}
+
+bool TextureCache::write(const std::string& filename,
+                         uint64_t sourceHash,
+                         uint32_t numChannels,
+                         BlockFormat blockFormat,
+                         const DecodedImage* image)
+{
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.sourceHash = sourceHash;
+  header.numChannels = numChannels;
+  header.requestedBlockFormat = static_cast<uint32_t>(blockFormat);
+  header.blockFormat = static_cast<uint32_t>(image->blockFormat);
+  header.width = image->width;
+  header.height = image->height;
+  header.numLevels = static_cast<uint32_t>(image->levels.size());
+
+  // two threads can end up baking the same image, so each one writes its own temporary file
+  const auto temporaryFilename =
+    filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(image->pixels.data()), image->pixels.size());
+
+    if (!file)
+    {
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporaryFilename, filename, error);
+  if (error)
+  {
+    std::filesystem::remove(temporaryFilename, error);
+    return false;
+  }
+
+  return true;
+}
+
+std::shared_ptr<DecodedImage> TextureCache::bake(const DecodedImage* image, BlockFormat blockFormat)
+{
+  // bc4 compresses the only channel, every other format works on rgba
+  const auto numChannels = blockFormat == BlockFormat::BC4 ? 1u : 4u;
+  if (image->numChannels != numChannels)
+  {
+    throw std::runtime_error("Failed to bake texture, image has " + std::to_string(image->numChannels) +
+                             " channels but the block format needs " + std::to_string(numChannels) + ".");
+  }
+
+  if (blockFormat == BlockFormat::BC3)
+  {
+    auto opaque = true;
+    for (size_t i = 3; i < image->pixels.size() && opaque; i += 4)
+    {
+      opaque = image->pixels[i] == 255;
+    }
+
+    if (opaque)
+    {
+      blockFormat = BlockFormat::BC1;
+    }
+  }
+
+  auto baked = std::make_shared<DecodedImage>();
+  baked->width = image->width;
+  baked->height = image->height;
+  baked->numChannels = image->numChannels;
+  baked->blockFormat = blockFormat;
+  appendLevels(baked.get());
+
+  const auto& lastLevel = baked->levels.back();
+  baked->pixels.resize(lastLevel.offset + lastLevel.size);
+
+  std::vector<uint8_t> levelPixels = image->pixels, nextLevelPixels;
+  for (size_t i = 0; i < baked->levels.size(); ++i)
+  {
+    const auto& level = baked->levels.at(i);
+
+    if (i > 0)
+    {
+      const auto& previousLevel = baked->levels.at(i - 1);
+      downsample(levelPixels, previousLevel.width, previousLevel.height, numChannels, nextLevelPixels, level.width,
+                 level.height);
+      levelPixels.swap(nextLevelPixels);
+    }
+
+    BlockCompression::compress(blockFormat, levelPixels.data(), level.width, level.height,
+                               baked->pixels.data() + level.offset);
+  }
+
+  return baked;
+}
+
+std::shared_ptr<DecodedImage>
+TextureCache::load(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat)
+{
+  const auto sourceHash = MeshCache::hashFile(filename);
+  const auto cacheFilename = getCacheFilename(filename, blockFormat);
+
+  auto image = read(cacheFilename, sourceHash, numChannels, blockFormat);
+  if (image)
+  {
+    return image;
+  }
+
+  const auto decodedImage = ImageDecoder::decode(filename, numChannels);
+  image = bake(decodedImage.get(), blockFormat);
+
+  // failing to write the cache only means the next start has to bake again
+  write(cacheFilename, sourceHash, numChannels, blockFormat, image.get());
+
+  return image;
+}
\ No newline at end of file
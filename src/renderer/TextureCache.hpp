@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ImageDecoder.hpp"
+
+#include <string>
+
+// binary cache of a block compressed texture with its full mip chain, baked next to the source image on first load
+class TextureCache
+{
+private:
+  static std::shared_ptr<DecodedImage>
+  read(const std::string& filename, uint64_t sourceHash, uint32_t numChannels, BlockFormat blockFormat);
+  static bool write(const std::string& filename,
+                    uint64_t sourceHash,
+                    uint32_t numChannels,
+                    BlockFormat blockFormat,
+                    const DecodedImage* image);
+
+  // builds the mip chain of a decoded image and compresses every level, bc3 falls back to bc1 for opaque images
+  static std::shared_ptr<DecodedImage> bake(const DecodedImage* image, BlockFormat blockFormat);
+
+public:
+  static const uint32_t VERSION;
+
+  // loads the cache if it was baked from the same source image and format, bakes and writes it otherwise
+  static std::shared_ptr<DecodedImage>
+  load(const std::string& filename, uint32_t numChannels, BlockFormat blockFormat);
+};
\ No newline at end of file
@@ -0,0 +1,393 @@
+#include "TextureUploader.hpp"
+#include "Settings.hpp"
+
+#include <algorithm>
+#include <limits>
+
+const vk::DeviceSize TextureUploader::STAGING_RING_SIZE = 64 * 1024 * 1024;
+
+namespace
+{
+// satisfies the buffer offset requirements of copies into all formats used for textures
+const vk::DeviceSize STAGING_ALIGNMENT = 16;
+} // namespace
+
+vk::Buffer* TextureUploader::createBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size)
+{
+  auto bufferCreateInfo = vk::BufferCreateInfo().setSize(size).setUsage(vk::BufferUsageFlagBits::eTransferSrc);
+  auto buffer = context->getDevice()->createBuffer(bufferCreateInfo);
+  return new vk::Buffer(buffer);
+}
+
+MemoryAllocator::Allocation* TextureUploader::createBufferMemory(const std::shared_ptr<Context> context,
+                                                                 const vk::Buffer* buffer)
+{
+  const auto memoryPropertyFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+  return context->getMemoryAllocator()->allocateForBuffer(*buffer, memoryPropertyFlags);
+}
+
+vk::CommandPool* TextureUploader::createCommandPool(const std::shared_ptr<Context> context, uint32_t queueFamilyIndex)
+{
+  auto commandPoolCreateInfo = vk::CommandPoolCreateInfo()
+                                 .setQueueFamilyIndex(queueFamilyIndex)
+                                 .setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+  auto commandPool = context->getDevice()->createCommandPool(commandPoolCreateInfo);
+  return new vk::CommandPool(commandPool);
+}
+
+vk::CommandBuffer* TextureUploader::createCommandBuffer(const std::shared_ptr<Context> context,
+                                                        const vk::CommandPool* commandPool)
+{
+  auto commandBufferAllocateInfo =
+    vk::CommandBufferAllocateInfo().setCommandPool(*commandPool).setCommandBufferCount(1);
+  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
+  return new vk::CommandBuffer(commandBuffer);
+}
+
+vk::Semaphore* TextureUploader::createSemaphore(const std::shared_ptr<Context> context)
+{
+  auto semaphore = context->getDevice()->createSemaphore(vk::SemaphoreCreateInfo());
+  return new vk::Semaphore(semaphore);
+}
+
+vk::Fence* TextureUploader::createFence(const std::shared_ptr<Context> context)
+{
+  auto fence = context->getDevice()->createFence(vk::FenceCreateInfo());
+  return new vk::Fence(fence);
+}
+
+TextureUploader::TextureUploader(const std::shared_ptr<Context> context)
+{
+  this->context = context;
+
+  stagingRingBuffer =
+    std::unique_ptr<vk::Buffer, decltype(bufferDeleter)>(createBuffer(context, STAGING_RING_SIZE), bufferDeleter);
+  stagingRingBufferMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(bufferMemoryDeleter)>(
+    createBufferMemory(context, stagingRingBuffer.get()), bufferMemoryDeleter);
+  stagingRingData = static_cast<char*>(stagingRingBufferMemory->mappedData);
+  stagingRingOffset = 0;
+
+  oversizedStagingBuffers =
+    std::unique_ptr<std::vector<vk::Buffer>, decltype(buffersDeleter)>(new std::vector<vk::Buffer>(), buffersDeleter);
+  oversizedStagingBuffersMemory =
+    std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(buffersMemoryDeleter)>(
+      new std::vector<MemoryAllocator::Allocation*>(), buffersMemoryDeleter);
+
+  transferCommandPool = std::unique_ptr<vk::CommandPool, decltype(commandPoolDeleter)>(
+    createCommandPool(context, context->getTransferQueueFamilyIndex()), commandPoolDeleter);
+  transferCommandBuffer = std::unique_ptr<vk::CommandBuffer>(createCommandBuffer(context, transferCommandPool.get()));
+
+  if (context->hasDedicatedTransferQueue())
+  // the mip chain is generated with blits, which only the graphics queue supports
+  {
+    graphicsCommandPool = std::unique_ptr<vk::CommandPool, decltype(commandPoolDeleter)>(
+      createCommandPool(context, context->getQueueFamilyIndex()), commandPoolDeleter);
+    graphicsCommandBuffer = std::unique_ptr<vk::CommandBuffer>(createCommandBuffer(context, graphicsCommandPool.get()));
+    transferDoneSemaphore =
+      std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)>(createSemaphore(context), semaphoreDeleter);
+  }
+
+  fence = std::unique_ptr<vk::Fence, decltype(fenceDeleter)>(createFence(context), fenceDeleter);
+
+  recording = false;
+}
+
+void* TextureUploader::allocateStaging(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset)
+{
+  if (size > STAGING_RING_SIZE)
+  // kept alive until the batch it is used in has completed
+  {
+    auto oversizedBuffer = std::unique_ptr<vk::Buffer>(createBuffer(context, size));
+    oversizedStagingBuffers->push_back(*oversizedBuffer);
+    auto oversizedBufferMemory = createBufferMemory(context, oversizedBuffer.get());
+    oversizedStagingBuffersMemory->push_back(oversizedBufferMemory);
+
+    buffer = *oversizedBuffer;
+    offset = 0;
+    return oversizedBufferMemory->mappedData;
+  }
+
+  offset = (stagingRingOffset + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  if (offset + size > STAGING_RING_SIZE)
+  // the ring is full, so the batch has to finish before its space can be reused
+  {
+    submitAndWait();
+    offset = 0;
+  }
+
+  stagingRingOffset = offset + size;
+  buffer = *stagingRingBuffer;
+  return stagingRingData + offset;
+}
+
+void TextureUploader::beginRecording()
+{
+  if (recording)
+  {
+    return;
+  }
+
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  transferCommandBuffer->begin(commandBufferBeginInfo);
+  if (graphicsCommandBuffer)
+  {
+    graphicsCommandBuffer->begin(commandBufferBeginInfo);
+  }
+  recording = true;
+}
+
+void TextureUploader::upload(const vk::Image* image,
+                             uint32_t width,
+                             uint32_t height,
+                             uint32_t mipLevels,
+                             const void* pixels,
+                             vk::DeviceSize size)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  vk::Buffer stagingBuffer;
+  vk::DeviceSize stagingOffset;
+  auto stagingData = allocateStaging(size, stagingBuffer, stagingOffset);
+  memcpy(stagingData, pixels, static_cast<size_t>(size));
+
+  beginRecording();
+
+  const auto dedicatedTransferQueue = context->hasDedicatedTransferQueue();
+  auto copyCommandBuffer = *transferCommandBuffer;
+  auto mipCommandBuffer = dedicatedTransferQueue ? *graphicsCommandBuffer : copyCommandBuffer;
+  const auto numMipLevels = Settings::mipMapping ? mipLevels : 1;
+
+  // the first level is copied on the transfer queue, the rest of the chain is blitted from it on the graphics queue
+  auto barrier = vk::ImageMemoryBarrier()
+                   .setOldLayout(vk::ImageLayout::eUndefined)
+                   .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+                   .setImage(*image);
+  barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
+    .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+  copyCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                    vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+  auto region = vk::BufferImageCopy()
+                  .setBufferOffset(stagingOffset)
+                  .setImageExtent(vk::Extent3D(width, height, 1))
+                  .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1));
+  copyCommandBuffer.copyBufferToImage(stagingBuffer, *image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+
+  const auto firstLevelLayout =
+    numMipLevels > 1 ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eShaderReadOnlyOptimal;
+  const auto firstLevelStage =
+    numMipLevels > 1 ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eFragmentShader;
+  const auto firstLevelAccess = numMipLevels > 1 ? vk::AccessFlagBits::eTransferRead : vk::AccessFlagBits::eShaderRead;
+
+  if (dedicatedTransferQueue)
+  // hand the first level over from the transfer to the graphics queue family, this pair of barriers has to match
+  {
+    barrier = vk::ImageMemoryBarrier()
+                .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+                .setNewLayout(firstLevelLayout)
+                .setSrcQueueFamilyIndex(context->getTransferQueueFamilyIndex())
+                .setDstQueueFamilyIndex(context->getQueueFamilyIndex())
+                .setImage(*image);
+    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+    copyCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                      vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.setSrcAccessMask(vk::AccessFlags()).setDstAccessMask(firstLevelAccess);
+    mipCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, firstLevelStage, vk::DependencyFlags(), 0,
+                                     nullptr, 0, nullptr, 1, &barrier);
+  }
+  else if (numMipLevels == 1)
+  {
+    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal).setNewLayout(firstLevelLayout);
+    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(firstLevelAccess);
+    copyCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, firstLevelStage, vk::DependencyFlags(), 0,
+                                      nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  if (numMipLevels > 1)
+  {
+    barrier = vk::ImageMemoryBarrier()
+                .setOldLayout(vk::ImageLayout::eUndefined)
+                .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+                .setImage(*image);
+    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 1, numMipLevels - 1, 0, 1))
+      .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+    mipCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                     vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+    auto mipWidth = static_cast<int32_t>(width);
+    auto mipHeight = static_cast<int32_t>(height);
+
+    barrier = vk::ImageMemoryBarrier().setImage(*image);
+    for (uint32_t i = 1; i < numMipLevels; ++i)
+    {
+      barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i - 1, 1, 0, 1));
+      barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal).setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
+      barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+      mipCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+                                       vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+      const auto nextMipWidth = std::max(mipWidth / 2, 1);
+      const auto nextMipHeight = std::max(mipHeight / 2, 1);
+
+      auto blit = vk::ImageBlit()
+                    .setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1) })
+                    .setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0, 1));
+      blit.setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(nextMipWidth, nextMipHeight, 1) })
+        .setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1));
+      mipCommandBuffer.blitImage(*image, vk::ImageLayout::eTransferSrcOptimal, *image,
+                                 vk::ImageLayout::eTransferDstOptimal, 1, &blit, vk::Filter::eLinear);
+
+      barrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal).setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+      barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferRead).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+      mipCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+                                       vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+      mipWidth = nextMipWidth;
+      mipHeight = nextMipHeight;
+    }
+
+    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, numMipLevels - 1, 1, 0, 1));
+    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal).setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    mipCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+                                     vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+}
+
+void TextureUploader::uploadLevels(const vk::Image* image, const DecodedImage* decodedImage, uint32_t numLevels)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // the levels are stored back to back, so they can share one staging allocation
+  const auto& lastLevel = decodedImage->levels.at(numLevels - 1);
+  const auto size = static_cast<vk::DeviceSize>(lastLevel.offset + lastLevel.size);
+
+  vk::Buffer stagingBuffer;
+  vk::DeviceSize stagingOffset;
+  auto stagingData = allocateStaging(size, stagingBuffer, stagingOffset);
+  memcpy(stagingData, decodedImage->pixels.data(), static_cast<size_t>(size));
+
+  beginRecording();
+
+  const auto subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, numLevels, 0, 1);
+
+  auto barrier = vk::ImageMemoryBarrier()
+                   .setOldLayout(vk::ImageLayout::eUndefined)
+                   .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+                   .setImage(*image);
+  barrier.setSubresourceRange(subresourceRange).setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+  transferCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                         vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+  std::vector<vk::BufferImageCopy> regions(numLevels);
+  for (uint32_t i = 0; i < numLevels; ++i)
+  {
+    const auto& level = decodedImage->levels.at(i);
+    regions.at(i)
+      .setBufferOffset(stagingOffset + level.offset)
+      .setImageExtent(vk::Extent3D(level.width, level.height, 1))
+      .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1));
+  }
+  transferCommandBuffer->copyBufferToImage(stagingBuffer, *image, vk::ImageLayout::eTransferDstOptimal,
+                                           static_cast<uint32_t>(regions.size()), regions.data());
+
+  barrier = vk::ImageMemoryBarrier()
+              .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+              .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+              .setImage(*image);
+  barrier.setSubresourceRange(subresourceRange).setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+
+  if (context->hasDedicatedTransferQueue())
+  // nothing is left to do on the graphics queue but to take ownership, the pair of barriers has to match
+  {
+    barrier.setSrcQueueFamilyIndex(context->getTransferQueueFamilyIndex())
+      .setDstQueueFamilyIndex(context->getQueueFamilyIndex());
+    transferCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                           vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), 0, nullptr,
+                                           0, nullptr, 1, &barrier);
+
+    barrier.setSrcAccessMask(vk::AccessFlags()).setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    graphicsCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                           vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0,
+                                           nullptr, 0, nullptr, 1, &barrier);
+  }
+  else
+  {
+    barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    transferCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                           vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0,
+                                           nullptr, 0, nullptr, 1, &barrier);
+  }
+}
+
+void TextureUploader::submitAndWait()
+{
+  if (!recording)
+  {
+    return;
+  }
+
+  transferCommandBuffer->end();
+
+  if (context->hasDedicatedTransferQueue())
+  {
+    graphicsCommandBuffer->end();
+
+    auto transferSubmitInfo = vk::SubmitInfo()
+                                .setCommandBufferCount(1)
+                                .setPCommandBuffers(transferCommandBuffer.get())
+                                .setSignalSemaphoreCount(1)
+                                .setPSignalSemaphores(transferDoneSemaphore.get());
+    context->getTransferQueue().submit({ transferSubmitInfo }, nullptr);
+
+    vk::PipelineStageFlags waitDstStageMask = vk::PipelineStageFlagBits::eAllCommands;
+    auto graphicsSubmitInfo = vk::SubmitInfo()
+                                .setWaitSemaphoreCount(1)
+                                .setPWaitSemaphores(transferDoneSemaphore.get())
+                                .setPWaitDstStageMask(&waitDstStageMask)
+                                .setCommandBufferCount(1)
+                                .setPCommandBuffers(graphicsCommandBuffer.get());
+    context->getQueue().submit({ graphicsSubmitInfo }, *fence);
+  }
+  else
+  {
+    auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(transferCommandBuffer.get());
+    context->getQueue().submit({ submitInfo }, *fence);
+  }
+
+  if (context->getDevice()->waitForFences(1, fence.get(), true, std::numeric_limits<uint64_t>::max()) !=
+      vk::Result::eSuccess)
+  {
+    throw std::runtime_error("Failed to wait for texture uploads to complete.");
+  }
+  context->getDevice()->resetFences(1, fence.get());
+
+  context->getDevice()->resetCommandPool(*transferCommandPool, vk::CommandPoolResetFlags());
+  if (graphicsCommandPool)
+  {
+    context->getDevice()->resetCommandPool(*graphicsCommandPool, vk::CommandPoolResetFlags());
+  }
+
+  for (auto& buffer : *oversizedStagingBuffers)
+  {
+    context->getDevice()->destroyBuffer(buffer);
+  }
+  oversizedStagingBuffers->clear();
+
+  for (auto& bufferMemory : *oversizedStagingBuffersMemory)
+  {
+    context->getMemoryAllocator()->free(bufferMemory);
+  }
+  oversizedStagingBuffersMemory->clear();
+
+  stagingRingOffset = 0;
+  recording = false;
+}
+
+void TextureUploader::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  submitAndWait();
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Context.hpp"
+#include "ImageDecoder.hpp"
+
+#include <mutex>
+
+// records the uploads and mip chains of many textures into shared command buffers that are submitted together, with a
+// single fence to wait on for the whole batch instead of one queue stall per texture
+class TextureUploader
+{
+public:
+  // textures larger than the persistently mapped staging ring get a temporary staging buffer of their own
+  static const vk::DeviceSize STAGING_RING_SIZE;
+
+private:
+  std::shared_ptr<Context> context;
+  std::mutex mutex;
+
+  static vk::Buffer* createBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size);
+  std::function<void(vk::Buffer*)> bufferDeleter = [this](vk::Buffer* buffer) {
+    if (context->getDevice())
+      context->getDevice()->destroyBuffer(*buffer);
+  };
+  std::unique_ptr<vk::Buffer, decltype(bufferDeleter)> stagingRingBuffer;
+
+  static MemoryAllocator::Allocation* createBufferMemory(const std::shared_ptr<Context> context,
+                                                         const vk::Buffer* buffer);
+  std::function<void(MemoryAllocator::Allocation*)> bufferMemoryDeleter =
+    [this](MemoryAllocator::Allocation* bufferMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(bufferMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(bufferMemoryDeleter)> stagingRingBufferMemory;
+
+  std::function<void(std::vector<vk::Buffer>*)> buffersDeleter = [this](std::vector<vk::Buffer>* buffers) {
+    if (context->getDevice())
+    {
+      for (auto& buffer : *buffers)
+        context->getDevice()->destroyBuffer(buffer);
+    }
+  };
+  std::unique_ptr<std::vector<vk::Buffer>, decltype(buffersDeleter)> oversizedStagingBuffers;
+
+  std::function<void(std::vector<MemoryAllocator::Allocation*>*)> buffersMemoryDeleter =
+    [this](std::vector<MemoryAllocator::Allocation*>* buffersMemory) {
+      if (context->getDevice())
+      {
+        for (auto& bufferMemory : *buffersMemory)
+          context->getMemoryAllocator()->free(bufferMemory);
+      }
+    };
+  std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(buffersMemoryDeleter)>
+    oversizedStagingBuffersMemory;
+
+  static vk::CommandPool* createCommandPool(const std::shared_ptr<Context> context, uint32_t queueFamilyIndex);
+  std::function<void(vk::CommandPool*)> commandPoolDeleter = [this](vk::CommandPool* commandPool) {
+    if (context->getDevice())
+      context->getDevice()->destroyCommandPool(*commandPool);
+  };
+  std::unique_ptr<vk::CommandPool, decltype(commandPoolDeleter)> transferCommandPool, graphicsCommandPool;
+
+  static vk::CommandBuffer* createCommandBuffer(const std::shared_ptr<Context> context,
+                                               const vk::CommandPool* commandPool);
+  std::unique_ptr<vk::CommandBuffer> transferCommandBuffer, graphicsCommandBuffer;
+
+  static vk::Semaphore* createSemaphore(const std::shared_ptr<Context> context);
+  std::function<void(vk::Semaphore*)> semaphoreDeleter = [this](vk::Semaphore* semaphore) {
+    if (context->getDevice())
+      context->getDevice()->destroySemaphore(*semaphore);
+  };
+  std::unique_ptr<vk::Semaphore, decltype(semaphoreDeleter)> transferDoneSemaphore;
+
+  static vk::Fence* createFence(const std::shared_ptr<Context> context);
+  std::function<void(vk::Fence*)> fenceDeleter = [this](vk::Fence* fence) {
+    if (context->getDevice())
+      context->getDevice()->destroyFence(*fence);
+  };
+  std::unique_ptr<vk::Fence, decltype(fenceDeleter)> fence;
+
+  char* stagingRingData;
+  vk::DeviceSize stagingRingOffset;
+  bool recording;
+
+  void* allocateStaging(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset);
+  void beginRecording();
+  void submitAndWait();
+
+public:
+  TextureUploader(const std::shared_ptr<Context> context);
+
+  // safe to call from any thread, the image is not ready to be sampled before the next flush
+  void upload(const vk::Image* image,
+              uint32_t width,
+              uint32_t height,
+              uint32_t mipLevels,
+              const void* pixels,
+              vk::DeviceSize size);
+  // copies the first levels of an image that already comes with its mip chain, entirely on the transfer queue
+  void uploadLevels(const vk::Image* image, const DecodedImage* decodedImage, uint32_t numLevels);
+  // submits everything recorded so far and waits for it to complete
+  void flush();
+};
\ No newline at end of file
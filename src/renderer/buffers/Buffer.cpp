@@ -8,37 +8,11 @@ Buffer::createBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size
   return new vk::Buffer(buffer);
 }
 
-vk::DeviceMemory* Buffer::createMemory(const std::shared_ptr<Context> context,
-                                       const vk::Buffer* buffer,
-                                       vk::DeviceSize size,
-                                       vk::MemoryPropertyFlags memoryPropertyFlags)
+MemoryAllocator::Allocation* Buffer::createMemory(const std::shared_ptr<Context> context,
+                                                  const vk::Buffer* buffer,
+                                                  vk::MemoryPropertyFlags memoryPropertyFlags)
 {
-  auto memoryRequirements = context->getDevice()->getBufferMemoryRequirements(*buffer);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for buffer.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindBufferMemory(*buffer, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
+  return context->getMemoryAllocator()->allocateForBuffer(*buffer, memoryPropertyFlags);
 }
 
 Buffer::Buffer(const std::shared_ptr<Context> context,
@@ -49,19 +23,19 @@ Buffer::Buffer(const std::shared_ptr<Context> context,
   this->context = context;
 
   buffer = std::unique_ptr<vk::Buffer, decltype(bufferDeleter)>(createBuffer(context, size, usage), bufferDeleter);
-  memory = std::unique_ptr<vk::DeviceMemory, decltype(memoryDeleter)>(createMemory(context, buffer.get(), size,
-                                                                                   memoryPropertyFlags),
-                                                                      memoryDeleter);
+  memory = std::unique_ptr<MemoryAllocator::Allocation, decltype(memoryDeleter)>(
+    createMemory(context, buffer.get(), memoryPropertyFlags), memoryDeleter);
 
   isMemoryMapped = false;
   mappedMemoryLocation = nullptr;
 }
 
+// host visible memory is mapped by the allocator for as long as it exists, so this only hands out the pointer
 void Buffer::mapMemory()
 {
   if (!isMemoryMapped)
   {
-    mappedMemoryLocation = context->getDevice()->mapMemory(*memory, 0, VK_WHOLE_SIZE);
+    mappedMemoryLocation = memory->mappedData;
     isMemoryMapped = true;
   }
 }
@@ -70,7 +44,7 @@ void Buffer::unmapMemory()
 {
   if (isMemoryMapped)
   {
-    context->getDevice()->unmapMemory(*memory);
+    mappedMemoryLocation = nullptr;
     isMemoryMapped = false;
   }
 }
\ No newline at end of file
@@ -15,15 +15,14 @@ private:
   };
   std::unique_ptr<vk::Buffer, decltype(bufferDeleter)> buffer;
 
-  static vk::DeviceMemory* createMemory(const std::shared_ptr<Context> context,
-                                        const vk::Buffer* buffer,
-                                        vk::DeviceSize size,
-                                        vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> memoryDeleter = [this](vk::DeviceMemory* memory) {
+  static MemoryAllocator::Allocation* createMemory(const std::shared_ptr<Context> context,
+                                                   const vk::Buffer* buffer,
+                                                   vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(MemoryAllocator::Allocation*)> memoryDeleter = [this](MemoryAllocator::Allocation* memory) {
     if (context->getDevice())
-      context->getDevice()->freeMemory(*memory);
+      context->getMemoryAllocator()->free(memory);
   };
-  std::unique_ptr<vk::DeviceMemory, decltype(memoryDeleter)> memory;
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(memoryDeleter)> memory;
 
   bool isMemoryMapped;
   void* mappedMemoryLocation;
@@ -45,9 +44,18 @@ public:
   {
     return buffer.get();
   }
+  // the memory is shared with other resources, the buffer starts at the memory offset
   vk::DeviceMemory* getMemory() const
   {
-    return memory.get();
+    return &memory->memory;
+  }
+  vk::DeviceSize getMemoryOffset() const
+  {
+    return memory->offset;
+  }
+  vk::MappedMemoryRange getMappedMemoryRange() const
+  {
+    return vk::MappedMemoryRange(memory->memory, memory->offset, memory->size);
   }
   void* getMemoryMappedLocation() const
   {
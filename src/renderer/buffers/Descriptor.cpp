@@ -11,26 +11,48 @@ vk::DescriptorSetLayout* Descriptor::createLayout(const std::shared_ptr<Context>
   return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
 }
 
-vk::DescriptorSet* Descriptor::createSet(const std::shared_ptr<Context> context,
-                                         const std::shared_ptr<DescriptorPool> descriptorPool,
-                                         const vk::DescriptorSetLayout* layout,
-                                         const vk::Buffer* buffer,
-                                         vk::DeviceSize range,
-                                         vk::DescriptorType type)
+std::vector<vk::DescriptorSet>* Descriptor::createSets(const std::shared_ptr<Context> context,
+                                                      const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                      const vk::DescriptorSetLayout* layout,
+                                                      const vk::Buffer* buffer,
+                                                      vk::DeviceSize range,
+                                                      vk::DescriptorType type,
+                                                      uint32_t numSets,
+                                                      vk::DeviceSize setStride)
 {
+  std::vector<vk::DescriptorSetLayout> layouts(numSets, *layout);
   auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
                                      .setDescriptorPool(*descriptorPool->getPool())
-                                     .setDescriptorSetCount(1)
-                                     .setPSetLayouts(layout);
-  auto descriptorSet = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo).at(0);
-  auto descriptorBufferInfo = vk::DescriptorBufferInfo().setBuffer(*buffer).setRange(range);
-  auto writeDescriptorSet = vk::WriteDescriptorSet()
-                              .setDstSet(descriptorSet)
-                              .setDescriptorType(type)
-                              .setDescriptorCount(1)
-                              .setPBufferInfo(&descriptorBufferInfo);
-  context->getDevice()->updateDescriptorSets(1, &writeDescriptorSet, 0, nullptr);
-  return new vk::DescriptorSet(descriptorSet);
+                                     .setDescriptorSetCount(numSets)
+                                     .setPSetLayouts(layouts.data());
+  auto descriptorSets = new std::vector<vk::DescriptorSet>(
+    context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo));
+  writeSets(context, descriptorSets, buffer, range, type, setStride);
+  return descriptorSets;
+}
+
+void Descriptor::writeSets(const std::shared_ptr<Context> context,
+                           const std::vector<vk::DescriptorSet>* sets,
+                           const vk::Buffer* buffer,
+                           vk::DeviceSize range,
+                           vk::DescriptorType type,
+                           vk::DeviceSize setStride)
+{
+  const auto numSets = static_cast<uint32_t>(sets->size());
+  std::vector<vk::DescriptorBufferInfo> descriptorBufferInfos(numSets);
+  std::vector<vk::WriteDescriptorSet> writeDescriptorSets(numSets);
+  for (uint32_t i = 0; i < numSets; ++i)
+  {
+    descriptorBufferInfos[i] = vk::DescriptorBufferInfo().setBuffer(*buffer).setOffset(i * setStride).setRange(range);
+    writeDescriptorSets[i] = vk::WriteDescriptorSet()
+                               .setDstSet(sets->at(i))
+                               .setDescriptorType(type)
+                               .setDescriptorCount(1)
+                               .setPBufferInfo(&descriptorBufferInfos[i]);
+  }
+
+  context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                             writeDescriptorSets.data(), 0, nullptr);
 }
 
 Descriptor::Descriptor(const std::shared_ptr<Context> context,
@@ -38,13 +60,23 @@ Descriptor::Descriptor(const std::shared_ptr<Context> context,
                        vk::DescriptorType type,
                        vk::ShaderStageFlags shaderStageFlags,
                        const vk::Buffer* buffer,
-                       vk::DeviceSize range)
+                       vk::DeviceSize range,
+                       uint32_t numSets,
+                       vk::DeviceSize setStride)
 {
   this->context = context;
   this->descriptorPool = descriptorPool;
+  this->type = type;
+  this->range = range;
 
   layout =
     std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(createLayout(context, type, shaderStageFlags),
                                                                       layoutDeleter);
-  set = std::unique_ptr<vk::DescriptorSet>(createSet(context, descriptorPool, layout.get(), buffer, range, type));
+  sets = std::unique_ptr<std::vector<vk::DescriptorSet>>(
+    createSets(context, descriptorPool, layout.get(), buffer, range, type, numSets, setStride));
+}
+
+void Descriptor::update(const vk::Buffer* buffer, vk::DeviceSize setStride)
+{
+  writeSets(context, sets.get(), buffer, range, type, setStride);
 }
@@ -17,28 +17,46 @@ private:
   };
   std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)> layout;
 
-  static vk::DescriptorSet* createSet(const std::shared_ptr<Context> context,
-                                      const std::shared_ptr<DescriptorPool> descriptorPool,
-                                      const vk::DescriptorSetLayout* layout,
-                                      const vk::Buffer* buffer,
-                                      vk::DeviceSize range,
-                                      vk::DescriptorType type);
-  std::unique_ptr<vk::DescriptorSet> set;
+  static std::vector<vk::DescriptorSet>* createSets(const std::shared_ptr<Context> context,
+                                                    const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                    const vk::DescriptorSetLayout* layout,
+                                                    const vk::Buffer* buffer,
+                                                    vk::DeviceSize range,
+                                                    vk::DescriptorType type,
+                                                    uint32_t numSets,
+                                                    vk::DeviceSize setStride);
+  std::unique_ptr<std::vector<vk::DescriptorSet>> sets;
+
+  static void writeSets(const std::shared_ptr<Context> context,
+                        const std::vector<vk::DescriptorSet>* sets,
+                        const vk::Buffer* buffer,
+                        vk::DeviceSize range,
+                        vk::DescriptorType type,
+                        vk::DeviceSize setStride);
+
+  vk::DescriptorType type;
+  vk::DeviceSize range;
 
 public:
+  // creates one set per frame in flight, each pointing setStride bytes further into the buffer
   Descriptor(const std::shared_ptr<Context> context,
              const std::shared_ptr<DescriptorPool> descriptorPool,
              vk::DescriptorType type,
              vk::ShaderStageFlags shaderStageFlags,
              const vk::Buffer* buffer,
-             vk::DeviceSize range);
+             vk::DeviceSize range,
+             uint32_t numSets = 1,
+             vk::DeviceSize setStride = 0);
+
+  // points the sets at another buffer, none of them may be in use by the device
+  void update(const vk::Buffer* buffer, vk::DeviceSize setStride);
 
   vk::DescriptorSetLayout* getLayout() const
   {
     return layout.get();
   }
-  vk::DescriptorSet* getSet() const
+  vk::DescriptorSet* getSet(const uint32_t index = 0) const
   {
-    return set.get();
+    return &sets->at(index);
   }
 };
\ No newline at end of file
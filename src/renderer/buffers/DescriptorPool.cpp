@@ -1,34 +1,86 @@
 #include "DescriptorPool.hpp"
 #include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
+#include "renderer/culling_pass/DepthPyramid.hpp"
+
+#include <algorithm>
 
 vk::DescriptorPool*
 DescriptorPool::createPool(const std::shared_ptr<Context> context, uint32_t numMaterials, uint32_t numShadowMaps)
 {
   // TODO: double check all this... all the + 8s at the ends are because I've lost track.
 
-  // we need one descriptor set per texture (five textures per material), one per shadow map, one for the ui font,
-  // one for each of the two textures in the geometry buffer and one for each for each of the two textures in the
-  // lighting buffer
+  // we need one descriptor set per texture (five textures per material), one per shadow map, one for the ui font
+  // and one for each for each of the two textures in the lighting buffer
   std::vector<vk::DescriptorPoolSize> poolSizes = { vk::DescriptorPoolSize()
-                                                      .setDescriptorCount(numMaterials * 5 + numShadowMaps + 1 + 2 + 2 +
+                                                      .setDescriptorCount(numMaterials * 5 + numShadowMaps + 1 + 2 +
                                                                           Settings::shadowMapCascadeCount + 8)
                                                       .setType(vk::DescriptorType::eCombinedImageSampler) };
 
+  // every shadow map reads the regions of its cascades in the shadow atlas from a uniform buffer, pool sizes may not
+  // be empty even without shadow maps
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(std::max(numShadowMaps, 1u))
+                        .setType(vk::DescriptorType::eUniformBuffer));
+
+  // the geometry buffer is read as input attachments, two textures and depth
+  poolSizes.push_back(vk::DescriptorPoolSize().setDescriptorCount(3).setType(vk::DescriptorType::eInputAttachment));
+
+  // uniform buffer descriptor sets exist once per frame in flight
   uint32_t maxSets = 0;
   if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
   {
-    maxSets = numMaterials + 8 + Settings::shadowMapCascadeCount + numShadowMaps + 8;
-    poolSizes.push_back(
-      vk::DescriptorPoolSize().setDescriptorCount(5).setType(vk::DescriptorType::eUniformBufferDynamic));
-    poolSizes.push_back(vk::DescriptorPoolSize().setDescriptorCount(1).setType(vk::DescriptorType::eUniformBuffer));
+    maxSets = numMaterials + 8 + Settings::shadowMapCascadeCount + numShadowMaps + 8 * Sync::MAX_FRAMES_IN_FLIGHT;
+    poolSizes.push_back(vk::DescriptorPoolSize()
+                          .setDescriptorCount(5 * Sync::MAX_FRAMES_IN_FLIGHT)
+                          .setType(vk::DescriptorType::eUniformBufferDynamic));
+    poolSizes.push_back(vk::DescriptorPoolSize()
+                          .setDescriptorCount(1 * Sync::MAX_FRAMES_IN_FLIGHT)
+                          .setType(vk::DescriptorType::eUniformBuffer));
   }
   else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
   {
-    maxSets = numMaterials + 8 + Settings::shadowMapCascadeCount + numShadowMaps + 8;
-    poolSizes.push_back(
-      vk::DescriptorPoolSize().setDescriptorCount(5).setType(vk::DescriptorType::eUniformBufferDynamic));
-    poolSizes.push_back(vk::DescriptorPoolSize().setDescriptorCount(1).setType(vk::DescriptorType::eUniformBuffer));
+    maxSets = numMaterials + 8 + Settings::shadowMapCascadeCount + numShadowMaps + 8 * Sync::MAX_FRAMES_IN_FLIGHT;
+    poolSizes.push_back(vk::DescriptorPoolSize()
+                          .setDescriptorCount(5 * Sync::MAX_FRAMES_IN_FLIGHT)
+                          .setType(vk::DescriptorType::eUniformBufferDynamic));
+    poolSizes.push_back(vk::DescriptorPoolSize()
+                          .setDescriptorCount(1 * Sync::MAX_FRAMES_IN_FLIGHT)
+                          .setType(vk::DescriptorType::eUniformBuffer));
   }
+  else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    // all per-frame data lives in a single storage buffer
+    maxSets = numMaterials + 8 + Settings::shadowMapCascadeCount + numShadowMaps + 8 * Sync::MAX_FRAMES_IN_FLIGHT;
+    poolSizes.push_back(vk::DescriptorPoolSize()
+                          .setDescriptorCount(1 * Sync::MAX_FRAMES_IN_FLIGHT)
+                          .setType(vk::DescriptorType::eStorageBuffer));
+  }
+
+  // the culling pass reads and writes up to ten storage buffers and reads the depth pyramid, with one set per frame in
+  // flight
+  maxSets += Sync::MAX_FRAMES_IN_FLIGHT;
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(10 * Sync::MAX_FRAMES_IN_FLIGHT)
+                        .setType(vk::DescriptorType::eStorageBuffer));
+
+  // each level of the depth pyramid is reduced from the one before it, with one set per level
+  maxSets += DepthPyramid::MAX_MIP_LEVELS;
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(DepthPyramid::MAX_MIP_LEVELS + Sync::MAX_FRAMES_IN_FLIGHT)
+                        .setType(vk::DescriptorType::eCombinedImageSampler));
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(DepthPyramid::MAX_MIP_LEVELS)
+                        .setType(vk::DescriptorType::eStorageImage));
+
+  // the depth reduction reads the geometry buffer depth and writes its range, with one set per frame in flight
+  maxSets += Sync::MAX_FRAMES_IN_FLIGHT;
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(Sync::MAX_FRAMES_IN_FLIGHT)
+                        .setType(vk::DescriptorType::eCombinedImageSampler));
+  poolSizes.push_back(vk::DescriptorPoolSize()
+                        .setDescriptorCount(Sync::MAX_FRAMES_IN_FLIGHT)
+                        .setType(vk::DescriptorType::eStorageBuffer));
 
   auto descriptorPoolCreateInfo =
     vk::DescriptorPoolCreateInfo().setMaxSets(maxSets).setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
@@ -81,30 +133,38 @@ vk::DescriptorSetLayout* DescriptorPool::createShadowMapLayout(const std::shared
       vk::DescriptorType::eCombinedImageSampler);
   shadowMapSamplerLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-  auto descriptorSetLayoutCreateInfo =
-    vk::DescriptorSetLayoutCreateInfo().setBindingCount(1).setPBindings(&shadowMapSamplerLayoutBinding);
+  // the regions of the cascades in the shadow atlas
+  auto shadowMapRectsLayoutBinding =
+    vk::DescriptorSetLayoutBinding().setBinding(1).setDescriptorCount(1).setDescriptorType(
+      vk::DescriptorType::eUniformBuffer);
+  shadowMapRectsLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+  std::vector<vk::DescriptorSetLayoutBinding> bindings = { shadowMapSamplerLayoutBinding, shadowMapRectsLayoutBinding };
+  auto descriptorSetLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
+                                         .setBindingCount(static_cast<uint32_t>(bindings.size()))
+                                         .setPBindings(bindings.data());
   return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
 }
 
 vk::DescriptorSetLayout* DescriptorPool::createGeometryBufferLayout(const std::shared_ptr<Context> context)
 {
-  auto albedoSamplerLayoutBinding =
+  auto albedoInputLayoutBinding =
     vk::DescriptorSetLayoutBinding().setBinding(0).setDescriptorCount(1).setDescriptorType(
-      vk::DescriptorType::eCombinedImageSampler);
-  albedoSamplerLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+      vk::DescriptorType::eInputAttachment);
+  albedoInputLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-  auto normalSamplerLayoutBinding =
+  auto normalInputLayoutBinding =
     vk::DescriptorSetLayoutBinding().setBinding(1).setDescriptorCount(1).setDescriptorType(
-      vk::DescriptorType::eCombinedImageSampler);
-  normalSamplerLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+      vk::DescriptorType::eInputAttachment);
+  normalInputLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-  auto depthSamplerLayoutBinding =
+  auto depthInputLayoutBinding =
     vk::DescriptorSetLayoutBinding().setBinding(2).setDescriptorCount(1).setDescriptorType(
-      vk::DescriptorType::eCombinedImageSampler);
-  depthSamplerLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+      vk::DescriptorType::eInputAttachment);
+  depthInputLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-  std::vector<vk::DescriptorSetLayoutBinding> bindings = { albedoSamplerLayoutBinding, normalSamplerLayoutBinding,
-                                                           depthSamplerLayoutBinding };
+  std::vector<vk::DescriptorSetLayoutBinding> bindings = { albedoInputLayoutBinding, normalInputLayoutBinding,
+                                                           depthInputLayoutBinding };
   auto descriptorSetLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
                                          .setBindingCount(static_cast<uint32_t>(bindings.size()))
                                          .setPBindings(bindings.data());
@@ -142,6 +202,71 @@ vk::DescriptorSetLayout* DescriptorPool::createFontLayout(const std::shared_ptr<
   return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
 }
 
+vk::DescriptorSetLayout* DescriptorPool::createCullingLayout(const std::shared_ptr<Context> context,
+                                                             bool occlusionCulling)
+{
+  // mesh instances, world matrices, views, draw commands, visible world matrices and statistics, the materials,
+  // compacted draws and draw counts of the draw compaction, followed by the occluded mesh instances when culling
+  // occlusion
+  const uint32_t numStorageBuffers = occlusionCulling ? 10 : 9;
+  std::vector<vk::DescriptorSetLayoutBinding> bindings;
+  for (uint32_t i = 0; i < numStorageBuffers; ++i)
+  {
+    bindings.push_back(vk::DescriptorSetLayoutBinding().setBinding(i).setDescriptorCount(1).setDescriptorType(
+      vk::DescriptorType::eStorageBuffer));
+    bindings.back().setStageFlags(vk::ShaderStageFlagBits::eCompute);
+  }
+
+  // depth pyramid
+  if (occlusionCulling)
+  {
+    bindings.push_back(
+      vk::DescriptorSetLayoutBinding().setBinding(numStorageBuffers).setDescriptorCount(1).setDescriptorType(
+        vk::DescriptorType::eCombinedImageSampler));
+    bindings.back().setStageFlags(vk::ShaderStageFlagBits::eCompute);
+  }
+
+  auto descriptorSetLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
+                                         .setBindingCount(static_cast<uint32_t>(bindings.size()))
+                                         .setPBindings(bindings.data());
+  return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
+}
+
+vk::DescriptorSetLayout* DescriptorPool::createDepthPyramidLayout(const std::shared_ptr<Context> context)
+{
+  auto sourceLayoutBinding = vk::DescriptorSetLayoutBinding().setBinding(0).setDescriptorCount(1).setDescriptorType(
+    vk::DescriptorType::eCombinedImageSampler);
+  sourceLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+  auto destinationLayoutBinding =
+    vk::DescriptorSetLayoutBinding().setBinding(1).setDescriptorCount(1).setDescriptorType(
+      vk::DescriptorType::eStorageImage);
+  destinationLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+  std::vector<vk::DescriptorSetLayoutBinding> bindings = { sourceLayoutBinding, destinationLayoutBinding };
+  auto descriptorSetLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
+                                         .setBindingCount(static_cast<uint32_t>(bindings.size()))
+                                         .setPBindings(bindings.data());
+  return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
+}
+
+vk::DescriptorSetLayout* DescriptorPool::createDepthReductionLayout(const std::shared_ptr<Context> context)
+{
+  auto depthLayoutBinding = vk::DescriptorSetLayoutBinding().setBinding(0).setDescriptorCount(1).setDescriptorType(
+    vk::DescriptorType::eCombinedImageSampler);
+  depthLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+  auto rangeLayoutBinding = vk::DescriptorSetLayoutBinding().setBinding(1).setDescriptorCount(1).setDescriptorType(
+    vk::DescriptorType::eStorageBuffer);
+  rangeLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+  std::vector<vk::DescriptorSetLayoutBinding> bindings = { depthLayoutBinding, rangeLayoutBinding };
+  auto descriptorSetLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
+                                         .setBindingCount(static_cast<uint32_t>(bindings.size()))
+                                         .setPBindings(bindings.data());
+  return new vk::DescriptorSetLayout(context->getDevice()->createDescriptorSetLayout(descriptorSetLayoutCreateInfo));
+}
+
 DescriptorPool::DescriptorPool(const std::shared_ptr<Context> context, uint32_t numMaterials, uint32_t numShadowMaps)
 {
   this->context = context;
@@ -160,4 +285,14 @@ DescriptorPool::DescriptorPool(const std::shared_ptr<Context> context, uint32_t
                                                                       layoutDeleter);
   fontLayout =
     std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(createFontLayout(context), layoutDeleter);
+  cullingLayout = std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(
+    createCullingLayout(context, false), layoutDeleter);
+  occlusionCullingLayout = std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(
+    createCullingLayout(context, true), layoutDeleter);
+  depthPyramidLayout =
+    std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(createDepthPyramidLayout(context),
+                                                                      layoutDeleter);
+  depthReductionLayout =
+    std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)>(createDepthReductionLayout(context),
+                                                                      layoutDeleter);
 }
\ No newline at end of file
@@ -35,6 +35,15 @@ private:
   static vk::DescriptorSetLayout* createFontLayout(const std::shared_ptr<Context> context);
   std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)> fontLayout;
 
+  static vk::DescriptorSetLayout* createCullingLayout(const std::shared_ptr<Context> context, bool occlusionCulling);
+  std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)> cullingLayout, occlusionCullingLayout;
+
+  static vk::DescriptorSetLayout* createDepthPyramidLayout(const std::shared_ptr<Context> context);
+  std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)> depthPyramidLayout;
+
+  static vk::DescriptorSetLayout* createDepthReductionLayout(const std::shared_ptr<Context> context);
+  std::unique_ptr<vk::DescriptorSetLayout, decltype(layoutDeleter)> depthReductionLayout;
+
 public:
   DescriptorPool(const std::shared_ptr<Context> context, uint32_t numMaterials, uint32_t numShadowMaps);
 
@@ -63,4 +72,20 @@ public:
   {
     return fontLayout.get();
   }
+  vk::DescriptorSetLayout* getCullingLayout() const
+  {
+    return cullingLayout.get();
+  }
+  vk::DescriptorSetLayout* getOcclusionCullingLayout() const
+  {
+    return occlusionCullingLayout.get();
+  }
+  vk::DescriptorSetLayout* getDepthPyramidLayout() const
+  {
+    return depthPyramidLayout.get();
+  }
+  vk::DescriptorSetLayout* getDepthReductionLayout() const
+  {
+    return depthReductionLayout.get();
+  }
 };
\ No newline at end of file
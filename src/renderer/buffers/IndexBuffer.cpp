@@ -10,9 +10,9 @@ void IndexBuffer::finalize(const std::shared_ptr<Context> context)
     buffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eIndexBuffer, size,
                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto memory = context->getDevice()->mapMemory(*buffer->getMemory(), 0, size);
-    memcpy(memory, indices.data(), size);
-    context->getDevice()->unmapMemory(*buffer->getMemory());
+    buffer->mapMemory();
+    memcpy(buffer->getMemoryMappedLocation(), indices.data(), size);
+    buffer->unmapMemory();
   }
   else
   {
@@ -25,9 +25,9 @@ void IndexBuffer::finalize(const std::shared_ptr<Context> context)
     auto stagingBuffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eTransferSrc, size,
                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto memory = context->getDevice()->mapMemory(*stagingBuffer->getMemory(), 0, size);
-    memcpy(memory, indices.data(), size);
-    context->getDevice()->unmapMemory(*stagingBuffer->getMemory());
+    stagingBuffer->mapMemory();
+    memcpy(stagingBuffer->getMemoryMappedLocation(), indices.data(), size);
+    stagingBuffer->unmapMemory();
 
     buffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
@@ -0,0 +1,17 @@
+#include "InstanceBuffer.hpp"
+
+#include <algorithm>
+
+InstanceBuffer::InstanceBuffer(const std::shared_ptr<Context> context, uint32_t numInstances, uint32_t numFrames)
+{
+  // a scene without any instances still needs a valid buffer to bind
+  frameSize = std::max(numInstances, 1u) * sizeof(Instance);
+
+  // the culling pass reads the world matrices as a storage buffer
+  buffer = std::make_unique<Buffer>(context,
+                                    vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                                    frameSize * numFrames,
+                                    vk::MemoryPropertyFlagBits::eHostVisible |
+                                      vk::MemoryPropertyFlagBits::eHostCoherent);
+  buffer->mapMemory();
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Buffer.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+struct Instance
+{
+  glm::mat4 worldMatrix;
+};
+
+// per instance vertex data, bound as a second vertex buffer that advances once per instance instead of once per vertex
+class InstanceBuffer
+{
+private:
+  std::unique_ptr<Buffer> buffer;
+  vk::DeviceSize frameSize;
+
+public:
+  // allocates a separate copy of the data for each of numFrames frames, kept mapped for the lifetime of the buffer
+  InstanceBuffer(const std::shared_ptr<Context> context, uint32_t numInstances, uint32_t numFrames);
+
+  Buffer* getBuffer() const
+  {
+    return buffer.get();
+  }
+  Instance* getInstances(const uint32_t frameIndex) const
+  {
+    return reinterpret_cast<Instance*>(static_cast<char*>(buffer->getMemoryMappedLocation()) +
+                                       getFrameOffset(frameIndex));
+  }
+  vk::DeviceSize getFrameOffset(const uint32_t frameIndex) const
+  {
+    return frameIndex * frameSize;
+  }
+};
\ No newline at end of file
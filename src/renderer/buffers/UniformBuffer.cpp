@@ -1,24 +1,129 @@
 #include "UniformBuffer.hpp"
 
-UniformBuffer::UniformBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size, bool dynamic)
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return alignment > 0 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+} // namespace
+
+Buffer* UniformBuffer::createBuffer(const std::shared_ptr<Context> context,
+                                    vk::DeviceSize size,
+                                    vk::MemoryPropertyFlags memoryPropertyFlags,
+                                    bool storage)
+{
+  auto buffer = new Buffer(context,
+                           storage ? vk::BufferUsageFlagBits::eStorageBuffer : vk::BufferUsageFlagBits::eUniformBuffer,
+                           size, memoryPropertyFlags);
+
+  // host visible memory stays mapped for the lifetime of the buffer
+  buffer->mapMemory();
+  return buffer;
+}
+
+UniformBuffer::UniformBuffer(const std::shared_ptr<Context> context,
+                             vk::DeviceSize size,
+                             bool dynamic,
+                             uint32_t numFrames,
+                             bool storage)
 {
   this->context = context;
   this->dynamic = dynamic;
+  this->storage = storage;
+  this->numFrames = numFrames;
+
+  // every allocation has to start at a valid uniform or storage buffer offset, and every frame for non-coherent memory
+  // also at a valid flush offset
+  const auto limits = context->getPhysicalDevice()->getProperties().limits;
+  allocationAlignment = storage ? limits.minStorageBufferOffsetAlignment : limits.minUniformBufferOffsetAlignment;
+  nonCoherentAtomSize = limits.nonCoherentAtomSize;
+  frameAlignment = allocationAlignment;
+  if (dynamic)
+  {
+    frameAlignment = std::max(frameAlignment, nonCoherentAtomSize);
+  }
 
-  vk::MemoryPropertyFlags memoryPropertyFlagBits =
-    dynamic ? vk::MemoryPropertyFlagBits::eHostVisible :
-              (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-  buffer = std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eUniformBuffer, size, memoryPropertyFlagBits);
+  // an empty region would make for an invalid buffer, for example when there are no shadow maps
+  frameSize = alignUp(std::max(size, vk::DeviceSize(1)), frameAlignment);
+
+  memoryPropertyFlags = dynamic ?
+                          vk::MemoryPropertyFlags(vk::MemoryPropertyFlagBits::eHostVisible) :
+                          (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+  buffer = std::unique_ptr<Buffer>(createBuffer(context, frameSize * numFrames, memoryPropertyFlags, storage));
 
   descriptors = std::make_unique<std::vector<std::unique_ptr<Descriptor>>>();
+
+  frameIndex = 0;
+  frameHead = 0;
+  resized = false;
 }
 
 void UniformBuffer::addDescriptor(const std::shared_ptr<DescriptorPool> descriptorPool,
                                   vk::ShaderStageFlagBits shaderStageFlags,
                                   vk::DeviceSize range)
 {
-  descriptors->push_back(std::make_unique<Descriptor>(context, descriptorPool,
-                                                      dynamic ? vk::DescriptorType::eUniformBufferDynamic :
-                                                                vk::DescriptorType::eUniformBuffer,
-                                                      shaderStageFlags, buffer->getBuffer(), range));
+  auto type = dynamic ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer;
+  if (storage)
+  {
+    type = vk::DescriptorType::eStorageBuffer;
+  }
+
+  descriptors->push_back(std::make_unique<Descriptor>(context, descriptorPool, type, shaderStageFlags,
+                                                      buffer->getBuffer(), range, numFrames, frameSize));
+}
+
+void UniformBuffer::beginFrame(uint32_t frameIndex)
+{
+  this->frameIndex = frameIndex;
+  frameHead = 0;
+  resized = false;
+}
+
+void* UniformBuffer::allocate(vk::DeviceSize size)
+{
+  const auto offset = alignUp(frameHead, allocationAlignment);
+  if (offset + size > frameSize)
+  {
+    grow(offset + size);
+  }
+
+  frameHead = offset + size;
+  return static_cast<char*>(buffer->getMemoryMappedLocation()) + frameIndex * frameSize + offset;
+}
+
+void UniformBuffer::grow(vk::DeviceSize requiredFrameSize)
+{
+  // the old buffer and the descriptor sets of all frames are about to be replaced, so none of them may still be in use
+  context->getQueue().waitIdle();
+
+  const auto oldFrameSize = frameSize;
+  frameSize = alignUp(std::max(requiredFrameSize, frameSize * 2), frameAlignment);
+
+  auto newBuffer = std::unique_ptr<Buffer>(createBuffer(context, frameSize * numFrames, memoryPropertyFlags, storage));
+
+  // keep what the current frame has allocated so far, the other frames write theirs again before they are used
+  memcpy(static_cast<char*>(newBuffer->getMemoryMappedLocation()) + frameIndex * frameSize,
+         static_cast<char*>(buffer->getMemoryMappedLocation()) + frameIndex * oldFrameSize, frameHead);
+  buffer = std::move(newBuffer);
+
+  for (auto& descriptor : *descriptors)
+  {
+    descriptor->update(buffer->getBuffer(), frameSize);
+  }
+
+  resized = true;
+}
+
+vk::MappedMemoryRange UniformBuffer::getMappedMemoryRange() const
+{
+  // the buffer may not start at the beginning of its memory, and an empty range is not a valid flush
+  const auto size = std::min(alignUp(std::max(frameHead, vk::DeviceSize(1)), nonCoherentAtomSize), frameSize);
+  return vk::MappedMemoryRange()
+    .setMemory(*buffer->getMemory())
+    .setOffset(buffer->getMemoryOffset() + frameIndex * frameSize)
+    .setSize(size);
 }
\ No newline at end of file
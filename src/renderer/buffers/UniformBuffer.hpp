@@ -3,21 +3,50 @@
 #include "Buffer.hpp"
 #include "Descriptor.hpp"
 
+// linear upload arena with a separate region for each of numFrames frames, allocations are bumped from the start of
+// the current frame's region so that it can be written to while the GPU still reads the others, optionally backed by a
+// storage buffer for data that is indexed in the shaders instead of selected with dynamic offsets
 class UniformBuffer
 {
 private:
   std::unique_ptr<Buffer> buffer;
   std::unique_ptr<std::vector<std::unique_ptr<Descriptor>>> descriptors;
   std::shared_ptr<Context> context;
-  bool dynamic;
+  bool dynamic, storage;
+  uint32_t numFrames;
+  vk::MemoryPropertyFlags memoryPropertyFlags;
+  vk::DeviceSize allocationAlignment, frameAlignment, nonCoherentAtomSize;
+  vk::DeviceSize frameSize;
+
+  uint32_t frameIndex;
+  vk::DeviceSize frameHead;
+  bool resized;
+
+  static Buffer* createBuffer(const std::shared_ptr<Context> context,
+                              vk::DeviceSize size,
+                              vk::MemoryPropertyFlags memoryPropertyFlags,
+                              bool storage);
+
+  void grow(vk::DeviceSize requiredFrameSize);
 
 public:
-  UniformBuffer(const std::shared_ptr<Context> context, vk::DeviceSize size, bool dynamic);
+  // size is only the initial size of each frame's region, which grows when a frame allocates more than that
+  UniformBuffer(const std::shared_ptr<Context> context,
+                vk::DeviceSize size,
+                bool dynamic,
+                uint32_t numFrames = 1,
+                bool storage = false);
 
   void addDescriptor(const std::shared_ptr<DescriptorPool> descriptorPool,
                      vk::ShaderStageFlagBits shaderStageFlags,
                      vk::DeviceSize range);
 
+  // discards the previous allocations of the frame
+  void beginFrame(uint32_t frameIndex);
+  // the returned memory starts at a valid dynamic offset, which is the same for the same sequence of allocations in
+  // every frame
+  void* allocate(vk::DeviceSize size);
+
   Buffer* getBuffer() const
   {
     return buffer.get();
@@ -26,4 +55,11 @@ public:
   {
     return descriptors->at(index).get();
   }
+  // growing rewrites the descriptor sets, so command buffers recorded with them have to be recorded again
+  bool wasResized() const
+  {
+    return resized;
+  }
+  // covers exactly what was allocated in the current frame, rounded up to a valid flush size
+  vk::MappedMemoryRange getMappedMemoryRange() const;
 };
\ No newline at end of file
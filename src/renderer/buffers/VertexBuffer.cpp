@@ -1,18 +1,57 @@
 #include "VertexBuffer.hpp"
 #include "renderer/Settings.hpp"
 
-void VertexBuffer::finalize(const std::shared_ptr<Context> context)
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+// folds the unit sphere onto the octahedron and unfolds its lower half into the corners of the square
+glm::vec2 encodeOctahedral(const glm::vec3& vector)
 {
-  vk::DeviceSize size = sizeof(vertices[0]) * vertices.size();
+  const auto length = glm::abs(vector.x) + glm::abs(vector.y) + glm::abs(vector.z);
+  if (length <= 0.0f)
+  {
+    return glm::vec2(0.0f);
+  }
+
+  auto encoded = glm::vec2(vector.x, vector.y) / length;
+  if (vector.z < 0.0f)
+  {
+    const auto sign = glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+    encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+  }
+
+  return encoded;
+}
+
+// copies one member out of every vertex into a tightly packed array
+template <typename VertexType, typename MemberType>
+std::vector<MemberType> deinterleave(const std::vector<VertexType>& vertices, MemberType VertexType::*member)
+{
+  std::vector<MemberType> stream;
+  stream.reserve(vertices.size());
+  for (const auto& vertex : vertices)
+  {
+    stream.push_back(vertex.*member);
+  }
+
+  return stream;
+}
+} // namespace
+
+std::unique_ptr<Buffer>
+VertexBuffer::upload(const std::shared_ptr<Context> context, const void* data, vk::DeviceSize size)
+{
+  std::unique_ptr<Buffer> buffer;
 
   if (!Settings::vertexIndexBufferStaging)
   {
     buffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eVertexBuffer, size,
                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto memory = context->getDevice()->mapMemory(*buffer->getMemory(), 0, size);
-    memcpy(memory, vertices.data(), size);
-    context->getDevice()->unmapMemory(*buffer->getMemory());
+    buffer->mapMemory();
+    memcpy(buffer->getMemoryMappedLocation(), data, size);
+    buffer->unmapMemory();
   }
   else
   {
@@ -25,9 +64,9 @@ void VertexBuffer::finalize(const std::shared_ptr<Context> context)
     auto stagingBuffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eTransferSrc, size,
                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto memory = context->getDevice()->mapMemory(*stagingBuffer->getMemory(), 0, size);
-    memcpy(memory, vertices.data(), size);
-    context->getDevice()->unmapMemory(*stagingBuffer->getMemory());
+    stagingBuffer->mapMemory();
+    memcpy(stagingBuffer->getMemoryMappedLocation(), data, size);
+    stagingBuffer->unmapMemory();
 
     buffer =
       std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
@@ -40,4 +79,56 @@ void VertexBuffer::finalize(const std::shared_ptr<Context> context)
     context->getQueue().waitIdle();
     context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
   }
+
+  return buffer;
+}
+
+void VertexBuffer::finalize(const std::shared_ptr<Context> context)
+{
+  const auto positions = deinterleave(vertices, &Vertex::position);
+  const auto attributes = deinterleave(vertices, &Vertex::attributes);
+  positionBuffer = upload(context, positions.data(), sizeof(positions[0]) * positions.size());
+  attributeBuffer = upload(context, attributes.data(), sizeof(attributes[0]) * attributes.size());
+
+  // only scene models are compressed, so this stays empty when vertex compression is disabled
+  if (!compressedVertices.empty())
+  {
+    const auto compressedPositions = deinterleave(compressedVertices, &CompressedVertex::position);
+    const auto compressedAttributes = deinterleave(compressedVertices, &CompressedVertex::attributes);
+    compressedPositionBuffer =
+      upload(context, compressedPositions.data(), sizeof(compressedPositions[0]) * compressedPositions.size());
+    compressedAttributeBuffer =
+      upload(context, compressedAttributes.data(), sizeof(compressedAttributes[0]) * compressedAttributes.size());
+  }
+}
+
+CompressedVertex
+VertexBuffer::compressVertex(const Vertex& vertex, const glm::vec3& boundsMin, const glm::vec3& boundsExtent)
+{
+  CompressedVertex compressedVertex;
+
+  for (glm::length_t i = 0; i < 3; ++i)
+  {
+    const auto position = boundsExtent[i] > 0.0f ? (vertex.position[i] - boundsMin[i]) / boundsExtent[i] : 0.0f;
+    compressedVertex.position[i] = glm::packUnorm1x16(position);
+  }
+
+  // a mirrored tangent frame has a bitangent pointing the other way than the cross product of normal and tangent
+  const auto& attributes = vertex.attributes;
+  const auto handedness = glm::dot(glm::cross(attributes.normal, attributes.tangent), attributes.bitangent);
+  compressedVertex.position[3] = handedness < 0.0f ? 0 : 65535;
+
+  auto& compressedAttributes = compressedVertex.attributes;
+  compressedAttributes.texCoord[0] = glm::packHalf1x16(attributes.texCoord.x);
+  compressedAttributes.texCoord[1] = glm::packHalf1x16(attributes.texCoord.y);
+
+  const auto normal = encodeOctahedral(attributes.normal);
+  const auto tangent = encodeOctahedral(attributes.tangent);
+  for (glm::length_t i = 0; i < 2; ++i)
+  {
+    compressedAttributes.normal[i] = static_cast<int16_t>(glm::packSnorm1x16(normal[i]));
+    compressedAttributes.tangent[i] = static_cast<int16_t>(glm::packSnorm1x16(tangent[i]));
+  }
+
+  return compressedVertex;
 }
\ No newline at end of file
@@ -5,31 +5,77 @@
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
 
-struct Vertex
+// everything but the position, uploaded as a separate stream so that passes which only need positions skip it
+struct VertexAttributes
 {
-  glm::vec3 position;
   glm::vec2 texCoord;
   glm::vec3 normal;
   glm::vec3 tangent;
   glm::vec3 bitangent;
 };
 
+struct Vertex
+{
+  glm::vec3 position;
+  VertexAttributes attributes;
+};
+
+struct CompressedVertexAttributes
+{
+  uint16_t texCoord[2]; // half precision
+  int16_t normal[2], tangent[2]; // snorm octahedral, the bitangent is rebuilt from these and the handedness
+};
+
+// 20 byte alternative to the full vertex, decoded in the vertex shader with the bounds of the mesh it belongs to
+struct CompressedVertex
+{
+  glm::u16vec4 position; // unorm relative to the mesh bounds, w holds the handedness of the tangent frame
+  CompressedVertexAttributes attributes;
+};
+
+// vertices are kept interleaved on the host so that models can be spliced in one piece, and only get split into a
+// position and an attribute stream when they are uploaded
 class VertexBuffer
 {
 private:
   std::vector<Vertex> vertices;
-  std::unique_ptr<Buffer> buffer;
+  std::unique_ptr<Buffer> positionBuffer, attributeBuffer;
+
+  std::vector<CompressedVertex> compressedVertices;
+  std::unique_ptr<Buffer> compressedPositionBuffer, compressedAttributeBuffer;
+
+  static std::unique_ptr<Buffer> upload(const std::shared_ptr<Context> context, const void* data, vk::DeviceSize size);
 
 public:
   void finalize(const std::shared_ptr<Context> context);
 
+  static CompressedVertex
+  compressVertex(const Vertex& vertex, const glm::vec3& boundsMin, const glm::vec3& boundsExtent);
+
   std::vector<Vertex>* getVertices()
   {
     return &vertices;
   }
-  Buffer* getBuffer() const
+  Buffer* getPositionBuffer() const
+  {
+    return positionBuffer.get();
+  }
+  Buffer* getAttributeBuffer() const
+  {
+    return attributeBuffer.get();
+  }
+  std::vector<CompressedVertex>* getCompressedVertices()
+  {
+    return &compressedVertices;
+  }
+  Buffer* getCompressedPositionBuffer() const
+  {
+    return compressedPositionBuffer.get();
+  }
+  Buffer* getCompressedAttributeBuffer() const
   {
-    return buffer.get();
+    return compressedAttributeBuffer.get();
   }
 };
\ No newline at end of file
@@ -47,11 +47,8 @@ vk::Pipeline* CompositePipeline::createPipeline(const std::shared_ptr<Window> wi
     vertexShader.getPipelineShaderStageCreateInfo(), fragmentShaderStageCreateInfo
   };
 
-  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex));
-  auto position = vk::VertexInputAttributeDescription()
-                    .setLocation(0)
-                    .setFormat(vk::Format::eR32G32B32Sfloat)
-                    .setOffset(offsetof(Vertex, position));
+  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex::position));
+  auto position = vk::VertexInputAttributeDescription().setLocation(0).setFormat(vk::Format::eR32G32B32Sfloat);
   auto vertexInputStateCreateInfo =
     vk::PipelineVertexInputStateCreateInfo().setVertexBindingDescriptionCount(1).setPVertexBindingDescriptions(
       &vertexInputBindingDescription);
@@ -1,4 +1,6 @@
 #include "Swapchain.hpp"
+#include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
 
 vk::SwapchainKHR* Swapchain::oldSwapchain = nullptr;
 std::vector<vk::Framebuffer>* Swapchain::oldFramebuffers = nullptr;
@@ -83,6 +85,27 @@ vk::SwapchainKHR* Swapchain::createSwapchain(const std::shared_ptr<Window> windo
   return oldSwapchain;
 }
 
+vk::Image* Swapchain::createOffscreenImage(const std::shared_ptr<Context> context, const vk::Extent2D swapchainExtent)
+{
+  auto imageCreateInfo = vk::ImageCreateInfo()
+                           .setImageType(vk::ImageType::e2D)
+                           .setExtent(vk::Extent3D(swapchainExtent.width, swapchainExtent.height, 1))
+                           .setMipLevels(1)
+                           .setArrayLayers(1);
+  imageCreateInfo.setFormat(vk::Format::eB8G8R8A8Unorm)
+    .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc);
+  auto image = context->getDevice()->createImage(imageCreateInfo);
+  return new vk::Image(image);
+}
+
+MemoryAllocator::Allocation* Swapchain::createOffscreenImageMemory(const std::shared_ptr<Context> context,
+                                                                   const vk::Image* image,
+                                                                   vk::MemoryPropertyFlags memoryPropertyFlags)
+{
+  return context->getMemoryAllocator()->allocateForImage(*image, memoryPropertyFlags,
+                                                         MemoryAllocator::Placement::General, true);
+}
+
 std::vector<vk::Image>* Swapchain::getImages(const std::shared_ptr<Context> context, const vk::SwapchainKHR* swapchain)
 {
   auto swapchainImages = context->getDevice()->getSwapchainImagesKHR(*swapchain);
@@ -112,7 +135,7 @@ vk::RenderPass* Swapchain::createRenderPass(const std::shared_ptr<Context> conte
     vk::AttachmentDescription().setFormat(vk::Format::eB8G8R8A8Unorm).setLoadOp(vk::AttachmentLoadOp::eClear);
   colorAttachmentDescription.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
     .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-    .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+    .setFinalLayout(Settings::headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
   auto colorAttachmentReference =
     vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
 
@@ -158,10 +181,10 @@ std::vector<vk::Framebuffer>* Swapchain::createFramebuffers(const std::shared_pt
   return oldFramebuffers;
 }
 
-std::vector<vk::CommandBuffer>* Swapchain::createCommandBuffers(const std::shared_ptr<Context> context,
-                                                                const std::vector<vk::Framebuffer>* framebuffers)
+std::vector<vk::CommandBuffer>* Swapchain::createCommandBuffers(const std::shared_ptr<Context> context)
 {
-  auto commandBuffers = std::vector<vk::CommandBuffer>(framebuffers->size());
+  // recorded every frame, so one per frame in flight is enough regardless of the number of swapchain images
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
   auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
                                      .setCommandPool(*context->getCommandPoolRepeat())
                                      .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
@@ -180,17 +203,34 @@ Swapchain::Swapchain(const std::shared_ptr<Window> window, const std::shared_ptr
   this->context = context;
   this->window = window;
 
-  swapchain =
-    std::unique_ptr<vk::SwapchainKHR, decltype(swapchainDeleter)>(createSwapchain(window, context, swapchainExtent),
-                                                                  swapchainDeleter);
+  if (Settings::headless)
+  // render into a single offscreen image instead of presenting to a surface
+  {
+    swapchainExtent = vk::Extent2D(window->getWidth(), window->getHeight());
+
+    offscreenImage = std::unique_ptr<vk::Image, decltype(offscreenImageDeleter)>(
+      createOffscreenImage(context, swapchainExtent), offscreenImageDeleter);
+    offscreenImageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(offscreenImageMemoryDeleter)>(
+      createOffscreenImageMemory(context, offscreenImage.get(), vk::MemoryPropertyFlagBits::eDeviceLocal),
+      offscreenImageMemoryDeleter);
 
-  if (!swapchain)
+    images = std::make_unique<std::vector<vk::Image>>(1, *offscreenImage);
+  }
+  else
   {
-    // this means we minimized the window and there is nothing to render
-    return;
+    swapchain =
+      std::unique_ptr<vk::SwapchainKHR, decltype(swapchainDeleter)>(createSwapchain(window, context, swapchainExtent),
+                                                                    swapchainDeleter);
+
+    if (!swapchain)
+    {
+      // this means we minimized the window and there is nothing to render
+      return;
+    }
+
+    images = std::unique_ptr<std::vector<vk::Image>>(getImages(context, swapchain.get()));
   }
 
-  images = std::unique_ptr<std::vector<vk::Image>>(getImages(context, swapchain.get()));
   imageViews =
     std::unique_ptr<std::vector<vk::ImageView>, decltype(imageViewsDeleter)>(createImageViews(context, images.get()),
                                                                              imageViewsDeleter);
@@ -199,16 +239,21 @@ Swapchain::Swapchain(const std::shared_ptr<Window> window, const std::shared_ptr
     std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(createRenderPass(context), renderPassDeleter);
   framebuffers = std::unique_ptr<std::vector<vk::Framebuffer>, decltype(framebuffersDeleter)>(
     createFramebuffers(context, renderPass.get(), imageViews.get(), swapchainExtent), framebuffersDeleter);
-  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context, framebuffers.get()));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context));
 }
 
-void Swapchain::recordCommandBuffers(const std::shared_ptr<CompositePipeline> compositePipeline,
-                                     const std::shared_ptr<LightingBuffer> lightingBuffer,
-                                     const std::shared_ptr<VertexBuffer> vertexBuffer,
-                                     const std::shared_ptr<IndexBuffer> indexBuffer,
-                                     const std::shared_ptr<Model> unitQuadModel,
-                                     const std::shared_ptr<UI> ui)
+void Swapchain::recordCommandBuffer(uint32_t frameIndex,
+                                    uint32_t imageIndex,
+                                    const std::shared_ptr<CompositePipeline> compositePipeline,
+                                    const std::shared_ptr<LightingBuffer> lightingBuffer,
+                                    const std::shared_ptr<VertexBuffer> vertexBuffer,
+                                    const std::shared_ptr<IndexBuffer> indexBuffer,
+                                    const std::shared_ptr<Model> unitQuadModel,
+                                    const std::shared_ptr<UI> ui)
 {
+  auto commandBuffer = commandBuffers->at(frameIndex);
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+
   auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
 
   std::array<float, 4> clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -220,36 +265,31 @@ void Swapchain::recordCommandBuffers(const std::shared_ptr<CompositePipeline> co
 
   renderPassBeginInfo.setClearValueCount(static_cast<uint32_t>(clearValues.size())).setPClearValues(clearValues.data());
 
-  for (size_t i = 0; i < commandBuffers->size(); ++i)
-  {
-    auto commandBuffer = commandBuffers->at(i);
-
-    commandBuffer.begin(commandBufferBeginInfo);
+  commandBuffer.begin(commandBufferBeginInfo);
 
-    commandBuffer.resetQueryPool(*context->getQueryPool(), 6, 2);
-    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), 6);
+  commandBuffer.resetQueryPool(*context->getQueryPool(), queryOffset + 6, 2);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), queryOffset + 6);
 
-    renderPassBeginInfo.setFramebuffer(framebuffers->at(i));
-    commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+  renderPassBeginInfo.setFramebuffer(framebuffers->at(imageIndex));
+  commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
 
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *compositePipeline->getPipeline());
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *compositePipeline->getPipeline());
 
-    VkDeviceSize offsets[] = { 0 };
-    commandBuffer.bindVertexBuffers(0, 1, vertexBuffer->getBuffer()->getBuffer(), offsets);
-    commandBuffer.bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
+  VkDeviceSize offsets[] = { 0 };
+  commandBuffer.bindVertexBuffers(0, 1, vertexBuffer->getPositionBuffer()->getBuffer(), offsets);
+  commandBuffer.bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
 
-    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *compositePipeline->getPipelineLayout(), 0, 1,
-                                     lightingBuffer->getDescriptorSet(), 0, nullptr);
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *compositePipeline->getPipelineLayout(), 0, 1,
+                                   lightingBuffer->getDescriptorSet(), 0, nullptr);
 
-    auto mesh = unitQuadModel->getMeshes()->at(0);
-    commandBuffer.drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+  auto mesh = unitQuadModel->getMeshes()->at(0);
+  commandBuffer.drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
 
-    ui->render(&commandBuffer);
+  ui->render(&commandBuffer, frameIndex);
 
-    commandBuffer.endRenderPass();
+  commandBuffer.endRenderPass();
 
-    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), 7);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), queryOffset + 7);
 
-    commandBuffer.end();
-  }
+  commandBuffer.end();
 }
\ No newline at end of file
@@ -30,6 +30,23 @@ private:
   };
   std::unique_ptr<vk::SwapchainKHR, decltype(swapchainDeleter)> swapchain;
 
+  static vk::Image* createOffscreenImage(const std::shared_ptr<Context> context, const vk::Extent2D swapchainExtent);
+  std::function<void(vk::Image*)> offscreenImageDeleter = [this](vk::Image* offscreenImage) {
+    if (context->getDevice())
+      context->getDevice()->destroyImage(*offscreenImage);
+  };
+  std::unique_ptr<vk::Image, decltype(offscreenImageDeleter)> offscreenImage;
+
+  static MemoryAllocator::Allocation* createOffscreenImageMemory(const std::shared_ptr<Context> context,
+                                                                 const vk::Image* image,
+                                                                 vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(MemoryAllocator::Allocation*)> offscreenImageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* offscreenImageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(offscreenImageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(offscreenImageMemoryDeleter)> offscreenImageMemory;
+
   static std::vector<vk::Image>* getImages(const std::shared_ptr<Context> context, const vk::SwapchainKHR* swapchain);
   std::unique_ptr<std::vector<vk::Image>> images;
 
@@ -65,19 +82,20 @@ private:
     };
   std::unique_ptr<std::vector<vk::Framebuffer>, decltype(framebuffersDeleter)> framebuffers;
 
-  static std::vector<vk::CommandBuffer>*
-  createCommandBuffers(const std::shared_ptr<Context> context, const std::vector<vk::Framebuffer>* framebuffers);
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context);
   std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers;
 
 public:
   Swapchain(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context);
 
-  void recordCommandBuffers(const std::shared_ptr<CompositePipeline> compositePipeline,
-                            const std::shared_ptr<LightingBuffer> lightingBuffer,
-                            const std::shared_ptr<VertexBuffer> vertexBuffer,
-                            const std::shared_ptr<IndexBuffer> indexBuffer,
-                            const std::shared_ptr<Model> unitQuadModel,
-                            const std::shared_ptr<UI> ui);
+  void recordCommandBuffer(uint32_t frameIndex,
+                           uint32_t imageIndex,
+                           const std::shared_ptr<CompositePipeline> compositePipeline,
+                           const std::shared_ptr<LightingBuffer> lightingBuffer,
+                           const std::shared_ptr<VertexBuffer> vertexBuffer,
+                           const std::shared_ptr<IndexBuffer> indexBuffer,
+                           const std::shared_ptr<Model> unitQuadModel,
+                           const std::shared_ptr<UI> ui);
 
   vk::Extent2D getSwapchainExtent() const
   {
@@ -91,8 +109,8 @@ public:
   {
     return renderPass.get();
   }
-  vk::CommandBuffer* getCommandBuffer(const uint32_t index) const
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
   {
-    return &commandBuffers.get()->at(index);
+    return &commandBuffers.get()->at(frameIndex);
   }
 };
\ No newline at end of file
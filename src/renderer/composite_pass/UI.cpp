@@ -1,6 +1,7 @@
 #include "UI.hpp"
 #include "renderer/Settings.hpp"
 #include "renderer/Shader.hpp"
+#include "renderer/Sync.hpp"
 #include "renderer/buffers/Buffer.hpp"
 
 #include <fstream>
@@ -19,11 +20,16 @@ float UI::mipLoadBias = Settings::mipLoadBias;
 bool UI::reuseCommandBuffers = Settings::reuseCommandBuffers;
 bool UI::transientCommandPool = Settings::transientCommandPool;
 bool UI::vertexIndexBufferStaging = Settings::vertexIndexBufferStaging;
-bool UI::keepUniformBufferMemoryMapped = Settings::keepUniformBufferMemoryMapped;
 int UI::dynamicUniformBufferStrategy = Settings::dynamicUniformBufferStrategy;
 bool UI::flushDynamicUniformBufferMemoryIndividually = Settings::flushDynamicUniformBufferMemoryIndividually;
 int UI::shadowMapResolution = Settings::shadowMapResolution;
 int UI::shadowMapCascadeCount = Settings::shadowMapCascadeCount;
+int UI::shadowAtlasResolution = Settings::shadowAtlasResolution;
+bool UI::shadowCaching = Settings::shadowCaching;
+float UI::shadowCacheThreshold = Settings::shadowCacheThreshold;
+int UI::shadowFarCascadeInterval = Settings::shadowFarCascadeInterval;
+bool UI::shadowSinglePass = Settings::shadowSinglePass;
+bool UI::shadowSampleDistribution = Settings::shadowSampleDistribution;
 float UI::shadowBias = Settings::shadowBias;
 int UI::shadowFilterRange = Settings::shadowFilterRange;
 float UI::bloomThreshold = Settings::bloomThreshold;
@@ -46,37 +52,12 @@ vk::Buffer* UI::createBuffer(const std::shared_ptr<Context> context, vk::DeviceS
   return new vk::Buffer(buffer);
 }
 
-vk::DeviceMemory* UI::createBufferMemory(const std::shared_ptr<Context> context,
-                                         const vk::Buffer* buffer,
-                                         vk::DeviceSize size,
-                                         vk::MemoryPropertyFlags memoryPropertyFlags)
+MemoryAllocator::Allocation* UI::createBufferMemory(const std::shared_ptr<Context> context,
+                                                    const vk::Buffer* buffer,
+                                                    vk::DeviceSize size,
+                                                    vk::MemoryPropertyFlags memoryPropertyFlags)
 {
-  auto memoryRequirements = context->getDevice()->getBufferMemoryRequirements(*buffer);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for buffer.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindBufferMemory(*buffer, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
+  return context->getMemoryAllocator()->allocateForBuffer(*buffer, memoryPropertyFlags);
 }
 
 vk::Image* UI::createFontImage(const std::shared_ptr<Context> context, uint32_t width, uint32_t height)
@@ -93,36 +74,11 @@ vk::Image* UI::createFontImage(const std::shared_ptr<Context> context, uint32_t
   return new vk::Image(image);
 }
 
-vk::DeviceMemory* UI::createFontImageMemory(const std::shared_ptr<Context> context,
-                                            const vk::Image* image,
-                                            vk::MemoryPropertyFlags memoryPropertyFlags)
+MemoryAllocator::Allocation* UI::createFontImageMemory(const std::shared_ptr<Context> context,
+                                                       const vk::Image* image,
+                                                       vk::MemoryPropertyFlags memoryPropertyFlags)
 {
-  auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(*image);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for font image.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindImageMemory(*image, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
+  return context->getMemoryAllocator()->allocateForImage(*image, memoryPropertyFlags);
 }
 
 vk::ImageView* UI::createFontImageView(const std::shared_ptr<Context> context, const vk::Image* image)
@@ -337,8 +293,15 @@ void UI::controlsFrame(const std::shared_ptr<Input> input, const std::shared_ptr
   }
 }
 
-void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_ptr<Camera> camera, float delta)
+void UI::statisticsFrame(const std::shared_ptr<Input> input,
+                         const std::shared_ptr<Camera> camera,
+                         const std::vector<std::shared_ptr<Light>>& lightList,
+                         const CullingStatistics& cullingStatistics,
+                         float delta,
+                         uint32_t frameIndex)
 {
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+
   const auto distance = 10.0f;
   ImGui::SetNextWindowPos(ImVec2(distance, distance), ImGuiCond_Always, ImVec2(0.0f, 0.0f));
   ImGui::SetNextWindowBgAlpha(0.3f);
@@ -378,9 +341,9 @@ void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_p
     // shadow pass time
     {
       uint32_t begin = 0, end = 0;
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 0, 1, sizeof(uint32_t), &begin, 0,
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset, 1, sizeof(uint32_t), &begin, 0,
                                                 vk::QueryResultFlagBits());
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 1, 1, sizeof(uint32_t), &end, 0,
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 1, 1, sizeof(uint32_t), &end, 0,
                                                 vk::QueryResultFlagBits());
       auto shadowPassDelta = end - begin;
 
@@ -401,9 +364,9 @@ void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_p
     // geometry pass time
     {
       uint32_t begin = 0, end = 0;
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 2, 1, sizeof(uint32_t), &begin, 0,
-                                                vk::QueryResultFlagBits());
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 3, 1, sizeof(uint32_t), &end, 0,
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 2, 1, sizeof(uint32_t), &begin,
+                                                0, vk::QueryResultFlagBits());
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 3, 1, sizeof(uint32_t), &end, 0,
                                                 vk::QueryResultFlagBits());
       auto geometryPassDelta = end - begin;
 
@@ -424,9 +387,9 @@ void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_p
     // lighting pass time
     {
       uint32_t begin = 0, end = 0;
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 4, 1, sizeof(uint32_t), &begin, 0,
-                                                vk::QueryResultFlagBits());
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 5, 1, sizeof(uint32_t), &end, 0,
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 4, 1, sizeof(uint32_t), &begin,
+                                                0, vk::QueryResultFlagBits());
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 5, 1, sizeof(uint32_t), &end, 0,
                                                 vk::QueryResultFlagBits());
       auto lightingPassDelta = end - begin;
 
@@ -447,9 +410,9 @@ void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_p
     // composite pass time
     {
       uint32_t begin = 0, end = 0;
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 6, 1, sizeof(uint32_t), &begin, 0,
-                                                vk::QueryResultFlagBits());
-      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 7, 1, sizeof(uint32_t), &end, 0,
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 6, 1, sizeof(uint32_t), &begin,
+                                                0, vk::QueryResultFlagBits());
+      context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 7, 1, sizeof(uint32_t), &end, 0,
                                                 vk::QueryResultFlagBits());
       auto compositePassDelta = end - begin;
 
@@ -464,6 +427,67 @@ void UI::statisticsFrame(const std::shared_ptr<Input> input, const std::shared_p
       s << static_cast<int>(max) << " ms";
       ImGui::PlotLines(s.str().c_str(), &compositePassTime[0], 50, 0, "", 0.0f, max, ImVec2(0, 80));
     }
+
+    ImGui::Separator();
+
+    // device memory
+    {
+      const auto statistics = context->getMemoryAllocator()->getStatistics();
+      const auto toMegabytes = [](vk::DeviceSize bytes) { return static_cast<float>(bytes) / (1024.0f * 1024.0f); };
+
+      ImGui::Text("Memory blocks: %u (%.1f MB)", statistics.numBlocks, toMegabytes(statistics.blockBytes));
+      ImGui::Text("Memory used: %.1f MB in %u allocations", toMegabytes(statistics.usedBytes),
+                  statistics.numAllocations);
+      ImGui::Text("Memory dedicated: %.1f MB in %u allocations", toMegabytes(statistics.dedicatedBytes),
+                  statistics.numDedicatedAllocations);
+      ImGui::Text("Memory fragmentation: %.0f%%", statistics.fragmentation * 100.0f);
+    }
+
+    ImGui::Separator();
+
+    // culling
+    {
+      ImGui::Text("Mesh instances: %u", cullingStatistics.numMeshInstances);
+      ImGui::Text("Frustum culled: %u", cullingStatistics.frustumCulled);
+      ImGui::Text("Occlusion culled: %u (%u disoccluded)", cullingStatistics.occlusionCulled,
+                  cullingStatistics.disoccluded);
+      if (cullingStatistics.occlusionRasterizerTime > 0.0f)
+      {
+        ImGui::Text("Occlusion rasterizer time: %.2f ms", cullingStatistics.occlusionRasterizerTime);
+      }
+      if (cullingStatistics.boundingVolumeHierarchyTime > 0.0f)
+      {
+        ImGui::Text("Lights culled: %u", cullingStatistics.lightsCulled);
+        ImGui::Text("Bounding volume hierarchy time: %.2f ms", cullingStatistics.boundingVolumeHierarchyTime);
+      }
+    }
+
+    // shadow caching, averaged over the lights with shadow maps
+    if (Settings::shadowCaching)
+    {
+      ImGui::Separator();
+
+      std::vector<float> cachedRates(Settings::shadowMapCascadeCount), skippedRates(Settings::shadowMapCascadeCount);
+      uint32_t numShadowMaps = 0;
+      for (const auto& light : lightList)
+      {
+        if (light->shadowMap)
+        {
+          for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+          {
+            cachedRates[i] += light->shadowMap->getCachedRates().at(i);
+            skippedRates[i] += light->shadowMap->getSkippedRates().at(i);
+          }
+          ++numShadowMaps;
+        }
+      }
+
+      for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+      {
+        const auto scale = 100.0f / static_cast<float>(std::max(numShadowMaps, 1u));
+        ImGui::Text("Cascade %d: %.0f%% cached, %.0f%% skipped", i, cachedRates[i] * scale, skippedRates[i] * scale);
+      }
+    }
   }
 
   ImGui::End();
@@ -743,9 +767,9 @@ bool UI::benchmarkFrame(const std::shared_ptr<Input> input, const std::shared_pt
     if (ImGui::CollapsingHeader("Memory Management"))
     {
       ImGui::Checkbox("Stage vertex and index buffers", &vertexIndexBufferStaging);
-      ImGui::Checkbox("Keep uniform buffer memory mapped", &keepUniformBufferMemoryMapped);
 
-      ImGui::Combo("Dynamic uniform buffer strategy", &dynamicUniformBufferStrategy, "Individual\0Global\0");
+      ImGui::Combo("Dynamic uniform buffer strategy", &dynamicUniformBufferStrategy,
+                   "Individual\0Global\0Superglobal\0");
       if (ImGui::IsItemHovered())
       {
         std::string tooltip = "The individual dynamic uniform buffer strategy uses\n";
@@ -753,7 +777,10 @@ bool UI::benchmarkFrame(const std::shared_ptr<Input> input, const std::shared_pt
         tooltip = tooltip.append("data (shadow map split depth, shadow map cascade\n");
         tooltip = tooltip.append("view and projection matrices, geometry world matrices\n");
         tooltip = tooltip.append("and so on). The global strategy uses only one dynamic\n");
-        tooltip = tooltip.append("uniform buffer and stores all data there, sequentially.");
+        tooltip = tooltip.append("uniform buffer and stores all data there, sequentially.\n");
+        tooltip = tooltip.append("The superglobal strategy stores all data of a frame,\n");
+        tooltip = tooltip.append("including the camera, in one storage buffer that is\n");
+        tooltip = tooltip.append("bound once per pass and indexed with push constants.");
         ImGui::SetTooltip(tooltip.c_str());
       }
 
@@ -767,6 +794,49 @@ bool UI::benchmarkFrame(const std::shared_ptr<Input> input, const std::shared_pt
     {
       ImGui::SliderInt("Resolution", &shadowMapResolution, 64, 16384);
       ImGui::SliderInt("Cascade count", &shadowMapCascadeCount, 1, 16);
+      ImGui::SliderInt("Atlas resolution", &shadowAtlasResolution, 1024, 16384);
+      if (ImGui::IsItemHovered())
+      {
+        std::string tooltip = "All shadow maps share one atlas of this resolution.\n";
+        tooltip = tooltip.append("Every two cascades halve the resolution above, and all\n");
+        tooltip = tooltip.append("cascades are halved again until they fit the atlas.");
+        ImGui::SetTooltip(tooltip.c_str());
+      }
+      ImGui::Checkbox("Cache static casters", &shadowCaching);
+      if (ImGui::IsItemHovered())
+      {
+        std::string tooltip = "Casters that have not moved for a while are drawn into\n";
+        tooltip = tooltip.append("a copy of each cascade, which is copied back every frame\n");
+        tooltip = tooltip.append("before only the moving casters are drawn on top.");
+        ImGui::SetTooltip(tooltip.c_str());
+      }
+      if (shadowCaching)
+      {
+        ImGui::SliderFloat("Cache threshold (texels)", &shadowCacheThreshold, 0.0f, 16.0f, "%.1f");
+        ImGui::SliderInt("Far cascade interval", &shadowFarCascadeInterval, 1, 16);
+        if (ImGui::IsItemHovered())
+        {
+          std::string tooltip = "The far half of the cascades is only drawn every this\n";
+          tooltip = tooltip.append("many frames and keeps its depth in between.");
+          ImGui::SetTooltip(tooltip.c_str());
+        }
+      }
+      ImGui::Checkbox("Draw cascades in one pass", &shadowSinglePass);
+      if (ImGui::IsItemHovered())
+      {
+        std::string tooltip = "Every mesh is drawn once into all cascades, with one\n";
+        tooltip = tooltip.append("instance per cascade it is visible to. Needs a device\n");
+        tooltip = tooltip.append("that can pick the viewport in the vertex shader.");
+        ImGui::SetTooltip(tooltip.c_str());
+      }
+      ImGui::Checkbox("Fit to visible depth", &shadowSampleDistribution);
+      if (ImGui::IsItemHovered())
+      {
+        std::string tooltip = "The cascades are split between the nearest and farthest
+";
+        tooltip = tooltip.append("depth visible a few frames ago instead of the whole view.");
+        ImGui::SetTooltip(tooltip.c_str());
+      }
       ImGui::SliderFloat("Bias", &shadowBias, 0.0f, 0.01f, "%.4f");
       ImGui::SliderInt("Filter Range", &shadowFilterRange, 0, 8);
     }
@@ -914,16 +984,7 @@ void UI::resultsFrame(const std::shared_ptr<Input> input)
 
     if (ImGui::Button("Export"))
     {
-      std::ofstream exportFile;
-      exportFile.open("export.csv", std::ios_base::app);
-      exportFile << ",Minimum,Average,Maximum" << std::endl;
-      exportFile << "Total," << totalMin << "," << totalAvg << "," << totalMax << std::endl;
-      exportFile << "Shadow Pass," << shadowMin << "," << shadowAvg << "," << shadowMax << std::endl;
-      exportFile << "Geometry Pass," << geometryMin << "," << geometryAvg << "," << geometryMax << std::endl;
-      exportFile << "Lighting Pass," << lightingMin << "," << lightingAvg << "," << lightingMax << std::endl;
-      exportFile << "Composite Pass," << compositeMin << "," << compositeAvg << "," << compositeMax << std::endl
-                 << std::endl;
-      exportFile.close();
+      exportResults("export.csv");
     }
 
     ImGui::SameLine();
@@ -937,6 +998,34 @@ void UI::resultsFrame(const std::shared_ptr<Input> input)
   ImGui::End();
 }
 
+bool UI::exportResults(const std::string& filename)
+{
+  if (resultTotal.size() <= 0 || resultShadowPass.size() <= 0 || resultGeometryPass.size() <= 0 ||
+      resultLightingPass.size() <= 0 || resultCompositePass.size() <= 0)
+  {
+    return false;
+  }
+
+  auto exportRow = [](std::ofstream& exportFile, const std::string& name, const std::vector<float>& result) {
+    exportFile << name << "," << *std::min_element(result.begin(), result.end()) << ","
+               << std::accumulate(result.begin(), result.end(), 0.0f) / result.size() << ","
+               << *std::max_element(result.begin(), result.end()) << std::endl;
+  };
+
+  std::ofstream exportFile;
+  exportFile.open(filename, std::ios_base::app);
+  exportFile << ",Minimum,Average,Maximum" << std::endl;
+  exportRow(exportFile, "Total", resultTotal);
+  exportRow(exportFile, "Shadow Pass", resultShadowPass);
+  exportRow(exportFile, "Geometry Pass", resultGeometryPass);
+  exportRow(exportFile, "Lighting Pass", resultLightingPass);
+  exportRow(exportFile, "Composite Pass", resultCompositePass);
+  exportFile << std::endl;
+  exportFile.close();
+
+  return true;
+}
+
 UI::UI(const std::shared_ptr<Window> window,
        const std::shared_ptr<Context> context,
        const std::shared_ptr<DescriptorPool> descriptorPool,
@@ -946,7 +1035,12 @@ UI::UI(const std::shared_ptr<Window> window,
   this->window = window;
   this->context = context;
 
-  vertexCount = indexCount = 0;
+  vertexCounts.resize(Sync::MAX_FRAMES_IN_FLIGHT, 0);
+  indexCounts.resize(Sync::MAX_FRAMES_IN_FLIGHT, 0);
+  vertexBuffersMemory.resize(Sync::MAX_FRAMES_IN_FLIGHT, nullptr);
+  indexBuffersMemory.resize(Sync::MAX_FRAMES_IN_FLIGHT, nullptr);
+  vertexBuffers.resize(Sync::MAX_FRAMES_IN_FLIGHT);
+  indexBuffers.resize(Sync::MAX_FRAMES_IN_FLIGHT);
 
   imGuiContext = ImGui::CreateContext();
 
@@ -968,22 +1062,20 @@ UI::UI(const std::shared_ptr<Window> window,
   VkDeviceSize uploadSize = texWidth * texHeight * 4 * sizeof(char);
 
   std::unique_ptr<vk::Buffer, decltype(bufferDeleter)> stagingBuffer;
-  std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)> stagingBufferMemory;
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(bufferMemoryDeleter)> stagingBufferMemory;
 
   stagingBuffer = std::unique_ptr<vk::Buffer, decltype(bufferDeleter)>(
     createBuffer(context, uploadSize, vk::BufferUsageFlagBits::eTransferSrc), bufferDeleter);
-  stagingBufferMemory = std::unique_ptr<vk::DeviceMemory, decltype(bufferMemoryDeleter)>(
+  stagingBufferMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(bufferMemoryDeleter)>(
     createBufferMemory(context, stagingBuffer.get(), uploadSize,
                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent),
     bufferMemoryDeleter);
 
-  auto memory = context->getDevice()->mapMemory(*stagingBufferMemory, 0, uploadSize);
-  memcpy(memory, fontData, uploadSize);
-  context->getDevice()->unmapMemory(*stagingBufferMemory);
+  memcpy(stagingBufferMemory->mappedData, fontData, uploadSize);
 
   fontImage = std::unique_ptr<vk::Image, decltype(fontImageDeleter)>(createFontImage(context, texWidth, texHeight),
                                                                      fontImageDeleter);
-  fontImageMemory = std::unique_ptr<vk::DeviceMemory, decltype(fontImageMemoryDeleter)>(
+  fontImageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(fontImageMemoryDeleter)>(
     createFontImageMemory(context, fontImage.get(), vk::MemoryPropertyFlagBits::eDeviceLocal), fontImageMemoryDeleter);
 
   auto commandBufferAllocateInfo =
@@ -1048,11 +1140,16 @@ void UI::makeChangesToSettings()
   Settings::reuseCommandBuffers = reuseCommandBuffers;
   Settings::transientCommandPool = transientCommandPool;
   Settings::vertexIndexBufferStaging = vertexIndexBufferStaging;
-  Settings::keepUniformBufferMemoryMapped = keepUniformBufferMemoryMapped;
   Settings::dynamicUniformBufferStrategy = dynamicUniformBufferStrategy;
   Settings::flushDynamicUniformBufferMemoryIndividually = flushDynamicUniformBufferMemoryIndividually;
   Settings::shadowMapResolution = shadowMapResolution;
   Settings::shadowMapCascadeCount = shadowMapCascadeCount;
+  Settings::shadowAtlasResolution = shadowAtlasResolution;
+  Settings::shadowCaching = shadowCaching;
+  Settings::shadowCacheThreshold = shadowCacheThreshold;
+  Settings::shadowFarCascadeInterval = shadowFarCascadeInterval;
+  Settings::shadowSinglePass = shadowSinglePass;
+  Settings::shadowSampleDistribution = shadowSampleDistribution;
   Settings::shadowBias = shadowBias;
   Settings::shadowFilterRange = shadowFilterRange;
   Settings::bloomThreshold = bloomThreshold;
@@ -1069,34 +1166,39 @@ bool UI::update(const std::shared_ptr<Input> input,
                 const std::shared_ptr<ShadowPipeline> shadowPipeline,
                 const std::shared_ptr<CompositePipeline> compositePipeline,
                 const std::shared_ptr<LightingBuffer> lightingBuffer,
-                float delta)
+                const CullingStatistics& cullingStatistics,
+                float delta,
+                uint32_t frameIndex)
 {
+  // the queries of this frame index were written by the last frame that used it, which has finished by now
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+
   if (camera->getState() == CameraState::OnRails)
   {
     resultTotal.push_back(delta);
 
     uint32_t begin = 0, end = 0;
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 0, 1, sizeof(uint32_t), &begin, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset, 1, sizeof(uint32_t), &begin, 0,
                                               vk::QueryResultFlagBits());
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 1, 1, sizeof(uint32_t), &end, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 1, 1, sizeof(uint32_t), &end, 0,
                                               vk::QueryResultFlagBits());
     resultShadowPass.push_back(static_cast<float>(end - begin) / 1e6f);
 
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 2, 1, sizeof(uint32_t), &begin, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 2, 1, sizeof(uint32_t), &begin, 0,
                                               vk::QueryResultFlagBits());
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 3, 1, sizeof(uint32_t), &end, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 3, 1, sizeof(uint32_t), &end, 0,
                                               vk::QueryResultFlagBits());
     resultGeometryPass.push_back(static_cast<float>(end - begin) / 1e6f);
 
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 4, 1, sizeof(uint32_t), &begin, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 4, 1, sizeof(uint32_t), &begin, 0,
                                               vk::QueryResultFlagBits());
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 5, 1, sizeof(uint32_t), &end, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 5, 1, sizeof(uint32_t), &end, 0,
                                               vk::QueryResultFlagBits());
     resultLightingPass.push_back(static_cast<float>(end - begin) / 1e6f);
 
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 6, 1, sizeof(uint32_t), &begin, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 6, 1, sizeof(uint32_t), &begin, 0,
                                               vk::QueryResultFlagBits());
-    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), 7, 1, sizeof(uint32_t), &end, 0,
+    context->getDevice()->getQueryPoolResults(*context->getQueryPool(), queryOffset + 7, 1, sizeof(uint32_t), &end, 0,
                                               vk::QueryResultFlagBits());
     resultCompositePass.push_back(static_cast<float>(end - begin) / 1e6f);
   }
@@ -1115,7 +1217,7 @@ bool UI::update(const std::shared_ptr<Input> input,
 
   ImGui::NewFrame();
 
-  statisticsFrame(input, camera, delta);
+  statisticsFrame(input, camera, lightList, cullingStatistics, delta, frameIndex);
 
   bool benchmarkFrameWantsToApplyChanges = false, lightEditorWantsToApplyChanges = false;
   if (camera->getState() != CameraState::OnRails)
@@ -1145,34 +1247,33 @@ bool UI::update(const std::shared_ptr<Input> input,
   VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
   VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
+  auto& vertexBuffer = vertexBuffers.at(frameIndex);
+  auto& indexBuffer = indexBuffers.at(frameIndex);
+  auto& vertexCount = vertexCounts.at(frameIndex);
+  auto& indexCount = indexCounts.at(frameIndex);
+  auto& vertexBufferMemory = vertexBuffersMemory.at(frameIndex);
+  auto& indexBufferMemory = indexBuffersMemory.at(frameIndex);
+
   // vertex buffer
   if (!vertexBuffer || vertexCount != imDrawData->TotalVtxCount)
   {
-    if (vertexBuffer)
-    {
-      context->getDevice()->unmapMemory(*vertexBuffer->getMemory());
-    }
-
     vertexBuffer = std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eVertexBuffer, vertexBufferSize,
                                             vk::MemoryPropertyFlagBits::eHostVisible);
     vertexCount = imDrawData->TotalVtxCount;
 
-    vertexBufferMemory = context->getDevice()->mapMemory(*vertexBuffer->getMemory(), 0, vertexBufferSize);
+    vertexBuffer->mapMemory();
+    vertexBufferMemory = vertexBuffer->getMemoryMappedLocation();
   }
 
   // index buffer
   if (!indexBuffer || indexCount < imDrawData->TotalIdxCount)
   {
-    if (indexBuffer)
-    {
-      context->getDevice()->unmapMemory(*indexBuffer->getMemory());
-    }
-
     indexBuffer = std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eIndexBuffer, indexBufferSize,
                                            vk::MemoryPropertyFlagBits::eHostVisible);
     indexCount = imDrawData->TotalIdxCount;
 
-    indexBufferMemory = context->getDevice()->mapMemory(*indexBuffer->getMemory(), 0, indexBufferSize);
+    indexBuffer->mapMemory();
+    indexBufferMemory = indexBuffer->getMemoryMappedLocation();
   }
 
   // upload data
@@ -1189,15 +1290,17 @@ bool UI::update(const std::shared_ptr<Input> input,
   }
 
   std::vector<vk::MappedMemoryRange> memoryRanges;
-  memoryRanges.push_back(vk::MappedMemoryRange(*vertexBuffer->getMemory(), 0, VK_WHOLE_SIZE));
-  memoryRanges.push_back(vk::MappedMemoryRange(*indexBuffer->getMemory(), 0, VK_WHOLE_SIZE));
+  memoryRanges.push_back(vertexBuffer->getMappedMemoryRange());
+  memoryRanges.push_back(indexBuffer->getMappedMemoryRange());
   context->getDevice()->flushMappedMemoryRanges(static_cast<uint32_t>(memoryRanges.size()), memoryRanges.data());
 
   return lightEditorWantsToApplyChanges || benchmarkFrameWantsToApplyChanges;
 }
 
-void UI::render(const vk::CommandBuffer* commandBuffer)
+void UI::render(const vk::CommandBuffer* commandBuffer, uint32_t frameIndex)
 {
+  const auto& vertexBuffer = vertexBuffers.at(frameIndex);
+  const auto& indexBuffer = indexBuffers.at(frameIndex);
   if (!vertexBuffer || !indexBuffer)
   {
     return;
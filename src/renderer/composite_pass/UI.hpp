@@ -4,6 +4,7 @@
 #include "core/Camera.hpp"
 #include "core/Input.hpp"
 #include "core/Light.hpp"
+#include "renderer/Culling.hpp"
 #include "renderer/buffers/Buffer.hpp"
 #include "renderer/buffers/DescriptorPool.hpp"
 #include "renderer/lighting_pass/LightingBuffer.hpp"
@@ -24,11 +25,16 @@ private:
   static bool transientCommandPool;
   static bool reuseCommandBuffers;
   static bool vertexIndexBufferStaging;
-  static bool keepUniformBufferMemoryMapped;
   static int dynamicUniformBufferStrategy;
   static bool flushDynamicUniformBufferMemoryIndividually;
   static int shadowMapResolution;
   static int shadowMapCascadeCount;
+  static int shadowAtlasResolution;
+  static bool shadowCaching;
+  static float shadowCacheThreshold;
+  static int shadowFarCascadeInterval;
+  static bool shadowSinglePass;
+  static bool shadowSampleDistribution;
   static float shadowBias;
   static int shadowFilterRange;
   static float bloomThreshold;
@@ -43,10 +49,11 @@ private:
 
   static ImGuiContext* imGuiContext;
 
-  int32_t vertexCount, indexCount;
-  void *vertexBufferMemory, *indexBufferMemory;
+  // one set of vertex and index buffers per frame in flight
+  std::vector<int32_t> vertexCounts, indexCounts;
+  std::vector<void*> vertexBuffersMemory, indexBuffersMemory;
 
-  std::unique_ptr<Buffer> vertexBuffer, indexBuffer;
+  std::vector<std::unique_ptr<Buffer>> vertexBuffers, indexBuffers;
 
   static std::array<float, 50> totalTime, shadowPassTime, geometryPassTime, lightingPassTime, compositePassTime;
   static std::vector<float> resultTotal, resultShadowPass, resultGeometryPass, resultLightingPass, resultCompositePass;
@@ -58,14 +65,15 @@ private:
       context->getDevice()->destroyBuffer(*buffer);
   };
 
-  static vk::DeviceMemory* createBufferMemory(const std::shared_ptr<Context> context,
-                                              const vk::Buffer* buffer,
-                                              vk::DeviceSize size,
-                                              vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> bufferMemoryDeleter = [this](vk::DeviceMemory* bufferMemory) {
-    if (context->getDevice())
-      context->getDevice()->freeMemory(*bufferMemory);
-  };
+  static MemoryAllocator::Allocation* createBufferMemory(const std::shared_ptr<Context> context,
+                                                         const vk::Buffer* buffer,
+                                                         vk::DeviceSize size,
+                                                         vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(MemoryAllocator::Allocation*)> bufferMemoryDeleter =
+    [this](MemoryAllocator::Allocation* bufferMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(bufferMemory);
+    };
 
   static vk::Image* createFontImage(const std::shared_ptr<Context> context, uint32_t width, uint32_t height);
   std::function<void(vk::Image*)> fontImageDeleter = [this](vk::Image* fontImage) {
@@ -74,14 +82,15 @@ private:
   };
   std::unique_ptr<vk::Image, decltype(fontImageDeleter)> fontImage;
 
-  static vk::DeviceMemory* createFontImageMemory(const std::shared_ptr<Context> context,
-                                                 const vk::Image* image,
-                                                 vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> fontImageMemoryDeleter = [this](vk::DeviceMemory* fontImageMemory) {
-    if (context->getDevice())
-      context->getDevice()->freeMemory(*fontImageMemory);
-  };
-  std::unique_ptr<vk::DeviceMemory, decltype(fontImageMemoryDeleter)> fontImageMemory;
+  static MemoryAllocator::Allocation* createFontImageMemory(const std::shared_ptr<Context> context,
+                                                            const vk::Image* image,
+                                                            vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(MemoryAllocator::Allocation*)> fontImageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* fontImageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(fontImageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(fontImageMemoryDeleter)> fontImageMemory;
 
   static vk::ImageView* createFontImageView(const std::shared_ptr<Context> context, const vk::Image* image);
   std::function<void(vk::ImageView*)> fontImageViewDeleter = [this](vk::ImageView* fontImageView) {
@@ -123,7 +132,12 @@ private:
 
   void crosshairFrame();
   void controlsFrame(const std::shared_ptr<Input> input, const std::shared_ptr<Camera> camera);
-  void statisticsFrame(const std::shared_ptr<Input> input, const std::shared_ptr<Camera> camera, float delta);
+  void statisticsFrame(const std::shared_ptr<Input> input,
+                       const std::shared_ptr<Camera> camera,
+                       const std::vector<std::shared_ptr<Light>>& lightList,
+                       const CullingStatistics& cullingStatistics,
+                       float delta,
+                       uint32_t frameIndex);
   bool lightEditorFrame(const std::shared_ptr<Input> input,
                         const std::shared_ptr<Camera> camera,
                         std::vector<std::shared_ptr<Light>>& lightList);
@@ -139,8 +153,8 @@ public:
   ~UI()
   {
     if (imGuiContext) /*ImGui::DestroyContext(imGuiContext);*/
-      vertexBuffer = nullptr;
-    indexBuffer = nullptr;
+      vertexBuffers.clear();
+    indexBuffers.clear();
   } // TODO: need to destroy the context but this causes a crash at program termination if the renderer was
     // re-finalized...
 
@@ -152,8 +166,12 @@ public:
               const std::shared_ptr<ShadowPipeline> shadowPipeline,
               const std::shared_ptr<CompositePipeline> compositePipeline,
               const std::shared_ptr<LightingBuffer> lightingBuffer,
-              float delta);
-  void render(const vk::CommandBuffer* commandBuffer);
+              const CullingStatistics& cullingStatistics,
+              float delta,
+              uint32_t frameIndex);
+  void render(const vk::CommandBuffer* commandBuffer, uint32_t frameIndex);
+
+  static bool exportResults(const std::string& filename);
 
   // std::function<void()> applyChanges;
 };
\ No newline at end of file
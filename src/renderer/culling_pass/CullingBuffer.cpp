@@ -0,0 +1,504 @@
+#include "CullingBuffer.hpp"
+#include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+// vulkan does not allow empty buffers, which an empty scene would otherwise need
+vk::DeviceSize getBufferSize(vk::DeviceSize size)
+{
+  return std::max(size, static_cast<vk::DeviceSize>(sizeof(glm::vec4)));
+}
+
+std::unique_ptr<Buffer> createHostBuffer(const std::shared_ptr<Context> context,
+                                         vk::BufferUsageFlags usage,
+                                         const void* data,
+                                         vk::DeviceSize size)
+{
+  auto buffer =
+    std::make_unique<Buffer>(context, usage, getBufferSize(size),
+                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+  buffer->mapMemory();
+  if (data)
+  {
+    memcpy(buffer->getMemoryMappedLocation(), data, size);
+  }
+  else
+  {
+    memset(buffer->getMemoryMappedLocation(), 0, getBufferSize(size));
+  }
+  return buffer;
+}
+} // namespace
+
+std::vector<vk::DescriptorSet>*
+CullingBuffer::createDescriptorSets(const std::shared_ptr<Context> context,
+                                    const std::shared_ptr<DescriptorPool> descriptorPool,
+                                    const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                    const CullingBuffer* cullingBuffer)
+{
+  const auto layout = cullingBuffer->depthPyramid ? descriptorPool->getOcclusionCullingLayout() :
+                                                    descriptorPool->getCullingLayout();
+  std::vector<vk::DescriptorSetLayout> layouts(Sync::MAX_FRAMES_IN_FLIGHT, *layout);
+  auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
+                                     .setDescriptorPool(*descriptorPool->getPool())
+                                     .setDescriptorSetCount(static_cast<uint32_t>(layouts.size()))
+                                     .setPSetLayouts(layouts.data());
+  auto descriptorSets = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo);
+
+  for (uint32_t i = 0; i < descriptorSets.size(); ++i)
+  {
+    // the whole instance buffer is bound, the push constants select the frame's world matrices within it
+    std::vector<vk::DescriptorBufferInfo> descriptorBufferInfos = {
+      vk::DescriptorBufferInfo(*cullingBuffer->meshInstanceBuffer->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*instanceBuffer->getBuffer()->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->viewBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->drawBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->visibleInstanceBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->statisticsBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->drawMaterialBuffer->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->compactedDrawBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE),
+      vk::DescriptorBufferInfo(*cullingBuffer->drawCountBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE)
+    };
+    if (cullingBuffer->depthPyramid)
+    {
+      descriptorBufferInfos.push_back(
+        vk::DescriptorBufferInfo(*cullingBuffer->occludedBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE));
+    }
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
+      vk::WriteDescriptorSet()
+        .setDstSet(descriptorSets.at(i))
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(static_cast<uint32_t>(descriptorBufferInfos.size()))
+        .setPBufferInfo(descriptorBufferInfos.data())
+    };
+
+    // the pyramid stays in the general layout it is built in
+    vk::DescriptorImageInfo depthPyramidImageInfo;
+    if (cullingBuffer->depthPyramid)
+    {
+      depthPyramidImageInfo = vk::DescriptorImageInfo(*cullingBuffer->depthPyramid->getSampler(),
+                                                      *cullingBuffer->depthPyramid->getImageView(),
+                                                      vk::ImageLayout::eGeneral);
+      writeDescriptorSets.push_back(vk::WriteDescriptorSet()
+                                      .setDstSet(descriptorSets.at(i))
+                                      .setDstBinding(static_cast<uint32_t>(descriptorBufferInfos.size()))
+                                      .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                                      .setDescriptorCount(1)
+                                      .setPImageInfo(&depthPyramidImageInfo));
+    }
+
+    context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                               writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  return new std::vector<vk::DescriptorSet>(descriptorSets);
+}
+
+std::vector<vk::CommandBuffer>* CullingBuffer::createCommandBuffers(const std::shared_ptr<Context> context,
+                                                                   vk::CommandBufferLevel level)
+{
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
+  auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+                                     .setCommandPool(*context->getCommandPoolOnce())
+                                     .setLevel(level)
+                                     .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
+  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, commandBuffers.data()) !=
+      vk::Result::eSuccess)
+  {
+    throw std::runtime_error("Failed to allocate command buffers.");
+  }
+
+  return new std::vector<vk::CommandBuffer>(commandBuffers);
+}
+
+CullingBuffer::CullingBuffer(const std::shared_ptr<Context> context,
+                             const std::shared_ptr<DescriptorPool> descriptorPool,
+                             const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                             const std::vector<std::shared_ptr<Model>>* models,
+                             uint32_t numViews,
+                             const std::shared_ptr<DepthPyramid> depthPyramid)
+{
+  this->context = context;
+  this->descriptorPool = descriptorPool;
+  this->depthPyramid = depthPyramid;
+  this->numViews = numViews;
+  // the second camera pass draws what the first one wrongly found occluded, after all other views
+  numDrawViews = depthPyramid ? numViews + 1 : numViews;
+
+  // the visible instances of a mesh go to the range its instances take up in the list of all mesh instances, every
+  // view has its own copy of that list
+  std::vector<CullingMeshInstance> meshInstances;
+  std::vector<vk::DrawIndexedIndirectCommand> meshDraws;
+  std::vector<const Material*> meshMaterials;
+  for (auto& model : *models)
+  {
+    const auto numInstances = static_cast<uint32_t>(model->getInstances()->size());
+    for (auto& mesh : *model->getMeshes())
+    {
+      const auto meshIndex = static_cast<uint32_t>(meshDraws.size());
+      meshDraws.push_back(vk::DrawIndexedIndirectCommand(mesh->indexCount, 0, mesh->firstIndex, 0,
+                                                         static_cast<uint32_t>(meshInstances.size())));
+      meshMaterials.push_back(mesh->material.get());
+
+      for (uint32_t i = 0; i < numInstances; ++i)
+      {
+        CullingMeshInstance meshInstance = {};
+        meshInstance.boundsMin = glm::vec4(mesh->boundsMin, 0.0f);
+        meshInstance.boundsMax = glm::vec4(mesh->boundsMax, 0.0f);
+        meshInstance.boundingSphere = mesh->boundingSphere;
+        meshInstance.instance = model->getFirstInstance() + i;
+        meshInstance.draw = meshIndex;
+        meshInstances.push_back(meshInstance);
+      }
+    }
+  }
+
+  numMeshInstances = static_cast<uint32_t>(meshInstances.size());
+  numDraws = static_cast<uint32_t>(meshDraws.size());
+
+  // the draws are grouped by material so that the geometry pass binds each material once and draws all of its meshes
+  // with a single call, the meshes of a material keep their order
+  std::unordered_map<const Material*, uint32_t> materialOrder;
+  for (const auto material : meshMaterials)
+  {
+    materialOrder.emplace(material, static_cast<uint32_t>(materialOrder.size()));
+  }
+  std::vector<uint32_t> drawMeshes(numDraws);
+  std::iota(drawMeshes.begin(), drawMeshes.end(), 0);
+  std::stable_sort(drawMeshes.begin(), drawMeshes.end(), [&](uint32_t a, uint32_t b) {
+    return materialOrder.at(meshMaterials.at(a)) < materialOrder.at(meshMaterials.at(b));
+  });
+
+  std::vector<vk::DrawIndexedIndirectCommand> draws;
+  std::vector<uint32_t> meshDrawIndices(numDraws), materialFirstDraws;
+  for (const auto mesh : drawMeshes)
+  {
+    const auto draw = static_cast<uint32_t>(draws.size());
+    if (materialDraws.empty() || materialDraws.back().material != meshMaterials.at(mesh))
+    {
+      materialDraws.push_back({ meshMaterials.at(mesh), draw, 0 });
+    }
+    ++materialDraws.back().numDraws;
+
+    meshDrawIndices.at(mesh) = draw;
+    materialFirstDraws.push_back(materialDraws.back().firstDraw);
+    draws.push_back(meshDraws.at(mesh));
+  }
+
+  for (auto& meshInstance : meshInstances)
+  {
+    meshInstance.draw = meshDrawIndices.at(meshInstance.draw);
+  }
+
+  // each view writes to its own copy of the mesh instances, so the draws of all views start out the same
+  for (uint32_t i = 1; i < numDrawViews; ++i)
+  {
+    for (uint32_t j = 0; j < numDraws; ++j)
+    {
+      draws.push_back(draws.at(j));
+    }
+  }
+
+  meshInstanceBuffer =
+    createHostBuffer(context, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+                     meshInstances.data(), meshInstances.size() * sizeof(CullingMeshInstance));
+  drawTemplateBuffer = createHostBuffer(context, vk::BufferUsageFlagBits::eTransferSrc, draws.data(),
+                                        draws.size() * sizeof(vk::DrawIndexedIndirectCommand));
+  drawMaterialBuffer = createHostBuffer(context, vk::BufferUsageFlagBits::eStorageBuffer, materialFirstDraws.data(),
+                                        materialFirstDraws.size() * sizeof(uint32_t));
+
+  // the first camera pass, followed by the second one when culling occlusion
+  const auto numCameraPasses = numDrawViews - numViews + 1;
+
+  for (uint32_t i = 0; i < Sync::MAX_FRAMES_IN_FLIGHT; ++i)
+  {
+    viewBuffers.push_back(createHostBuffer(context, vk::BufferUsageFlagBits::eStorageBuffer, nullptr,
+                                           sizeof(CullingViewData) + numViews * 6 * sizeof(glm::vec4)));
+
+    drawBuffers.push_back(std::make_unique<Buffer>(
+      context,
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+        vk::BufferUsageFlagBits::eTransferDst,
+      getBufferSize(draws.size() * sizeof(vk::DrawIndexedIndirectCommand)), vk::MemoryPropertyFlagBits::eDeviceLocal));
+
+    visibleInstanceBuffers.push_back(
+      std::make_unique<Buffer>(context,
+                               vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+                               getBufferSize(numDrawViews * numMeshInstances * sizeof(Instance)),
+                               vk::MemoryPropertyFlagBits::eDeviceLocal));
+
+    statisticsBuffers.push_back(createHostBuffer(
+      context, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, nullptr,
+      sizeof(CullingStatistics)));
+
+    compactedDrawBuffers.push_back(std::make_unique<Buffer>(
+      context, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      getBufferSize(numCameraPasses * numDraws * sizeof(vk::DrawIndexedIndirectCommand)),
+      vk::MemoryPropertyFlagBits::eDeviceLocal));
+
+    drawCountBuffers.push_back(std::make_unique<Buffer>(
+      context,
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+        vk::BufferUsageFlagBits::eTransferDst,
+      getBufferSize(numCameraPasses * numDraws * sizeof(uint32_t)), vk::MemoryPropertyFlagBits::eDeviceLocal));
+
+    if (depthPyramid)
+    {
+      occludedBuffers.push_back(std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eStorageBuffer,
+                                                         getBufferSize(numMeshInstances * sizeof(uint32_t)),
+                                                         vk::MemoryPropertyFlagBits::eDeviceLocal));
+    }
+  }
+
+  descriptorSets = std::unique_ptr<std::vector<vk::DescriptorSet>>(
+    createDescriptorSets(context, descriptorPool, instanceBuffer, this));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(
+    createCommandBuffers(context, vk::CommandBufferLevel::ePrimary));
+  if (depthPyramid)
+  {
+    occlusionCommandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(
+      createCommandBuffers(context, vk::CommandBufferLevel::eSecondary));
+  }
+}
+
+CullingBuffer::~CullingBuffer()
+{
+  // explicitly free the descriptor sets because the culling buffer is rebuilt along with the scene
+  context->getDevice()->freeDescriptorSets(*descriptorPool->getPool(), static_cast<uint32_t>(descriptorSets->size()),
+                                           descriptorSets->data());
+}
+
+void CullingBuffer::recordDrawCompaction(const vk::CommandBuffer* commandBuffer,
+                                         const std::shared_ptr<CullingPipeline> cullingPipeline,
+                                         uint32_t frameIndex) const
+{
+  if (!cullingPipeline->getCompactionPipeline())
+  {
+    return;
+  }
+
+  // the instance counts of the draws are only final once all mesh instances were culled
+  auto barrier = vk::BufferMemoryBarrier()
+                   .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                   .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+                   .setBuffer(*drawBuffers.at(frameIndex)->getBuffer())
+                   .setSize(VK_WHOLE_SIZE);
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::DependencyFlags(), 0, nullptr, 1, &barrier, 0, nullptr);
+
+  // shares the layout of the culling pipeline, so the descriptor set and push constants stay bound
+  commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, *cullingPipeline->getCompactionPipeline());
+  commandBuffer->dispatch((numDraws + CullingPipeline::WORK_GROUP_SIZE - 1) / CullingPipeline::WORK_GROUP_SIZE, 1, 1);
+}
+
+CullingPushConstants CullingBuffer::getPushConstants(const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                                     uint32_t frameIndex,
+                                                     bool secondPass) const
+{
+  CullingPushConstants pushConstants;
+  pushConstants.numMeshInstances = numMeshInstances;
+  pushConstants.numDraws = numDraws;
+  pushConstants.numViews = numViews;
+  pushConstants.firstInstance = static_cast<uint32_t>(instanceBuffer->getFrameOffset(frameIndex) / sizeof(Instance));
+  pushConstants.decodeShadowPositions = Settings::vertexCompression ? 1 : 0;
+  pushConstants.secondPass = secondPass ? 1 : 0;
+  pushConstants.depthWidth = depthPyramid ? depthPyramid->getWidth() : 0;
+  pushConstants.depthHeight = depthPyramid ? depthPyramid->getHeight() : 0;
+  return pushConstants;
+}
+
+void CullingBuffer::recordCommandBuffer(const std::shared_ptr<CullingPipeline> cullingPipeline,
+                                        const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                        uint32_t frameIndex)
+{
+  auto commandBuffer = &commandBuffers->at(frameIndex);
+  const auto drawBuffer = drawBuffers.at(frameIndex)->getBuffer();
+  const auto visibleInstanceBuffer = visibleInstanceBuffers.at(frameIndex)->getBuffer();
+  const auto statisticsBuffer = statisticsBuffers.at(frameIndex)->getBuffer();
+  const auto drawCountBuffer = drawCountBuffers.at(frameIndex)->getBuffer();
+
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+  commandBuffer->begin(commandBufferBeginInfo);
+
+  // the draws of the last frame with this index have to be done before their commands are reset, and so does its
+  // second pass before the first pass of this frame overwrites what it found occluded
+  auto memoryBarrier = vk::MemoryBarrier()
+                         .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                         .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput |
+                                   vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::DependencyFlags(), 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  const auto drawsSize = numDrawViews * numDraws * sizeof(vk::DrawIndexedIndirectCommand);
+  if (drawsSize > 0)
+  {
+    commandBuffer->copyBuffer(*drawTemplateBuffer->getBuffer(), *drawBuffer, vk::BufferCopy(0, 0, drawsSize));
+  }
+  commandBuffer->fillBuffer(*statisticsBuffer, 0, sizeof(CullingStatistics), 0);
+  commandBuffer->fillBuffer(*drawCountBuffer, 0, VK_WHOLE_SIZE, 0);
+
+  std::array<vk::BufferMemoryBarrier, 3> transferBarriers = {
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+      .setBuffer(*drawBuffer)
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+      .setBuffer(*statisticsBuffer)
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+      .setBuffer(*drawCountBuffer)
+      .setSize(VK_WHOLE_SIZE)
+  };
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::DependencyFlags(), 0, nullptr, static_cast<uint32_t>(transferBarriers.size()),
+                                 transferBarriers.data(), 0, nullptr);
+
+  commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, *cullingPipeline->getPipeline());
+  commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, *cullingPipeline->getPipelineLayout(), 0, 1,
+                                    &descriptorSets->at(frameIndex), 0, nullptr);
+
+  const auto pushConstants = getPushConstants(instanceBuffer, frameIndex, false);
+  commandBuffer->pushConstants(*cullingPipeline->getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+                               sizeof(pushConstants), &pushConstants);
+
+  commandBuffer->dispatch((numMeshInstances + CullingPipeline::WORK_GROUP_SIZE - 1) / CullingPipeline::WORK_GROUP_SIZE,
+                          1, 1);
+  recordDrawCompaction(commandBuffer, cullingPipeline, frameIndex);
+
+  // the passes submitted after this read the draws and instances
+  std::array<vk::BufferMemoryBarrier, 4> barriers = {
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*drawBuffer)
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*compactedDrawBuffers.at(frameIndex)->getBuffer())
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*drawCountBuffers.at(frameIndex)->getBuffer())
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead)
+      .setBuffer(*visibleInstanceBuffer)
+      .setSize(VK_WHOLE_SIZE)
+  };
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                 vk::DependencyFlags(), 0, nullptr, static_cast<uint32_t>(barriers.size()),
+                                 barriers.data(), 0, nullptr);
+
+  // the statistics are read by the host once the frame is done
+  auto statisticsBarrier = vk::BufferMemoryBarrier()
+                             .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                             .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                             .setBuffer(*statisticsBuffer)
+                             .setSize(VK_WHOLE_SIZE);
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+                                 vk::DependencyFlags(), 0, nullptr, 1, &statisticsBarrier, 0, nullptr);
+
+  commandBuffer->end();
+}
+
+void CullingBuffer::recordOcclusionCommandBuffer(const std::shared_ptr<CullingPipeline> cullingPipeline,
+                                                 const std::shared_ptr<DepthPyramidPipeline> depthPyramidPipeline,
+                                                 const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                                 uint32_t frameIndex)
+{
+  auto commandBuffer = &occlusionCommandBuffers->at(frameIndex);
+  const auto drawBuffer = drawBuffers.at(frameIndex)->getBuffer();
+  const auto visibleInstanceBuffer = visibleInstanceBuffers.at(frameIndex)->getBuffer();
+
+  // executed outside of any render pass, between the two camera passes of the geometry pass
+  auto commandBufferInheritanceInfo = vk::CommandBufferInheritanceInfo();
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo()
+                                  .setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse)
+                                  .setPInheritanceInfo(&commandBufferInheritanceInfo);
+  commandBuffer->begin(commandBufferBeginInfo);
+
+  // the first camera pass has to be written before the pyramid reduces its depth and the second camera pass loads it
+  // again, and the pyramid of the last frame has to be done being read before it is overwritten
+  auto firstPassBarrier =
+    vk::MemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eColorAttachmentRead |
+                        vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                        vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+  commandBuffer->pipelineBarrier(
+    vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests |
+      vk::PipelineStageFlagBits::eComputeShader,
+    vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eColorAttachmentOutput,
+    vk::DependencyFlags(), 1, &firstPassBarrier, 0, nullptr, 0, nullptr);
+
+  // ends with a barrier after every level, so the second pass can sample the whole pyramid
+  depthPyramid->recordCommands(commandBuffer, depthPyramidPipeline);
+
+  commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, *cullingPipeline->getPipeline());
+  commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, *cullingPipeline->getPipelineLayout(), 0, 1,
+                                    &descriptorSets->at(frameIndex), 0, nullptr);
+
+  const auto pushConstants = getPushConstants(instanceBuffer, frameIndex, true);
+  commandBuffer->pushConstants(*cullingPipeline->getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+                               sizeof(pushConstants), &pushConstants);
+
+  commandBuffer->dispatch((numMeshInstances + CullingPipeline::WORK_GROUP_SIZE - 1) / CullingPipeline::WORK_GROUP_SIZE,
+                          1, 1);
+  recordDrawCompaction(commandBuffer, cullingPipeline, frameIndex);
+
+  // the second camera pass reads the draws and instances, the host reads the statistics once the frame is done
+  std::array<vk::BufferMemoryBarrier, 4> barriers = {
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*drawBuffer)
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*compactedDrawBuffers.at(frameIndex)->getBuffer())
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+      .setBuffer(*drawCountBuffers.at(frameIndex)->getBuffer())
+      .setSize(VK_WHOLE_SIZE),
+    vk::BufferMemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead)
+      .setBuffer(*visibleInstanceBuffer)
+      .setSize(VK_WHOLE_SIZE)
+  };
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                 vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                                 vk::DependencyFlags(), 0, nullptr, static_cast<uint32_t>(barriers.size()),
+                                 barriers.data(), 0, nullptr);
+
+  auto statisticsBarrier = vk::BufferMemoryBarrier()
+                             .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                             .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                             .setBuffer(*statisticsBuffers.at(frameIndex)->getBuffer())
+                             .setSize(VK_WHOLE_SIZE);
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+                                 vk::DependencyFlags(), 0, nullptr, 1, &statisticsBarrier, 0, nullptr);
+
+  commandBuffer->end();
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "CullingPipeline.hpp"
+#include "DepthPyramid.hpp"
+#include "renderer/Culling.hpp"
+#include "renderer/Model.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
+
+// matches the mesh instances of the culling shader
+struct CullingMeshInstance
+{
+  glm::vec4 boundsMin, boundsMax, boundingSphere;
+  uint32_t instance, draw;
+  uint32_t padding[2];
+};
+
+// matches the start of the views of the culling shader, the six planes of every view follow it
+struct CullingViewData
+{
+  // only read when culling occlusion, the depth pyramid was built with the camera of the previous frame
+  glm::mat4 cameraViewProjectionMatrix, previousCameraViewProjectionMatrix;
+  // zero until a frame has built the depth pyramid
+  uint32_t hasDepthPyramid;
+  uint32_t padding[3];
+};
+
+// the draws of a material follow each other in every view
+struct MaterialDraws
+{
+  const Material* material;
+  uint32_t firstDraw, numDraws;
+};
+
+// the draws of every view are culled on the GPU, which writes one indirect draw per mesh and view along with the
+// world matrices of its visible instances, so that the command buffers drawing them never have to change
+class CullingBuffer
+{
+private:
+  std::shared_ptr<Context> context;
+  std::shared_ptr<DescriptorPool> descriptorPool;
+  std::shared_ptr<DepthPyramid> depthPyramid;
+
+  std::unique_ptr<Buffer> meshInstanceBuffer;
+  // the draws of all views without any instances, copied over the draws at the start of every frame
+  std::unique_ptr<Buffer> drawTemplateBuffer;
+  // the first draw of the material of every draw
+  std::unique_ptr<Buffer> drawMaterialBuffer;
+  std::vector<std::unique_ptr<Buffer>> viewBuffers, drawBuffers, visibleInstanceBuffers, statisticsBuffers;
+  // the visible draws of every camera pass, moved to the front of the range of their material and counted at its first
+  // draw, only written when the culling pipeline compacts draws
+  std::vector<std::unique_ptr<Buffer>> compactedDrawBuffers, drawCountBuffers;
+  // only exist when culling occlusion
+  std::vector<std::unique_ptr<Buffer>> occludedBuffers;
+
+  static std::vector<vk::DescriptorSet>* createDescriptorSets(const std::shared_ptr<Context> context,
+                                                              const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                              const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                                              const CullingBuffer* cullingBuffer);
+  std::unique_ptr<std::vector<vk::DescriptorSet>> descriptorSets;
+
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context,
+                                                              vk::CommandBufferLevel level);
+  std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers, occlusionCommandBuffers;
+
+  // the views with draws include the second camera pass when culling occlusion
+  uint32_t numMeshInstances, numDraws, numViews, numDrawViews;
+
+  std::vector<MaterialDraws> materialDraws;
+
+  CullingPushConstants getPushConstants(const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                        uint32_t frameIndex,
+                                        bool secondPass) const;
+  // after culling, so that the culled draws of the camera can be read with a draw count
+  void recordDrawCompaction(const vk::CommandBuffer* commandBuffer,
+                            const std::shared_ptr<CullingPipeline> cullingPipeline,
+                            uint32_t frameIndex) const;
+
+public:
+  // the first view is the camera, followed by the cascades of every shadow map, the depth pyramid is only given when
+  // culling occlusion
+  CullingBuffer(const std::shared_ptr<Context> context,
+                const std::shared_ptr<DescriptorPool> descriptorPool,
+                const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                const std::vector<std::shared_ptr<Model>>* models,
+                uint32_t numViews,
+                const std::shared_ptr<DepthPyramid> depthPyramid = nullptr);
+  ~CullingBuffer();
+
+  // the recorded commands never change, so this only needs to happen once per frame in flight
+  void recordCommandBuffer(const std::shared_ptr<CullingPipeline> cullingPipeline,
+                           const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                           uint32_t frameIndex);
+  // builds the depth pyramid from the first camera pass and tests what it found occluded again for the second one,
+  // executed by the geometry pass between the two
+  void recordOcclusionCommandBuffer(const std::shared_ptr<CullingPipeline> cullingPipeline,
+                                    const std::shared_ptr<DepthPyramidPipeline> depthPyramidPipeline,
+                                    const std::shared_ptr<InstanceBuffer> instanceBuffer,
+                                    uint32_t frameIndex);
+
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
+  {
+    return &commandBuffers->at(frameIndex);
+  }
+  // a secondary command buffer, null unless culling occlusion
+  vk::CommandBuffer* getOcclusionCommandBuffer(const uint32_t frameIndex) const
+  {
+    return occlusionCommandBuffers ? &occlusionCommandBuffers->at(frameIndex) : nullptr;
+  }
+  // written by the host every frame
+  CullingViewData* getViewData(const uint32_t frameIndex) const
+  {
+    return static_cast<CullingViewData*>(viewBuffers.at(frameIndex)->getMemoryMappedLocation());
+  }
+  // six planes per view, written by the host every frame
+  glm::vec4* getViewPlanes(const uint32_t frameIndex) const
+  {
+    return reinterpret_cast<glm::vec4*>(getViewData(frameIndex) + 1);
+  }
+  // of the last frame with this index, so only valid once it is done
+  const CullingStatistics* getStatistics(const uint32_t frameIndex) const
+  {
+    return static_cast<const CullingStatistics*>(statisticsBuffers.at(frameIndex)->getMemoryMappedLocation());
+  }
+  Buffer* getDrawBuffer(const uint32_t frameIndex) const
+  {
+    return drawBuffers.at(frameIndex).get();
+  }
+  // bound as the instance vertex buffer at the offset of a view, the draws of every view start at the mesh instances
+  // they cover
+  Buffer* getVisibleInstanceBuffer(const uint32_t frameIndex) const
+  {
+    return visibleInstanceBuffers.at(frameIndex).get();
+  }
+  vk::DeviceSize getVisibleInstanceOffset(uint32_t view) const
+  {
+    return view * numMeshInstances * sizeof(Instance);
+  }
+  // bound as another instance vertex buffer next to the visible instances, for the bounds of their mesh
+  Buffer* getMeshInstanceBuffer() const
+  {
+    return meshInstanceBuffer.get();
+  }
+  vk::DeviceSize getDrawOffset(uint32_t view, uint32_t draw) const
+  {
+    return (view * numDraws + draw) * sizeof(vk::DrawIndexedIndirectCommand);
+  }
+  Buffer* getCompactedDrawBuffer(const uint32_t frameIndex) const
+  {
+    return compactedDrawBuffers.at(frameIndex).get();
+  }
+  Buffer* getDrawCountBuffer(const uint32_t frameIndex) const
+  {
+    return drawCountBuffers.at(frameIndex).get();
+  }
+  // the compacted draws of the second camera pass follow those of the first one
+  vk::DeviceSize getCompactedDrawOffset(bool secondPass, uint32_t draw) const
+  {
+    return ((secondPass ? numDraws : 0) + draw) * sizeof(vk::DrawIndexedIndirectCommand);
+  }
+  // the draw count of a material is stored at its first draw
+  vk::DeviceSize getDrawCountOffset(bool secondPass, uint32_t draw) const
+  {
+    return ((secondPass ? numDraws : 0) + draw) * sizeof(uint32_t);
+  }
+  // the draws of the second camera pass come after those of all views
+  uint32_t getSecondPassView() const
+  {
+    return numViews;
+  }
+  // one per mesh of every model, grouped by material and otherwise in the order the models and their meshes are stored
+  uint32_t getNumDraws() const
+  {
+    return numDraws;
+  }
+  // in the order the materials are first used
+  const std::vector<MaterialDraws>* getMaterialDraws() const
+  {
+    return &materialDraws;
+  }
+};
@@ -0,0 +1,50 @@
+#include "CullingPipeline.hpp"
+#include "renderer/Shader.hpp"
+
+const uint32_t CullingPipeline::WORK_GROUP_SIZE = 64;
+
+vk::PipelineLayout* CullingPipeline::createPipelineLayout(const std::shared_ptr<Context> context,
+                                                          const vk::DescriptorSetLayout* setLayout)
+{
+  auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo().setSetLayoutCount(1).setPSetLayouts(setLayout);
+  auto pushConstantRange =
+    vk::PushConstantRange().setStageFlags(vk::ShaderStageFlagBits::eCompute).setSize(sizeof(CullingPushConstants));
+  pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
+  pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRange);
+  auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
+  return new vk::PipelineLayout(pipelineLayout);
+}
+
+vk::Pipeline* CullingPipeline::createPipeline(const vk::PipelineLayout* pipelineLayout,
+                                              const std::shared_ptr<Context> context,
+                                              const std::string& shaderFilename)
+{
+  Shader computeShader(context, shaderFilename, vk::ShaderStageFlagBits::eCompute);
+
+  auto pipelineCreateInfo = vk::ComputePipelineCreateInfo()
+                              .setStage(computeShader.getPipelineShaderStageCreateInfo())
+                              .setLayout(*pipelineLayout);
+  auto pipeline = context->getDevice()->createComputePipeline(nullptr, pipelineCreateInfo);
+  return new vk::Pipeline(pipeline);
+}
+
+CullingPipeline::CullingPipeline(const std::shared_ptr<Context> context,
+                                 const std::shared_ptr<DescriptorPool> descriptorPool,
+                                 bool occlusionCulling)
+{
+  this->context = context;
+
+  const auto setLayout =
+    occlusionCulling ? descriptorPool->getOcclusionCullingLayout() : descriptorPool->getCullingLayout();
+  pipelineLayout = std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)>(
+    createPipelineLayout(context, setLayout), pipelineLayoutDeleter);
+  pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(
+    createPipeline(pipelineLayout.get(), context,
+                   occlusionCulling ? "shaders/OcclusionCulling.comp.spv" : "shaders/Culling.comp.spv"),
+    pipelineDeleter);
+  if (context->getCmdDrawIndexedIndirectCount())
+  {
+    compactionPipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(
+      createPipeline(pipelineLayout.get(), context, "shaders/DrawCompaction.comp.spv"), pipelineDeleter);
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "renderer/buffers/DescriptorPool.hpp"
+
+// matches the push constants of the culling shader
+struct CullingPushConstants
+{
+  uint32_t numMeshInstances, numDraws, numViews;
+  // index of the current frame's first world matrix in the instance buffer
+  uint32_t firstInstance;
+  uint32_t decodeShadowPositions;
+  // only read when culling occlusion, the second pass tests what the first one found occluded again
+  uint32_t secondPass;
+  // of the geometry buffer depth the depth pyramid is built from
+  uint32_t depthWidth, depthHeight;
+};
+
+class CullingPipeline
+{
+public:
+  // invocations per work group, as declared in the culling shader
+  static const uint32_t WORK_GROUP_SIZE;
+
+private:
+  std::shared_ptr<Context> context;
+
+  static vk::PipelineLayout* createPipelineLayout(const std::shared_ptr<Context> context,
+                                                  const vk::DescriptorSetLayout* setLayout);
+  std::function<void(vk::PipelineLayout*)> pipelineLayoutDeleter = [this](vk::PipelineLayout* pipelineLayout) {
+    if (context->getDevice())
+      context->getDevice()->destroyPipelineLayout(*pipelineLayout);
+  };
+  std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)> pipelineLayout;
+
+  static vk::Pipeline* createPipeline(const vk::PipelineLayout* pipelineLayout,
+                                      const std::shared_ptr<Context> context,
+                                      const std::string& shaderFilename);
+  std::function<void(vk::Pipeline*)> pipelineDeleter = [this](vk::Pipeline* pipeline) {
+    if (context->getDevice())
+      context->getDevice()->destroyPipeline(*pipeline);
+  };
+  // the compaction pipeline shares the layout and moves the visible draws of the camera to the front of the range of
+  // their material
+  std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> pipeline, compactionPipeline;
+
+public:
+  // occlusion culling additionally tests the camera's mesh instances against the depth pyramid
+  CullingPipeline(const std::shared_ptr<Context> context,
+                  const std::shared_ptr<DescriptorPool> descriptorPool,
+                  bool occlusionCulling);
+
+  vk::PipelineLayout* getPipelineLayout() const
+  {
+    return pipelineLayout.get();
+  }
+  vk::Pipeline* getPipeline() const
+  {
+    return pipeline.get();
+  }
+  // null unless the device supports indirect draw counts
+  vk::Pipeline* getCompactionPipeline() const
+  {
+    return compactionPipeline.get();
+  }
+};
@@ -0,0 +1,228 @@
+#include "DepthPyramid.hpp"
+
+#include <algorithm>
+
+const uint32_t DepthPyramid::MAX_MIP_LEVELS = 16;
+
+vk::Image* DepthPyramid::createImage(const std::shared_ptr<Context> context, const DepthPyramid* depthPyramid)
+{
+  const auto extent = depthPyramid->getMipLevelExtent(0);
+  auto imageCreateInfo = vk::ImageCreateInfo()
+                           .setImageType(vk::ImageType::e2D)
+                           .setExtent(vk::Extent3D(extent.width, extent.height, 1))
+                           .setMipLevels(depthPyramid->numMipLevels)
+                           .setArrayLayers(1);
+  imageCreateInfo.setFormat(vk::Format::eR32Sfloat)
+    .setInitialLayout(vk::ImageLayout::eUndefined)
+    .setUsage(vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
+  auto image = context->getDevice()->createImage(imageCreateInfo);
+  return new vk::Image(image);
+}
+
+MemoryAllocator::Allocation* DepthPyramid::createImageMemory(const std::shared_ptr<Context> context,
+                                                             const vk::Image* image)
+{
+  return context->getMemoryAllocator()->allocateForImage(*image, vk::MemoryPropertyFlagBits::eDeviceLocal);
+}
+
+vk::ImageView* DepthPyramid::createImageView(const std::shared_ptr<Context> context,
+                                             const vk::Image* image,
+                                             uint32_t firstMipLevel,
+                                             uint32_t numMipLevels)
+{
+  auto imageViewCreateInfo =
+    vk::ImageViewCreateInfo().setImage(*image).setViewType(vk::ImageViewType::e2D).setFormat(vk::Format::eR32Sfloat);
+  imageViewCreateInfo.setSubresourceRange(
+    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, firstMipLevel, numMipLevels, 0, 1));
+  auto imageView = context->getDevice()->createImageView(imageViewCreateInfo);
+  return new vk::ImageView(imageView);
+}
+
+std::vector<vk::ImageView>* DepthPyramid::createMipImageViews(const std::shared_ptr<Context> context,
+                                                              const vk::Image* image,
+                                                              uint32_t numMipLevels)
+{
+  auto mipImageViews = std::vector<vk::ImageView>(numMipLevels);
+  for (uint32_t i = 0; i < numMipLevels; ++i)
+  {
+    auto imageViewCreateInfo =
+      vk::ImageViewCreateInfo().setImage(*image).setViewType(vk::ImageViewType::e2D).setFormat(vk::Format::eR32Sfloat);
+    imageViewCreateInfo.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1));
+    mipImageViews[i] = context->getDevice()->createImageView(imageViewCreateInfo);
+  }
+  return new std::vector<vk::ImageView>(mipImageViews);
+}
+
+vk::Sampler* DepthPyramid::createSampler(const std::shared_ptr<Context> context, uint32_t numMipLevels)
+{
+  // the culling fetches texels directly, so nothing is ever filtered
+  auto samplerCreateInfo = vk::SamplerCreateInfo()
+                             .setMagFilter(vk::Filter::eNearest)
+                             .setMinFilter(vk::Filter::eNearest)
+                             .setMipmapMode(vk::SamplerMipmapMode::eNearest);
+  samplerCreateInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+  samplerCreateInfo.setMaxAnisotropy(1.0f).setMaxLod(static_cast<float>(numMipLevels));
+  auto sampler = context->getDevice()->createSampler(samplerCreateInfo);
+  return new vk::Sampler(sampler);
+}
+
+std::vector<vk::DescriptorSet>* DepthPyramid::createDescriptorSets(const std::shared_ptr<Context> context,
+                                                                   const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                                   const vk::ImageView* depthImageView,
+                                                                   const DepthPyramid* depthPyramid)
+{
+  std::vector<vk::DescriptorSetLayout> layouts(depthPyramid->numMipLevels, *descriptorPool->getDepthPyramidLayout());
+  auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
+                                     .setDescriptorPool(*descriptorPool->getPool())
+                                     .setDescriptorSetCount(static_cast<uint32_t>(layouts.size()))
+                                     .setPSetLayouts(layouts.data());
+  auto descriptorSets = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo);
+
+  for (uint32_t i = 0; i < descriptorSets.size(); ++i)
+  {
+    // the first level is reduced from the geometry buffer depth, all others from the level before them
+    auto sourceDescriptorImageInfo = vk::DescriptorImageInfo().setSampler(*depthPyramid->sampler);
+    if (i == 0)
+    {
+      sourceDescriptorImageInfo.setImageLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+        .setImageView(*depthImageView);
+    }
+    else
+    {
+      sourceDescriptorImageInfo.setImageLayout(vk::ImageLayout::eGeneral)
+        .setImageView(depthPyramid->mipImageViews->at(i - 1));
+    }
+
+    auto sourceWriteDescriptorSet = vk::WriteDescriptorSet()
+                                      .setDstBinding(0)
+                                      .setDstSet(descriptorSets.at(i))
+                                      .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    sourceWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&sourceDescriptorImageInfo);
+
+    auto destinationDescriptorImageInfo = vk::DescriptorImageInfo()
+                                            .setImageLayout(vk::ImageLayout::eGeneral)
+                                            .setImageView(depthPyramid->mipImageViews->at(i));
+    auto destinationWriteDescriptorSet = vk::WriteDescriptorSet()
+                                           .setDstBinding(1)
+                                           .setDstSet(descriptorSets.at(i))
+                                           .setDescriptorType(vk::DescriptorType::eStorageImage);
+    destinationWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&destinationDescriptorImageInfo);
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets = { sourceWriteDescriptorSet,
+                                                                destinationWriteDescriptorSet };
+    context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                               writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  return new std::vector<vk::DescriptorSet>(descriptorSets);
+}
+
+vk::Extent2D DepthPyramid::getMipLevelExtent(uint32_t mipLevel) const
+{
+  auto extent = vk::Extent2D(width, height);
+  for (uint32_t i = 0; i <= mipLevel; ++i)
+  {
+    extent.width = std::max((extent.width + 1) / 2, 1u);
+    extent.height = std::max((extent.height + 1) / 2, 1u);
+  }
+  return extent;
+}
+
+DepthPyramid::DepthPyramid(const std::shared_ptr<Window> window,
+                           const std::shared_ptr<Context> context,
+                           const std::shared_ptr<DescriptorPool> descriptorPool,
+                           const vk::ImageView* depthImageView)
+{
+  this->context = context;
+  this->descriptorPool = descriptorPool;
+
+  width = window->getWidth();
+  height = window->getHeight();
+
+  numMipLevels = 1;
+  while (numMipLevels < MAX_MIP_LEVELS)
+  {
+    const auto extent = getMipLevelExtent(numMipLevels - 1);
+    if (extent.width == 1 && extent.height == 1)
+    {
+      break;
+    }
+
+    ++numMipLevels;
+  }
+
+  image = std::unique_ptr<vk::Image, decltype(imageDeleter)>(createImage(context, this), imageDeleter);
+  imageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)>(
+    createImageMemory(context, image.get()), imageMemoryDeleter);
+  imageView = std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)>(
+    createImageView(context, image.get(), 0, numMipLevels), imageViewDeleter);
+  mipImageViews = std::unique_ptr<std::vector<vk::ImageView>, decltype(mipImageViewsDeleter)>(
+    createMipImageViews(context, image.get(), numMipLevels), mipImageViewsDeleter);
+  sampler =
+    std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context, numMipLevels), samplerDeleter);
+
+  // the pyramid never leaves the general layout, so that it is valid to sample before the first frame built it
+  auto commandBufferAllocateInfo =
+    vk::CommandBufferAllocateInfo().setCommandPool(*context->getCommandPoolOnce()).setCommandBufferCount(1);
+  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  commandBuffer.begin(commandBufferBeginInfo);
+
+  auto barrier = vk::ImageMemoryBarrier()
+                   .setOldLayout(vk::ImageLayout::eUndefined)
+                   .setNewLayout(vk::ImageLayout::eGeneral)
+                   .setImage(*image);
+  barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, numMipLevels, 0, 1));
+  barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+  commandBuffer.end();
+  auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&commandBuffer);
+  context->getQueue().submit({ submitInfo }, nullptr);
+  context->getQueue().waitIdle();
+  context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
+
+  descriptorSets = std::unique_ptr<std::vector<vk::DescriptorSet>>(
+    createDescriptorSets(context, descriptorPool, depthImageView, this));
+}
+
+DepthPyramid::~DepthPyramid()
+{
+  // explicitly free the descriptor sets because the pyramid is rebuilt along with the geometry buffer
+  context->getDevice()->freeDescriptorSets(*descriptorPool->getPool(), static_cast<uint32_t>(descriptorSets->size()),
+                                           descriptorSets->data());
+}
+
+void DepthPyramid::recordCommands(const vk::CommandBuffer* commandBuffer,
+                                  const std::shared_ptr<DepthPyramidPipeline> depthPyramidPipeline) const
+{
+  commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, *depthPyramidPipeline->getPipeline());
+
+  for (uint32_t i = 0; i < numMipLevels; ++i)
+  {
+    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, *depthPyramidPipeline->getPipelineLayout(), 0,
+                                      1, &descriptorSets->at(i), 0, nullptr);
+
+    const auto extent = getMipLevelExtent(i);
+    commandBuffer->dispatch((extent.width + DepthPyramidPipeline::WORK_GROUP_SIZE - 1) /
+                              DepthPyramidPipeline::WORK_GROUP_SIZE,
+                            (extent.height + DepthPyramidPipeline::WORK_GROUP_SIZE - 1) /
+                              DepthPyramidPipeline::WORK_GROUP_SIZE,
+                            1);
+
+    // the next level is reduced from this one
+    auto barrier = vk::ImageMemoryBarrier()
+                     .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                     .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+                     .setOldLayout(vk::ImageLayout::eGeneral)
+                     .setNewLayout(vk::ImageLayout::eGeneral);
+    barrier.setImage(*image).setSubresourceRange(
+      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1));
+    commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                   vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), 0, nullptr, 0,
+                                   nullptr, 1, &barrier);
+  }
+}
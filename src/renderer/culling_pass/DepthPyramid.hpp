@@ -0,0 +1,103 @@
+#pragma once
+
+#include "DepthPyramidPipeline.hpp"
+#include "core/Window.hpp"
+
+// the farthest depth of the geometry buffer over ever larger regions, the first level halves the geometry buffer and
+// each further level halves the one before it, rounding up, until a single texel is left
+class DepthPyramid
+{
+public:
+  // enough for a geometry buffer of 65536 pixels along its longer side
+  static const uint32_t MAX_MIP_LEVELS;
+
+private:
+  std::shared_ptr<Context> context;
+  std::shared_ptr<DescriptorPool> descriptorPool;
+
+  uint32_t width, height, numMipLevels;
+
+  static vk::Image* createImage(const std::shared_ptr<Context> context, const DepthPyramid* depthPyramid);
+  std::function<void(vk::Image*)> imageDeleter = [this](vk::Image* image) {
+    if (context->getDevice())
+      context->getDevice()->destroyImage(*image);
+  };
+  std::unique_ptr<vk::Image, decltype(imageDeleter)> image;
+
+  static MemoryAllocator::Allocation* createImageMemory(const std::shared_ptr<Context> context, const vk::Image* image);
+  std::function<void(MemoryAllocator::Allocation*)> imageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* imageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(imageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)> imageMemory;
+
+  static vk::ImageView* createImageView(const std::shared_ptr<Context> context,
+                                        const vk::Image* image,
+                                        uint32_t firstMipLevel,
+                                        uint32_t numMipLevels);
+  std::function<void(vk::ImageView*)> imageViewDeleter = [this](vk::ImageView* imageView) {
+    if (context->getDevice())
+      context->getDevice()->destroyImageView(*imageView);
+  };
+  std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)> imageView;
+
+  // one per level, written by the reduction into it and read by the reduction into the next
+  static std::vector<vk::ImageView>*
+  createMipImageViews(const std::shared_ptr<Context> context, const vk::Image* image, uint32_t numMipLevels);
+  std::function<void(std::vector<vk::ImageView>*)> mipImageViewsDeleter =
+    [this](std::vector<vk::ImageView>* mipImageViews) {
+      if (context->getDevice())
+      {
+        for (auto& mipImageView : *mipImageViews)
+          context->getDevice()->destroyImageView(mipImageView);
+      }
+    };
+  std::unique_ptr<std::vector<vk::ImageView>, decltype(mipImageViewsDeleter)> mipImageViews;
+
+  static vk::Sampler* createSampler(const std::shared_ptr<Context> context, uint32_t numMipLevels);
+  std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
+    if (context->getDevice())
+      context->getDevice()->destroySampler(*sampler);
+  };
+  std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
+
+  static std::vector<vk::DescriptorSet>* createDescriptorSets(const std::shared_ptr<Context> context,
+                                                              const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                              const vk::ImageView* depthImageView,
+                                                              const DepthPyramid* depthPyramid);
+  std::unique_ptr<std::vector<vk::DescriptorSet>> descriptorSets;
+
+  vk::Extent2D getMipLevelExtent(uint32_t mipLevel) const;
+
+public:
+  // built from the given geometry buffer depth, which has to be sampled as read only depth
+  DepthPyramid(const std::shared_ptr<Window> window,
+               const std::shared_ptr<Context> context,
+               const std::shared_ptr<DescriptorPool> descriptorPool,
+               const vk::ImageView* depthImageView);
+  ~DepthPyramid();
+
+  // reduces the depth into every level in turn, the pyramid stays in the general layout so that it can be sampled
+  // right after
+  void recordCommands(const vk::CommandBuffer* commandBuffer,
+                      const std::shared_ptr<DepthPyramidPipeline> depthPyramidPipeline) const;
+
+  vk::ImageView* getImageView() const
+  {
+    return imageView.get();
+  }
+  vk::Sampler* getSampler() const
+  {
+    return sampler.get();
+  }
+  // of the geometry buffer depth the pyramid is built from
+  uint32_t getWidth() const
+  {
+    return width;
+  }
+  uint32_t getHeight() const
+  {
+    return height;
+  }
+};
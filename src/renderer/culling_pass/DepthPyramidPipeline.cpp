@@ -0,0 +1,35 @@
+#include "DepthPyramidPipeline.hpp"
+#include "renderer/Shader.hpp"
+
+const uint32_t DepthPyramidPipeline::WORK_GROUP_SIZE = 8;
+
+vk::PipelineLayout* DepthPyramidPipeline::createPipelineLayout(const std::shared_ptr<Context> context,
+                                                               const vk::DescriptorSetLayout* setLayout)
+{
+  auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo().setSetLayoutCount(1).setPSetLayouts(setLayout);
+  auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
+  return new vk::PipelineLayout(pipelineLayout);
+}
+
+vk::Pipeline* DepthPyramidPipeline::createPipeline(const vk::PipelineLayout* pipelineLayout,
+                                                   const std::shared_ptr<Context> context)
+{
+  Shader computeShader(context, "shaders/DepthPyramid.comp.spv", vk::ShaderStageFlagBits::eCompute);
+
+  auto pipelineCreateInfo = vk::ComputePipelineCreateInfo()
+                              .setStage(computeShader.getPipelineShaderStageCreateInfo())
+                              .setLayout(*pipelineLayout);
+  auto pipeline = context->getDevice()->createComputePipeline(nullptr, pipelineCreateInfo);
+  return new vk::Pipeline(pipeline);
+}
+
+DepthPyramidPipeline::DepthPyramidPipeline(const std::shared_ptr<Context> context,
+                                           const std::shared_ptr<DescriptorPool> descriptorPool)
+{
+  this->context = context;
+
+  pipelineLayout = std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)>(
+    createPipelineLayout(context, descriptorPool->getDepthPyramidLayout()), pipelineLayoutDeleter);
+  pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(createPipeline(pipelineLayout.get(), context),
+                                                                      pipelineDeleter);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "renderer/buffers/DescriptorPool.hpp"
+
+class DepthPyramidPipeline
+{
+public:
+  // invocations per work group along each axis, as declared in the depth pyramid shader
+  static const uint32_t WORK_GROUP_SIZE;
+
+private:
+  std::shared_ptr<Context> context;
+
+  static vk::PipelineLayout* createPipelineLayout(const std::shared_ptr<Context> context,
+                                                  const vk::DescriptorSetLayout* setLayout);
+  std::function<void(vk::PipelineLayout*)> pipelineLayoutDeleter = [this](vk::PipelineLayout* pipelineLayout) {
+    if (context->getDevice())
+      context->getDevice()->destroyPipelineLayout(*pipelineLayout);
+  };
+  std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)> pipelineLayout;
+
+  static vk::Pipeline* createPipeline(const vk::PipelineLayout* pipelineLayout, const std::shared_ptr<Context> context);
+  std::function<void(vk::Pipeline*)> pipelineDeleter = [this](vk::Pipeline* pipeline) {
+    if (context->getDevice())
+      context->getDevice()->destroyPipeline(*pipeline);
+  };
+  std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> pipeline;
+
+public:
+  DepthPyramidPipeline(const std::shared_ptr<Context> context, const std::shared_ptr<DescriptorPool> descriptorPool);
+
+  vk::PipelineLayout* getPipelineLayout() const
+  {
+    return pipelineLayout.get();
+  }
+  vk::Pipeline* getPipeline() const
+  {
+    return pipeline.get();
+  }
+};
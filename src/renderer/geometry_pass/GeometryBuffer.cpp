@@ -1,8 +1,11 @@
 #include "GeometryBuffer.hpp"
+#include "renderer/Culling.hpp"
 #include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
 
-std::vector<vk::Image>*
-GeometryBuffer::createImages(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context)
+std::vector<vk::Image>* GeometryBuffer::createImages(const std::shared_ptr<Window> window,
+                                                     const std::shared_ptr<Context> context,
+                                                     bool occlusionCulling)
 {
   std::vector<vk::Image> images;
 
@@ -12,7 +15,11 @@ GeometryBuffer::createImages(const std::shared_ptr<Window> window, const std::sh
                            .setMipLevels(1)
                            .setArrayLayers(1);
   imageCreateInfo.setInitialLayout(vk::ImageLayout::ePreinitialized)
-    .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
+    .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+  if (!occlusionCulling)
+  {
+    imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+  }
 
   // albedo and metallic
   imageCreateInfo.setFormat(vk::Format::eR8G8B8A8Unorm);
@@ -25,41 +32,22 @@ GeometryBuffer::createImages(const std::shared_ptr<Window> window, const std::sh
   return new std::vector<vk::Image>(images);
 }
 
-std::vector<vk::DeviceMemory>* GeometryBuffer::createImagesMemory(const std::shared_ptr<Context> context,
-                                                                  const std::vector<vk::Image>* images,
-                                                                  vk::MemoryPropertyFlags memoryPropertyFlags)
+std::vector<MemoryAllocator::Allocation*>* GeometryBuffer::createImagesMemory(const std::shared_ptr<Context> context,
+                                                                            const std::vector<vk::Image>* images,
+                                                                            bool occlusionCulling)
 {
-  auto imagesMemory = std::vector<vk::DeviceMemory>(images->size());
+  // the geometry buffer is only read by the lighting subpass, so it never has to leave the render pass, unless it is
+  // kept between the two passes of occlusion culling
+  auto imagesMemory = std::vector<MemoryAllocator::Allocation*>(images->size());
   for (size_t i = 0; i < imagesMemory.size(); ++i)
   {
-    auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(images->at(i));
-    auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-    uint32_t memoryTypeIndex = 0;
-    bool foundMatch = false;
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-    {
-      if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-          (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-      {
-        memoryTypeIndex = i;
-        foundMatch = true;
-        break;
-      }
-    }
-
-    if (!foundMatch)
-    {
-      throw std::runtime_error("Failed to find suitable memory type for geometry buffer image.");
-    }
-
-    auto memoryAllocateInfo =
-      vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-    imagesMemory[i] = context->getDevice()->allocateMemory(memoryAllocateInfo);
-    context->getDevice()->bindImageMemory(images->at(i), imagesMemory[i], 0);
+    imagesMemory[i] =
+      occlusionCulling ?
+        context->getMemoryAllocator()->allocateForImage(images->at(i), vk::MemoryPropertyFlagBits::eDeviceLocal) :
+        context->getMemoryAllocator()->allocateForTransientImage(images->at(i));
   }
 
-  return new std::vector<vk::DeviceMemory>(imagesMemory);
+  return new std::vector<MemoryAllocator::Allocation*>(imagesMemory);
 }
 
 std::vector<vk::ImageView>*
@@ -83,8 +71,9 @@ GeometryBuffer::createImageViews(const std::shared_ptr<Context> context, const s
   return new std::vector<vk::ImageView>(imageViews);
 }
 
-vk::Image*
-GeometryBuffer::createDepthImage(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context)
+vk::Image* GeometryBuffer::createDepthImage(const std::shared_ptr<Window> window,
+                                            const std::shared_ptr<Context> context,
+                                            bool sampled)
 {
   auto imageCreateInfo = vk::ImageCreateInfo()
                            .setImageType(vk::ImageType::e2D)
@@ -93,41 +82,29 @@ GeometryBuffer::createDepthImage(const std::shared_ptr<Window> window, const std
                            .setArrayLayers(1);
   imageCreateInfo.setFormat(vk::Format::eD32Sfloat)
     .setInitialLayout(vk::ImageLayout::ePreinitialized)
-    .setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
+    .setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment);
+  if (sampled)
+  {
+    imageCreateInfo.usage |= vk::ImageUsageFlagBits::eSampled;
+  }
+  else
+  {
+    imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+  }
   auto image = context->getDevice()->createImage(imageCreateInfo);
   return new vk::Image(image);
 }
 
-vk::DeviceMemory* GeometryBuffer::createDepthImageMemory(const std::shared_ptr<Context> context,
-                                                         const vk::Image* image,
-                                                         vk::MemoryPropertyFlags memoryPropertyFlags)
+MemoryAllocator::Allocation* GeometryBuffer::createDepthImageMemory(const std::shared_ptr<Context> context,
+                                                                    const vk::Image* image,
+                                                                    bool sampled)
 {
-  auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(*image);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+  if (sampled)
   {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for depth image.");
+    return context->getMemoryAllocator()->allocateForImage(*image, vk::MemoryPropertyFlagBits::eDeviceLocal);
   }
 
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindImageMemory(*image, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
+  return context->getMemoryAllocator()->allocateForTransientImage(*image);
 }
 
 vk::ImageView* GeometryBuffer::createDepthImageView(const std::shared_ptr<Context> context, const vk::Image* image)
@@ -139,16 +116,34 @@ vk::ImageView* GeometryBuffer::createDepthImageView(const std::shared_ptr<Contex
   return new vk::ImageView(depthImageView);
 }
 
-vk::RenderPass* GeometryBuffer::createRenderPass(const std::shared_ptr<Context> context)
+vk::RenderPass* GeometryBuffer::createRenderPass(const std::shared_ptr<Context> context,
+                                                 bool occlusionCulling,
+                                                 bool keepDepth,
+                                                 bool firstPass)
 {
   std::vector<vk::AttachmentDescription> attachmentDescriptions;
 
+  // the geometry buffer is cleared and thrown away within the render pass, only the lighting buffer is kept, while the
+  // two passes of occlusion culling only differ in these operations and layouts, which keeps them compatible
   auto attachmentDescription = vk::AttachmentDescription()
                                  .setLoadOp(vk::AttachmentLoadOp::eClear)
+                                 .setStoreOp(vk::AttachmentStoreOp::eDontCare)
                                  .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
                                  .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+  if (occlusionCulling && firstPass)
+  {
+    attachmentDescription.setStoreOp(vk::AttachmentStoreOp::eStore);
+  }
+  else if (occlusionCulling)
+  {
+    attachmentDescription.setLoadOp(vk::AttachmentLoadOp::eLoad);
+  }
 
   // albedo and metallic
+  if (occlusionCulling && !firstPass)
+  {
+    attachmentDescription.setInitialLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+  }
   attachmentDescription.setFormat(vk::Format::eR8G8B8A8Unorm).setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
   attachmentDescriptions.push_back(attachmentDescription);
 
@@ -157,28 +152,88 @@ vk::RenderPass* GeometryBuffer::createRenderPass(const std::shared_ptr<Context>
   attachmentDescriptions.push_back(attachmentDescription);
 
   // depth
+  if (occlusionCulling && !firstPass)
+  {
+    attachmentDescription.setInitialLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+  }
+  if (keepDepth)
+  {
+    attachmentDescription.setStoreOp(vk::AttachmentStoreOp::eStore);
+  }
   attachmentDescription.setFormat(vk::Format::eD32Sfloat).setFinalLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal);
   attachmentDescriptions.push_back(attachmentDescription);
 
-  std::vector<vk::AttachmentReference> colorAttachmentReferences;
+  // lighting fullscale and halfscale, which the first pass leaves alone
+  attachmentDescription.setLoadOp(vk::AttachmentLoadOp::eClear)
+    .setStoreOp(vk::AttachmentStoreOp::eStore)
+    .setFormat(vk::Format::eR8G8B8A8Unorm)
+    .setInitialLayout(vk::ImageLayout::eUndefined)
+    .setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+  if (occlusionCulling && firstPass)
+  {
+    attachmentDescription.setLoadOp(vk::AttachmentLoadOp::eDontCare).setStoreOp(vk::AttachmentStoreOp::eDontCare);
+  }
+  attachmentDescriptions.push_back(attachmentDescription);
+  attachmentDescriptions.push_back(attachmentDescription);
+
+  // geometry subpass
+
+  std::vector<vk::AttachmentReference> geometryColorAttachmentReferences;
 
   // albedo and metallic
-  colorAttachmentReferences.push_back(
+  geometryColorAttachmentReferences.push_back(
     vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
 
   // world-space normal and roughness
-  colorAttachmentReferences.push_back(
+  geometryColorAttachmentReferences.push_back(
     vk::AttachmentReference().setAttachment(1).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
 
   auto depthAttachmentReference =
     vk::AttachmentReference().setAttachment(2).setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
-  auto subpassDescription = vk::SubpassDescription()
-                              .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-                              .setColorAttachmentCount(static_cast<uint32_t>(colorAttachmentReferences.size()));
-  subpassDescription.setPColorAttachments(colorAttachmentReferences.data())
+  // lighting subpass
+
+  std::vector<vk::AttachmentReference> lightingInputAttachmentReferences;
+
+  // albedo and metallic
+  lightingInputAttachmentReferences.push_back(
+    vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eShaderReadOnlyOptimal));
+
+  // world-space normal and roughness
+  lightingInputAttachmentReferences.push_back(
+    vk::AttachmentReference().setAttachment(1).setLayout(vk::ImageLayout::eShaderReadOnlyOptimal));
+
+  // depth
+  lightingInputAttachmentReferences.push_back(
+    vk::AttachmentReference().setAttachment(2).setLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal));
+
+  std::vector<vk::AttachmentReference> lightingColorAttachmentReferences;
+
+  // fullscale
+  lightingColorAttachmentReferences.push_back(
+    vk::AttachmentReference().setAttachment(3).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
+
+  // halfscale
+  lightingColorAttachmentReferences.push_back(
+    vk::AttachmentReference().setAttachment(4).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
+
+  std::array<vk::SubpassDescription, 2> subpassDescriptions;
+
+  subpassDescriptions[0]
+    .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+    .setColorAttachmentCount(static_cast<uint32_t>(geometryColorAttachmentReferences.size()));
+  subpassDescriptions[0]
+    .setPColorAttachments(geometryColorAttachmentReferences.data())
     .setPDepthStencilAttachment(&depthAttachmentReference);
 
+  subpassDescriptions[1]
+    .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+    .setInputAttachmentCount(static_cast<uint32_t>(lightingInputAttachmentReferences.size()))
+    .setPInputAttachments(lightingInputAttachmentReferences.data());
+  subpassDescriptions[1]
+    .setColorAttachmentCount(static_cast<uint32_t>(lightingColorAttachmentReferences.size()))
+    .setPColorAttachments(lightingColorAttachmentReferences.data());
+
   std::vector<vk::SubpassDependency> subpassDependencies;
 
   auto subpassDependency = vk::SubpassDependency()
@@ -191,7 +246,18 @@ vk::RenderPass* GeometryBuffer::createRenderPass(const std::shared_ptr<Context>
   subpassDependency.setDependencyFlags(vk::DependencyFlagBits::eByRegion);
   subpassDependencies.push_back(subpassDependency);
 
+  // each light only reads the geometry buffer at its own pixel, so the lighting can start region by region
   subpassDependency.setSrcSubpass(0)
+    .setDstSubpass(1)
+    .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput |
+                     vk::PipelineStageFlagBits::eLateFragmentTests)
+    .setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader);
+  subpassDependency
+    .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+    .setDstAccessMask(vk::AccessFlagBits::eInputAttachmentRead);
+  subpassDependencies.push_back(subpassDependency);
+
+  subpassDependency.setSrcSubpass(1)
     .setDstSubpass(VK_SUBPASS_EXTERNAL)
     .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
     .setDstStageMask(vk::PipelineStageFlagBits::eBottomOfPipe);
@@ -203,8 +269,8 @@ vk::RenderPass* GeometryBuffer::createRenderPass(const std::shared_ptr<Context>
   auto renderPassCreateInfo = vk::RenderPassCreateInfo()
                                 .setAttachmentCount(static_cast<uint32_t>(attachmentDescriptions.size()))
                                 .setPAttachments(attachmentDescriptions.data());
-  renderPassCreateInfo.setSubpassCount(1)
-    .setPSubpasses(&subpassDescription)
+  renderPassCreateInfo.setSubpassCount(static_cast<uint32_t>(subpassDescriptions.size()))
+    .setPSubpasses(subpassDescriptions.data())
     .setDependencyCount(static_cast<uint32_t>(subpassDependencies.size()))
     .setPDependencies(subpassDependencies.data());
   auto renderPass = context->getDevice()->createRenderPass(renderPassCreateInfo);
@@ -215,10 +281,12 @@ vk::Framebuffer* GeometryBuffer::createFramebuffer(const std::shared_ptr<Window>
                                                    const std::shared_ptr<Context> context,
                                                    const std::vector<vk::ImageView>* imageViews,
                                                    const vk::ImageView* depthImageView,
+                                                   const std::vector<vk::ImageView>* lightingImageViews,
                                                    const vk::RenderPass* renderPass)
 {
   std::vector<vk::ImageView> attachments(*imageViews);
   attachments.push_back(*depthImageView);
+  attachments.insert(attachments.end(), lightingImageViews->begin(), lightingImageViews->end());
 
   auto framebufferCreateInfo =
     vk::FramebufferCreateInfo().setRenderPass(*renderPass).setWidth(window->getWidth()).setHeight(window->getHeight());
@@ -228,40 +296,26 @@ vk::Framebuffer* GeometryBuffer::createFramebuffer(const std::shared_ptr<Window>
   return new vk::Framebuffer(context->getDevice()->createFramebuffer(framebufferCreateInfo));
 }
 
-vk::Sampler* GeometryBuffer::createSampler(const std::shared_ptr<Context> context)
+std::vector<vk::CommandBuffer>* GeometryBuffer::createCommandBuffers(const std::shared_ptr<Context> context)
 {
-  auto samplerCreateInfo = vk::SamplerCreateInfo()
-                             .setMagFilter(vk::Filter::eNearest)
-                             .setMinFilter(vk::Filter::eNearest)
-                             .setMipmapMode(vk::SamplerMipmapMode::eLinear);
-  samplerCreateInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
-    .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
-    .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
-  samplerCreateInfo.setMaxAnisotropy(1.0f).setMaxLod(1.0f).setBorderColor(vk::BorderColor::eFloatOpaqueWhite);
-  auto sampler = context->getDevice()->createSampler(samplerCreateInfo);
-  return new vk::Sampler(sampler);
-}
-
-vk::CommandBuffer* GeometryBuffer::createCommandBuffer(const std::shared_ptr<Context> context)
-{
-  vk::CommandBuffer commandBuffer;
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
   auto commandBufferAllocateInfo =
     vk::CommandBufferAllocateInfo()
       .setCommandPool(Settings::reuseCommandBuffers ? *context->getCommandPoolOnce() : *context->getCommandPoolRepeat())
-      .setCommandBufferCount(1);
-  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, &commandBuffer) != vk::Result::eSuccess)
+      .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
+  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, commandBuffers.data()) !=
+      vk::Result::eSuccess)
   {
-    throw std::runtime_error("Failed to allocate command buffer.");
+    throw std::runtime_error("Failed to allocate command buffers.");
   }
 
-  return new vk::CommandBuffer(commandBuffer);
+  return new std::vector<vk::CommandBuffer>(commandBuffers);
 }
 
 vk::DescriptorSet* GeometryBuffer::createDescriptorSet(const std::shared_ptr<Context> context,
                                                        const std::shared_ptr<DescriptorPool> descriptorPool,
                                                        const std::vector<vk::ImageView>* imageViews,
-                                                       const vk::ImageView* depthImageView,
-                                                       const vk::Sampler* sampler)
+                                                       const vk::ImageView* depthImageView)
 {
   auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
                                      .setDescriptorPool(*descriptorPool->getPool())
@@ -270,41 +324,36 @@ vk::DescriptorSet* GeometryBuffer::createDescriptorSet(const std::shared_ptr<Con
   auto descriptorSet = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo).at(0);
 
   // albedo and metallic
-  auto albedoDescriptorImageInfo = vk::DescriptorImageInfo()
-                                     .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-                                     .setImageView(imageViews->at(0))
-                                     .setSampler(*sampler);
-  auto albedoSamplerWriteDescriptorSet = vk::WriteDescriptorSet()
-                                           .setDstBinding(0)
-                                           .setDstSet(descriptorSet)
-                                           .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-  albedoSamplerWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&albedoDescriptorImageInfo);
+  auto albedoDescriptorImageInfo =
+    vk::DescriptorImageInfo().setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal).setImageView(imageViews->at(0));
+  auto albedoInputWriteDescriptorSet = vk::WriteDescriptorSet()
+                                         .setDstBinding(0)
+                                         .setDstSet(descriptorSet)
+                                         .setDescriptorType(vk::DescriptorType::eInputAttachment);
+  albedoInputWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&albedoDescriptorImageInfo);
 
   // world-space normal and roughness
-  auto normalDescriptorImageInfo = vk::DescriptorImageInfo()
-                                     .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-                                     .setImageView(imageViews->at(1))
-                                     .setSampler(*sampler);
-  auto normalSamplerWriteDescriptorSet = vk::WriteDescriptorSet()
-                                           .setDstBinding(1)
-                                           .setDstSet(descriptorSet)
-                                           .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-  normalSamplerWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&normalDescriptorImageInfo);
+  auto normalDescriptorImageInfo =
+    vk::DescriptorImageInfo().setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal).setImageView(imageViews->at(1));
+  auto normalInputWriteDescriptorSet = vk::WriteDescriptorSet()
+                                         .setDstBinding(1)
+                                         .setDstSet(descriptorSet)
+                                         .setDescriptorType(vk::DescriptorType::eInputAttachment);
+  normalInputWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&normalDescriptorImageInfo);
 
   // depth
   auto depthDescriptorImageInfo = vk::DescriptorImageInfo()
                                     .setImageLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
-                                    .setImageView(*depthImageView)
-                                    .setSampler(*sampler);
-  auto depthSamplerWriteDescriptorSet = vk::WriteDescriptorSet()
-                                          .setDstBinding(2)
-                                          .setDstSet(descriptorSet)
-                                          .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-  depthSamplerWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&depthDescriptorImageInfo);
-
-  std::vector<vk::WriteDescriptorSet> writeDescriptorSets = { albedoSamplerWriteDescriptorSet,
-                                                              normalSamplerWriteDescriptorSet,
-                                                              depthSamplerWriteDescriptorSet };
+                                    .setImageView(*depthImageView);
+  auto depthInputWriteDescriptorSet = vk::WriteDescriptorSet()
+                                        .setDstBinding(2)
+                                        .setDstSet(descriptorSet)
+                                        .setDescriptorType(vk::DescriptorType::eInputAttachment);
+  depthInputWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&depthDescriptorImageInfo);
+
+  std::vector<vk::WriteDescriptorSet> writeDescriptorSets = { albedoInputWriteDescriptorSet,
+                                                              normalInputWriteDescriptorSet,
+                                                              depthInputWriteDescriptorSet };
   context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
                                              writeDescriptorSets.data(), 0, nullptr);
   return new vk::DescriptorSet(descriptorSet);
@@ -312,77 +361,161 @@ vk::DescriptorSet* GeometryBuffer::createDescriptorSet(const std::shared_ptr<Con
 
 GeometryBuffer::GeometryBuffer(const std::shared_ptr<Window> window,
                                const std::shared_ptr<Context> context,
-                               const std::shared_ptr<DescriptorPool> descriptorPool)
+                               const std::shared_ptr<DescriptorPool> descriptorPool,
+                               const std::vector<vk::ImageView>* lightingImageViews,
+                               bool occlusionCulling,
+                               bool keepDepth)
 {
   this->window = window;
   this->context = context;
+  this->occlusionCulling = occlusionCulling;
 
-  images =
-    std::unique_ptr<std::vector<vk::Image>, decltype(imagesDeleter)>(createImages(window, context), imagesDeleter);
-  imagesMemory = std::unique_ptr<std::vector<vk::DeviceMemory>, decltype(imagesMemoryDeleter)>(
-    createImagesMemory(context, images.get(), vk::MemoryPropertyFlagBits::eDeviceLocal), imagesMemoryDeleter);
+  images = std::unique_ptr<std::vector<vk::Image>, decltype(imagesDeleter)>(
+    createImages(window, context, occlusionCulling), imagesDeleter);
+  imagesMemory = std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(imagesMemoryDeleter)>(
+    createImagesMemory(context, images.get(), occlusionCulling), imagesMemoryDeleter);
   imageViews =
     std::unique_ptr<std::vector<vk::ImageView>, decltype(imageViewsDeleter)>(createImageViews(context, images.get()),
                                                                              imageViewsDeleter);
 
-  depthImage =
-    std::unique_ptr<vk::Image, decltype(depthImageDeleter)>(createDepthImage(window, context), depthImageDeleter);
-  depthImageMemory = std::unique_ptr<vk::DeviceMemory, decltype(depthImageMemoryDeleter)>(
-    createDepthImageMemory(context, depthImage.get(), vk::MemoryPropertyFlagBits::eDeviceLocal),
-    depthImageMemoryDeleter);
+  depthImage = std::unique_ptr<vk::Image, decltype(depthImageDeleter)>(
+    createDepthImage(window, context, occlusionCulling || keepDepth), depthImageDeleter);
+  depthImageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(depthImageMemoryDeleter)>(
+    createDepthImageMemory(context, depthImage.get(), occlusionCulling || keepDepth), depthImageMemoryDeleter);
   depthImageView =
     std::unique_ptr<vk::ImageView, decltype(depthImageViewDeleter)>(createDepthImageView(context, depthImage.get()),
                                                                     depthImageViewDeleter);
 
-  renderPass =
-    std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(createRenderPass(context), renderPassDeleter);
+  renderPass = std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(
+    createRenderPass(context, occlusionCulling, keepDepth), renderPassDeleter);
+  if (occlusionCulling)
+  {
+    firstPassRenderPass = std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(
+      createRenderPass(context, occlusionCulling, keepDepth, true), renderPassDeleter);
+  }
 
   framebuffer = std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)>(
-    createFramebuffer(window, context, imageViews.get(), depthImageView.get(), renderPass.get()), framebufferDeleter);
+    createFramebuffer(window, context, imageViews.get(), depthImageView.get(), lightingImageViews, renderPass.get()),
+    framebufferDeleter);
 
-  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context), samplerDeleter);
-
-  auto commandBufferAllocateInfo =
-    vk::CommandBufferAllocateInfo().setCommandPool(*context->getCommandPoolOnce()).setCommandBufferCount(1);
-  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
-  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  commandBuffer.begin(commandBufferBeginInfo);
-
-  auto barrier = vk::ImageMemoryBarrier()
-                   .setOldLayout(vk::ImageLayout::eUndefined)
-                   .setNewLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
-                   .setImage(*depthImage);
-  barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1));
-  barrier.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead |
-                           vk::AccessFlagBits::eDepthStencilAttachmentWrite);
-  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eEarlyFragmentTests,
-                                vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
-
-  commandBuffer.end();
-  auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&commandBuffer);
-  context->getQueue().submit({ submitInfo }, nullptr);
-  context->getQueue().waitIdle();
-  context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
-
-  this->commandBuffer = std::unique_ptr<vk::CommandBuffer>(createCommandBuffer(context));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context));
 
   descriptorSet = std::unique_ptr<vk::DescriptorSet>(
-    createDescriptorSet(context, descriptorPool, imageViews.get(), depthImageView.get(), sampler.get()));
+    createDescriptorSet(context, descriptorPool, imageViews.get(), depthImageView.get()));
+}
+
+void GeometryBuffer::recordMeshes(const vk::CommandBuffer* commandBuffer,
+                                  const std::shared_ptr<GeometryPipeline> geometryPipeline,
+                                  const std::vector<std::shared_ptr<Model>>* models,
+                                  uint32_t frameIndex,
+                                  const std::vector<uint8_t>* visibility,
+                                  const CullingBuffer* cullingBuffer,
+                                  uint32_t cullingView) const
+{
+  auto pipelineLayout = geometryPipeline->getPipelineLayout();
+
+  // the draws of a material follow each other in the culling buffer, so each material is bound once and all of its
+  // meshes are drawn with one call, the bounds of compressed positions come with the instances
+  if (cullingBuffer)
+  {
+    const auto drawBuffer = cullingBuffer->getDrawBuffer(frameIndex)->getBuffer();
+    const auto secondPass = cullingView == cullingBuffer->getSecondPassView();
+    const auto drawIndexedIndirectCount = context->getCmdDrawIndexedIndirectCount();
+    for (const auto& materialDraws : *cullingBuffer->getMaterialDraws())
+    {
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        materialDraws.material->getDescriptorSet(), 0, nullptr);
+
+      // the culling pass moved the visible draws of the material to the front of its range and counted them
+      if (drawIndexedIndirectCount)
+      {
+        drawIndexedIndirectCount(
+          static_cast<VkCommandBuffer>(*commandBuffer),
+          static_cast<VkBuffer>(*cullingBuffer->getCompactedDrawBuffer(frameIndex)->getBuffer()),
+          cullingBuffer->getCompactedDrawOffset(secondPass, materialDraws.firstDraw),
+          static_cast<VkBuffer>(*cullingBuffer->getDrawCountBuffer(frameIndex)->getBuffer()),
+          cullingBuffer->getDrawCountOffset(secondPass, materialDraws.firstDraw), materialDraws.numDraws,
+          sizeof(vk::DrawIndexedIndirectCommand));
+      }
+      else if (context->getEnabledFeatures().multiDrawIndirect)
+      {
+        commandBuffer->drawIndexedIndirect(*drawBuffer,
+                                           cullingBuffer->getDrawOffset(cullingView, materialDraws.firstDraw),
+                                           materialDraws.numDraws, sizeof(vk::DrawIndexedIndirectCommand));
+      }
+      else
+      {
+        for (uint32_t i = 0; i < materialDraws.numDraws; ++i)
+        {
+          commandBuffer->drawIndexedIndirect(*drawBuffer,
+                                             cullingBuffer->getDrawOffset(cullingView, materialDraws.firstDraw + i), 1,
+                                             sizeof(vk::DrawIndexedIndirectCommand));
+        }
+      }
+    }
+    return;
+  }
+
+  // the visibility holds one entry per instance of each mesh, the meshes of a model follow each other
+  uint32_t visibilityIndex = 0;
+  for (uint32_t i = 0; i < models->size(); ++i)
+  {
+    auto model = models->at(i);
+
+    const auto numInstances = static_cast<uint32_t>(model->getInstances()->size());
+    if (numInstances == 0)
+    {
+      continue;
+    }
+
+    for (size_t j = 0; j < model->getMeshes()->size(); ++j, visibilityIndex += numInstances)
+    {
+      auto mesh = model->getMeshes()->at(j);
+
+      const uint8_t* meshVisibility = visibility ? visibility->data() + visibilityIndex : nullptr;
+      if (!isAnyInstanceVisible(meshVisibility, numInstances))
+      {
+        continue;
+      }
+
+      auto material = mesh->material.get();
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        material->getDescriptorSet(), 0, nullptr);
+
+      if (Settings::vertexCompression)
+      {
+        const glm::vec4 bounds[] = { glm::vec4(mesh->boundsMin, 0.0f),
+                                     glm::vec4(mesh->boundsMax - mesh->boundsMin, 0.0f) };
+        commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(bounds), bounds);
+      }
+
+      drawVisibleInstances(commandBuffer, mesh.get(), model->getFirstInstance(), numInstances, meshVisibility);
+    }
+  }
 }
 
 void GeometryBuffer::recordCommandBuffer(const std::shared_ptr<GeometryPipeline> geometryPipeline,
                                          const std::shared_ptr<VertexBuffer> vertexBuffer,
                                          const std::shared_ptr<IndexBuffer> indexBuffer,
+                                         const std::shared_ptr<InstanceBuffer> instanceBuffer,
                                          const vk::DescriptorSet* cameraViewProjectionMatrixDescriptorSet,
-                                         const vk::DescriptorSet* geometryWorldMatrixDescriptorSet,
                                          const std::vector<std::shared_ptr<Model>>* models,
-                                         uint32_t numShadowMaps)
+                                         const vk::CommandBuffer* lightingCommandBuffer,
+                                         uint32_t frameIndex,
+                                         const std::vector<uint8_t>* visibility,
+                                         const CullingBuffer* cullingBuffer)
 {
+  auto commandBuffer = &commandBuffers->at(frameIndex);
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+
   auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
 
   std::array<float, 4> clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
-  std::array<vk::ClearValue, 3> clearValues = { vk::ClearColorValue(clearColor), vk::ClearColorValue(clearColor),
-                                                vk::ClearDepthStencilValue(1.0f, 0) };
+  std::array<float, 4> lightingClearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+  std::array<vk::ClearValue, 5> clearValues = { vk::ClearColorValue(clearColor), vk::ClearColorValue(clearColor),
+                                                vk::ClearDepthStencilValue(1.0f, 0),
+                                                vk::ClearColorValue(lightingClearColor),
+                                                vk::ClearColorValue(lightingClearColor) };
 
   auto renderPassBeginInfo = vk::RenderPassBeginInfo().setRenderPass(*renderPass);
   renderPassBeginInfo.setRenderArea(vk::Rect2D(vk::Offset2D(), vk::Extent2D(window->getWidth(), window->getHeight())));
@@ -390,56 +523,87 @@ void GeometryBuffer::recordCommandBuffer(const std::shared_ptr<GeometryPipeline>
 
   commandBuffer->begin(commandBufferBeginInfo);
 
-  commandBuffer->resetQueryPool(*context->getQueryPool(), 2, 2);
-  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), 2);
+  // the lighting subpass writes its timestamps from within the render pass, where queries can not be reset
+  commandBuffer->resetQueryPool(*context->getQueryPool(), queryOffset + 2, 4);
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), queryOffset + 2);
 
   renderPassBeginInfo.setFramebuffer(*framebuffer);
-  commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
 
-  commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *geometryPipeline->getPipeline());
-
-  VkDeviceSize offsets[] = { 0 };
-  commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getBuffer()->getBuffer(), offsets);
-  commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
-
-  auto pipelineLayout = geometryPipeline->getPipelineLayout();
-
-  // bind camera view projection matrix
-  commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
-                                    cameraViewProjectionMatrixDescriptorSet, 0, nullptr);
-
-  for (uint32_t i = 0; i < models->size(); ++i)
+  std::array<vk::Buffer, 2> vertexBuffers = { *vertexBuffer->getPositionBuffer()->getBuffer(),
+                                              *vertexBuffer->getAttributeBuffer()->getBuffer() };
+  if (Settings::vertexCompression)
   {
-    auto model = models->at(i);
-
-    uint32_t dynamicOffset = 0;
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+    vertexBuffers = { *vertexBuffer->getCompressedPositionBuffer()->getBuffer(),
+                      *vertexBuffer->getCompressedAttributeBuffer()->getBuffer() };
+  }
+  std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+
+  // executing the occlusion commands leaves the bindings undefined, so both passes of occlusion culling set them up
+  const auto bindGeometry = [&](uint32_t cullingView) {
+    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *geometryPipeline->getPipeline());
+    commandBuffer->bindVertexBuffers(0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(),
+                                     offsets.data());
+    commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
+
+    // each frame in flight reads the world matrices from its own region of the instance buffer, or from the visible
+    // instances the culling pass wrote for it and the view, next to the mesh instances holding the bounds of their mesh
+    if (cullingBuffer)
     {
-      dynamicOffset = (numShadowMaps + i) * context->getUniformBufferDataAlignment() +
-                      numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+      VkDeviceSize instanceOffsets[] = { cullingBuffer->getVisibleInstanceOffset(cullingView) };
+      commandBuffer->bindVertexBuffers(2, 1, cullingBuffer->getVisibleInstanceBuffer(frameIndex)->getBuffer(),
+                                       instanceOffsets);
+      if (Settings::vertexCompression)
+      {
+        VkDeviceSize meshInstanceOffsets[] = { 0 };
+        commandBuffer->bindVertexBuffers(3, 1, cullingBuffer->getMeshInstanceBuffer()->getBuffer(),
+                                         meshInstanceOffsets);
+      }
     }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+    else
     {
-      dynamicOffset = i * context->getUniformBufferDataAlignment();
+      VkDeviceSize instanceOffsets[] = { instanceBuffer->getFrameOffset(frameIndex) };
+      commandBuffer->bindVertexBuffers(2, 1, instanceBuffer->getBuffer()->getBuffer(), instanceOffsets);
     }
 
-    // bind geometry world matrix
-    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
-                                      geometryWorldMatrixDescriptorSet, 1, &dynamicOffset);
+    // bind camera view projection matrix, with the superglobal strategy this is the frame data holding it
+    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *geometryPipeline->getPipelineLayout(), 0, 1,
+                                      cameraViewProjectionMatrixDescriptorSet, 0, nullptr);
+  };
 
-    for (size_t j = 0; j < model->getMeshes()->size(); ++j)
-    {
-      auto mesh = model->getMeshes()->at(j);
-      auto material = mesh->material.get();
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
-                                        material->getDescriptorSet(), 0, nullptr);
-      commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
-    }
+  const auto occlusionCommandBuffer = cullingBuffer ? cullingBuffer->getOcclusionCommandBuffer(frameIndex) : nullptr;
+  if (occlusionCulling && occlusionCommandBuffer)
+  {
+    // the first pass draws what was visible in the last frame, which the depth pyramid is then built from, and the
+    // lighting subpass has nothing to do yet
+    renderPassBeginInfo.setRenderPass(*firstPassRenderPass);
+    commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+    bindGeometry(0);
+    recordMeshes(commandBuffer, geometryPipeline, models, frameIndex, nullptr, cullingBuffer, 0);
+    commandBuffer->nextSubpass(vk::SubpassContents::eInline);
+    commandBuffer->endRenderPass();
+
+    commandBuffer->executeCommands(1, occlusionCommandBuffer);
+
+    // the second pass loads the geometry buffer and adds what the first pass wrongly found occluded
+    renderPassBeginInfo.setRenderPass(*renderPass);
+    commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+    bindGeometry(cullingBuffer->getSecondPassView());
+    recordMeshes(commandBuffer, geometryPipeline, models, frameIndex, nullptr, cullingBuffer,
+                 cullingBuffer->getSecondPassView());
+  }
+  else
+  {
+    commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+    bindGeometry(0);
+    recordMeshes(commandBuffer, geometryPipeline, models, frameIndex, visibility, cullingBuffer, 0);
   }
 
-  commandBuffer->endRenderPass();
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), queryOffset + 3);
+
+  commandBuffer->nextSubpass(vk::SubpassContents::eSecondaryCommandBuffers);
+  commandBuffer->executeCommands(1, lightingCommandBuffer);
 
-  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), 3);
+  commandBuffer->endRenderPass();
 
   commandBuffer->end();
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "GeometryPipeline.hpp"
 #include "core/Camera.hpp"
 #include "renderer/Model.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
+#include "renderer/culling_pass/CullingBuffer.hpp"
 
 class GeometryBuffer
 {
@@ -10,8 +12,9 @@ private:
   std::shared_ptr<Window> window;
   std::shared_ptr<Context> context;
 
-  static std::vector<vk::Image>*
-  createImages(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context);
+  static std::vector<vk::Image>* createImages(const std::shared_ptr<Window> window,
+                                              const std::shared_ptr<Context> context,
+                                              bool occlusionCulling);
   std::function<void(std::vector<vk::Image>*)> imagesDeleter = [this](std::vector<vk::Image>* images) {
     if (context->getDevice())
     {
@@ -21,18 +24,18 @@ private:
   };
   std::unique_ptr<std::vector<vk::Image>, decltype(imagesDeleter)> images;
 
-  static std::vector<vk::DeviceMemory>* createImagesMemory(const std::shared_ptr<Context> context,
-                                                           const std::vector<vk::Image>* images,
-                                                           vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(std::vector<vk::DeviceMemory>*)> imagesMemoryDeleter =
-    [this](std::vector<vk::DeviceMemory>* depthImageMemory) {
+  static std::vector<MemoryAllocator::Allocation*>* createImagesMemory(const std::shared_ptr<Context> context,
+                                                                      const std::vector<vk::Image>* images,
+                                                                      bool occlusionCulling);
+  std::function<void(std::vector<MemoryAllocator::Allocation*>*)> imagesMemoryDeleter =
+    [this](std::vector<MemoryAllocator::Allocation*>* imagesMemory) {
       if (context->getDevice())
       {
         for (auto& imageMemory : *imagesMemory)
-          context->getDevice()->freeMemory(imageMemory);
+          context->getMemoryAllocator()->free(imageMemory);
       }
     };
-  std::unique_ptr<std::vector<vk::DeviceMemory>, decltype(imagesMemoryDeleter)> imagesMemory;
+  std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(imagesMemoryDeleter)> imagesMemory;
 
   static std::vector<vk::ImageView>*
   createImageViews(const std::shared_ptr<Context> context, const std::vector<vk::Image>* images);
@@ -45,21 +48,24 @@ private:
   };
   std::unique_ptr<std::vector<vk::ImageView>, decltype(imageViewsDeleter)> imageViews;
 
-  static vk::Image* createDepthImage(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context);
+  // the depth is only sampled after the render pass for the depth pyramid and the depth reduction, otherwise it never
+  // leaves the tile memory
+  static vk::Image*
+  createDepthImage(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context, bool sampled);
   std::function<void(vk::Image*)> depthImageDeleter = [this](vk::Image* depthImage) {
     if (context->getDevice())
       context->getDevice()->destroyImage(*depthImage);
   };
   std::unique_ptr<vk::Image, decltype(depthImageDeleter)> depthImage;
 
-  static vk::DeviceMemory* createDepthImageMemory(const std::shared_ptr<Context> context,
-                                                  const vk::Image* image,
-                                                  vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> depthImageMemoryDeleter = [this](vk::DeviceMemory* depthImageMemory) {
-    if (context->getDevice())
-      context->getDevice()->freeMemory(*depthImageMemory);
-  };
-  std::unique_ptr<vk::DeviceMemory, decltype(depthImageMemoryDeleter)> depthImageMemory;
+  static MemoryAllocator::Allocation*
+  createDepthImageMemory(const std::shared_ptr<Context> context, const vk::Image* image, bool sampled);
+  std::function<void(MemoryAllocator::Allocation*)> depthImageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* depthImageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(depthImageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(depthImageMemoryDeleter)> depthImageMemory;
 
   static vk::ImageView* createDepthImageView(const std::shared_ptr<Context> context, const vk::Image* image);
   std::function<void(vk::ImageView*)> depthImageViewDeleter = [this](vk::ImageView* depthImageView) {
@@ -68,17 +74,24 @@ private:
   };
   std::unique_ptr<vk::ImageView, decltype(depthImageViewDeleter)> depthImageView;
 
-  static vk::RenderPass* createRenderPass(const std::shared_ptr<Context> context);
+  // when culling occlusion, the first pass only draws what was visible in the last frame and keeps the geometry buffer
+  // for the second pass, which draws the rest and continues with the lighting subpass, keeping the depth stores it at
+  // the end of the last pass
+  static vk::RenderPass* createRenderPass(const std::shared_ptr<Context> context,
+                                          bool occlusionCulling,
+                                          bool keepDepth,
+                                          bool firstPass = false);
   std::function<void(vk::RenderPass*)> renderPassDeleter = [this](vk::RenderPass* renderPass) {
     if (context->getDevice())
       context->getDevice()->destroyRenderPass(*renderPass);
   };
-  std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)> renderPass;
+  std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)> renderPass, firstPassRenderPass;
 
   static vk::Framebuffer* createFramebuffer(const std::shared_ptr<Window> window,
                                             const std::shared_ptr<Context> context,
                                             const std::vector<vk::ImageView>* imageViews,
                                             const vk::ImageView* depthImageView,
+                                            const std::vector<vk::ImageView>* lightingImageViews,
                                             const vk::RenderPass* renderPass);
   std::function<void(vk::Framebuffer*)> framebufferDeleter = [this](vk::Framebuffer* framebuffer) {
     if (context->getDevice())
@@ -86,46 +99,69 @@ private:
   };
   std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)> framebuffer;
 
-  static vk::Sampler* createSampler(const std::shared_ptr<Context> context);
-  std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
-    if (context->getDevice())
-      context->getDevice()->destroySampler(*sampler);
-  };
-  std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
-
-  static vk::CommandBuffer* createCommandBuffer(const std::shared_ptr<Context> context);
-  std::unique_ptr<vk::CommandBuffer> commandBuffer;
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context);
+  std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers;
 
   static vk::DescriptorSet* createDescriptorSet(const std::shared_ptr<Context> context,
                                                 const std::shared_ptr<DescriptorPool> descriptorPool,
                                                 const std::vector<vk::ImageView>* imageViews,
-                                                const vk::ImageView* depthImageView,
-                                                const vk::Sampler* sampler);
+                                                const vk::ImageView* depthImageView);
   std::unique_ptr<vk::DescriptorSet> descriptorSet;
 
+  bool occlusionCulling;
+
+  void recordMeshes(const vk::CommandBuffer* commandBuffer,
+                    const std::shared_ptr<GeometryPipeline> geometryPipeline,
+                    const std::vector<std::shared_ptr<Model>>* models,
+                    uint32_t frameIndex,
+                    const std::vector<uint8_t>* visibility,
+                    const CullingBuffer* cullingBuffer,
+                    uint32_t cullingView) const;
+
 public:
+  // the render pass continues with the lighting subpass, which reads the geometry buffer as input attachments and
+  // renders into the given lighting buffer image views, culling occlusion keeps the depth for the depth pyramid, and
+  // keeping the depth leaves it readable after the render pass for the depth reduction
   GeometryBuffer(const std::shared_ptr<Window> window,
                  const std::shared_ptr<Context> context,
-                 const std::shared_ptr<DescriptorPool> descriptorPool);
-
+                 const std::shared_ptr<DescriptorPool> descriptorPool,
+                 const std::vector<vk::ImageView>* lightingImageViews,
+                 bool occlusionCulling = false,
+                 bool keepDepth = false);
+
+  // only the mesh instances marked in the visibility are drawn, all of them are drawn without one, and the culling
+  // buffer replaces the draws with the ones the GPU wrote for the camera, split into two passes around its occlusion
+  // commands if it has them
   void recordCommandBuffer(const std::shared_ptr<GeometryPipeline> geometryPipeline,
                            const std::shared_ptr<VertexBuffer> vertexBuffer,
                            const std::shared_ptr<IndexBuffer> indexBuffer,
+                           const std::shared_ptr<InstanceBuffer> instanceBuffer,
                            const vk::DescriptorSet* cameraViewProjectionMatrixDescriptorSet,
-                           const vk::DescriptorSet* geometryWorldMatrixDescriptorSet,
                            const std::vector<std::shared_ptr<Model>>* models,
-                           uint32_t numShadowMaps);
+                           const vk::CommandBuffer* lightingCommandBuffer,
+                           uint32_t frameIndex,
+                           const std::vector<uint8_t>* visibility = nullptr,
+                           const CullingBuffer* cullingBuffer = nullptr);
 
   vk::RenderPass* getRenderPass() const
   {
     return renderPass.get();
   }
-  vk::CommandBuffer* getCommandBuffer() const
+  vk::Framebuffer* getFramebuffer() const
   {
-    return commandBuffer.get();
+    return framebuffer.get();
+  }
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
+  {
+    return &commandBuffers->at(frameIndex);
   }
   vk::DescriptorSet* getDescriptorSet() const
   {
     return descriptorSet.get();
   }
+  // in the read only depth layout after the first pass
+  vk::ImageView* getDepthImageView() const
+  {
+    return depthImageView.get();
+  }
 };
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "GeometryPipeline.hpp"
+#include "renderer/Settings.hpp"
 #include "renderer/Shader.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
 #include "renderer/buffers/VertexBuffer.hpp"
+#include "renderer/culling_pass/CullingBuffer.hpp"
 
 vk::PipelineLayout* GeometryPipeline::createPipelineLayout(const std::shared_ptr<Context> context,
                                                            std::vector<vk::DescriptorSetLayout> setLayouts)
@@ -8,6 +11,12 @@ vk::PipelineLayout* GeometryPipeline::createPipelineLayout(const std::shared_ptr
   auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo()
                                     .setSetLayoutCount(static_cast<uint32_t>(setLayouts.size()))
                                     .setPSetLayouts(setLayouts.data());
+
+  // bounds of the mesh being drawn, used to decode compressed positions
+  auto pushConstantRange =
+    vk::PushConstantRange().setStageFlags(vk::ShaderStageFlagBits::eVertex).setSize(2 * sizeof(glm::vec4));
+  pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
+  pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRange);
   auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
   return new vk::PipelineLayout(pipelineLayout);
 }
@@ -15,41 +24,126 @@ vk::PipelineLayout* GeometryPipeline::createPipelineLayout(const std::shared_ptr
 vk::Pipeline* GeometryPipeline::createPipeline(const std::shared_ptr<Window> window,
                                                const vk::RenderPass* renderPass,
                                                const vk::PipelineLayout* pipelineLayout,
-                                               std::shared_ptr<Context> context)
+                                               std::shared_ptr<Context> context,
+                                               bool gpuCulling)
 {
-  Shader vertexShader(context, "shaders/GeometryPass.vert.spv", vk::ShaderStageFlagBits::eVertex);
+  // the superglobal strategy reads the camera from the frame data storage buffer, culling on the GPU draws many meshes
+  // per call and reads the bounds to decode compressed positions with from the mesh instances
+  const auto boundsPerInstance = Settings::vertexCompression && gpuCulling;
+  std::string vertexShaderFilename =
+    Settings::vertexCompression ? "shaders/GeometryPassCompressed" : "shaders/GeometryPass";
+  if (boundsPerInstance)
+  {
+    vertexShaderFilename += "Culled";
+  }
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    vertexShaderFilename += "SuperGlobal";
+  }
+  Shader vertexShader(context, vertexShaderFilename + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
   Shader fragmentShader(context, "shaders/GeometryPass.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
   std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreateInfos = {
     vertexShader.getPipelineShaderStageCreateInfo(), fragmentShader.getPipelineShaderStageCreateInfo()
   };
 
-  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex));
-  auto position = vk::VertexInputAttributeDescription()
-                    .setLocation(0)
+  // positions and the remaining attributes come from separate streams, the world matrix advances per instance
+  auto positionInputBindingDescription = vk::VertexInputBindingDescription().setBinding(0);
+  auto attributeInputBindingDescription = vk::VertexInputBindingDescription().setBinding(1);
+  auto instanceInputBindingDescription = vk::VertexInputBindingDescription()
+                                           .setBinding(2)
+                                           .setStride(sizeof(Instance))
+                                           .setInputRate(vk::VertexInputRate::eInstance);
+
+  std::vector<vk::VertexInputAttributeDescription> vertexInputAttributeDescriptions;
+  if (Settings::vertexCompression)
+  {
+    positionInputBindingDescription.setStride(sizeof(CompressedVertex::position));
+    attributeInputBindingDescription.setStride(sizeof(CompressedVertexAttributes));
+    auto position =
+      vk::VertexInputAttributeDescription().setLocation(0).setBinding(0).setFormat(vk::Format::eR16G16B16A16Unorm);
+    auto texCoord = vk::VertexInputAttributeDescription()
+                      .setLocation(1)
+                      .setBinding(1)
+                      .setFormat(vk::Format::eR16G16Sfloat)
+                      .setOffset(offsetof(CompressedVertexAttributes, texCoord));
+    auto normal = vk::VertexInputAttributeDescription()
+                    .setLocation(2)
+                    .setBinding(1)
+                    .setFormat(vk::Format::eR16G16Snorm)
+                    .setOffset(offsetof(CompressedVertexAttributes, normal));
+    auto tangent = vk::VertexInputAttributeDescription()
+                     .setLocation(3)
+                     .setBinding(1)
+                     .setFormat(vk::Format::eR16G16Snorm)
+                     .setOffset(offsetof(CompressedVertexAttributes, tangent));
+    vertexInputAttributeDescriptions = { position, texCoord, normal, tangent };
+  }
+  else
+  {
+    positionInputBindingDescription.setStride(sizeof(Vertex::position));
+    attributeInputBindingDescription.setStride(sizeof(VertexAttributes));
+    auto position =
+      vk::VertexInputAttributeDescription().setLocation(0).setBinding(0).setFormat(vk::Format::eR32G32B32Sfloat);
+    auto texCoord = vk::VertexInputAttributeDescription()
+                      .setLocation(1)
+                      .setBinding(1)
+                      .setFormat(vk::Format::eR32G32Sfloat)
+                      .setOffset(offsetof(VertexAttributes, texCoord));
+    auto normal = vk::VertexInputAttributeDescription()
+                    .setLocation(2)
+                    .setBinding(1)
                     .setFormat(vk::Format::eR32G32B32Sfloat)
-                    .setOffset(offsetof(Vertex, position));
-  auto texCoord = vk::VertexInputAttributeDescription()
-                    .setLocation(1)
-                    .setFormat(vk::Format::eR32G32Sfloat)
-                    .setOffset(offsetof(Vertex, texCoord));
-  auto normal = vk::VertexInputAttributeDescription()
-                  .setLocation(2)
-                  .setFormat(vk::Format::eR32G32B32Sfloat)
-                  .setOffset(offsetof(Vertex, normal));
-  auto tangent = vk::VertexInputAttributeDescription()
-                   .setLocation(3)
-                   .setFormat(vk::Format::eR32G32B32Sfloat)
-                   .setOffset(offsetof(Vertex, tangent));
-  auto bitangent = vk::VertexInputAttributeDescription()
-                     .setLocation(4)
+                    .setOffset(offsetof(VertexAttributes, normal));
+    auto tangent = vk::VertexInputAttributeDescription()
+                     .setLocation(3)
+                     .setBinding(1)
                      .setFormat(vk::Format::eR32G32B32Sfloat)
-                     .setOffset(offsetof(Vertex, bitangent));
-  std::vector<vk::VertexInputAttributeDescription> vertexInputAttributeDescriptions = { position, texCoord, normal,
-                                                                                        tangent, bitangent };
-  auto vertexInputStateCreateInfo =
-    vk::PipelineVertexInputStateCreateInfo().setVertexBindingDescriptionCount(1).setPVertexBindingDescriptions(
-      &vertexInputBindingDescription);
+                     .setOffset(offsetof(VertexAttributes, tangent));
+    auto bitangent = vk::VertexInputAttributeDescription()
+                       .setLocation(4)
+                       .setBinding(1)
+                       .setFormat(vk::Format::eR32G32B32Sfloat)
+                       .setOffset(offsetof(VertexAttributes, bitangent));
+    vertexInputAttributeDescriptions = { position, texCoord, normal, tangent, bitangent };
+  }
+
+  // the world matrix takes up one location per column
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription()
+                                                 .setLocation(5 + i)
+                                                 .setBinding(2)
+                                                 .setFormat(vk::Format::eR32G32B32A32Sfloat)
+                                                 .setOffset(offsetof(Instance, worldMatrix) + i * sizeof(glm::vec4)));
+  }
+
+  std::vector<vk::VertexInputBindingDescription> vertexInputBindingDescriptions = {
+    positionInputBindingDescription, attributeInputBindingDescription, instanceInputBindingDescription
+  };
+
+  // the mesh instances of a draw all share the bounds of its mesh, and the draw starts at the first of them
+  if (boundsPerInstance)
+  {
+    vertexInputBindingDescriptions.push_back(vk::VertexInputBindingDescription()
+                                               .setBinding(3)
+                                               .setStride(sizeof(CullingMeshInstance))
+                                               .setInputRate(vk::VertexInputRate::eInstance));
+    vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription()
+                                                 .setLocation(9)
+                                                 .setBinding(3)
+                                                 .setFormat(vk::Format::eR32G32B32A32Sfloat)
+                                                 .setOffset(offsetof(CullingMeshInstance, boundsMin)));
+    vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription()
+                                                 .setLocation(10)
+                                                 .setBinding(3)
+                                                 .setFormat(vk::Format::eR32G32B32A32Sfloat)
+                                                 .setOffset(offsetof(CullingMeshInstance, boundsMax)));
+  }
+  auto vertexInputStateCreateInfo = vk::PipelineVertexInputStateCreateInfo()
+                                      .setVertexBindingDescriptionCount(
+                                        static_cast<uint32_t>(vertexInputBindingDescriptions.size()))
+                                      .setPVertexBindingDescriptions(vertexInputBindingDescriptions.data());
   vertexInputStateCreateInfo.setVertexAttributeDescriptionCount(
     static_cast<uint32_t>(vertexInputAttributeDescriptions.size()));
   vertexInputStateCreateInfo.setPVertexAttributeDescriptions(vertexInputAttributeDescriptions.data());
@@ -103,14 +197,14 @@ vk::Pipeline* GeometryPipeline::createPipeline(const std::shared_ptr<Window> win
 GeometryPipeline::GeometryPipeline(const std::shared_ptr<Window> window,
                                    const std::shared_ptr<Context> context,
                                    std::vector<vk::DescriptorSetLayout> setLayouts,
-                                   const vk::RenderPass* renderPass)
+                                   const vk::RenderPass* renderPass,
+                                   bool gpuCulling)
 {
   this->context = context;
 
   pipelineLayout =
     std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)>(createPipelineLayout(context, setLayouts),
                                                                          pipelineLayoutDeleter);
-  pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(createPipeline(window, renderPass,
-                                                                                     pipelineLayout.get(), context),
-                                                                      pipelineDeleter);
+  pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(
+    createPipeline(window, renderPass, pipelineLayout.get(), context, gpuCulling), pipelineDeleter);
 }
@@ -18,7 +18,8 @@ private:
   static vk::Pipeline* createPipeline(const std::shared_ptr<Window> window,
                                       const vk::RenderPass* renderPass,
                                       const vk::PipelineLayout* pipelineLayout,
-                                      const std::shared_ptr<Context> context);
+                                      const std::shared_ptr<Context> context,
+                                      bool gpuCulling);
   std::function<void(vk::Pipeline*)> pipelineDeleter = [this](vk::Pipeline* pipeline) {
     if (context->getDevice())
       context->getDevice()->destroyPipeline(*pipeline);
@@ -26,10 +27,13 @@ private:
   std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> pipeline;
 
 public:
+  // culling on the GPU binds the mesh instances of the culling buffer as a fourth vertex buffer when positions are
+  // compressed
   GeometryPipeline(const std::shared_ptr<Window> window,
                    const std::shared_ptr<Context> context,
                    std::vector<vk::DescriptorSetLayout> setLayouts,
-                   const vk::RenderPass* renderPass);
+                   const vk::RenderPass* renderPass,
+                   bool gpuCulling);
 
   vk::PipelineLayout* getPipelineLayout() const
   {
@@ -1,5 +1,6 @@
 #include "LightingBuffer.hpp"
 #include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
 
 std::vector<vk::Image>*
 LightingBuffer::createImages(const std::shared_ptr<Window> window, const std::shared_ptr<Context> context)
@@ -25,41 +26,20 @@ LightingBuffer::createImages(const std::shared_ptr<Window> window, const std::sh
   return new std::vector<vk::Image>(images);
 }
 
-std::vector<vk::DeviceMemory>* LightingBuffer::createImagesMemory(const std::shared_ptr<Context> context,
-                                                                  const std::vector<vk::Image>* images,
-                                                                  vk::MemoryPropertyFlags memoryPropertyFlags)
+std::vector<MemoryAllocator::Allocation*>* LightingBuffer::createImagesMemory(
+  const std::shared_ptr<Context> context,
+  const std::vector<vk::Image>* images,
+  vk::MemoryPropertyFlags memoryPropertyFlags)
 {
-  auto imagesMemory = std::vector<vk::DeviceMemory>(images->size());
+  // attachments are large and get recreated along with the window, so each of them gets memory of its own
+  auto imagesMemory = std::vector<MemoryAllocator::Allocation*>(images->size());
   for (size_t i = 0; i < imagesMemory.size(); ++i)
   {
-    auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(images->at(i));
-    auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-    uint32_t memoryTypeIndex = 0;
-    bool foundMatch = false;
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-    {
-      if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-          (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-      {
-        memoryTypeIndex = i;
-        foundMatch = true;
-        break;
-      }
-    }
-
-    if (!foundMatch)
-    {
-      throw std::runtime_error("Failed to find suitable memory type for lighting buffer image.");
-    }
-
-    auto memoryAllocateInfo =
-      vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-    imagesMemory[i] = context->getDevice()->allocateMemory(memoryAllocateInfo);
-    context->getDevice()->bindImageMemory(images->at(i), imagesMemory[i], 0);
+    imagesMemory[i] = context->getMemoryAllocator()->allocateForImage(images->at(i), memoryPropertyFlags,
+                                                                      MemoryAllocator::Placement::General, true);
   }
 
-  return new std::vector<vk::DeviceMemory>(imagesMemory);
+  return new std::vector<MemoryAllocator::Allocation*>(imagesMemory);
 }
 
 std::vector<vk::ImageView>*
@@ -82,82 +62,6 @@ LightingBuffer::createImageViews(const std::shared_ptr<Context> context, const s
   return new std::vector<vk::ImageView>(imageViews);
 }
 
-vk::RenderPass* LightingBuffer::createRenderPass(const std::shared_ptr<Context> context)
-{
-  std::vector<vk::AttachmentDescription> attachmentDescriptions;
-
-  auto attachmentDescription = vk::AttachmentDescription()
-                                 .setLoadOp(vk::AttachmentLoadOp::eClear)
-                                 .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-                                 .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-  attachmentDescription.setFormat(vk::Format::eR8G8B8A8Unorm).setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-
-  // fullscale
-  attachmentDescriptions.push_back(attachmentDescription);
-
-  // halfscale
-  attachmentDescriptions.push_back(attachmentDescription);
-
-  std::vector<vk::AttachmentReference> colorAttachmentReferences;
-
-  // fullscale
-  colorAttachmentReferences.push_back(
-    vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
-
-  // halfscale
-  colorAttachmentReferences.push_back(
-    vk::AttachmentReference().setAttachment(1).setLayout(vk::ImageLayout::eColorAttachmentOptimal));
-
-  auto subpassDescription = vk::SubpassDescription()
-                              .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-                              .setColorAttachmentCount(static_cast<uint32_t>(colorAttachmentReferences.size()));
-  subpassDescription.setPColorAttachments(colorAttachmentReferences.data());
-
-  std::vector<vk::SubpassDependency> subpassDependencies;
-
-  auto subpassDependency = vk::SubpassDependency()
-                             .setSrcSubpass(VK_SUBPASS_EXTERNAL)
-                             .setDstSubpass(0)
-                             .setSrcStageMask(vk::PipelineStageFlagBits::eBottomOfPipe)
-                             .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-  subpassDependency.setSrcAccessMask(vk::AccessFlagBits::eMemoryRead)
-    .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
-  subpassDependency.setDependencyFlags(vk::DependencyFlagBits::eByRegion);
-  subpassDependencies.push_back(subpassDependency);
-
-  subpassDependency.setSrcSubpass(0)
-    .setDstSubpass(VK_SUBPASS_EXTERNAL)
-    .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-    .setDstStageMask(vk::PipelineStageFlagBits::eBottomOfPipe);
-  subpassDependency
-    .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite)
-    .setDstAccessMask(vk::AccessFlagBits::eMemoryRead);
-  subpassDependencies.push_back(subpassDependency);
-
-  auto renderPassCreateInfo = vk::RenderPassCreateInfo()
-                                .setAttachmentCount(static_cast<uint32_t>(attachmentDescriptions.size()))
-                                .setPAttachments(attachmentDescriptions.data());
-  renderPassCreateInfo.setSubpassCount(1)
-    .setPSubpasses(&subpassDescription)
-    .setDependencyCount(static_cast<uint32_t>(subpassDependencies.size()))
-    .setPDependencies(subpassDependencies.data());
-  auto renderPass = context->getDevice()->createRenderPass(renderPassCreateInfo);
-  return new vk::RenderPass(renderPass);
-}
-
-vk::Framebuffer* LightingBuffer::createFramebuffer(const std::shared_ptr<Window> window,
-                                                   const std::shared_ptr<Context> context,
-                                                   const std::vector<vk::ImageView>* imageViews,
-                                                   const vk::RenderPass* renderPass)
-{
-  auto framebufferCreateInfo =
-    vk::FramebufferCreateInfo().setRenderPass(*renderPass).setWidth(window->getWidth()).setHeight(window->getHeight());
-  framebufferCreateInfo.setAttachmentCount(static_cast<uint32_t>(imageViews->size()))
-    .setPAttachments(imageViews->data())
-    .setLayers(1);
-  return new vk::Framebuffer(context->getDevice()->createFramebuffer(framebufferCreateInfo));
-}
-
 vk::Sampler* LightingBuffer::createSampler(const std::shared_ptr<Context> context)
 {
   auto samplerCreateInfo = vk::SamplerCreateInfo()
@@ -172,19 +76,22 @@ vk::Sampler* LightingBuffer::createSampler(const std::shared_ptr<Context> contex
   return new vk::Sampler(sampler);
 }
 
-vk::CommandBuffer* LightingBuffer::createCommandBuffer(const std::shared_ptr<Context> context)
+// executed by the geometry pass command buffers in the lighting subpass
+std::vector<vk::CommandBuffer>* LightingBuffer::createCommandBuffers(const std::shared_ptr<Context> context)
 {
-  vk::CommandBuffer commandBuffer;
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
   auto commandBufferAllocateInfo =
     vk::CommandBufferAllocateInfo()
       .setCommandPool(Settings::reuseCommandBuffers ? *context->getCommandPoolOnce() : *context->getCommandPoolRepeat())
-      .setCommandBufferCount(1);
-  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, &commandBuffer) != vk::Result::eSuccess)
+      .setLevel(vk::CommandBufferLevel::eSecondary)
+      .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
+  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, commandBuffers.data()) !=
+      vk::Result::eSuccess)
   {
-    throw std::runtime_error("Failed to allocate command buffer.");
+    throw std::runtime_error("Failed to allocate command buffers.");
   }
 
-  return new vk::CommandBuffer(commandBuffer);
+  return new std::vector<vk::CommandBuffer>(commandBuffers);
 }
 
 vk::DescriptorSet* LightingBuffer::createDescriptorSet(const std::shared_ptr<Context> context,
@@ -234,18 +141,14 @@ LightingBuffer::LightingBuffer(const std::shared_ptr<Window> window,
 
   images =
     std::unique_ptr<std::vector<vk::Image>, decltype(imagesDeleter)>(createImages(window, context), imagesDeleter);
-  imagesMemory = std::unique_ptr<std::vector<vk::DeviceMemory>, decltype(imagesMemoryDeleter)>(
+  imagesMemory = std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(imagesMemoryDeleter)>(
     createImagesMemory(context, images.get(), vk::MemoryPropertyFlagBits::eDeviceLocal), imagesMemoryDeleter);
   imageViews =
     std::unique_ptr<std::vector<vk::ImageView>, decltype(imageViewsDeleter)>(createImageViews(context, images.get()),
                                                                              imageViewsDeleter);
 
-  renderPass =
-    std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(createRenderPass(context), renderPassDeleter);
-  framebuffer = std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)>(
-    createFramebuffer(window, context, imageViews.get(), renderPass.get()), framebufferDeleter);
   sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context), samplerDeleter);
-  commandBuffer = std::unique_ptr<vk::CommandBuffer>(createCommandBuffer(context));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context));
   descriptorSet =
     std::unique_ptr<vk::DescriptorSet>(createDescriptorSet(context, descriptorPool, imageViews.get(), sampler.get()));
 }
@@ -261,190 +164,290 @@ void LightingBuffer::recordCommandBuffers(const std::shared_ptr<LightingPipeline
                                           const vk::DescriptorSet* lightDataDescriptorSet,
                                           const std::vector<std::shared_ptr<Light>>& lightList,
                                           uint32_t numShadowMaps,
-                                          uint32_t numModels,
                                           const std::shared_ptr<Model> unitQuadModel,
-                                          const std::shared_ptr<Model> unitSphereModel)
+                                          const std::shared_ptr<Model> unitSphereModel,
+                                          uint32_t frameIndex,
+                                          const std::vector<uint8_t>* lightVisibility)
 {
-  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
-
-  std::array<float, 4> clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-  std::array<vk::ClearValue, 2> clearValues = { vk::ClearColorValue(clearColor), vk::ClearColorValue(clearColor) };
-
-  auto renderPassBeginInfo = vk::RenderPassBeginInfo().setRenderPass(*renderPass);
-  renderPassBeginInfo.setRenderArea(vk::Rect2D(vk::Offset2D(), vk::Extent2D(window->getWidth(), window->getHeight())));
-  renderPassBeginInfo.setClearValueCount(static_cast<uint32_t>(clearValues.size())).setPClearValues(clearValues.data());
+  auto commandBuffer = &commandBuffers->at(frameIndex);
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+
+  auto commandBufferInheritanceInfo = vk::CommandBufferInheritanceInfo()
+                                        .setRenderPass(*geometryBuffer->getRenderPass())
+                                        .setSubpass(1)
+                                        .setFramebuffer(*geometryBuffer->getFramebuffer());
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo()
+                                  .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue |
+                                            vk::CommandBufferUsageFlagBits::eSimultaneousUse)
+                                  .setPInheritanceInfo(&commandBufferInheritanceInfo);
 
   commandBuffer->begin(commandBufferBeginInfo);
 
-  commandBuffer->resetQueryPool(*context->getQueryPool(), 4, 2);
-  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), 4);
+  // the queries are reset by the geometry pass before the render pass begins
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), queryOffset + 4);
 
-  renderPassBeginInfo.setFramebuffer(*framebuffer);
-  commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-
-  // Draw lights with shadow maps
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  // the frame data is bound once per pipeline, each light only pushes the indices of its data in there
   {
-    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineWithShadowMaps());
+    // the frame data holds the split depths and cascade view projection matrices of all shadow maps, followed by the
+    // world matrices and data of all lights
+    const auto firstLightWorldMatrix = numShadowMaps * (1 + Settings::shadowMapCascadeCount);
+    const auto firstLightData = firstLightWorldMatrix + static_cast<uint32_t>(lightList.size());
 
     VkDeviceSize offsets[] = { 0 };
-    commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getBuffer()->getBuffer(), offsets);
+    commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getPositionBuffer()->getBuffer(), offsets);
     commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
 
-    auto pipelineLayout = lightingPipelines->getPipelineLayoutWithShadowMaps();
-
-    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
-                                      geometryBuffer->getDescriptorSet(), 0, nullptr);
-    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
-                                      uniformBufferDescriptorSet, 0, nullptr);
-
-    uint32_t shadowMapIndex = 0;
-    for (uint32_t j = 0; j < lightList.size(); ++j)
+    // Draw lights with shadow maps
     {
-      const auto light = lightList.at(j);
+      commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineWithShadowMaps());
 
-      if (!light->shadowMap)
-      {
-        continue;
-      }
+      auto pipelineLayout = lightingPipelines->getPipelineLayoutWithShadowMaps();
 
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 3, 1,
-                                        light->shadowMap->getSharedDescriptorSet(), 0, nullptr);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
+                                        uniformBufferDescriptorSet, 0, nullptr);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        geometryBuffer->getDescriptorSet(), 0, nullptr);
 
-      uint32_t dynamicOffset = 0;
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        dynamicOffset = numShadowMaps * context->getUniformBufferDataAlignment() +
-                        shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+      uint32_t shadowMapIndex = 0;
+      for (uint32_t j = 0; j < lightList.size(); ++j)
       {
-        dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
+        const auto light = lightList.at(j);
+
+        if (!light->shadowMap)
+        {
+          continue;
+        }
+
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
+                                          light->shadowMap->getSharedDescriptorSet(), 0, nullptr);
+
+        // light world matrix, light data, first shadow map cascade view projection matrix and shadow map split depths
+        const uint32_t indices[] = { firstLightWorldMatrix + j, firstLightData + j,
+                                     numShadowMaps + shadowMapIndex * Settings::shadowMapCascadeCount,
+                                     shadowMapIndex };
+        commandBuffer->pushConstants(*pipelineLayout,
+                                     vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0,
+                                     sizeof(indices), indices);
+
+        if (light->type == LightType::Directional)
+        {
+          auto mesh = unitQuadModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+        else
+        {
+          auto mesh = unitSphereModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+
+        ++shadowMapIndex;
       }
+    }
 
-      // bind shadow map cascade view projection matrices
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 5, 1,
-                                        shadowMapCascadesViewProjectionMatricesDescriptorSet, 1, &dynamicOffset);
-
-      // bind shadow map cascade splits
-      dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignment();
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 6, 1,
-                                        shadowMapCascadeSplitsDescriptorSet, 1, &dynamicOffset);
+    // Draw lights without shadow maps
+    {
+      commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineNoShadowMaps());
 
-      dynamicOffset = 0;
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        dynamicOffset = (numShadowMaps + numModels + j) * context->getUniformBufferDataAlignment() +
-                        numShadowMaps * context->getUniformBufferDataAlignmentLarge();
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-      {
-        dynamicOffset = j * context->getUniformBufferDataAlignment();
-      }
+      auto pipelineLayout = lightingPipelines->getPipelineLayoutNoShadowMaps();
 
-      // bind light world matrix
       commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
-                                        lightWorldMatrixDescriptorSet, 1, &dynamicOffset);
-
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        dynamicOffset = (numShadowMaps + numModels + static_cast<uint32_t>(lightList.size()) + j) *
-                          context->getUniformBufferDataAlignment() +
-                        numShadowMaps * context->getUniformBufferDataAlignmentLarge();
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-      {
-        dynamicOffset = j * context->getUniformBufferDataAlignment();
-      }
-
-      // bind light data
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 4, 1, lightDataDescriptorSet,
-                                        1, &dynamicOffset);
+                                        uniformBufferDescriptorSet, 0, nullptr);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        geometryBuffer->getDescriptorSet(), 0, nullptr);
 
-      if (light->type == LightType::Directional)
-      {
-        auto mesh = unitQuadModel->getMeshes()->at(0);
-        commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
-      }
-      else
+      for (uint32_t j = 0; j < lightList.size(); ++j)
       {
-        auto mesh = unitSphereModel->getMeshes()->at(0);
-        commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        const auto light = lightList.at(j);
+
+        if (light->shadowMap || (lightVisibility && !lightVisibility->at(j)))
+        {
+          continue;
+        }
+
+        // light world matrix and light data, there are no shadow maps to index
+        const uint32_t indices[] = { firstLightWorldMatrix + j, firstLightData + j, 0, 0 };
+        commandBuffer->pushConstants(*pipelineLayout,
+                                     vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0,
+                                     sizeof(indices), indices);
+
+        if (light->type == LightType::Directional)
+        {
+          auto mesh = unitQuadModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+        else
+        {
+          auto mesh = unitSphereModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
       }
-
-      ++shadowMapIndex;
     }
   }
-
-  // Draw lights without shadow maps
+  else
   {
-    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineNoShadowMaps());
-
-    VkDeviceSize offsets[] = { 0 };
-    commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getBuffer()->getBuffer(), offsets);
-    commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
+    // Draw lights with shadow maps
+    {
+      commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineWithShadowMaps());
 
-    auto pipelineLayout = lightingPipelines->getPipelineLayoutNoShadowMaps();
+      VkDeviceSize offsets[] = { 0 };
+      commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getPositionBuffer()->getBuffer(), offsets);
+      commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
 
-    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
-                                      geometryBuffer->getDescriptorSet(), 0, nullptr);
-    commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
-                                      uniformBufferDescriptorSet, 0, nullptr);
+      auto pipelineLayout = lightingPipelines->getPipelineLayoutWithShadowMaps();
 
-    for (uint32_t j = 0; j < lightList.size(); ++j)
-    {
-      const auto light = lightList.at(j);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
+                                        geometryBuffer->getDescriptorSet(), 0, nullptr);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        uniformBufferDescriptorSet, 0, nullptr);
 
-      if (light->shadowMap)
+      uint32_t shadowMapIndex = 0;
+      for (uint32_t j = 0; j < lightList.size(); ++j)
       {
-        continue;
+        const auto light = lightList.at(j);
+
+        if (!light->shadowMap)
+        {
+          continue;
+        }
+
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 3, 1,
+                                          light->shadowMap->getSharedDescriptorSet(), 0, nullptr);
+
+        uint32_t dynamicOffset = 0;
+        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+        {
+          dynamicOffset = numShadowMaps * context->getUniformBufferDataAlignment() +
+                          shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
+        }
+        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+        {
+          dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
+        }
+
+        // bind shadow map cascade view projection matrices
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 5, 1,
+                                          shadowMapCascadesViewProjectionMatricesDescriptorSet, 1, &dynamicOffset);
+
+        // bind shadow map cascade splits
+        dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignment();
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 6, 1,
+                                          shadowMapCascadeSplitsDescriptorSet, 1, &dynamicOffset);
+
+        dynamicOffset = 0;
+        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+        {
+          dynamicOffset = (numShadowMaps + j) * context->getUniformBufferDataAlignment() +
+                          numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+        }
+        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+        {
+          dynamicOffset = j * context->getUniformBufferDataAlignment();
+        }
+
+        // bind light world matrix
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
+                                          lightWorldMatrixDescriptorSet, 1, &dynamicOffset);
+
+        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+        {
+          dynamicOffset = (numShadowMaps + static_cast<uint32_t>(lightList.size()) + j) *
+                            context->getUniformBufferDataAlignment() +
+                          numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+        }
+        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+        {
+          dynamicOffset = j * context->getUniformBufferDataAlignment();
+        }
+
+        // bind light data
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 4, 1,
+                                          lightDataDescriptorSet, 1, &dynamicOffset);
+
+        if (light->type == LightType::Directional)
+        {
+          auto mesh = unitQuadModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+        else
+        {
+          auto mesh = unitSphereModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+
+        ++shadowMapIndex;
       }
+    }
 
-      uint32_t dynamicOffset = 0;
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        dynamicOffset = (numShadowMaps + numModels + j) * context->getUniformBufferDataAlignment() +
-                        numShadowMaps * context->getUniformBufferDataAlignmentLarge();
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-      {
-        dynamicOffset = j * context->getUniformBufferDataAlignment();
-      }
+    // Draw lights without shadow maps
+    {
+      commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *lightingPipelines->getPipelineNoShadowMaps());
 
-      // bind light world matrix
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
-                                        lightWorldMatrixDescriptorSet, 1, &dynamicOffset);
+      VkDeviceSize offsets[] = { 0 };
+      commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getPositionBuffer()->getBuffer(), offsets);
+      commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
 
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
-      {
-        dynamicOffset = (numShadowMaps + numModels + static_cast<uint32_t>(lightList.size()) + j) *
-                          context->getUniformBufferDataAlignment() +
-                        numShadowMaps * context->getUniformBufferDataAlignmentLarge();
-      }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
-      {
-        dynamicOffset = j * context->getUniformBufferDataAlignment();
-      }
+      auto pipelineLayout = lightingPipelines->getPipelineLayoutNoShadowMaps();
 
-      // bind light data
-      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 3, 1, lightDataDescriptorSet,
-                                        1, &dynamicOffset);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 2, 1,
+                                        geometryBuffer->getDescriptorSet(), 0, nullptr);
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
+                                        uniformBufferDescriptorSet, 0, nullptr);
 
-      if (light->type == LightType::Directional)
-      {
-        auto mesh = unitQuadModel->getMeshes()->at(0);
-        commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
-      }
-      else
+      for (uint32_t j = 0; j < lightList.size(); ++j)
       {
-        auto mesh = unitSphereModel->getMeshes()->at(0);
-        commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        const auto light = lightList.at(j);
+
+        if (light->shadowMap || (lightVisibility && !lightVisibility->at(j)))
+        {
+          continue;
+        }
+
+        uint32_t dynamicOffset = 0;
+        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+        {
+          dynamicOffset = (numShadowMaps + j) * context->getUniformBufferDataAlignment() +
+                          numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+        }
+        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+        {
+          dynamicOffset = j * context->getUniformBufferDataAlignment();
+        }
+
+        // bind light world matrix
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
+                                          lightWorldMatrixDescriptorSet, 1, &dynamicOffset);
+
+        if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+        {
+          dynamicOffset = (numShadowMaps + static_cast<uint32_t>(lightList.size()) + j) *
+                            context->getUniformBufferDataAlignment() +
+                          numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+        }
+        else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+        {
+          dynamicOffset = j * context->getUniformBufferDataAlignment();
+        }
+
+        // bind light data
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 3, 1,
+                                          lightDataDescriptorSet, 1, &dynamicOffset);
+
+        if (light->type == LightType::Directional)
+        {
+          auto mesh = unitQuadModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
+        else
+        {
+          auto mesh = unitSphereModel->getMeshes()->at(0);
+          commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+        }
       }
     }
   }
 
-  commandBuffer->endRenderPass();
-
-  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), 5);
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), queryOffset + 5);
 
   commandBuffer->end();
 }
\ No newline at end of file
@@ -23,18 +23,18 @@ private:
   };
   std::unique_ptr<std::vector<vk::Image>, decltype(imagesDeleter)> images;
 
-  static std::vector<vk::DeviceMemory>* createImagesMemory(const std::shared_ptr<Context> context,
-                                                           const std::vector<vk::Image>* images,
-                                                           vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(std::vector<vk::DeviceMemory>*)> imagesMemoryDeleter =
-    [this](std::vector<vk::DeviceMemory>* depthImageMemory) {
+  static std::vector<MemoryAllocator::Allocation*>* createImagesMemory(const std::shared_ptr<Context> context,
+                                                                      const std::vector<vk::Image>* images,
+                                                                      vk::MemoryPropertyFlags memoryPropertyFlags);
+  std::function<void(std::vector<MemoryAllocator::Allocation*>*)> imagesMemoryDeleter =
+    [this](std::vector<MemoryAllocator::Allocation*>* imagesMemory) {
       if (context->getDevice())
       {
         for (auto& imageMemory : *imagesMemory)
-          context->getDevice()->freeMemory(imageMemory);
+          context->getMemoryAllocator()->free(imageMemory);
       }
     };
-  std::unique_ptr<std::vector<vk::DeviceMemory>, decltype(imagesMemoryDeleter)> imagesMemory;
+  std::unique_ptr<std::vector<MemoryAllocator::Allocation*>, decltype(imagesMemoryDeleter)> imagesMemory;
 
   static std::vector<vk::ImageView>*
   createImageViews(const std::shared_ptr<Context> context, const std::vector<vk::Image>* images);
@@ -47,23 +47,6 @@ private:
   };
   std::unique_ptr<std::vector<vk::ImageView>, decltype(imageViewsDeleter)> imageViews;
 
-  static vk::RenderPass* createRenderPass(const std::shared_ptr<Context> context);
-  std::function<void(vk::RenderPass*)> renderPassDeleter = [this](vk::RenderPass* renderPass) {
-    if (context->getDevice())
-      context->getDevice()->destroyRenderPass(*renderPass);
-  };
-  std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)> renderPass;
-
-  static vk::Framebuffer* createFramebuffer(const std::shared_ptr<Window> window,
-                                            const std::shared_ptr<Context> context,
-                                            const std::vector<vk::ImageView>* imageViews,
-                                            const vk::RenderPass* renderPass);
-  std::function<void(vk::Framebuffer*)> framebufferDeleter = [this](vk::Framebuffer* framebuffer) {
-    if (context->getDevice())
-      context->getDevice()->destroyFramebuffer(*framebuffer);
-  };
-  std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)> framebuffer;
-
   static vk::Sampler* createSampler(const std::shared_ptr<Context> context);
   std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
     if (context->getDevice())
@@ -71,8 +54,8 @@ private:
   };
   std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
 
-  static vk::CommandBuffer* createCommandBuffer(const std::shared_ptr<Context> context);
-  std::unique_ptr<vk::CommandBuffer> commandBuffer;
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context);
+  std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers;
 
   static vk::DescriptorSet* createDescriptorSet(const std::shared_ptr<Context> context,
                                                 const std::shared_ptr<DescriptorPool> descriptorPool,
@@ -81,10 +64,13 @@ private:
   std::unique_ptr<vk::DescriptorSet> descriptorSet;
 
 public:
+  // the images are rendered to in the lighting subpass of the geometry buffer render pass
   LightingBuffer(const std::shared_ptr<Window> window,
                  const std::shared_ptr<Context> context,
                  const std::shared_ptr<DescriptorPool> descriptorPool);
 
+  // with the superglobal strategy the uniform buffer descriptor set holds all frame data, the other sets are unused,
+  // the lights without shadow maps are skipped where the visibility is 0
   void recordCommandBuffers(const std::shared_ptr<LightingPipelines> lightingPipelines,
                             const std::shared_ptr<GeometryBuffer> geometryBuffer,
                             const std::shared_ptr<VertexBuffer> vertexBuffer,
@@ -96,17 +82,18 @@ public:
                             const vk::DescriptorSet* lightDataDescriptorSet,
                             const std::vector<std::shared_ptr<Light>>& lightList,
                             uint32_t numShadowMaps,
-                            uint32_t numModels,
                             const std::shared_ptr<Model> unitQuadModel,
-                            const std::shared_ptr<Model> unitSphereModel);
+                            const std::shared_ptr<Model> unitSphereModel,
+                            uint32_t frameIndex,
+                            const std::vector<uint8_t>* lightVisibility = nullptr);
 
-  vk::RenderPass* getRenderPass() const
+  std::vector<vk::ImageView>* getImageViews() const
   {
-    return renderPass.get();
+    return imageViews.get();
   }
-  vk::CommandBuffer* getCommandBuffer() const
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
   {
-    return commandBuffer.get();
+    return &commandBuffers->at(frameIndex);
   }
   vk::DescriptorSet* getDescriptorSet() const
   {
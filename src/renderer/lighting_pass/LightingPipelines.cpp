@@ -9,6 +9,17 @@ vk::PipelineLayout* LightingPipelines::createPipelineLayout(const std::shared_pt
   auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo()
                                     .setSetLayoutCount(static_cast<uint32_t>(setLayouts.size()))
                                     .setPSetLayouts(setLayouts.data());
+
+  // the superglobal strategy selects the light and shadow map data in the frame data storage buffer by index
+  auto pushConstantRange = vk::PushConstantRange()
+                             .setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
+                             .setSize(4 * sizeof(uint32_t));
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
+    pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRange);
+  }
+
   auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
   return new vk::PipelineLayout(pipelineLayout);
 }
@@ -57,8 +68,14 @@ vk::Pipeline* LightingPipelines::createPipelineNoShadowMaps(const std::shared_pt
                               .setPMapEntries(specializationConstants.data());
   specializationInfo.setDataSize(sizeof(specializationData)).setPData(&specializationData);
 
-  Shader vertexShader(context, "shaders/LightingPassNoShadowMaps.vert.spv", vk::ShaderStageFlagBits::eVertex);
-  Shader fragmentShader(context, "shaders/LightingPassNoShadowMaps.frag.spv", vk::ShaderStageFlagBits::eFragment);
+  // the superglobal strategy reads the camera and light data from the frame data storage buffer
+  std::string shaderFilename = "shaders/LightingPassNoShadowMaps";
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    shaderFilename += "SuperGlobal";
+  }
+  Shader vertexShader(context, shaderFilename + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
+  Shader fragmentShader(context, shaderFilename + ".frag.spv", vk::ShaderStageFlagBits::eFragment);
 
   auto fragmentShaderStageCreateInfo =
     fragmentShader.getPipelineShaderStageCreateInfo().setPSpecializationInfo(&specializationInfo);
@@ -66,11 +83,8 @@ vk::Pipeline* LightingPipelines::createPipelineNoShadowMaps(const std::shared_pt
     vertexShader.getPipelineShaderStageCreateInfo(), fragmentShaderStageCreateInfo
   };
 
-  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex));
-  auto position = vk::VertexInputAttributeDescription()
-                    .setLocation(0)
-                    .setFormat(vk::Format::eR32G32B32Sfloat)
-                    .setOffset(offsetof(Vertex, position));
+  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex::position));
+  auto position = vk::VertexInputAttributeDescription().setLocation(0).setFormat(vk::Format::eR32G32B32Sfloat);
   auto vertexInputStateCreateInfo =
     vk::PipelineVertexInputStateCreateInfo().setVertexBindingDescriptionCount(1).setPVertexBindingDescriptions(
       &vertexInputBindingDescription);
@@ -114,7 +128,7 @@ vk::Pipeline* LightingPipelines::createPipelineNoShadowMaps(const std::shared_pt
   pipelineCreateInfo.setPRasterizationState(&rasterizationStateCreateInfo)
     .setPMultisampleState(&multisampleStateCreateInfo)
     .setPColorBlendState(&colorBlendStateCreateInfo);
-  pipelineCreateInfo.setRenderPass(*renderPass).setLayout(*pipelineLayout);
+  pipelineCreateInfo.setRenderPass(*renderPass).setSubpass(1).setLayout(*pipelineLayout);
   auto pipeline = context->getDevice()->createGraphicsPipeline(nullptr, pipelineCreateInfo);
   return new vk::Pipeline(pipeline);
 }
@@ -169,8 +183,14 @@ vk::Pipeline* LightingPipelines::createPipelineWithShadowMaps(const std::shared_
                               .setPMapEntries(specializationConstants.data());
   specializationInfo.setDataSize(sizeof(specializationData)).setPData(&specializationData);
 
-  Shader vertexShader(context, "shaders/LightingPassWithShadowMaps.vert.spv", vk::ShaderStageFlagBits::eVertex);
-  Shader fragmentShader(context, "shaders/LightingPassWithShadowMaps.frag.spv", vk::ShaderStageFlagBits::eFragment);
+  // the superglobal strategy reads the camera and light data from the frame data storage buffer
+  std::string shaderFilename = "shaders/LightingPassWithShadowMaps";
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    shaderFilename += "SuperGlobal";
+  }
+  Shader vertexShader(context, shaderFilename + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
+  Shader fragmentShader(context, shaderFilename + ".frag.spv", vk::ShaderStageFlagBits::eFragment);
 
   auto fragmentShaderStageCreateInfo =
     fragmentShader.getPipelineShaderStageCreateInfo().setPSpecializationInfo(&specializationInfo);
@@ -178,11 +198,8 @@ vk::Pipeline* LightingPipelines::createPipelineWithShadowMaps(const std::shared_
     vertexShader.getPipelineShaderStageCreateInfo(), fragmentShaderStageCreateInfo
   };
 
-  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex));
-  auto position = vk::VertexInputAttributeDescription()
-                    .setLocation(0)
-                    .setFormat(vk::Format::eR32G32B32Sfloat)
-                    .setOffset(offsetof(Vertex, position));
+  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex::position));
+  auto position = vk::VertexInputAttributeDescription().setLocation(0).setFormat(vk::Format::eR32G32B32Sfloat);
   auto vertexInputStateCreateInfo =
     vk::PipelineVertexInputStateCreateInfo().setVertexBindingDescriptionCount(1).setPVertexBindingDescriptions(
       &vertexInputBindingDescription);
@@ -226,7 +243,7 @@ vk::Pipeline* LightingPipelines::createPipelineWithShadowMaps(const std::shared_
   pipelineCreateInfo.setPRasterizationState(&rasterizationStateCreateInfo)
     .setPMultisampleState(&multisampleStateCreateInfo)
     .setPColorBlendState(&colorBlendStateCreateInfo);
-  pipelineCreateInfo.setRenderPass(*renderPass).setLayout(*pipelineLayout);
+  pipelineCreateInfo.setRenderPass(*renderPass).setSubpass(1).setLayout(*pipelineLayout);
   auto pipeline = context->getDevice()->createGraphicsPipeline(nullptr, pipelineCreateInfo);
   return new vk::Pipeline(pipeline);
 }
@@ -31,6 +31,7 @@ private:
   std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> pipelineNoShadowMaps, pipelineWithShadowMaps;
 
 public:
+  // the lights are drawn in the second subpass of the geometry buffer render pass
   LightingPipelines(const std::shared_ptr<Window> window,
                     const std::shared_ptr<Context> context,
                     std::vector<vk::DescriptorSetLayout> setLayoutsNoShadowMaps,
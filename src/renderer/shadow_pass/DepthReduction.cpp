@@ -0,0 +1,172 @@
+#include "DepthReduction.hpp"
+#include "renderer/Sync.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace
+{
+// the largest float followed by zero, so that the first depth found replaces both ends
+const std::array<uint32_t, 2> EMPTY_RANGE = { 0x7F7FFFFF, 0 };
+} // namespace
+
+vk::Sampler* DepthReduction::createSampler(const std::shared_ptr<Context> context)
+{
+  // the reduction fetches texels directly, so nothing is ever filtered
+  auto samplerCreateInfo = vk::SamplerCreateInfo()
+                             .setMagFilter(vk::Filter::eNearest)
+                             .setMinFilter(vk::Filter::eNearest)
+                             .setMipmapMode(vk::SamplerMipmapMode::eNearest);
+  samplerCreateInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+  samplerCreateInfo.setMaxAnisotropy(1.0f);
+  auto sampler = context->getDevice()->createSampler(samplerCreateInfo);
+  return new vk::Sampler(sampler);
+}
+
+std::vector<vk::DescriptorSet>*
+DepthReduction::createDescriptorSets(const std::shared_ptr<Context> context,
+                                     const std::shared_ptr<DescriptorPool> descriptorPool,
+                                     const vk::ImageView* depthImageView,
+                                     const DepthReduction* depthReduction)
+{
+  std::vector<vk::DescriptorSetLayout> layouts(Sync::MAX_FRAMES_IN_FLIGHT, *descriptorPool->getDepthReductionLayout());
+  auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
+                                     .setDescriptorPool(*descriptorPool->getPool())
+                                     .setDescriptorSetCount(static_cast<uint32_t>(layouts.size()))
+                                     .setPSetLayouts(layouts.data());
+  auto descriptorSets = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo);
+
+  for (uint32_t i = 0; i < descriptorSets.size(); ++i)
+  {
+    auto depthDescriptorImageInfo = vk::DescriptorImageInfo()
+                                      .setSampler(*depthReduction->sampler)
+                                      .setImageLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+                                      .setImageView(*depthImageView);
+    auto depthWriteDescriptorSet = vk::WriteDescriptorSet()
+                                     .setDstBinding(0)
+                                     .setDstSet(descriptorSets.at(i))
+                                     .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    depthWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&depthDescriptorImageInfo);
+
+    auto rangeDescriptorBufferInfo =
+      vk::DescriptorBufferInfo(*depthReduction->rangeBuffers.at(i)->getBuffer(), 0, VK_WHOLE_SIZE);
+    auto rangeWriteDescriptorSet = vk::WriteDescriptorSet()
+                                     .setDstBinding(1)
+                                     .setDstSet(descriptorSets.at(i))
+                                     .setDescriptorType(vk::DescriptorType::eStorageBuffer);
+    rangeWriteDescriptorSet.setDescriptorCount(1).setPBufferInfo(&rangeDescriptorBufferInfo);
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets = { depthWriteDescriptorSet, rangeWriteDescriptorSet };
+    context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                               writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  return new std::vector<vk::DescriptorSet>(descriptorSets);
+}
+
+std::vector<vk::CommandBuffer>* DepthReduction::createCommandBuffers(const std::shared_ptr<Context> context)
+{
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
+  auto commandBufferAllocateInfo = vk::CommandBufferAllocateInfo()
+                                     .setCommandPool(*context->getCommandPoolOnce())
+                                     .setLevel(vk::CommandBufferLevel::ePrimary)
+                                     .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
+  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, commandBuffers.data()) !=
+      vk::Result::eSuccess)
+  {
+    throw std::runtime_error("Failed to allocate command buffers.");
+  }
+
+  return new std::vector<vk::CommandBuffer>(commandBuffers);
+}
+
+DepthReduction::DepthReduction(const std::shared_ptr<Window> window,
+                               const std::shared_ptr<Context> context,
+                               const std::shared_ptr<DescriptorPool> descriptorPool,
+                               const vk::ImageView* depthImageView)
+{
+  this->context = context;
+  this->descriptorPool = descriptorPool;
+
+  width = window->getWidth();
+  height = window->getHeight();
+
+  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context), samplerDeleter);
+
+  // stays mapped, the frames before the first reduction read an empty range
+  for (uint32_t i = 0; i < Sync::MAX_FRAMES_IN_FLIGHT; ++i)
+  {
+    rangeBuffers.push_back(std::make_unique<Buffer>(
+      context, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, sizeof(EMPTY_RANGE),
+      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+    rangeBuffers.back()->mapMemory();
+    memcpy(rangeBuffers.back()->getMemoryMappedLocation(), EMPTY_RANGE.data(), sizeof(EMPTY_RANGE));
+  }
+
+  descriptorSets = std::unique_ptr<std::vector<vk::DescriptorSet>>(
+    createDescriptorSets(context, descriptorPool, depthImageView, this));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context));
+}
+
+DepthReduction::~DepthReduction()
+{
+  // explicitly free the descriptor sets because the reduction is rebuilt along with the geometry buffer
+  context->getDevice()->freeDescriptorSets(*descriptorPool->getPool(), static_cast<uint32_t>(descriptorSets->size()),
+                                           descriptorSets->data());
+}
+
+void DepthReduction::recordCommandBuffer(const std::shared_ptr<DepthReductionPipeline> depthReductionPipeline,
+                                         uint32_t frameIndex)
+{
+  auto commandBuffer = &commandBuffers->at(frameIndex);
+  const auto rangeBuffer = rangeBuffers.at(frameIndex)->getBuffer();
+
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+  commandBuffer->begin(commandBufferBeginInfo);
+
+  // the range is reset for this frame once the host is done reading the last one with this index
+  commandBuffer->updateBuffer(*rangeBuffer, 0, sizeof(EMPTY_RANGE), EMPTY_RANGE.data());
+
+  // the geometry pass has to be done writing the depth, which it leaves readable
+  std::array<vk::MemoryBarrier, 2> barriers = {
+    vk::MemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead),
+    vk::MemoryBarrier()
+      .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+  };
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eTransfer,
+                                 vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(),
+                                 static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr, 0, nullptr);
+
+  commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, *depthReductionPipeline->getPipeline());
+  commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, *depthReductionPipeline->getPipelineLayout(), 0,
+                                    1, &descriptorSets->at(frameIndex), 0, nullptr);
+  const auto workGroupSize = DepthReductionPipeline::WORK_GROUP_SIZE;
+  commandBuffer->dispatch((width + workGroupSize - 1) / workGroupSize, (height + workGroupSize - 1) / workGroupSize, 1);
+
+  // the host reads the range once the frame is done
+  auto rangeBarrier = vk::BufferMemoryBarrier()
+                        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                        .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                        .setBuffer(*rangeBuffer)
+                        .setSize(VK_WHOLE_SIZE);
+  commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+                                 vk::DependencyFlags(), 0, nullptr, 1, &rangeBarrier, 0, nullptr);
+
+  commandBuffer->end();
+}
+
+glm::vec2 DepthReduction::getDepthRange(const uint32_t frameIndex) const
+{
+  std::array<uint32_t, 2> range;
+  memcpy(range.data(), rangeBuffers.at(frameIndex)->getMemoryMappedLocation(), sizeof(range));
+
+  glm::vec2 depthRange;
+  memcpy(&depthRange.x, &range[0], sizeof(float));
+  memcpy(&depthRange.y, &range[1], sizeof(float));
+  return depthRange;
+}
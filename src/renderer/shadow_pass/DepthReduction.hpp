@@ -0,0 +1,55 @@
+#pragma once
+
+#include "DepthReductionPipeline.hpp"
+#include "core/Window.hpp"
+#include "renderer/buffers/Buffer.hpp"
+
+// the nearest and farthest depth of the geometry buffer, reduced on the GPU after the geometry pass and read by the
+// host once the frame is done, so that the shadow maps are fitted to what was visible a few frames before
+class DepthReduction
+{
+private:
+  std::shared_ptr<Context> context;
+  std::shared_ptr<DescriptorPool> descriptorPool;
+
+  uint32_t width, height;
+
+  static vk::Sampler* createSampler(const std::shared_ptr<Context> context);
+  std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
+    if (context->getDevice())
+      context->getDevice()->destroySampler(*sampler);
+  };
+  std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
+
+  // one per frame in flight, the bits of both depths as unsigned integers, which sort the same as positive floats
+  std::vector<std::unique_ptr<Buffer>> rangeBuffers;
+
+  static std::vector<vk::DescriptorSet>* createDescriptorSets(const std::shared_ptr<Context> context,
+                                                              const std::shared_ptr<DescriptorPool> descriptorPool,
+                                                              const vk::ImageView* depthImageView,
+                                                              const DepthReduction* depthReduction);
+  std::unique_ptr<std::vector<vk::DescriptorSet>> descriptorSets;
+
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context);
+  std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers;
+
+public:
+  // reduced from the given geometry buffer depth, which has to be kept after the geometry pass
+  DepthReduction(const std::shared_ptr<Window> window,
+                 const std::shared_ptr<Context> context,
+                 const std::shared_ptr<DescriptorPool> descriptorPool,
+                 const vk::ImageView* depthImageView);
+  ~DepthReduction();
+
+  // the recorded commands never change, so this only needs to happen once per frame in flight
+  void recordCommandBuffer(const std::shared_ptr<DepthReductionPipeline> depthReductionPipeline, uint32_t frameIndex);
+
+  // submitted right after the geometry pass
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
+  {
+    return &commandBuffers->at(frameIndex);
+  }
+  // the nearest depth in x and the farthest in y of the last frame with this index, so only valid once it is done,
+  // the nearest is larger than the farthest when nothing but the background was visible
+  glm::vec2 getDepthRange(const uint32_t frameIndex) const;
+};
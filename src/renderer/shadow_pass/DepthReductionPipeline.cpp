@@ -0,0 +1,35 @@
+#include "DepthReductionPipeline.hpp"
+#include "renderer/Shader.hpp"
+
+const uint32_t DepthReductionPipeline::WORK_GROUP_SIZE = 16;
+
+vk::PipelineLayout* DepthReductionPipeline::createPipelineLayout(const std::shared_ptr<Context> context,
+                                                                 const vk::DescriptorSetLayout* setLayout)
+{
+  auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo().setSetLayoutCount(1).setPSetLayouts(setLayout);
+  auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
+  return new vk::PipelineLayout(pipelineLayout);
+}
+
+vk::Pipeline* DepthReductionPipeline::createPipeline(const vk::PipelineLayout* pipelineLayout,
+                                                     const std::shared_ptr<Context> context)
+{
+  Shader computeShader(context, "shaders/DepthReduction.comp.spv", vk::ShaderStageFlagBits::eCompute);
+
+  auto pipelineCreateInfo = vk::ComputePipelineCreateInfo()
+                              .setStage(computeShader.getPipelineShaderStageCreateInfo())
+                              .setLayout(*pipelineLayout);
+  auto pipeline = context->getDevice()->createComputePipeline(nullptr, pipelineCreateInfo);
+  return new vk::Pipeline(pipeline);
+}
+
+DepthReductionPipeline::DepthReductionPipeline(const std::shared_ptr<Context> context,
+                                               const std::shared_ptr<DescriptorPool> descriptorPool)
+{
+  this->context = context;
+
+  pipelineLayout = std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)>(
+    createPipelineLayout(context, descriptorPool->getDepthReductionLayout()), pipelineLayoutDeleter);
+  pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(createPipeline(pipelineLayout.get(), context),
+                                                                      pipelineDeleter);
+}
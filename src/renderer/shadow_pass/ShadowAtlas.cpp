@@ -0,0 +1,223 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+const uint32_t ShadowAtlas::MAX_CASCADES = 16;
+const uint32_t ShadowAtlas::MIN_CASCADE_RESOLUTION = 16;
+
+vk::Image* ShadowAtlas::createImage(const std::shared_ptr<Context> context, uint32_t resolution)
+{
+  auto imageCreateInfo = vk::ImageCreateInfo()
+                           .setImageType(vk::ImageType::e2D)
+                           .setExtent(vk::Extent3D(resolution, resolution, 1))
+                           .setMipLevels(1)
+                           .setArrayLayers(1);
+  imageCreateInfo.setFormat(vk::Format::eD32Sfloat)
+    .setInitialLayout(vk::ImageLayout::eUndefined)
+    .setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
+  if (Settings::shadowCaching)
+  {
+    // the cached static casters are copied out of and back into the regions of the cascades
+    imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+  }
+  auto image = context->getDevice()->createImage(imageCreateInfo);
+  return new vk::Image(image);
+}
+
+MemoryAllocator::Allocation* ShadowAtlas::createImageMemory(const std::shared_ptr<Context> context,
+                                                            const vk::Image* image)
+{
+  return context->getMemoryAllocator()->allocateForImage(*image, vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                         MemoryAllocator::Placement::General, true);
+}
+
+vk::Image* ShadowAtlas::createCacheImage(const std::shared_ptr<Context> context, uint32_t resolution)
+{
+  auto imageCreateInfo = vk::ImageCreateInfo()
+                           .setImageType(vk::ImageType::e2D)
+                           .setExtent(vk::Extent3D(resolution, resolution, 1))
+                           .setMipLevels(1)
+                           .setArrayLayers(1);
+  imageCreateInfo.setFormat(vk::Format::eD32Sfloat)
+    .setInitialLayout(vk::ImageLayout::eUndefined)
+    .setUsage(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst);
+  auto image = context->getDevice()->createImage(imageCreateInfo);
+  return new vk::Image(image);
+}
+
+vk::ImageView* ShadowAtlas::createImageView(const std::shared_ptr<Context> context, const vk::Image* image)
+{
+  auto imageViewCreateInfo =
+    vk::ImageViewCreateInfo().setImage(*image).setViewType(vk::ImageViewType::e2D).setFormat(vk::Format::eD32Sfloat);
+  imageViewCreateInfo.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1));
+  auto imageView = context->getDevice()->createImageView(imageViewCreateInfo);
+  return new vk::ImageView(imageView);
+}
+
+vk::Framebuffer* ShadowAtlas::createFramebuffer(const std::shared_ptr<Context> context,
+                                                const vk::ImageView* imageView,
+                                                const vk::RenderPass* renderPass,
+                                                uint32_t resolution)
+{
+  auto framebufferCreateInfo =
+    vk::FramebufferCreateInfo().setRenderPass(*renderPass).setWidth(resolution).setHeight(resolution);
+  framebufferCreateInfo.setAttachmentCount(1).setPAttachments(imageView).setLayers(1);
+  auto framebuffer = context->getDevice()->createFramebuffer(framebufferCreateInfo);
+  return new vk::Framebuffer(framebuffer);
+}
+
+vk::Sampler* ShadowAtlas::createSampler(const std::shared_ptr<Context> context)
+{
+  // the lighting shaders keep half a texel away from the edges of each region, so that filtering never reaches into
+  // the regions next to it
+  auto samplerCreateInfo = vk::SamplerCreateInfo()
+                             .setMagFilter(vk::Filter::eLinear)
+                             .setMinFilter(vk::Filter::eLinear)
+                             .setMipmapMode(vk::SamplerMipmapMode::eLinear);
+  samplerCreateInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+    .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+  samplerCreateInfo.setMaxAnisotropy(1.0f).setMaxLod(1.0f).setBorderColor(vk::BorderColor::eFloatOpaqueWhite);
+  auto sampler = context->getDevice()->createSampler(samplerCreateInfo);
+  return new vk::Sampler(sampler);
+}
+
+bool ShadowAtlas::pack(std::vector<vk::Rect2D>& rects, uint32_t resolution)
+{
+  // the regions are square, so every row is as high as the first region placed in it
+  std::vector<size_t> order(rects.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&rects](size_t a, size_t b) { return rects[a].extent.width > rects[b].extent.width; });
+
+  uint32_t x = 0, y = 0, rowHeight = 0;
+  for (const auto i : order)
+  {
+    auto& rect = rects[i];
+    if (x + rect.extent.width > resolution)
+    {
+      x = 0;
+      y += rowHeight;
+      rowHeight = 0;
+    }
+
+    if (rect.extent.width > resolution || y + rect.extent.height > resolution)
+    {
+      return false;
+    }
+
+    rect.offset = vk::Offset2D(static_cast<int32_t>(x), static_cast<int32_t>(y));
+    x += rect.extent.width;
+    rowHeight = std::max(rowHeight, rect.extent.height);
+  }
+
+  return true;
+}
+
+ShadowAtlas::ShadowAtlas(const std::shared_ptr<Context> context,
+                         const vk::RenderPass* renderPass,
+                         uint32_t numShadowMaps)
+{
+  this->context = context;
+  this->numShadowMaps = numShadowMaps;
+
+  resolution = std::min(static_cast<uint32_t>(Settings::shadowAtlasResolution),
+                        context->getPhysicalDevice()->getProperties().limits.maxImageDimension2D);
+
+  rects.resize(numShadowMaps * Settings::shadowMapCascadeCount);
+  for (uint32_t i = 0; i < numShadowMaps; ++i)
+  {
+    for (int j = 0; j < Settings::shadowMapCascadeCount; ++j)
+    {
+      const auto cascadeResolution =
+        std::max(static_cast<uint32_t>(Settings::shadowMapResolution) >> (j / 2), MIN_CASCADE_RESOLUTION);
+      rects[i * Settings::shadowMapCascadeCount + j].extent = vk::Extent2D(cascadeResolution, cascadeResolution);
+    }
+  }
+
+  // halving every region keeps the near cascades sharper than the far ones while trading resolution for more lights
+  while (!pack(rects, resolution))
+  {
+    bool canShrink = false;
+    for (auto& rect : rects)
+    {
+      if (rect.extent.width > MIN_CASCADE_RESOLUTION)
+      {
+        rect.extent = vk::Extent2D(rect.extent.width / 2, rect.extent.height / 2);
+        canShrink = true;
+      }
+    }
+
+    if (!canShrink)
+    {
+      throw std::runtime_error("Failed to fit the shadow maps into the shadow atlas.");
+    }
+  }
+
+  image = std::unique_ptr<vk::Image, decltype(imageDeleter)>(createImage(context, resolution), imageDeleter);
+  imageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)>(
+    createImageMemory(context, image.get()), imageMemoryDeleter);
+  if (Settings::shadowCaching)
+  {
+    cacheImage =
+      std::unique_ptr<vk::Image, decltype(imageDeleter)>(createCacheImage(context, resolution), imageDeleter);
+    cacheImageMemory = std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)>(
+      createImageMemory(context, cacheImage.get()), imageMemoryDeleter);
+  }
+  imageView =
+    std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)>(createImageView(context, image.get()), imageViewDeleter);
+  framebuffer = std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)>(
+    createFramebuffer(context, imageView.get(), renderPass, resolution), framebufferDeleter);
+  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context), samplerDeleter);
+
+  // the rects never change, so they are written once instead of with the frame data
+  const auto rectBufferSize = numShadowMaps * MAX_CASCADES * sizeof(glm::vec4);
+  rectBuffer =
+    std::make_unique<Buffer>(context, vk::BufferUsageFlagBits::eUniformBuffer, rectBufferSize,
+                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+  rectBuffer->mapMemory();
+  auto scaleOffsets = static_cast<glm::vec4*>(rectBuffer->getMemoryMappedLocation());
+  for (uint32_t i = 0; i < numShadowMaps; ++i)
+  {
+    for (int j = 0; j < Settings::shadowMapCascadeCount; ++j)
+    {
+      const auto& rect = getRect(i, j);
+      scaleOffsets[i * MAX_CASCADES + j] =
+        glm::vec4(glm::vec2(rect.extent.width, rect.extent.height), glm::vec2(rect.offset.x, rect.offset.y)) /
+        static_cast<float>(resolution);
+    }
+  }
+  rectBuffer->unmapMemory();
+
+  // the render pass expects the atlas to be readable between cascades, since it only clears the region it renders
+  auto commandBufferAllocateInfo =
+    vk::CommandBufferAllocateInfo().setCommandPool(*context->getCommandPoolOnce()).setCommandBufferCount(1);
+  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  commandBuffer.begin(commandBufferBeginInfo);
+
+  auto barrier = vk::ImageMemoryBarrier()
+                   .setOldLayout(vk::ImageLayout::eUndefined)
+                   .setNewLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+                   .setImage(*image);
+  barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1));
+  barrier.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                           vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                                vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+
+  if (cacheImage)
+  {
+    barrier.setNewLayout(vk::ImageLayout::eGeneral).setImage(*cacheImage);
+    barrier.setDstAccessMask(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                  vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  commandBuffer.end();
+  auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&commandBuffer);
+  context->getQueue().submit({ submitInfo }, nullptr);
+  context->getQueue().waitIdle();
+  context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
+}
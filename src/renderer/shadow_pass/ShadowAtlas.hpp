@@ -0,0 +1,116 @@
+#pragma once
+
+#include "renderer/Settings.hpp"
+#include "renderer/buffers/Buffer.hpp"
+
+// one depth image shared by the cascades of every shadow map, each cascade renders into and is sampled from its own
+// square region of it, so that far cascades take up less memory than near ones and the memory for all shadow maps
+// stays the same no matter how many lights cast shadows
+class ShadowAtlas
+{
+public:
+  // the most cascades a shadow map can have, their regions are spaced this far apart in the rect buffer
+  static const uint32_t MAX_CASCADES;
+  // regions are never shrunk below this to fit the atlas
+  static const uint32_t MIN_CASCADE_RESOLUTION;
+
+private:
+  std::shared_ptr<Context> context;
+
+  uint32_t resolution, numShadowMaps;
+
+  // one region per cascade of every shadow map, the cascades of a shadow map follow each other
+  std::vector<vk::Rect2D> rects;
+
+  static vk::Image* createImage(const std::shared_ptr<Context> context, uint32_t resolution);
+  std::function<void(vk::Image*)> imageDeleter = [this](vk::Image* image) {
+    if (context->getDevice())
+      context->getDevice()->destroyImage(*image);
+  };
+  std::unique_ptr<vk::Image, decltype(imageDeleter)> image;
+
+  static vk::Image* createCacheImage(const std::shared_ptr<Context> context, uint32_t resolution);
+
+  static MemoryAllocator::Allocation* createImageMemory(const std::shared_ptr<Context> context, const vk::Image* image);
+  std::function<void(MemoryAllocator::Allocation*)> imageMemoryDeleter =
+    [this](MemoryAllocator::Allocation* imageMemory) {
+      if (context->getDevice())
+        context->getMemoryAllocator()->free(imageMemory);
+    };
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)> imageMemory;
+
+  // only exists while caching static casters, holds the cascades with only them drawn at the same regions as the atlas
+  // and stays in the general layout, since it is only ever copied from and to
+  std::unique_ptr<vk::Image, decltype(imageDeleter)> cacheImage;
+  std::unique_ptr<MemoryAllocator::Allocation, decltype(imageMemoryDeleter)> cacheImageMemory;
+
+  static vk::ImageView* createImageView(const std::shared_ptr<Context> context, const vk::Image* image);
+  std::function<void(vk::ImageView*)> imageViewDeleter = [this](vk::ImageView* imageView) {
+    if (context->getDevice())
+      context->getDevice()->destroyImageView(*imageView);
+  };
+  std::unique_ptr<vk::ImageView, decltype(imageViewDeleter)> imageView;
+
+  static vk::Framebuffer* createFramebuffer(const std::shared_ptr<Context> context,
+                                            const vk::ImageView* imageView,
+                                            const vk::RenderPass* renderPass,
+                                            uint32_t resolution);
+  std::function<void(vk::Framebuffer*)> framebufferDeleter = [this](vk::Framebuffer* framebuffer) {
+    if (context->getDevice())
+      context->getDevice()->destroyFramebuffer(*framebuffer);
+  };
+  std::unique_ptr<vk::Framebuffer, decltype(framebufferDeleter)> framebuffer;
+
+  static vk::Sampler* createSampler(const std::shared_ptr<Context> context);
+  std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
+    if (context->getDevice())
+      context->getDevice()->destroySampler(*sampler);
+  };
+  std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
+
+  // the scale of each region in xy and its offset in zw, in texture coordinates of the atlas
+  std::unique_ptr<Buffer> rectBuffer;
+
+  // places the regions in rows from the largest to the smallest, false if they do not fit
+  static bool pack(std::vector<vk::Rect2D>& rects, uint32_t resolution);
+
+public:
+  // gives cascade i of every shadow map the shadow map resolution halved i / 2 times, and halves all regions again
+  // until they fit the atlas resolution
+  ShadowAtlas(const std::shared_ptr<Context> context, const vk::RenderPass* renderPass, uint32_t numShadowMaps);
+
+  vk::Image* getImage() const
+  {
+    return image.get();
+  }
+  vk::Image* getCacheImage() const
+  {
+    return cacheImage.get();
+  }
+  vk::ImageView* getImageView() const
+  {
+    return imageView.get();
+  }
+  vk::Framebuffer* getFramebuffer() const
+  {
+    return framebuffer.get();
+  }
+  vk::Sampler* getSampler() const
+  {
+    return sampler.get();
+  }
+  uint32_t getResolution() const
+  {
+    return resolution;
+  }
+  const vk::Rect2D& getRect(uint32_t shadowMapIndex, uint32_t cascadeIndex) const
+  {
+    return rects.at(shadowMapIndex * Settings::shadowMapCascadeCount + cascadeIndex);
+  }
+  // the regions of a shadow map are bound as a uniform buffer at this range of the rect buffer
+  vk::DescriptorBufferInfo getRectBufferInfo(uint32_t shadowMapIndex) const
+  {
+    return vk::DescriptorBufferInfo(*rectBuffer->getBuffer(), shadowMapIndex * MAX_CASCADES * sizeof(glm::vec4),
+                                    Settings::shadowMapCascadeCount * sizeof(glm::vec4));
+  }
+};
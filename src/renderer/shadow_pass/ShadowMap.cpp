@@ -1,124 +1,27 @@
 #include "ShadowMap.hpp"
 #include "renderer/Settings.hpp"
+#include "renderer/Sync.hpp"
 
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
+#include <limits>
 
-vk::Image* ShadowMap::createDepthImage(const std::shared_ptr<Context> context)
-{
-  auto imageCreateInfo = vk::ImageCreateInfo()
-                           .setImageType(vk::ImageType::e2D)
-                           .setExtent(vk::Extent3D(Settings::shadowMapResolution, Settings::shadowMapResolution, 1))
-                           .setMipLevels(1);
-  imageCreateInfo.setArrayLayers(Settings::shadowMapCascadeCount)
-    .setFormat(vk::Format::eD32Sfloat)
-    .setInitialLayout(vk::ImageLayout::ePreinitialized);
-  imageCreateInfo.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
-  auto image = context->getDevice()->createImage(imageCreateInfo);
-  return new vk::Image(image);
-}
-
-vk::DeviceMemory* ShadowMap::createDepthImageMemory(const std::shared_ptr<Context> context,
-                                                    const vk::Image* image,
-                                                    vk::MemoryPropertyFlags memoryPropertyFlags)
-{
-  auto memoryRequirements = context->getDevice()->getImageMemoryRequirements(*image);
-  auto memoryProperties = context->getPhysicalDevice()->getMemoryProperties();
-
-  uint32_t memoryTypeIndex = 0;
-  bool foundMatch = false;
-  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-  {
-    if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
-        (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
-    {
-      memoryTypeIndex = i;
-      foundMatch = true;
-      break;
-    }
-  }
-
-  if (!foundMatch)
-  {
-    throw std::runtime_error("Failed to find suitable memory type for shadow map depth image.");
-  }
-
-  auto memoryAllocateInfo =
-    vk::MemoryAllocateInfo().setAllocationSize(memoryRequirements.size).setMemoryTypeIndex(memoryTypeIndex);
-  auto deviceMemory = context->getDevice()->allocateMemory(memoryAllocateInfo);
-  context->getDevice()->bindImageMemory(*image, deviceMemory, 0);
-  return new vk::DeviceMemory(deviceMemory);
-}
-
-vk::ImageView* ShadowMap::createSharedDepthImageView(const std::shared_ptr<Context> context, const vk::Image* image)
-{
-  auto imageViewCreateInfo = vk::ImageViewCreateInfo()
-                               .setImage(*image)
-                               .setViewType(vk::ImageViewType::e2DArray)
-                               .setFormat(vk::Format::eD32Sfloat);
-  imageViewCreateInfo.setSubresourceRange(
-    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, Settings::shadowMapCascadeCount));
-  auto depthImageView = context->getDevice()->createImageView(imageViewCreateInfo);
-  return new vk::ImageView(depthImageView);
-}
-
-std::vector<vk::ImageView>*
-ShadowMap::createDepthImageViews(const std::shared_ptr<Context> context, const vk::Image* image)
-{
-  auto depthImageViews = std::vector<vk::ImageView>(Settings::shadowMapCascadeCount);
-  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
-  {
-    auto imageViewCreateInfo =
-      vk::ImageViewCreateInfo().setImage(*image).setViewType(vk::ImageViewType::e2D).setFormat(vk::Format::eD32Sfloat);
-    imageViewCreateInfo.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, i, 1));
-    depthImageViews[i] = context->getDevice()->createImageView(imageViewCreateInfo);
-  }
-  return new std::vector<vk::ImageView>(depthImageViews);
-}
-
-std::vector<vk::Framebuffer>* ShadowMap::createFramebuffers(const std::shared_ptr<Context> context,
-                                                            const std::vector<vk::ImageView>* depthImageViews,
-                                                            const vk::RenderPass* renderPass)
-{
-  auto framebuffers = std::vector<vk::Framebuffer>(Settings::shadowMapCascadeCount);
-  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
-  {
-    auto framebufferCreateInfo = vk::FramebufferCreateInfo()
-                                   .setRenderPass(*renderPass)
-                                   .setWidth(Settings::shadowMapResolution)
-                                   .setHeight(Settings::shadowMapResolution);
-    framebufferCreateInfo.setAttachmentCount(1).setPAttachments(&depthImageViews->at(i)).setLayers(1);
-    framebuffers[i] = context->getDevice()->createFramebuffer(framebufferCreateInfo);
-  }
-  return new std::vector<vk::Framebuffer>(framebuffers);
-}
-
-vk::Sampler* ShadowMap::createSampler(const std::shared_ptr<Context> context)
-{
-  auto samplerCreateInfo = vk::SamplerCreateInfo()
-                             .setMagFilter(vk::Filter::eLinear)
-                             .setMinFilter(vk::Filter::eLinear)
-                             .setMipmapMode(vk::SamplerMipmapMode::eLinear);
-  samplerCreateInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
-    .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
-    .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
-  samplerCreateInfo.setMaxAnisotropy(1.0f).setMaxLod(1.0f).setBorderColor(vk::BorderColor::eFloatOpaqueWhite);
-  auto sampler = context->getDevice()->createSampler(samplerCreateInfo);
-  return new vk::Sampler(sampler);
-}
+const uint32_t ShadowMap::FRAMES_UNTIL_STATIC = 30;
 
-vk::CommandBuffer* ShadowMap::createCommandBuffer(const std::shared_ptr<Context> context)
+std::vector<vk::CommandBuffer>* ShadowMap::createCommandBuffers(const std::shared_ptr<Context> context)
 {
-  vk::CommandBuffer commandBuffer;
+  auto commandBuffers = std::vector<vk::CommandBuffer>(Sync::MAX_FRAMES_IN_FLIGHT);
   auto commandBufferAllocateInfo =
     vk::CommandBufferAllocateInfo()
       .setCommandPool(Settings::reuseCommandBuffers ? *context->getCommandPoolOnce() : *context->getCommandPoolRepeat())
-      .setCommandBufferCount(1);
-  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, &commandBuffer) != vk::Result::eSuccess)
+      .setCommandBufferCount(static_cast<uint32_t>(commandBuffers.size()));
+  if (context->getDevice()->allocateCommandBuffers(&commandBufferAllocateInfo, commandBuffers.data()) !=
+      vk::Result::eSuccess)
   {
-    throw std::runtime_error("Failed to allocate command buffer.");
+    throw std::runtime_error("Failed to allocate command buffers.");
   }
 
-  return new vk::CommandBuffer(commandBuffer);
+  return new std::vector<vk::CommandBuffer>(commandBuffers);
 }
 
 vk::DescriptorSet* ShadowMap::createSharedDescriptorSet(const std::shared_ptr<Context> context,
@@ -133,283 +36,759 @@ vk::DescriptorSet* ShadowMap::createSharedDescriptorSet(const std::shared_ptr<Co
 
   auto shadowMapDescriptorImageInfo = vk::DescriptorImageInfo()
                                         .setImageLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
-                                        .setImageView(*shadowMap->sharedDepthImageView)
-                                        .setSampler(*shadowMap->sampler);
+                                        .setImageView(*shadowMap->shadowAtlas->getImageView())
+                                        .setSampler(*shadowMap->shadowAtlas->getSampler());
   auto shadowMapSamplerWriteDescriptorSet = vk::WriteDescriptorSet()
                                               .setDstBinding(0)
                                               .setDstSet(descriptorSet)
                                               .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
   shadowMapSamplerWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&shadowMapDescriptorImageInfo);
 
-  context->getDevice()->updateDescriptorSets(1, &shadowMapSamplerWriteDescriptorSet, 0, nullptr);
+  // the lighting shaders look up the region of the cascade they sample from here
+  auto rectDescriptorBufferInfo = shadowMap->shadowAtlas->getRectBufferInfo(shadowMap->shadowMapIndex);
+  auto rectWriteDescriptorSet = vk::WriteDescriptorSet()
+                                  .setDstBinding(1)
+                                  .setDstSet(descriptorSet)
+                                  .setDescriptorType(vk::DescriptorType::eUniformBuffer);
+  rectWriteDescriptorSet.setDescriptorCount(1).setPBufferInfo(&rectDescriptorBufferInfo);
+
+  std::vector<vk::WriteDescriptorSet> writeDescriptorSets = { shadowMapSamplerWriteDescriptorSet,
+                                                              rectWriteDescriptorSet };
+  context->getDevice()->updateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                             writeDescriptorSets.data(), 0, nullptr);
   return new vk::DescriptorSet(descriptorSet);
 }
 
-std::vector<vk::DescriptorSet>* ShadowMap::createDescriptorSets(const std::shared_ptr<Context> context,
-                                                                const std::shared_ptr<DescriptorPool> descriptorPool,
-                                                                const ShadowMap* shadowMap)
-{
-  auto descriptorSets = std::vector<vk::DescriptorSet>(Settings::shadowMapCascadeCount);
-  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
-  {
-    auto descriptorSetAllocateInfo = vk::DescriptorSetAllocateInfo()
-                                       .setDescriptorPool(*descriptorPool->getPool())
-                                       .setDescriptorSetCount(1)
-                                       .setPSetLayouts(descriptorPool->getShadowMapLayout());
-    descriptorSets[i] = context->getDevice()->allocateDescriptorSets(descriptorSetAllocateInfo).at(0);
-
-    auto shadowMapDescriptorImageInfo = vk::DescriptorImageInfo()
-                                          .setImageLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
-                                          .setImageView(shadowMap->depthImageViews->at(i))
-                                          .setSampler(*shadowMap->sampler);
-    auto shadowMapSamplerWriteDescriptorSet = vk::WriteDescriptorSet()
-                                                .setDstBinding(0)
-                                                .setDstSet(descriptorSets[i])
-                                                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-    shadowMapSamplerWriteDescriptorSet.setDescriptorCount(1).setPImageInfo(&shadowMapDescriptorImageInfo);
-
-    context->getDevice()->updateDescriptorSets(1, &shadowMapSamplerWriteDescriptorSet, 0, nullptr);
-  }
-  return new std::vector<vk::DescriptorSet>(descriptorSets);
-}
-
 ShadowMap::ShadowMap(const std::shared_ptr<Context> context,
                      const std::shared_ptr<DescriptorPool> descriptorPool,
-                     const std::shared_ptr<ShadowPipeline> shadowPipeline)
+                     const std::shared_ptr<ShadowAtlas> shadowAtlas,
+                     uint32_t shadowMapIndex)
 {
   this->context = context;
   this->descriptorPool = descriptorPool;
+  this->shadowAtlas = shadowAtlas;
+  this->shadowMapIndex = shadowMapIndex;
 
-  depthImage = std::unique_ptr<vk::Image, decltype(depthImageDeleter)>(createDepthImage(context), depthImageDeleter);
-  depthImageMemory = std::unique_ptr<vk::DeviceMemory, decltype(depthImageMemoryDeleter)>(
-    createDepthImageMemory(context, depthImage.get(), vk::MemoryPropertyFlagBits::eDeviceLocal),
-    depthImageMemoryDeleter);
-  sharedDepthImageView = std::unique_ptr<vk::ImageView, decltype(sharedDepthImageViewDeleter)>(
-    createSharedDepthImageView(context, depthImage.get()), sharedDepthImageViewDeleter);
-  depthImageViews = std::unique_ptr<std::vector<vk::ImageView>, decltype(depthImageViewsDeleter)>(
-    createDepthImageViews(context, depthImage.get()), depthImageViewsDeleter);
-  framebuffers = std::unique_ptr<std::vector<vk::Framebuffer>, decltype(framebuffersDeleter)>(
-    createFramebuffers(context, depthImageViews.get(), shadowPipeline->getRenderPass()), framebuffersDeleter);
-  sampler = std::unique_ptr<vk::Sampler, decltype(samplerDeleter)>(createSampler(context), samplerDeleter);
-
-  auto commandBufferAllocateInfo =
-    vk::CommandBufferAllocateInfo().setCommandPool(*context->getCommandPoolOnce()).setCommandBufferCount(1);
-  auto commandBuffer = context->getDevice()->allocateCommandBuffers(commandBufferAllocateInfo).at(0);
-  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  commandBuffer.begin(commandBufferBeginInfo);
-
-  auto barrier = vk::ImageMemoryBarrier()
-                   .setOldLayout(vk::ImageLayout::eUndefined)
-                   .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-                   .setImage(*depthImage);
-  barrier.setSubresourceRange(
-    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, Settings::shadowMapCascadeCount));
-  barrier.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead |
-                           vk::AccessFlagBits::eDepthStencilAttachmentWrite);
-  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eEarlyFragmentTests,
-                                vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
-
-  commandBuffer.end();
-  auto submitInfo = vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&commandBuffer);
-  context->getQueue().submit({ submitInfo }, nullptr);
-  context->getQueue().waitIdle();
-  context->getDevice()->freeCommandBuffers(*context->getCommandPoolOnce(), 1, &commandBuffer);
-
-  this->commandBuffer = std::unique_ptr<vk::CommandBuffer>(createCommandBuffer(context));
+  commandBuffers = std::unique_ptr<std::vector<vk::CommandBuffer>>(createCommandBuffers(context));
+  cascadeInstanceBuffers.resize(Sync::MAX_FRAMES_IN_FLIGHT);
+  cascadeInstanceBufferSizes.assign(Sync::MAX_FRAMES_IN_FLIGHT, 0);
 
   sharedDescriptorSet = std::unique_ptr<vk::DescriptorSet>(createSharedDescriptorSet(context, descriptorPool, this));
-  descriptorSets = std::unique_ptr<std::vector<vk::DescriptorSet>>(createDescriptorSets(context, descriptorPool, this));
 
   splitDepths.resize(Settings::shadowMapCascadeCount);
   cascadeViewProjectionMatrices.resize(Settings::shadowMapCascadeCount);
+  cascadeVisibilities.resize(Settings::shadowMapCascadeCount);
+
+  // nothing is cached yet, so the first frame draws everything
+  cascadeUpdates.assign(Settings::shadowMapCascadeCount, CascadeUpdate::All);
+  cachedViewProjectionMatrices.resize(Settings::shadowMapCascadeCount);
+  cacheValid.assign(Settings::shadowMapCascadeCount, 0);
+  cachedRates.assign(Settings::shadowMapCascadeCount, 0.0f);
+  skippedRates.assign(Settings::shadowMapCascadeCount, 0.0f);
 }
 
 ShadowMap::~ShadowMap()
 {
-  // explicitly free the descriptor sets because shadow maps can be rebuild
+  // explicitly free the descriptor set because shadow maps can be rebuild
   context->getDevice()->freeDescriptorSets(*descriptorPool->getPool(), 1, sharedDescriptorSet.get());
-  context->getDevice()->freeDescriptorSets(*descriptorPool->getPool(), static_cast<uint32_t>(descriptorSets->size()),
-                                           descriptorSets->data());
 }
 
 void ShadowMap::recordCommandBuffer(const std::shared_ptr<VertexBuffer> vertexBuffer,
                                     const std::shared_ptr<IndexBuffer> indexBuffer,
+                                    const std::shared_ptr<InstanceBuffer> instanceBuffer,
                                     const vk::DescriptorSet* shadowMapCascadeViewProjectionMatricesDescriptorSet,
-                                    const vk::DescriptorSet* geometryWorldMatrixDescriptorSet,
                                     const std::shared_ptr<ShadowPipeline> shadowPipeline,
                                     const std::vector<std::shared_ptr<Model>>* models,
                                     uint32_t shadowMapIndex,
-                                    uint32_t numShadowMaps)
+                                    uint32_t numShadowMaps,
+                                    uint32_t frameIndex,
+                                    const CullingBuffer* cullingBuffer,
+                                    const std::vector<uint8_t>* dynamicCasters)
 {
-  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+  auto commandBuffer = &commandBuffers->at(frameIndex);
+  const auto queryOffset = frameIndex * Context::QUERIES_PER_FRAME;
+  const auto pipelineLayout = shadowPipeline->getPipelineLayout();
 
-  auto renderPassBeginInfo = vk::RenderPassBeginInfo().setRenderPass(*shadowPipeline->getRenderPass());
-  renderPassBeginInfo.setRenderArea(
-    vk::Rect2D(vk::Offset2D(), vk::Extent2D(Settings::shadowMapResolution, Settings::shadowMapResolution)));
+  auto commandBufferBeginInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
 
   vk::ClearValue clearValues[1];
   clearValues[0].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
-  renderPassBeginInfo.setClearValueCount(1).setPClearValues(clearValues);
 
-  this->commandBuffer->begin(commandBufferBeginInfo);
+  commandBuffer->begin(commandBufferBeginInfo);
+
+  commandBuffer->resetQueryPool(*context->getQueryPool(), queryOffset, 2);
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), queryOffset);
+
+  // the viewport of a cascade covers its region of the atlas
+  const auto getViewport = [&](uint32_t cascade) {
+    const auto& rect = shadowAtlas->getRect(shadowMapIndex, cascade);
+    return vk::Viewport()
+      .setX(static_cast<float>(rect.offset.x))
+      .setY(static_cast<float>(rect.offset.y))
+      .setWidth(static_cast<float>(rect.extent.width))
+      .setHeight(static_cast<float>(rect.extent.height))
+      .setMaxDepth(1.0f);
+  };
+
+  // binds the positions and indices along with the cascade matrices, the pushed index selects the matrix of the
+  // given cascade
+  const auto bindCascade = [&](uint32_t cascade) {
+    VkDeviceSize offsets[] = { 0 };
+    const auto positionBuffer =
+      Settings::vertexCompression ? vertexBuffer->getCompressedPositionBuffer() : vertexBuffer->getPositionBuffer();
+    commandBuffer->bindVertexBuffers(0, 1, positionBuffer->getBuffer(), offsets);
+    commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
 
-  this->commandBuffer->resetQueryPool(*context->getQueryPool(), 0, 2);
-  this->commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *context->getQueryPool(), 0);
+    auto cascadeIndex = cascade;
+    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+    {
+      // the frame data follows the split depths of all shadow maps with their cascade view projection matrices, the
+      // pushed index selects the matrix directly
+      cascadeIndex += numShadowMaps + shadowMapIndex * Settings::shadowMapCascadeCount;
 
-  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
-  {
-    renderPassBeginInfo.setFramebuffer(framebuffers->at(i));
-    this->commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+      // bind frame data
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
+                                        shadowMapCascadeViewProjectionMatricesDescriptorSet, 0, nullptr);
+    }
+    else
+    {
+      uint32_t dynamicOffset = 0;
+      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+      {
+        dynamicOffset = numShadowMaps * context->getUniformBufferDataAlignment() +
+                        shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
+      }
+      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+      {
+        dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignment();
+      }
 
-    this->commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *shadowPipeline->getPipeline());
+      // bind shadow map cascade view projection matrices
+      commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
+                                        shadowMapCascadeViewProjectionMatricesDescriptorSet, 1, &dynamicOffset);
+    }
 
-    VkDeviceSize offsets[] = { 0 };
-    this->commandBuffer->bindVertexBuffers(0, 1, vertexBuffer->getBuffer()->getBuffer(), offsets);
-    this->commandBuffer->bindIndexBuffer(*indexBuffer->getBuffer()->getBuffer(), 0, vk::IndexType::eUint32);
+    commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t),
+                                 &cascadeIndex);
+  };
+
+  // the camera is the first view of the culling buffer, followed by the cascades of every shadow map
+  const auto getCullingView = [&](uint32_t cascade) {
+    return 1 + shadowMapIndex * Settings::shadowMapCascadeCount + cascade;
+  };
+
+  // begins a render pass over the region of the cascade, the render area limits the clear to it, and binds everything
+  // the draws into it need, the instances come from the culling buffer when the draws do
+  const auto beginCascade = [&](uint32_t cascade, const vk::RenderPass* renderPass, bool drawsCulledInstances) {
+    const auto& rect = shadowAtlas->getRect(shadowMapIndex, cascade);
+    auto renderPassBeginInfo = vk::RenderPassBeginInfo()
+                                 .setRenderPass(*renderPass)
+                                 .setFramebuffer(*shadowAtlas->getFramebuffer())
+                                 .setRenderArea(rect);
+    renderPassBeginInfo.setClearValueCount(1).setPClearValues(clearValues);
+    commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+
+    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *shadowPipeline->getPipeline());
+
+    const auto viewport = getViewport(cascade);
+    commandBuffer->setViewport(0, 1, &viewport);
+    commandBuffer->setScissor(0, 1, &rect);
 
-    auto pipelineLayout = shadowPipeline->getPipelineLayout();
+    bindCascade(cascade);
 
-    uint32_t dynamicOffset = 0;
-    if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+    if (drawsCulledInstances)
     {
-      dynamicOffset = numShadowMaps * context->getUniformBufferDataAlignment() +
-                      shadowMapIndex * context->getUniformBufferDataAlignmentLarge();
+      VkDeviceSize instanceOffsets[] = { cullingBuffer->getVisibleInstanceOffset(getCullingView(cascade)) };
+      commandBuffer->bindVertexBuffers(1, 1, cullingBuffer->getVisibleInstanceBuffer(frameIndex)->getBuffer(),
+                                       instanceOffsets);
     }
-    else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+    else
     {
-      dynamicOffset = shadowMapIndex * context->getUniformBufferDataAlignment();
+      VkDeviceSize instanceOffsets[] = { instanceBuffer->getFrameOffset(frameIndex) };
+      commandBuffer->bindVertexBuffers(1, 1, instanceBuffer->getBuffer()->getBuffer(), instanceOffsets);
     }
+  };
+
+  // begins one render pass over the regions of all cascades, each with its own viewport, and clears the regions of
+  // the given ones only, the depth of the others is kept
+  const auto beginCascades = [&](const std::vector<uint32_t>& clearedCascades) {
+    std::vector<vk::Viewport> viewports;
+    std::vector<vk::Rect2D> scissors;
+    auto boundsMin = glm::ivec2(std::numeric_limits<int32_t>::max()), boundsMax = glm::ivec2(0);
+    for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+    {
+      const auto& rect = shadowAtlas->getRect(shadowMapIndex, i);
+      viewports.push_back(getViewport(i));
+      scissors.push_back(rect);
+      boundsMin = glm::min(boundsMin, glm::ivec2(rect.offset.x, rect.offset.y));
+      boundsMax =
+        glm::max(boundsMax, glm::ivec2(rect.offset.x + rect.extent.width, rect.offset.y + rect.extent.height));
+    }
+
+    const auto renderArea =
+      vk::Rect2D(vk::Offset2D(boundsMin.x, boundsMin.y),
+                 vk::Extent2D(static_cast<uint32_t>(boundsMax.x - boundsMin.x),
+                              static_cast<uint32_t>(boundsMax.y - boundsMin.y)));
+    auto renderPassBeginInfo = vk::RenderPassBeginInfo()
+                                 .setRenderPass(*shadowPipeline->getLoadRenderPass())
+                                 .setFramebuffer(*shadowAtlas->getFramebuffer())
+                                 .setRenderArea(renderArea);
+    commandBuffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+
+    // the render area may also cover regions of other shadow maps, so only the regions of the cascades are cleared
+    if (!clearedCascades.empty())
+    {
+      const auto clearAttachment = vk::ClearAttachment(vk::ImageAspectFlagBits::eDepth, 0, clearValues[0]);
+      std::vector<vk::ClearRect> clearRects;
+      for (const auto cascade : clearedCascades)
+      {
+        clearRects.push_back(vk::ClearRect(shadowAtlas->getRect(shadowMapIndex, cascade), 0, 1));
+      }
+      commandBuffer->clearAttachments(1, &clearAttachment, static_cast<uint32_t>(clearRects.size()),
+                                      clearRects.data());
+    }
+
+    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *shadowPipeline->getCascadesPipeline());
+    commandBuffer->setViewport(0, static_cast<uint32_t>(viewports.size()), viewports.data());
+    commandBuffer->setScissor(0, static_cast<uint32_t>(scissors.size()), scissors.data());
+
+    // the instances add their own cascade to the index of the first one
+    bindCascade(0);
 
-    // bind shadow map cascade view projection matrices
-    this->commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 1, 1,
-                                            shadowMapCascadeViewProjectionMatricesDescriptorSet, 1, &dynamicOffset);
+    VkDeviceSize instanceOffsets[] = { 0 };
+    commandBuffer->bindVertexBuffers(1, 1, cascadeInstanceBuffers.at(frameIndex)->getBuffer(), instanceOffsets);
+  };
 
-    this->commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t), &i);
+  // draws what the GPU found visible to the cascade
+  const auto drawCulledInstances = [&](uint32_t cascade) {
+    // the culling pass already folded decoding the positions into the world matrices it wrote
+    if (Settings::vertexCompression)
+    {
+      const glm::vec4 bounds[] = { glm::vec4(0.0f), glm::vec4(1.0f) };
+      commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, sizeof(glm::vec4),
+                                   sizeof(bounds), bounds);
+    }
 
+    const auto view = getCullingView(cascade);
+    const auto drawBuffer = cullingBuffer->getDrawBuffer(frameIndex)->getBuffer();
+    if (context->getEnabledFeatures().multiDrawIndirect)
+    {
+      commandBuffer->drawIndexedIndirect(*drawBuffer, cullingBuffer->getDrawOffset(view, 0),
+                                         cullingBuffer->getNumDraws(), sizeof(vk::DrawIndexedIndirectCommand));
+    }
+    else
+    {
+      for (uint32_t j = 0; j < cullingBuffer->getNumDraws(); ++j)
+      {
+        commandBuffer->drawIndexedIndirect(*drawBuffer, cullingBuffer->getDrawOffset(view, j), 1,
+                                           sizeof(vk::DrawIndexedIndirectCommand));
+      }
+    }
+  };
+
+  // draws the mesh instances set in the visibility, or all of them without one
+  const auto drawInstances = [&](const std::vector<uint8_t>& visibility) {
+    uint32_t visibilityIndex = 0;
     for (uint32_t j = 0; j < models->size(); ++j)
     {
       auto model = models->at(j);
 
-      if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_GLOBAL)
+      const auto numInstances = static_cast<uint32_t>(model->getInstances()->size());
+      if (numInstances == 0)
       {
-        dynamicOffset = (numShadowMaps + j) * context->getUniformBufferDataAlignment() +
-                        numShadowMaps * context->getUniformBufferDataAlignmentLarge();
+        continue;
       }
-      else if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_INDIVIDUAL)
+
+      for (size_t k = 0; k < model->getMeshes()->size(); ++k, visibilityIndex += numInstances)
       {
-        dynamicOffset = j * context->getUniformBufferDataAlignment();
+        auto mesh = model->getMeshes()->at(k);
+
+        const uint8_t* meshVisibility = visibility.empty() ? nullptr : visibility.data() + visibilityIndex;
+        if (!isAnyInstanceVisible(meshVisibility, numInstances))
+        {
+          continue;
+        }
+
+        if (Settings::vertexCompression)
+        {
+          const glm::vec4 bounds[] = { glm::vec4(mesh->boundsMin, 0.0f),
+                                       glm::vec4(mesh->boundsMax - mesh->boundsMin, 0.0f) };
+          commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, sizeof(glm::vec4),
+                                       sizeof(bounds), bounds);
+        }
+
+        drawVisibleInstances(commandBuffer, mesh.get(), model->getFirstInstance(), numInstances, meshVisibility);
       }
+    }
+  };
 
-      // bind geometry world matrix
-      this->commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, 1,
-                                              geometryWorldMatrixDescriptorSet, 1, &dynamicOffset);
+  const auto isCaching = dynamicCasters && shadowAtlas->getCacheImage();
 
-      for (size_t k = 0; k < model->getMeshes()->size(); ++k)
+  // one instanced draw per mesh into all given cascades, with one instance for every cascade a mesh instance is visible
+  // to, limited to either the static or the dynamic casters while caching
+  uint32_t numCascadeInstances = 0;
+  const auto drawCascadeInstances = [&](const std::vector<uint32_t>& cascades, uint8_t dynamic) {
+    auto cascadeInstances =
+      static_cast<CascadeInstance*>(cascadeInstanceBuffers.at(frameIndex)->getMemoryMappedLocation());
+
+    uint32_t visibilityIndex = 0;
+    for (uint32_t j = 0; j < models->size(); ++j)
+    {
+      auto model = models->at(j);
+
+      const auto numInstances = static_cast<uint32_t>(model->getInstances()->size());
+      if (numInstances == 0)
+      {
+        continue;
+      }
+      const auto modelWorldMatrices = worldMatrices.data() + model->getFirstInstance();
+
+      for (size_t k = 0; k < model->getMeshes()->size(); ++k, visibilityIndex += numInstances)
       {
         auto mesh = model->getMeshes()->at(k);
-        this->commandBuffer->drawIndexed(mesh->indexCount, 1, mesh->firstIndex, 0, 0);
+
+        const auto firstInstance = numCascadeInstances;
+        for (const auto cascade : cascades)
+        {
+          const auto& visibility = cascadeVisibilities.at(cascade);
+          for (uint32_t i = 0; i < numInstances; ++i)
+          {
+            const auto index = visibilityIndex + i;
+            if ((visibility.empty() || visibility[index]) && (!isCaching || dynamicCasters->at(index) == dynamic))
+            {
+              cascadeInstances[numCascadeInstances++] = { modelWorldMatrices[i], cascade };
+            }
+          }
+        }
+
+        if (numCascadeInstances == firstInstance)
+        {
+          continue;
+        }
+
+        if (Settings::vertexCompression)
+        {
+          const glm::vec4 bounds[] = { glm::vec4(mesh->boundsMin, 0.0f),
+                                       glm::vec4(mesh->boundsMax - mesh->boundsMin, 0.0f) };
+          commandBuffer->pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eVertex, sizeof(glm::vec4),
+                                       sizeof(bounds), bounds);
+        }
+
+        commandBuffer->drawIndexed(mesh->indexCount, numCascadeInstances - firstInstance, mesh->firstIndex, 0,
+                                   firstInstance);
       }
     }
+  };
+
+  // the visibility of the cascade limited to either its static or its dynamic casters, which are drawn from the
+  // instance buffer even when culling on the GPU since its draws hold both
+  const auto limitCasters = [&](uint32_t cascade, uint8_t dynamic) -> const std::vector<uint8_t>& {
+    const auto& visibility = cascadeVisibilities.at(cascade);
+    casterVisibility.resize(dynamicCasters->size());
+    for (size_t j = 0; j < casterVisibility.size(); ++j)
+    {
+      casterVisibility[j] = dynamicCasters->at(j) == dynamic && (visibility.empty() || visibility[j]) ? 1 : 0;
+    }
+    return casterVisibility;
+  };
 
-    this->commandBuffer->endRenderPass();
+  // copies the regions of the cascades between the atlas and its cache, the atlas is only in a transfer layout for the
+  // copies while the cache always stays in the general layout
+  const auto copyRegions = [&](const std::vector<uint32_t>& cascades, bool toCache) {
+    if (cascades.empty())
+    {
+      return;
+    }
+
+    const auto atlasLayout = toCache ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::eTransferDstOptimal;
+    const auto atlasAccess = toCache ? vk::AccessFlagBits::eTransferRead : vk::AccessFlagBits::eTransferWrite;
+
+    auto barrier = vk::ImageMemoryBarrier()
+                     .setOldLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+                     .setNewLayout(atlasLayout)
+                     .setImage(*shadowAtlas->getImage());
+    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1))
+      .setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eShaderRead);
+    barrier.setDstAccessMask(atlasAccess);
+    // the copies of earlier cascades and frames may still be using the cache
+    auto cacheBarrier = vk::MemoryBarrier()
+                          .setSrcAccessMask(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite)
+                          .setDstAccessMask(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+    commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests |
+                                     vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 1, &cacheBarrier, 0,
+                                   nullptr, 1, &barrier);
+
+    const auto subresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eDepth, 0, 0, 1);
+    std::vector<vk::ImageCopy> imageCopies;
+    for (const auto cascade : cascades)
+    {
+      const auto& rect = shadowAtlas->getRect(shadowMapIndex, cascade);
+      const auto offset = vk::Offset3D(rect.offset.x, rect.offset.y, 0);
+      imageCopies.push_back(vk::ImageCopy()
+                              .setSrcSubresource(subresource)
+                              .setSrcOffset(offset)
+                              .setDstSubresource(subresource)
+                              .setDstOffset(offset)
+                              .setExtent(vk::Extent3D(rect.extent.width, rect.extent.height, 1)));
+    }
+    if (toCache)
+    {
+      commandBuffer->copyImage(*shadowAtlas->getImage(), atlasLayout, *shadowAtlas->getCacheImage(),
+                               vk::ImageLayout::eGeneral, static_cast<uint32_t>(imageCopies.size()),
+                               imageCopies.data());
+    }
+    else
+    {
+      commandBuffer->copyImage(*shadowAtlas->getCacheImage(), vk::ImageLayout::eGeneral, *shadowAtlas->getImage(),
+                               atlasLayout, static_cast<uint32_t>(imageCopies.size()), imageCopies.data());
+    }
 
+    barrier.setOldLayout(atlasLayout).setNewLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+    barrier.setSrcAccessMask(atlasAccess)
+      .setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                        vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+    commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                                     vk::PipelineStageFlagBits::eLateFragmentTests,
+                                   vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &barrier);
+  };
+
+  // the depth written into the atlas is read by the lighting pass
+  const auto makeReadable = [&]() {
     auto barrier = vk::ImageMemoryBarrier()
                      .setOldLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
                      .setNewLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
-                     .setImage(*depthImage);
-    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, i, 1))
+                     .setImage(*shadowAtlas->getImage());
+    barrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1))
       .setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite);
     barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-    this->commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eEarlyFragmentTests,
-                                         vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr,
-                                         0, nullptr, 1, &barrier);
+    commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                                   vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0,
+                                   nullptr, 1, &barrier);
+  };
+
+  // all cascades are drawn in one pass unless the draws come from the culling buffer, which writes them per cascade
+  if (shadowPipeline->getCascadesPipeline() && (isCaching || !cullingBuffer))
+  {
+    // the cascades that are cleared and get all of their casters drawn, and the ones that get their static casters
+    // back from the cache
+    std::vector<uint32_t> clearedCascades, restoredCascades;
+    for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+    {
+      const auto update = isCaching ? cascadeUpdates.at(i) : CascadeUpdate::All;
+      if (update == CascadeUpdate::All)
+      {
+        clearedCascades.push_back(static_cast<uint32_t>(i));
+      }
+      else if (update == CascadeUpdate::Dynamic)
+      {
+        restoredCascades.push_back(static_cast<uint32_t>(i));
+      }
+    }
+
+    // nothing is drawn when every cascade is skipped
+    if (!clearedCascades.empty() || !restoredCascades.empty())
+    {
+      // the world matrices are looked up once per instance, and every mesh instance fits into the buffer once per
+      // cascade, since the static and dynamic casters of a cascade never overlap
+      worldMatrices.clear();
+      uint32_t numMeshInstances = 0;
+      for (const auto& model : *models)
+      {
+        for (const auto& instance : *model->getInstances())
+        {
+          worldMatrices.push_back(instance->getWorldMatrix());
+        }
+        numMeshInstances += static_cast<uint32_t>(model->getMeshes()->size() * model->getInstances()->size());
+      }
+
+      const auto size = std::max<vk::DeviceSize>(1, numMeshInstances) * Settings::shadowMapCascadeCount *
+                        sizeof(CascadeInstance);
+      auto& cascadeInstanceBuffer = cascadeInstanceBuffers.at(frameIndex);
+      if (!cascadeInstanceBuffer || cascadeInstanceBufferSizes.at(frameIndex) < size)
+      {
+        cascadeInstanceBuffer = std::make_unique<Buffer>(
+          context, vk::BufferUsageFlagBits::eVertexBuffer, size,
+          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        cascadeInstanceBuffer->mapMemory();
+        cascadeInstanceBufferSizes.at(frameIndex) = size;
+      }
+
+      if (!isCaching)
+      {
+        beginCascades(clearedCascades);
+        drawCascadeInstances(clearedCascades, 0);
+        commandBuffer->endRenderPass();
+      }
+      else
+      {
+        // the cached static casters go back into their regions first, the other cascades draw and cache them again
+        copyRegions(restoredCascades, false);
+
+        if (!clearedCascades.empty())
+        {
+          beginCascades(clearedCascades);
+          drawCascadeInstances(clearedCascades, 0);
+          commandBuffer->endRenderPass();
+
+          copyRegions(clearedCascades, true);
+        }
+
+        auto updatedCascades = clearedCascades;
+        updatedCascades.insert(updatedCascades.end(), restoredCascades.begin(), restoredCascades.end());
+        beginCascades({});
+        drawCascadeInstances(updatedCascades, 1);
+        commandBuffer->endRenderPass();
+      }
+
+      makeReadable();
+    }
+  }
+  else
+  {
+    for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+    {
+      const auto cascade = static_cast<uint32_t>(i);
+      const auto update = isCaching ? cascadeUpdates.at(i) : CascadeUpdate::All;
+      if (update == CascadeUpdate::Skip)
+      {
+        continue;
+      }
+
+      if (!isCaching)
+      {
+        beginCascade(cascade, shadowPipeline->getRenderPass(), cullingBuffer != nullptr);
+        if (cullingBuffer)
+        {
+          drawCulledInstances(cascade);
+        }
+        else
+        {
+          drawInstances(cascadeVisibilities.at(i));
+        }
+        commandBuffer->endRenderPass();
+      }
+      else
+      {
+        if (update == CascadeUpdate::All)
+        {
+          beginCascade(cascade, shadowPipeline->getRenderPass(), false);
+          drawInstances(limitCasters(cascade, 0));
+          commandBuffer->endRenderPass();
+
+          copyRegions({ cascade }, true);
+        }
+        else
+        {
+          copyRegions({ cascade }, false);
+        }
+
+        beginCascade(cascade, shadowPipeline->getLoadRenderPass(), false);
+        drawInstances(limitCasters(cascade, 1));
+        commandBuffer->endRenderPass();
+      }
+
+      makeReadable();
+    }
   }
 
-  this->commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), 1);
+  commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *context->getQueryPool(), queryOffset + 1);
 
-  this->commandBuffer->end();
+  commandBuffer->end();
 }
 
-void ShadowMap::update(const std::shared_ptr<Camera> camera, const glm::vec3 lightDirection)
+void ShadowMap::update(const std::shared_ptr<Camera> camera,
+                       const glm::vec3 lightDirection,
+                       const glm::vec3& sceneMin,
+                       const glm::vec3& sceneMax,
+                       const glm::vec2& depthRange)
 {
-  float* cascadeSplits = new float[Settings::shadowMapCascadeCount];
-
-  float nearClip = camera->getNearClip();
-  float farClip = camera->getFarClip();
-  float clipRange = farClip - nearClip;
+  const auto nearClip = camera->getNearClip();
+  const auto farClip = camera->getFarClip();
+  const auto clipRange = farClip - nearClip;
+
+  // the splits are spread over the given range only, the slices are still taken from the whole frustum
+  const auto minZ = depthRange.x, maxZ = depthRange.y;
+  const auto range = maxZ - minZ;
+  const auto ratio = maxZ / minZ;
+
+  // the corners of the camera frustum in view space, one per column, the depth range of the camera is zero to one, so
+  // that the size of each slice only depends on the projection and not on where the camera is
+  const auto inverseProjection = glm::inverse(*camera->getProjectionMatrix());
+  const auto inverseView = glm::inverse(*camera->getViewMatrix());
+  auto nearCorners =
+    inverseProjection * glm::mat4(glm::vec4(-1.0f, 1.0f, 0.0f, 1.0f), glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+                                  glm::vec4(1.0f, -1.0f, 0.0f, 1.0f), glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f));
+  glm::mat4 farCorners;
+  for (glm::length_t j = 0; j < 4; ++j)
+  {
+    // the far corners only differ by a depth of one
+    farCorners[j] = nearCorners[j] + inverseProjection[2];
+    farCorners[j] /= farCorners[j].w;
+    nearCorners[j] /= nearCorners[j].w;
+  }
+  const auto cornerRays = farCorners - nearCorners;
 
-  float minZ = nearClip;
-  float maxZ = nearClip + clipRange;
+  // the light looks along its direction from the origin, so that its texels stay put while the camera moves
+  const auto up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  const auto lightViewMatrix = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
 
-  float range = maxZ - minZ;
-  float ratio = maxZ / minZ;
+  // the depth range of the scene along the light, where casters can be even outside of the camera frustum
+  const auto hasScene = sceneMin.x <= sceneMax.x;
+  auto sceneNear = -std::numeric_limits<float>::max(), sceneFar = std::numeric_limits<float>::max();
+  if (hasScene)
+  {
+    const auto sceneCorners = lightViewMatrix * glm::mat4(glm::vec4(sceneMin.x, sceneMin.y, sceneMin.z, 1.0f),
+                                                          glm::vec4(sceneMax.x, sceneMin.y, sceneMin.z, 1.0f),
+                                                          glm::vec4(sceneMin.x, sceneMax.y, sceneMin.z, 1.0f),
+                                                          glm::vec4(sceneMax.x, sceneMax.y, sceneMin.z, 1.0f));
+    // the other four corners are the same ones moved along the world z axis
+    const auto offset = lightViewMatrix[2][2] * (sceneMax.z - sceneMin.z);
+    for (glm::length_t j = 0; j < 4; ++j)
+    {
+      sceneNear = std::max({ sceneNear, sceneCorners[j].z, sceneCorners[j].z + offset });
+      sceneFar = std::min({ sceneFar, sceneCorners[j].z, sceneCorners[j].z + offset });
+    }
+  }
 
   // calculate split depths based on view camera frustum
   // based on method presented in https://developer.nvidia.com/gpugems/GPUGems3/gpugems3_ch10.html
+  auto lastSplitDist = (minZ - nearClip) / clipRange;
   for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
   {
-    float p = (i + 1) / static_cast<float>(Settings::shadowMapCascadeCount);
-    float log = minZ * std::pow(ratio, p);
-    float uniform = minZ + range * p;
-    float d = 0.95f * (log - uniform) + uniform;
-    cascadeSplits[i] = (d - nearClip) / clipRange;
+    const auto p = (i + 1) / static_cast<float>(Settings::shadowMapCascadeCount);
+    const auto log = minZ * std::pow(ratio, p);
+    const auto uniform = minZ + range * p;
+    const auto d = 0.95f * (log - uniform) + uniform;
+    const auto splitDist = (d - nearClip) / clipRange;
+
+    // the corners of the slice of the camera frustum that this cascade covers
+    const auto sliceNear = nearCorners + cornerRays * lastSplitDist;
+    const auto sliceFar = nearCorners + cornerRays * splitDist;
+
+    const auto center = glm::vec3((sliceNear[0] + sliceNear[1] + sliceNear[2] + sliceNear[3] + sliceFar[0] +
+                                   sliceFar[1] + sliceFar[2] + sliceFar[3]) /
+                                  8.0f);
+    float radius = 0.0f;
+    for (glm::length_t j = 0; j < 4; ++j)
+    {
+      radius = glm::max(radius, glm::max(glm::length(glm::vec3(sliceNear[j]) - center),
+                                         glm::length(glm::vec3(sliceFar[j]) - center)));
+    }
+    // the sphere only changes size with the projection, rounding keeps it from flickering from precision alone
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // moving the cascade by whole texels only keeps the edges of its shadows from shimmering while the camera moves
+    const auto resolution = static_cast<float>(shadowAtlas->getRect(shadowMapIndex, i).extent.width);
+    const auto texelSize = 2.0f * radius / resolution;
+    auto lightCenter = glm::vec3(lightViewMatrix * inverseView * glm::vec4(center, 1.0f));
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // the light looks down its negative z axis, everything in the scene between it and the far end of the slice can
+    // cast a shadow into the slice, and nothing beyond the scene receives one
+    auto zNear = lightCenter.z + radius, zFar = lightCenter.z - radius;
+    if (hasScene)
+    {
+      zNear = sceneNear;
+      zFar = std::max(zFar, sceneFar);
+    }
+    zFar = std::min(zFar, zNear - 1.0f);
+
+    // bottom and top are swapped to flip y, since the projection is off center
+    const auto shadowMapProjectionMatrix = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                                      lightCenter.y + radius, lightCenter.y - radius, -zNear, -zFar);
+
+    // store split distance and matrix in cascade
+    splitDepths[i] = nearClip + splitDist * clipRange;
+    cascadeViewProjectionMatrices[i] = shadowMapProjectionMatrix * lightViewMatrix;
+
+    lastSplitDist = splitDist;
   }
 
-  // calculate orthographic projection matrix for each cascade
-  float lastSplitDist = 0.0;
-  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+  if (Settings::shadowCaching)
   {
-    float splitDist = cascadeSplits[i];
+    updateCache();
+  }
+}
 
-    glm::vec3 frustumCorners[8] = { glm::vec3(-1.0f, 1.0f, -1.0f), glm::vec3(1.0f, 1.0f, -1.0f),
-                                    glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-1.0f, -1.0f, -1.0f),
-                                    glm::vec3(-1.0f, 1.0f, 1.0f),  glm::vec3(1.0f, 1.0f, 1.0f),
-                                    glm::vec3(1.0f, -1.0f, 1.0f),  glm::vec3(-1.0f, -1.0f, 1.0f) };
+void ShadowMap::updateCache()
+{
+  ++frameCounter;
 
-    // project frustum corners into world space
-    glm::mat4 invCam = glm::inverse((*camera->getProjectionMatrix()) * (*camera->getViewMatrix()));
-    for (uint32_t j = 0; j < 8; ++j)
+  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+  {
+    auto& update = cascadeUpdates.at(i);
+
+    // the cache is only reused while the cascade stays close enough to where its static casters were drawn
+    const auto isCacheUsable =
+      cacheValid.at(i) &&
+      getTexelOffset(cachedViewProjectionMatrices.at(i), cascadeViewProjectionMatrices.at(i),
+                     shadowAtlas->getRect(shadowMapIndex, i).extent.width) <= Settings::shadowCacheThreshold;
+
+    // the far half of the cascades takes turns, so that they are not all drawn in the same frame
+    const auto isFar = i > 0 && i >= Settings::shadowMapCascadeCount / 2;
+    const auto interval = static_cast<uint32_t>(std::max(Settings::shadowFarCascadeInterval, 1));
+    if (isCacheUsable && isFar && (frameCounter + i) % interval != 0)
     {
-      glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[j], 1.0f);
-      frustumCorners[j] = invCorner / invCorner.w;
+      update = CascadeUpdate::Skip;
     }
-
-    for (uint32_t j = 0; j < 4; ++j)
+    else if (isCacheUsable)
     {
-      glm::vec3 dist = frustumCorners[j + 4] - frustumCorners[j];
-      frustumCorners[j + 4] = frustumCorners[j] + (dist * splitDist);
-      frustumCorners[j] = frustumCorners[j] + (dist * lastSplitDist);
+      update = CascadeUpdate::Dynamic;
     }
-
-    // get frustum center
-    glm::vec3 frustumCenter = glm::vec3(0.0f);
-    for (uint32_t j = 0; j < 8; ++j)
+    else
     {
-      frustumCenter += frustumCorners[j];
+      update = CascadeUpdate::All;
+      cachedViewProjectionMatrices.at(i) = cascadeViewProjectionMatrices.at(i);
+      cacheValid.at(i) = 1;
     }
-    frustumCenter /= 8.0f;
 
-    float radius = 0.0f;
-    for (uint32_t j = 0; j < 8; ++j)
-    {
-      float distance = glm::length(frustumCorners[j] - frustumCenter);
-      radius = glm::max(radius, distance);
-    }
-    radius = std::ceil(radius * 16.0f) / 16.0f;
+    // the cached static casters are only valid with the matrix they were drawn with
+    cascadeViewProjectionMatrices.at(i) = cachedViewProjectionMatrices.at(i);
+
+    // roughly the last fifty frames
+    cachedRates.at(i) += ((update != CascadeUpdate::All ? 1.0f : 0.0f) - cachedRates.at(i)) * 0.02f;
+    skippedRates.at(i) += ((update == CascadeUpdate::Skip ? 1.0f : 0.0f) - skippedRates.at(i)) * 0.02f;
+  }
+}
 
-    glm::vec3 maxExtents = glm::vec3(radius);
-    glm::vec3 minExtents = -maxExtents;
+float ShadowMap::getTexelOffset(const glm::mat4& from, const glm::mat4& to, uint32_t resolution)
+{
+  // where the corners of the region drawn with the new matrix end up with the old one
+  const auto toFrom = from * glm::inverse(to);
 
-    glm::mat4 shadowMapViewMatrix =
-      glm::lookAt(frustumCenter - lightDirection * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 shadowMapProjectionMatrix =
-      glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, -6500.0f, 6500.0f);
-    shadowMapProjectionMatrix[1][1] *= -1.0f;
+  float offset = 0.0f;
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    const auto corner = glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, 0.0f, 1.0f);
+    const auto moved = toFrom * corner;
+    offset = glm::max(offset, glm::length(glm::vec2(moved) / moved.w - glm::vec2(corner)));
+  }
 
-    // store split distance and matrix in cascade
-    splitDepths[i] = (camera->getNearClip() + splitDist * clipRange);
-    cascadeViewProjectionMatrices[i] = shadowMapProjectionMatrix * shadowMapViewMatrix;
+  // from clip space, which spans two units across the region
+  return offset * 0.5f * static_cast<float>(resolution);
+}
 
-    lastSplitDist = cascadeSplits[i];
+void ShadowMap::invalidateCache()
+{
+  std::fill(cacheValid.begin(), cacheValid.end(), 0);
+}
+
+void ShadowMap::cull(const CullingBounds& bounds, const BoundingVolumeHierarchy* boundingVolumeHierarchy)
+{
+  for (int i = 0; i < Settings::shadowMapCascadeCount; ++i)
+  {
+    auto frustum = Frustum(cascadeViewProjectionMatrices.at(i));
+    frustum.removeNearPlane();
+    if (boundingVolumeHierarchy)
+    {
+      boundingVolumeHierarchy->cull(frustum, bounds, cascadeVisibilities.at(i));
+    }
+    else
+    {
+      bounds.cull(frustum, cascadeVisibilities.at(i));
+    }
   }
-}
\ No newline at end of file
+}
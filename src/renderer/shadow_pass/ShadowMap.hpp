@@ -1,116 +1,125 @@
 #pragma once
 
+#include "ShadowAtlas.hpp"
 #include "ShadowPipeline.hpp"
 #include "core/Camera.hpp"
+#include "renderer/BoundingVolumeHierarchy.hpp"
+#include "renderer/Culling.hpp"
 #include "renderer/Model.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
 #include "renderer/buffers/UniformBuffer.hpp"
+#include "renderer/culling_pass/CullingBuffer.hpp"
 
 class ShadowMap
 {
-private:
-  std::shared_ptr<Context> context;
-  std::shared_ptr<DescriptorPool> descriptorPool;
-
-  static vk::Image* createDepthImage(const std::shared_ptr<Context> context);
-  std::function<void(vk::Image*)> depthImageDeleter = [this](vk::Image* depthImage) {
-    if (context->getDevice())
-      context->getDevice()->destroyImage(*depthImage);
-  };
-  std::unique_ptr<vk::Image, decltype(depthImageDeleter)> depthImage;
-
-  static vk::DeviceMemory* createDepthImageMemory(const std::shared_ptr<Context> context,
-                                                  const vk::Image* image,
-                                                  vk::MemoryPropertyFlags memoryPropertyFlags);
-  std::function<void(vk::DeviceMemory*)> depthImageMemoryDeleter = [this](vk::DeviceMemory* depthImageMemory) {
-    if (context->getDevice())
-      context->getDevice()->freeMemory(*depthImageMemory);
-  };
-  std::unique_ptr<vk::DeviceMemory, decltype(depthImageMemoryDeleter)> depthImageMemory;
+public:
+  // an instance counts as a dynamic caster until it has not moved for this many frames
+  static const uint32_t FRAMES_UNTIL_STATIC;
 
-  static vk::ImageView* createSharedDepthImageView(const std::shared_ptr<Context> context, const vk::Image* image);
-  std::function<void(vk::ImageView*)> sharedDepthImageViewDeleter = [this](vk::ImageView* depthImageView) {
-    if (context->getDevice())
-      context->getDevice()->destroyImageView(*depthImageView);
+  // what is drawn into a cascade this frame while caching static casters
+  enum class CascadeUpdate
+  {
+    // nothing, the cascade keeps its depth and matrix from the last frame it was drawn
+    Skip,
+    // the cached static casters are copied back and only the dynamic ones are drawn on top
+    Dynamic,
+    // the static casters are drawn and cached again with a new matrix, followed by the dynamic ones
+    All
   };
-  std::unique_ptr<vk::ImageView, decltype(sharedDepthImageViewDeleter)> sharedDepthImageView;
 
-  static std::vector<vk::ImageView>*
-  createDepthImageViews(const std::shared_ptr<Context> context, const vk::Image* image);
-  std::function<void(std::vector<vk::ImageView>*)> depthImageViewsDeleter =
-    [this](std::vector<vk::ImageView>* depthImageViews) {
-      if (context->getDevice())
-      {
-        for (auto& depthImageView : *depthImageViews)
-          context->getDevice()->destroyImageView(depthImageView);
-      }
-    };
-  std::unique_ptr<std::vector<vk::ImageView>, decltype(depthImageViewsDeleter)> depthImageViews;
-
-  static std::vector<vk::Framebuffer>* createFramebuffers(const std::shared_ptr<Context> context,
-                                                          const std::vector<vk::ImageView>* depthImageViews,
-                                                          const vk::RenderPass* renderPass);
-  std::function<void(std::vector<vk::Framebuffer>*)> framebuffersDeleter =
-    [this](std::vector<vk::Framebuffer>* framebuffers) {
-      if (context->getDevice())
-      {
-        for (auto& framebuffer : *framebuffers)
-          context->getDevice()->destroyFramebuffer(framebuffer);
-      }
-    };
-  std::unique_ptr<std::vector<vk::Framebuffer>, decltype(framebuffersDeleter)> framebuffers;
+private:
+  std::shared_ptr<Context> context;
+  std::shared_ptr<DescriptorPool> descriptorPool;
 
-  static vk::Sampler* createSampler(const std::shared_ptr<Context> context);
-  std::function<void(vk::Sampler*)> samplerDeleter = [this](vk::Sampler* sampler) {
-    if (context->getDevice())
-      context->getDevice()->destroySampler(*sampler);
-  };
-  std::unique_ptr<vk::Sampler, decltype(samplerDeleter)> sampler;
+  // the cascades render into their own regions of the atlas that all shadow maps share
+  std::shared_ptr<ShadowAtlas> shadowAtlas;
+  uint32_t shadowMapIndex;
 
-  static vk::CommandBuffer* createCommandBuffer(const std::shared_ptr<Context> context);
-  std::unique_ptr<vk::CommandBuffer> commandBuffer;
+  static std::vector<vk::CommandBuffer>* createCommandBuffers(const std::shared_ptr<Context> context);
+  std::unique_ptr<std::vector<vk::CommandBuffer>> commandBuffers;
 
   static vk::DescriptorSet* createSharedDescriptorSet(const std::shared_ptr<Context> context,
                                                       const std::shared_ptr<DescriptorPool> descriptorPool,
                                                       const ShadowMap* shadowMap);
   std::unique_ptr<vk::DescriptorSet> sharedDescriptorSet;
 
-  static std::vector<vk::DescriptorSet>* createDescriptorSets(const std::shared_ptr<Context> context,
-                                                              const std::shared_ptr<DescriptorPool> descriptorPool,
-                                                              const ShadowMap* shadowMap);
-  std::unique_ptr<std::vector<vk::DescriptorSet>> descriptorSets;
-
   std::vector<float> splitDepths;
   std::vector<glm::mat4> cascadeViewProjectionMatrices;
+  // one visibility per cascade, empty until the first cull
+  std::vector<std::vector<uint8_t>> cascadeVisibilities;
+  // the casters of the current draw, the visibility of the cascade limited to either the static or the dynamic ones
+  std::vector<uint8_t> casterVisibility;
+
+  // only used while drawing all cascades in one pass, the mesh instances of each draw with the cascade they are drawn
+  // into, written while recording and grown as needed, one per frame in flight
+  std::vector<std::unique_ptr<Buffer>> cascadeInstanceBuffers;
+  std::vector<vk::DeviceSize> cascadeInstanceBufferSizes;
+  // the world matrix of every instance of the frame being recorded
+  std::vector<glm::mat4> worldMatrices;
+
+  std::vector<CascadeUpdate> cascadeUpdates;
+  // the matrix the static casters of each cascade were cached with, only valid once they have been drawn
+  std::vector<glm::mat4> cachedViewProjectionMatrices;
+  std::vector<uint8_t> cacheValid;
+  // how often each cascade reused its cached static casters and how often it was skipped entirely, as running averages
+  std::vector<float> cachedRates, skippedRates;
+  uint32_t frameCounter = 0;
+
+  // picks the update of every cascade and keeps the cached matrices of the ones whose static casters are reused
+  void updateCache();
+  // the farthest that a corner of the region moves in texels when drawn with one matrix instead of the other
+  static float getTexelOffset(const glm::mat4& from, const glm::mat4& to, uint32_t resolution);
 
 public:
   ShadowMap(const std::shared_ptr<Context> context,
             const std::shared_ptr<DescriptorPool> descriptorPool,
-            const std::shared_ptr<ShadowPipeline> shadowPipeline);
+            const std::shared_ptr<ShadowAtlas> shadowAtlas,
+            uint32_t shadowMapIndex);
   ~ShadowMap();
 
+  // with the superglobal strategy the descriptor set holds all frame data instead of only the cascade matrices
+  // culled on the CPU, a cascade draws the casters it was culled to, or all of them before its first cull
+  // culled on the GPU, a cascade draws what the culling buffer found visible to it
+  // while caching static casters, the dynamic casters are given per mesh instance
+  // with a cascades pipeline, all cascades are drawn in one pass unless the draws come from the culling buffer
+  // drawing all cascades in one pass writes their instances while recording, so it is recorded again every frame
   void recordCommandBuffer(const std::shared_ptr<VertexBuffer> vertexBuffer,
                            const std::shared_ptr<IndexBuffer> indexBuffer,
+                           const std::shared_ptr<InstanceBuffer> instanceBuffer,
                            const vk::DescriptorSet* shadowMapCascadeViewProjectionMatricesDescriptorSet,
-                           const vk::DescriptorSet* geometryWorldMatrixDescriptorSet,
                            const std::shared_ptr<ShadowPipeline> shadowPipeline,
                            const std::vector<std::shared_ptr<Model>>* models,
                            uint32_t shadowMapIndex,
-                           uint32_t numShadowMaps);
-
-  void update(const std::shared_ptr<Camera> camera, const glm::vec3 lightDirection);
-
-  vk::CommandBuffer* getCommandBuffer() const
+                           uint32_t numShadowMaps,
+                           uint32_t frameIndex,
+                           const CullingBuffer* cullingBuffer = nullptr,
+                           const std::vector<uint8_t>* dynamicCasters = nullptr);
+
+  // fits every cascade to its slice of the camera frustum, snapped to its texels
+  // fits the depth range of every cascade to the scene box seen along the light
+  // the slices split the given view distances, the nearest in x and the farthest in y
+  // the cascades whose static casters are reused keep the matrices they were cached with
+  void update(const std::shared_ptr<Camera> camera,
+              const glm::vec3 lightDirection,
+              const glm::vec3& sceneMin,
+              const glm::vec3& sceneMax,
+              const glm::vec2& depthRange);
+  // draws the static casters of every cascade again the next time it is updated, when an instance started or stopped
+  // moving
+  void invalidateCache();
+  // builds the visible casters of each cascade from the current cascade matrices
+  // the cascades are extended towards the light, so casters outside of the camera view still throw their shadows
+  // the hierarchy is fitted to the bounds when given
+  void cull(const CullingBounds& bounds, const BoundingVolumeHierarchy* boundingVolumeHierarchy = nullptr);
+
+  vk::CommandBuffer* getCommandBuffer(const uint32_t frameIndex) const
   {
-    return commandBuffer.get();
+    return &commandBuffers->at(frameIndex);
   }
   vk::DescriptorSet* getSharedDescriptorSet() const
   {
     return sharedDescriptorSet.get();
   }
-  vk::DescriptorSet* getDescriptorSet(const uint32_t index) const
-  {
-    return &descriptorSets->at(index);
-  }
   float* getSplitDepths()
   {
     return splitDepths.data();
@@ -119,4 +128,12 @@ public:
   {
     return cascadeViewProjectionMatrices.data();
   }
+  const std::vector<float>& getCachedRates() const
+  {
+    return cachedRates;
+  }
+  const std::vector<float>& getSkippedRates() const
+  {
+    return skippedRates;
+  }
 };
@@ -3,13 +3,16 @@
 #include "renderer/Settings.hpp"
 #include "renderer/Shader.hpp"
 
-vk::RenderPass* ShadowPipeline::createRenderPass(const std::shared_ptr<Context> context)
+vk::RenderPass* ShadowPipeline::createRenderPass(const std::shared_ptr<Context> context, vk::AttachmentLoadOp loadOp)
 {
+  // every cascade only clears and renders its own region of the shadow atlas, the rest of it is kept as it is
   auto attachmentDescription = vk::AttachmentDescription()
-                                 .setLoadOp(vk::AttachmentLoadOp::eClear)
+                                 .setLoadOp(loadOp)
                                  .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
                                  .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
-  attachmentDescription.setFormat(vk::Format::eD32Sfloat).setFinalLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+  attachmentDescription.setFormat(vk::Format::eD32Sfloat)
+    .setInitialLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+    .setFinalLayout(vk::ImageLayout::eDepthStencilReadOnlyOptimal);
 
   auto depthAttachmentReference =
     vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
@@ -28,6 +31,19 @@ vk::RenderPass* ShadowPipeline::createRenderPass(const std::shared_ptr<Context>
   subpassDependency.setDependencyFlags(vk::DependencyFlagBits::eByRegion);
   subpassDependencies.push_back(subpassDependency);
 
+  // the lighting pass of the previous frame may still read the atlas where the cascade is about to be cleared, or the
+  // cached static casters may just have been copied into it
+  auto externalDependency = vk::SubpassDependency()
+                              .setSrcSubpass(VK_SUBPASS_EXTERNAL)
+                              .setSrcStageMask(vk::PipelineStageFlagBits::eFragmentShader |
+                                               vk::PipelineStageFlagBits::eTransfer)
+                              .setSrcAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferWrite);
+  externalDependency.setDstSubpass(0)
+    .setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+    .setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                      vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+  subpassDependencies.push_back(externalDependency);
+
   auto renderPassCreateInfo = vk::RenderPassCreateInfo()
                                 .setAttachmentCount(1)
                                 .setPAttachments(&attachmentDescription)
@@ -45,8 +61,9 @@ vk::PipelineLayout* ShadowPipeline::createPipelineLayout(const std::shared_ptr<C
   auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo()
                                     .setSetLayoutCount(static_cast<uint32_t>(setLayouts.size()))
                                     .setPSetLayouts(setLayouts.data());
+  // the cascade index padded to a vec4, followed by the bounds of the mesh being drawn to decode compressed positions
   auto pushConstantRange =
-    vk::PushConstantRange().setStageFlags(vk::ShaderStageFlagBits::eVertex).setSize(sizeof(uint32_t));
+    vk::PushConstantRange().setStageFlags(vk::ShaderStageFlagBits::eVertex).setSize(3 * sizeof(glm::vec4));
   pipelineLayoutCreateInfo.setPushConstantRangeCount(1);
   pipelineLayoutCreateInfo.setPPushConstantRanges(&pushConstantRange);
   auto pipelineLayout = context->getDevice()->createPipelineLayout(pipelineLayoutCreateInfo);
@@ -55,9 +72,20 @@ vk::PipelineLayout* ShadowPipeline::createPipelineLayout(const std::shared_ptr<C
 
 vk::Pipeline* ShadowPipeline::createPipeline(const vk::RenderPass* renderPass,
                                              const vk::PipelineLayout* pipelineLayout,
-                                             std::shared_ptr<Context> context)
+                                             std::shared_ptr<Context> context,
+                                             bool allCascades)
 {
-  Shader vertexShader(context, "shaders/ShadowPass.vert.spv", vk::ShaderStageFlagBits::eVertex);
+  // the superglobal strategy reads the cascade matrices from the frame data storage buffer
+  std::string vertexShaderFilename = allCascades ? "shaders/ShadowPassCascades" : "shaders/ShadowPass";
+  if (Settings::vertexCompression)
+  {
+    vertexShaderFilename += "Compressed";
+  }
+  if (Settings::dynamicUniformBufferStrategy == SETTINGS_DYNAMIC_UNIFORM_BUFFER_STRATEGY_SUPERGLOBAL)
+  {
+    vertexShaderFilename += "SuperGlobal";
+  }
+  Shader vertexShader(context, vertexShaderFilename + ".vert.spv", vk::ShaderStageFlagBits::eVertex);
   Shader fragmentShader(context, "shaders/ShadowPass.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
   auto vertexShaderStageCreateInfo = vertexShader.getPipelineShaderStageCreateInfo();
@@ -73,15 +101,45 @@ vk::Pipeline* ShadowPipeline::createPipeline(const vk::RenderPass* renderPass,
     vertexShaderStageCreateInfo, fragmentShader.getPipelineShaderStageCreateInfo()
   };
 
-  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex));
-  auto position = vk::VertexInputAttributeDescription()
-                    .setLocation(0)
-                    .setFormat(vk::Format::eR32G32B32Sfloat)
-                    .setOffset(offsetof(Vertex, position));
+  // only the position stream is bound, the other vertex attributes are never fetched for shadows
+  auto vertexInputBindingDescription = vk::VertexInputBindingDescription().setStride(sizeof(Vertex::position));
+  auto position = vk::VertexInputAttributeDescription().setLocation(0).setFormat(vk::Format::eR32G32B32Sfloat);
+  if (Settings::vertexCompression)
+  {
+    vertexInputBindingDescription.setStride(sizeof(CompressedVertex::position));
+    position.setFormat(vk::Format::eR16G16B16A16Unorm);
+  }
   std::vector<vk::VertexInputAttributeDescription> vertexInputAttributeDescriptions = { position };
-  auto vertexInputStateCreateInfo =
-    vk::PipelineVertexInputStateCreateInfo().setVertexBindingDescriptionCount(1).setPVertexBindingDescriptions(
-      &vertexInputBindingDescription);
+
+  // the world matrix advances per instance and takes up one location per column, followed by the cascade when
+  // drawing all of them at once
+  auto instanceInputBindingDescription = vk::VertexInputBindingDescription()
+                                           .setBinding(1)
+                                           .setStride(allCascades ? sizeof(CascadeInstance) : sizeof(Instance))
+                                           .setInputRate(vk::VertexInputRate::eInstance);
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription()
+                                                 .setLocation(1 + i)
+                                                 .setBinding(1)
+                                                 .setFormat(vk::Format::eR32G32B32A32Sfloat)
+                                                 .setOffset(offsetof(Instance, worldMatrix) + i * sizeof(glm::vec4)));
+  }
+  if (allCascades)
+  {
+    vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription()
+                                                 .setLocation(5)
+                                                 .setBinding(1)
+                                                 .setFormat(vk::Format::eR32Uint)
+                                                 .setOffset(offsetof(CascadeInstance, cascade)));
+  }
+
+  std::vector<vk::VertexInputBindingDescription> vertexInputBindingDescriptions = { vertexInputBindingDescription,
+                                                                                    instanceInputBindingDescription };
+  auto vertexInputStateCreateInfo = vk::PipelineVertexInputStateCreateInfo()
+                                      .setVertexBindingDescriptionCount(
+                                        static_cast<uint32_t>(vertexInputBindingDescriptions.size()))
+                                      .setPVertexBindingDescriptions(vertexInputBindingDescriptions.data());
   vertexInputStateCreateInfo.setVertexAttributeDescriptionCount(
     static_cast<uint32_t>(vertexInputAttributeDescriptions.size()));
   vertexInputStateCreateInfo.setPVertexAttributeDescriptions(vertexInputAttributeDescriptions.data());
@@ -89,14 +147,15 @@ vk::Pipeline* ShadowPipeline::createPipeline(const vk::RenderPass* renderPass,
   auto inputAssemblyStateCreateInfo =
     vk::PipelineInputAssemblyStateCreateInfo().setTopology(vk::PrimitiveTopology::eTriangleList);
 
-  auto viewport = vk::Viewport()
-                    .setWidth(static_cast<float>(Settings::shadowMapResolution))
-                    .setHeight(static_cast<float>(Settings::shadowMapResolution))
-                    .setMaxDepth(1.0f);
-  auto scissor = vk::Rect2D().setExtent(vk::Extent2D(Settings::shadowMapResolution, Settings::shadowMapResolution));
+  // the viewport and scissor are set to the region of the cascade in the shadow atlas before drawing into it, or to
+  // the regions of all of them
+  const auto numViewports = allCascades ? static_cast<uint32_t>(Settings::shadowMapCascadeCount) : 1;
   auto viewportStateCreateInfo =
-    vk::PipelineViewportStateCreateInfo().setViewportCount(1).setPViewports(&viewport).setScissorCount(1).setPScissors(
-      &scissor);
+    vk::PipelineViewportStateCreateInfo().setViewportCount(numViewports).setScissorCount(numViewports);
+  std::vector<vk::DynamicState> dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+  auto dynamicStateCreateInfo = vk::PipelineDynamicStateCreateInfo()
+                                  .setDynamicStateCount(static_cast<uint32_t>(dynamicStates.size()))
+                                  .setPDynamicStates(dynamicStates.data());
 
   auto rasterizationStateCreateInfo = vk::PipelineRasterizationStateCreateInfo()
                                         .setCullMode(vk::CullModeFlagBits::eBack)
@@ -120,22 +179,32 @@ vk::Pipeline* ShadowPipeline::createPipeline(const vk::RenderPass* renderPass,
   pipelineCreateInfo.setPRasterizationState(&rasterizationStateCreateInfo)
     .setPMultisampleState(&multisampleStateCreateInfo)
     .setPDepthStencilState(&depthStenctilStateCreateInfo);
-  pipelineCreateInfo.setPColorBlendState(&colorBlendStateCreateInfo);
+  pipelineCreateInfo.setPColorBlendState(&colorBlendStateCreateInfo).setPDynamicState(&dynamicStateCreateInfo);
   pipelineCreateInfo.setRenderPass(*renderPass).setLayout(*pipelineLayout);
   auto pipeline = context->getDevice()->createGraphicsPipeline(nullptr, pipelineCreateInfo);
   return new vk::Pipeline(pipeline);
 }
 
-ShadowPipeline::ShadowPipeline(const std::shared_ptr<Context> context, std::vector<vk::DescriptorSetLayout> setLayouts)
+ShadowPipeline::ShadowPipeline(const std::shared_ptr<Context> context,
+                               std::vector<vk::DescriptorSetLayout> setLayouts,
+                               bool allCascades)
 {
   this->context = context;
 
-  renderPass =
-    std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(createRenderPass(context), renderPassDeleter);
+  renderPass = std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(
+    createRenderPass(context, vk::AttachmentLoadOp::eClear), renderPassDeleter);
+  loadRenderPass = std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)>(
+    createRenderPass(context, vk::AttachmentLoadOp::eLoad), renderPassDeleter);
   pipelineLayout =
     std::unique_ptr<vk::PipelineLayout, decltype(pipelineLayoutDeleter)>(createPipelineLayout(context, setLayouts),
                                                                          pipelineLayoutDeleter);
   pipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(createPipeline(renderPass.get(),
-                                                                                     pipelineLayout.get(), context),
+                                                                                     pipelineLayout.get(), context,
+                                                                                     false),
                                                                       pipelineDeleter);
+  if (allCascades)
+  {
+    cascadesPipeline = std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)>(
+      createPipeline(renderPass.get(), pipelineLayout.get(), context, true), pipelineDeleter);
+  }
 }
@@ -1,18 +1,28 @@
 #pragma once
 
 #include "renderer/Texture.hpp"
+#include "renderer/buffers/InstanceBuffer.hpp"
+
+// per instance of the pipeline that draws all cascades at once, one for every cascade a mesh instance is drawn into
+struct CascadeInstance
+{
+  glm::mat4 worldMatrix;
+  uint32_t cascade;
+};
 
 class ShadowPipeline
 {
 private:
   std::shared_ptr<Context> context;
 
-  static vk::RenderPass* createRenderPass(const std::shared_ptr<Context> context);
+  static vk::RenderPass* createRenderPass(const std::shared_ptr<Context> context, vk::AttachmentLoadOp loadOp);
   std::function<void(vk::RenderPass*)> renderPassDeleter = [this](vk::RenderPass* renderPass) {
     if (context->getDevice())
       context->getDevice()->destroyRenderPass(*renderPass);
   };
   std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)> renderPass;
+  // compatible with the one above, but draws on top of the depth already in the region instead of clearing it
+  std::unique_ptr<vk::RenderPass, decltype(renderPassDeleter)> loadRenderPass;
 
   static vk::PipelineLayout*
   createPipelineLayout(const std::shared_ptr<Context> context, std::vector<vk::DescriptorSetLayout> setLayouts);
@@ -24,20 +34,30 @@ private:
 
   static vk::Pipeline* createPipeline(const vk::RenderPass* renderPass,
                                       const vk::PipelineLayout* pipelineLayout,
-                                      const std::shared_ptr<Context> context);
+                                      const std::shared_ptr<Context> context,
+                                      bool allCascades);
   std::function<void(vk::Pipeline*)> pipelineDeleter = [this](vk::Pipeline* pipeline) {
     if (context->getDevice())
       context->getDevice()->destroyPipeline(*pipeline);
   };
   std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> pipeline;
+  // only exists when drawing all cascades in one pass, it has a viewport per cascade and the vertex shader picks one
+  // from the cascade of each instance
+  std::unique_ptr<vk::Pipeline, decltype(pipelineDeleter)> cascadesPipeline;
 
 public:
-  ShadowPipeline(const std::shared_ptr<Context> context, std::vector<vk::DescriptorSetLayout> setLayouts);
+  ShadowPipeline(const std::shared_ptr<Context> context,
+                 std::vector<vk::DescriptorSetLayout> setLayouts,
+                 bool allCascades = false);
 
   vk::RenderPass* getRenderPass() const
   {
     return renderPass.get();
   }
+  vk::RenderPass* getLoadRenderPass() const
+  {
+    return loadRenderPass.get();
+  }
   vk::PipelineLayout* getPipelineLayout() const
   {
     return pipelineLayout.get();
@@ -46,4 +66,8 @@ public:
   {
     return pipeline.get();
   }
+  vk::Pipeline* getCascadesPipeline() const
+  {
+    return cascadesPipeline.get();
+  }
 };
\ No newline at end of file
@@ -3,10 +3,10 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout(set = 2, binding = 0) uniform sampler2D inDiffuseSampler;
-layout(set = 2, binding = 1) uniform sampler2D inNormalSampler;
-layout(set = 2, binding = 2) uniform sampler2D inMetallicSampler;
-layout(set = 2, binding = 3) uniform sampler2D inRoughnessSampler;
+layout(set = 1, binding = 0) uniform sampler2D inDiffuseSampler;
+layout(set = 1, binding = 1) uniform sampler2D inNormalSampler;
+layout(set = 1, binding = 2) uniform sampler2D inMetallicSampler;
+layout(set = 1, binding = 3) uniform sampler2D inRoughnessSampler;
 
 layout(location = 0) in vec2 inTexCoord;
 layout(location = 1) in vec3 inNormal;
@@ -25,9 +25,11 @@ void main()
 		discard;
 	}
 	
-	// calculate normal in tangent space
+	// calculate normal in tangent space, z is reconstructed since block compressed normal maps only store x and y
+	vec2 tangentNormal = texture(inNormalSampler, inTexCoord).rg * 2.0 - vec2(1.0);
+	float tangentNormalZ = sqrt(max(1.0 - dot(tangentNormal, tangentNormal), 0.0));
 	mat3 TBN = mat3(inTangent, inBitangent, inNormal);
-	vec3 normal = TBN * normalize(texture(inNormalSampler, inTexCoord).rgb * 2.0 - vec3(1.0));
+	vec3 normal = TBN * normalize(vec3(tangentNormal, tangentNormalZ));
 	normal = (normal + vec3(1.0)) * 0.5;
 	
 	// albedo and metallic
@@ -3,9 +3,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout(set = 0, binding = 0) uniform Geometry { mat4 worldMatrix; } geometry;
-
-layout(set = 1, binding = 0) uniform Camera
+layout(set = 0, binding = 0) uniform Camera
 {
   mat4 viewProjectionMatrix;
 } camera;
@@ -16,6 +14,9 @@ layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 inTangent;
 layout(location = 4) in vec3 inBitangent;
 
+// per instance, occupies locations 5 to 8
+layout(location = 5) in mat4 inWorldMatrix;
+
 layout(location = 0) out vec2 outTexCoord;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec3 outTangent;
@@ -23,11 +24,11 @@ layout(location = 3) out vec3 outBitangent;
 
 void main()
 {
-  gl_Position = camera.viewProjectionMatrix * geometry.worldMatrix * vec4(inPosition, 1.0);
+  gl_Position = camera.viewProjectionMatrix * inWorldMatrix * vec4(inPosition, 1.0);
 
   outTexCoord = inTexCoord;
   
-	outNormal = (geometry.worldMatrix * vec4(inNormal, 0.0)).xyz;	
-	outTangent = (geometry.worldMatrix * vec4(inTangent, 0.0)).xyz;
-	outBitangent = (geometry.worldMatrix * vec4(inBitangent, 0.0)).xyz;
+	outNormal = (inWorldMatrix * vec4(inNormal, 0.0)).xyz;	
+	outTangent = (inWorldMatrix * vec4(inTangent, 0.0)).xyz;
+	outBitangent = (inWorldMatrix * vec4(inBitangent, 0.0)).xyz;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "FrameData.include"
+#include "VertexCompression.include"
+
+layout(push_constant) uniform MeshBounds
+{
+  vec4 boundsMin;
+  vec4 boundsExtent;
+} meshBounds;
+
+// xyz relative to the mesh bounds, w is 0 for a mirrored tangent frame and 1 otherwise
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec2 inNormal;
+layout(location = 3) in vec2 inTangent;
+
+// per instance, occupies locations 5 to 8
+layout(location = 5) in mat4 inWorldMatrix;
+
+layout(location = 0) out vec2 outTexCoord;
+layout(location = 1) out vec3 outNormal;
+layout(location = 2) out vec3 outTangent;
+layout(location = 3) out vec3 outBitangent;
+
+void main()
+{
+  vec3 position = decodePosition(inPosition.xyz, meshBounds.boundsMin.xyz, meshBounds.boundsExtent.xyz);
+  gl_Position = frameData.cameraViewProjectionMatrix * inWorldMatrix * vec4(position, 1.0);
+
+  outTexCoord = inTexCoord;
+  
+  vec3 normal = decodeOctahedral(inNormal);
+  vec3 tangent = decodeOctahedral(inTangent);
+  vec3 bitangent = cross(normal, tangent) * (inPosition.w * 2.0 - 1.0);
+
+  outNormal = (inWorldMatrix * vec4(normal, 0.0)).xyz;
+  outTangent = (inWorldMatrix * vec4(tangent, 0.0)).xyz;
+  outBitangent = (inWorldMatrix * vec4(bitangent, 0.0)).xyz;
+}
\ No newline at end of file
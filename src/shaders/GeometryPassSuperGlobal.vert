@@ -0,0 +1,31 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "FrameData.include"
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec3 inTangent;
+layout(location = 4) in vec3 inBitangent;
+
+// per instance, occupies locations 5 to 8
+layout(location = 5) in mat4 inWorldMatrix;
+
+layout(location = 0) out vec2 outTexCoord;
+layout(location = 1) out vec3 outNormal;
+layout(location = 2) out vec3 outTangent;
+layout(location = 3) out vec3 outBitangent;
+
+void main()
+{
+  gl_Position = frameData.cameraViewProjectionMatrix * inWorldMatrix * vec4(inPosition, 1.0);
+
+  outTexCoord = inTexCoord;
+  
+	outNormal = (inWorldMatrix * vec4(inNormal, 0.0)).xyz;	
+	outTangent = (inWorldMatrix * vec4(inTangent, 0.0)).xyz;
+	outBitangent = (inWorldMatrix * vec4(inBitangent, 0.0)).xyz;
+}
\ No newline at end of file
@@ -10,9 +10,9 @@ layout (constant_id = 3) const float VOLUMETRIC_SCATTERING = 0.2;
 
 #include "Lighting.include"
 
-layout(set = 2, binding = 0) uniform sampler2D inAlbedoMetallic;
-layout(set = 2, binding = 1) uniform sampler2D inNormalRoughness;
-layout(set = 2, binding = 2) uniform sampler2D inDepth;
+layout(input_attachment_index = 0, set = 2, binding = 0) uniform subpassInput inAlbedoMetallic;
+layout(input_attachment_index = 1, set = 2, binding = 1) uniform subpassInput inNormalRoughness;
+layout(input_attachment_index = 2, set = 2, binding = 2) uniform subpassInput inDepth;
 
 layout(set = 3, binding = 0) uniform Light { mat4 data; } light;
 
@@ -34,8 +34,6 @@ vec3 reconstructPositionFromDepth(float depth)
 
 void main()
 {
-  const vec2 uv = gl_FragCoord.xy / textureSize(inAlbedoMetallic, 0).xy;
-  
   const vec3 lightPosition = light.data[0].xyz;
   const float lightType = light.data[0].w;
   const vec3 lightDirection = light.data[1].xyz;
@@ -44,13 +42,13 @@ void main()
   const float lightIntensity = light.data[2].w;
   const float lightCutoffCosine = light.data[3].y;
   
-  const vec3 position = reconstructPositionFromDepth(texture(inDepth, uv).r);
+  const vec3 position = reconstructPositionFromDepth(subpassLoad(inDepth).r);
 
-	const vec4 albedoMetallic = texture(inAlbedoMetallic, uv);
+	const vec4 albedoMetallic = subpassLoad(inAlbedoMetallic);
 	const vec3 albedo = albedoMetallic.rgb;
 	const float metallic = albedoMetallic.a;
 	
-	const vec4 normalRoughness = texture(inNormalRoughness, uv);
+	const vec4 normalRoughness = subpassLoad(inNormalRoughness);
 	const vec3 normal = normalize(normalRoughness.rgb * 2.0 - vec3(1.0));
 	const float roughness = normalRoughness.a;
   
@@ -0,0 +1,41 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "FrameData.include"
+#include "LightIndices.include"
+
+layout(location = 0) in vec3 inPosition;
+
+layout(location = 0) out vec3 outEyePosition;
+layout(location = 1) out vec3 outViewRay;
+layout(location = 2) out vec3 outEyeForward;
+layout(location = 3) out vec2 outCameraClip;
+
+void main()
+{
+  const mat4 lightWorldMatrix = frameData.matrices[lightIndices.worldMatrix];
+  const mat4 lightData = frameData.matrices[lightIndices.data];
+
+  outEyePosition = frameData.cameraPositionNearClip.xyz;
+  outEyeForward = frameData.cameraForwardFarClip.xyz;
+  outCameraClip = vec2(frameData.cameraPositionNearClip.w, frameData.cameraForwardFarClip.w);
+  
+  const float lightType = lightData[0].w;
+  if (lightType < 0.5)
+  // directional light
+  {
+    vec4 position = inverse(frameData.cameraViewProjectionMatrix) * vec4(inPosition, 1.0);
+    position /= position.w;
+    outViewRay = position.xyz - frameData.cameraPositionNearClip.xyz;
+    gl_Position = vec4(inPosition, 1.0);
+  }
+  else
+  // point or spotlight
+  {
+    vec4 position = lightWorldMatrix * vec4(inPosition, 1.0);
+    outViewRay = position.xyz - frameData.cameraPositionNearClip.xyz;
+    gl_Position = frameData.cameraViewProjectionMatrix * position;
+  }
+}
\ No newline at end of file
@@ -13,11 +13,12 @@ layout (constant_id = 6) const float VOLUMETRIC_SCATTERING = 0.2;
 
 #include "Lighting.include"
 
-layout(set = 2, binding = 0) uniform sampler2D inAlbedoMetallic;
-layout(set = 2, binding = 1) uniform sampler2D inNormalRoughness;
-layout(set = 2, binding = 2) uniform sampler2D inDepth;
+layout(input_attachment_index = 0, set = 2, binding = 0) uniform subpassInput inAlbedoMetallic;
+layout(input_attachment_index = 1, set = 2, binding = 1) uniform subpassInput inNormalRoughness;
+layout(input_attachment_index = 2, set = 2, binding = 2) uniform subpassInput inDepth;
 
-layout(set = 3, binding = 0) uniform sampler2DArray inShadowMap;
+layout(set = 3, binding = 0) uniform sampler2D inShadowMap;
+layout(set = 3, binding = 1) uniform ShadowMapRects { vec4[SHADOW_MAP_CASCADE_COUNT] rects; } shadowMapRects;
 
 layout(set = 4, binding = 0) uniform Light { mat4 data; } light;
 
@@ -42,8 +43,6 @@ vec3 reconstructPositionFromDepth(float depth)
 
 void main()
 {
-  const vec2 uv = gl_FragCoord.xy / textureSize(inAlbedoMetallic, 0).xy;
-  
   const vec3 lightPosition = light.data[0].xyz;
   const float lightType = light.data[0].w;
   const vec3 lightDirection = light.data[1].xyz;
@@ -53,13 +52,13 @@ void main()
   const bool lightCastShadows = light.data[3].x > 0.5;
   const float lightCutoffCosine = light.data[3].y;
   
-  const vec3 position = reconstructPositionFromDepth(texture(inDepth, uv).r);
+  const vec3 position = reconstructPositionFromDepth(subpassLoad(inDepth).r);
 
-	const vec4 albedoMetallic = texture(inAlbedoMetallic, uv);
+	const vec4 albedoMetallic = subpassLoad(inAlbedoMetallic);
 	const vec3 albedo = albedoMetallic.rgb;
 	const float metallic = albedoMetallic.a;
 	
-	const vec4 normalRoughness = texture(inNormalRoughness, uv);
+	const vec4 normalRoughness = subpassLoad(inNormalRoughness);
 	const vec3 normal = normalize(normalRoughness.rgb * 2.0 - vec3(1.0));
 	const float roughness = normalRoughness.a;
   
@@ -88,7 +87,7 @@ void main()
   {
     const float distance = length(inEyePosition - position);
     cascadeIndex = GetCascadeIndex(distance, shadowMapCascadeSplits.splits, SHADOW_MAP_CASCADE_COUNT);
-    light *= ShadowFiltered(shadowMapCascade.viewProjectionMatrices[cascadeIndex], position, inShadowMap, cascadeIndex, SHADOW_BIAS, SHADOW_FILTER_RANGE);
+    light *= ShadowFiltered(shadowMapCascade.viewProjectionMatrices[cascadeIndex], position, inShadowMap, shadowMapRects.rects[cascadeIndex], SHADOW_BIAS, SHADOW_FILTER_RANGE);
   }
   
   outLBuffer0 = vec4(light, 1.0);
@@ -105,6 +104,6 @@ void main()
   
   if (lightCastShadows)
   {
-    outLBuffer1 += vec4(Volumetric(position, inEyePosition, shadowMapCascade.viewProjectionMatrices[cascadeIndex], inShadowMap, cascadeIndex, lightToFragment, lightColor, lightIntensity, SHADOW_BIAS), 0.0);
+    outLBuffer1 += vec4(Volumetric(position, inEyePosition, shadowMapCascade.viewProjectionMatrices[cascadeIndex], inShadowMap, shadowMapRects.rects[cascadeIndex], lightToFragment, lightColor, lightIntensity, SHADOW_BIAS), 0.0);
   }
 }
\ No newline at end of file
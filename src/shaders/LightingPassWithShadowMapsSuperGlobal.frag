@@ -0,0 +1,108 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (constant_id = 0) const int SHADOW_MAP_CASCADE_COUNT = 6;
+layout (constant_id = 1) const float SHADOW_BIAS = 0.001;
+layout (constant_id = 2) const int SHADOW_FILTER_RANGE = 2;
+layout (constant_id = 3) const float BLOOM_THRESHOLD = 0.8;
+layout (constant_id = 4) const float VOLUMETRIC_INTENSITY = 5.0;
+layout (constant_id = 5) const int VOLUMETRIC_STEPS = 10;
+layout (constant_id = 6) const float VOLUMETRIC_SCATTERING = 0.2;
+
+#include "Lighting.include"
+
+#include "FrameData.include"
+#include "LightIndices.include"
+
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput inAlbedoMetallic;
+layout(input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput inNormalRoughness;
+layout(input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput inDepth;
+
+layout(set = 2, binding = 0) uniform sampler2D inShadowMap;
+layout(set = 2, binding = 1) uniform ShadowMapRects { vec4[SHADOW_MAP_CASCADE_COUNT] rects; } shadowMapRects;
+
+layout(location = 0) in vec3 inEyePosition;
+layout(location = 1) in vec3 inViewRay;
+layout(location = 2) in vec3 inEyeForward;
+layout(location = 3) in vec2 inCameraClip;
+
+layout(location = 0) out vec4 outLBuffer0;
+layout(location = 1) out vec4 outLBuffer1;
+
+vec3 reconstructPositionFromDepth(float depth)
+{
+  depth = (inCameraClip.x * inCameraClip.y) / (inCameraClip.y + depth * (inCameraClip.x - inCameraClip.y));
+  const vec3 viewRay = normalize(inViewRay);
+  const float viewZDist = dot(inEyeForward, viewRay);
+  return inEyePosition + viewRay * (depth / viewZDist);
+}
+
+void main()
+{
+  const mat4 lightData = frameData.matrices[lightIndices.data];
+  const vec3 lightPosition = lightData[0].xyz;
+  const float lightType = lightData[0].w;
+  const vec3 lightDirection = lightData[1].xyz;
+  const float lightRange = lightData[1].w;
+  const vec3 lightColor = lightData[2].xyz;
+  const float lightIntensity = lightData[2].w;
+  const bool lightCastShadows = lightData[3].x > 0.5;
+  const float lightCutoffCosine = lightData[3].y;
+  
+  const vec3 position = reconstructPositionFromDepth(subpassLoad(inDepth).r);
+
+	const vec4 albedoMetallic = subpassLoad(inAlbedoMetallic);
+	const vec3 albedo = albedoMetallic.rgb;
+	const float metallic = albedoMetallic.a;
+	
+	const vec4 normalRoughness = subpassLoad(inNormalRoughness);
+	const vec3 normal = normalize(normalRoughness.rgb * 2.0 - vec3(1.0));
+	const float roughness = normalRoughness.a;
+  
+  vec3 light = vec3(0.0);
+  
+  vec3 lightToFragment = normalize(lightDirection);
+  if (lightType > 0.5)
+  // point or spotlight
+  {
+    lightToFragment = normalize(position - lightPosition);
+  }
+  
+  light += Diffuse(normal, lightToFragment, lightDirection, lightColor, lightIntensity, lightType > 1.5, lightCutoffCosine);
+  light += Specular(inEyePosition, position, lightToFragment, lightDirection, normal, lightColor, lightIntensity, roughness, lightType > 1.5, lightCutoffCosine);
+   
+  if (lightType > 0.5)
+  // point or spotlight
+  {
+    light *= Attenuation(length(position - lightPosition), lightRange);
+  }
+  
+  light *= max(albedo, 0.0);
+  
+  uint cascadeIndex = 0;
+  if (lightCastShadows)
+  {
+    const float distance = length(inEyePosition - position);
+    cascadeIndex = GetCascadeIndex(distance, frameData.matrices[lightIndices.shadowMapCascadeSplits], SHADOW_MAP_CASCADE_COUNT);
+    light *= ShadowFiltered(frameData.matrices[lightIndices.shadowMapCascadeViewProjectionMatrices + cascadeIndex], position, inShadowMap, shadowMapRects.rects[cascadeIndex], SHADOW_BIAS, SHADOW_FILTER_RANGE);
+  }
+  
+  outLBuffer0 = vec4(light, 1.0);
+  
+  float brightness = 0.2126 * light.r + 0.7152 * light.g + 0.0722 * light.b;
+  if (brightness > BLOOM_THRESHOLD)
+  {
+    outLBuffer1 = vec4(light, 1.0);
+  }
+  else
+  {
+    outLBuffer1 = vec4(0.0, 0.0, 0.0, 1.0);
+  }
+  
+  if (lightCastShadows)
+  {
+    outLBuffer1 += vec4(Volumetric(position, inEyePosition, frameData.matrices[lightIndices.shadowMapCascadeViewProjectionMatrices + cascadeIndex], inShadowMap, shadowMapRects.rects[cascadeIndex], lightToFragment, lightColor, lightIntensity, SHADOW_BIAS), 0.0);
+  }
+}
\ No newline at end of file
@@ -5,14 +5,16 @@
 
 layout (constant_id = 0) const int SHADOW_MAP_CASCADE_COUNT = 6;
 
-layout(set = 0, binding = 0) uniform Geometry { mat4 worldMatrix; } geometry;
-layout(set = 1, binding = 0) uniform ShadowMapCascade { mat4 viewProjectionMatrices[SHADOW_MAP_CASCADE_COUNT]; } shadowMapCascades;
+layout(set = 0, binding = 0) uniform ShadowMapCascade { mat4 viewProjectionMatrices[SHADOW_MAP_CASCADE_COUNT]; } shadowMapCascades;
 
 layout(push_constant) uniform ShadowMapCascadeIndex { uint index; } shadowMapCascadeIndex;
 
 layout(location = 0) in vec3 inPosition;
 
+// per instance, occupies locations 1 to 4
+layout(location = 1) in mat4 inWorldMatrix;
+
 void main()
 {
-	gl_Position = shadowMapCascades.viewProjectionMatrices[shadowMapCascadeIndex.index] * geometry.worldMatrix * vec4(inPosition, 1.0);
+	gl_Position = shadowMapCascades.viewProjectionMatrices[shadowMapCascadeIndex.index] * inWorldMatrix * vec4(inPosition, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_viewport_layer_array : enable
+
+#include "VertexCompression.include"
+
+layout (constant_id = 0) const int SHADOW_MAP_CASCADE_COUNT = 6;
+
+layout(set = 0, binding = 0) uniform ShadowMapCascade { mat4 viewProjectionMatrices[SHADOW_MAP_CASCADE_COUNT]; } shadowMapCascades;
+
+// the index of the first cascade, the instance adds its own cascade to it
+layout(push_constant) uniform ShadowMapCascadeIndex
+{
+  uint index;
+  vec4 boundsMin;
+  vec4 boundsExtent;
+} shadowMapCascadeIndex;
+
+// xyz relative to the mesh bounds, the handedness in w is not needed here
+layout(location = 0) in vec4 inPosition;
+
+// per instance, occupies locations 1 to 4
+layout(location = 1) in mat4 inWorldMatrix;
+layout(location = 5) in uint inCascade;
+
+void main()
+{
+	vec3 position = decodePosition(inPosition.xyz, shadowMapCascadeIndex.boundsMin.xyz, shadowMapCascadeIndex.boundsExtent.xyz);
+	gl_Position = shadowMapCascades.viewProjectionMatrices[shadowMapCascadeIndex.index + inCascade] * inWorldMatrix * vec4(position, 1.0);
+	// every cascade has its own viewport on its region of the shadow atlas
+	gl_ViewportIndex = int(inCascade);
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_viewport_layer_array : enable
+
+#include "FrameData.include"
+
+// the index addresses the frame data matrix of the first cascade directly, the instance adds its own cascade to it
+layout(push_constant) uniform ShadowMapCascadeIndex { uint index; } shadowMapCascadeIndex;
+
+layout(location = 0) in vec3 inPosition;
+
+// per instance, occupies locations 1 to 4
+layout(location = 1) in mat4 inWorldMatrix;
+layout(location = 5) in uint inCascade;
+
+void main()
+{
+	gl_Position = frameData.matrices[shadowMapCascadeIndex.index + inCascade] * inWorldMatrix * vec4(inPosition, 1.0);
+	// every cascade has its own viewport on its region of the shadow atlas
+	gl_ViewportIndex = int(inCascade);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "FrameData.include"
+#include "VertexCompression.include"
+
+// the index addresses the frame data matrices directly
+layout(push_constant) uniform ShadowMapCascadeIndex
+{
+  uint index;
+  vec4 boundsMin;
+  vec4 boundsExtent;
+} shadowMapCascadeIndex;
+
+// xyz relative to the mesh bounds, the handedness in w is not needed here
+layout(location = 0) in vec4 inPosition;
+
+// per instance, occupies locations 1 to 4
+layout(location = 1) in mat4 inWorldMatrix;
+
+void main()
+{
+	vec3 position = decodePosition(inPosition.xyz, shadowMapCascadeIndex.boundsMin.xyz, shadowMapCascadeIndex.boundsExtent.xyz);
+	gl_Position = frameData.matrices[shadowMapCascadeIndex.index] * inWorldMatrix * vec4(position, 1.0);
+}
\ No newline at end of file
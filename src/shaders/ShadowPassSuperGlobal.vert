@@ -0,0 +1,19 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "FrameData.include"
+
+// the index addresses the frame data matrices directly
+layout(push_constant) uniform ShadowMapCascadeIndex { uint index; } shadowMapCascadeIndex;
+
+layout(location = 0) in vec3 inPosition;
+
+// per instance, occupies locations 1 to 4
+layout(location = 1) in mat4 inWorldMatrix;
+
+void main()
+{
+	gl_Position = frameData.matrices[shadowMapCascadeIndex.index] * inWorldMatrix * vec4(inPosition, 1.0);
+}
\ No newline at end of file